@@ -0,0 +1,84 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "event_executor.h"
+
+#include <cassert>
+
+namespace redtail { namespace executor
+{
+
+EventExecutor::EventExecutor(const Params& params):
+    params_(params), min_period_(Clock::duration::zero())
+{
+    assert(params_.max_rate_hz >= 0);
+    assert(params_.idle_ms > 0);
+    if (params_.max_rate_hz > 0)
+        min_period_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / params_.max_rate_hz));
+}
+
+void EventExecutor::notify(bool dropped)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pending_)
+            pending_since_ = Clock::now();
+        pending_ = true;
+        if (dropped)
+            dropped_++;
+    }
+    cv_.notify_one();
+}
+
+void EventExecutor::run(const std::function<void()>& process, const std::function<bool()>& is_ok)
+{
+    auto idle = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(params_.idle_ms));
+    // Allows the first run to start immediately.
+    auto next_start = Clock::now() - min_period_;
+    while (is_ok())
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!cv_.wait_for(lock, idle, [this] { return pending_ || stop_; }))
+                continue;
+            // Rate limit: wait for the end of the period, stop() can still interrupt.
+            if (!stop_ && Clock::now() < next_start)
+                cv_.wait_until(lock, next_start, [this] { return stop_; });
+            if (stop_)
+                break;
+            auto now = Clock::now();
+            wait_ms_ += std::chrono::duration<double, std::milli>(now - pending_since_).count();
+            runs_++;
+            pending_   = false;
+            next_start = now + min_period_;
+        }
+        process();
+    }
+}
+
+void EventExecutor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+}
+
+EventExecutor::Stats EventExecutor::getStats(bool reset)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats res;
+    res.runs    = runs_;
+    res.dropped = dropped_;
+    res.wait_ms = runs_ > 0 ? (float)(wait_ms_ / runs_) : 0;
+    if (reset)
+    {
+        runs_    = 0;
+        dropped_ = 0;
+        wait_ms_ = 0;
+    }
+    return res;
+}
+
+} }
@@ -0,0 +1,131 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_EVENT_EXECUTOR_H
+#define REDTAIL_EVENT_EXECUTOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace redtail { namespace executor
+{
+
+// Event-driven processing loop shared by the nodes. Instead of polling for new
+// messages at a fixed rate, processing thread sleeps on a condition variable and
+// is woken up as soon as a message is posted to one of its inputs (see LatestInput),
+// so input-to-output latency does not include up to a full polling period
+// (wake-up takes tens of microseconds, see EventExecutorTests.WakeUpLatency in caffe_ros).
+// max_rate_hz is a ceiling only: processing starts immediately unless the previous
+// run started less than 1 / max_rate_hz ago.
+// Messages are expected to be posted from other threads, e.g. ROS callbacks
+// executed by ros::AsyncSpinner while the main thread runs the executor.
+class EventExecutor
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Params
+    {
+        // Max processing rate in Hz, 0 - not limited.
+        float max_rate_hz = 0;
+        // Max time to sleep without events before checking the is_ok predicate
+        // passed to run() (e.g. ros::ok which can't notify the executor).
+        float idle_ms     = 100;
+    };
+
+    // Statistics since the last reset.
+    struct Stats
+    {
+        uint64_t runs       = 0;
+        // Messages replaced by newer ones before they were processed.
+        uint64_t dropped    = 0;
+        // Average time from the first pending event to the start of processing.
+        float    wait_ms    = 0;
+    };
+
+    explicit EventExecutor(const Params& params);
+
+    EventExecutor(const EventExecutor&) = delete;
+    EventExecutor& operator=(const EventExecutor&) = delete;
+
+    // Wakes up processing thread, can be called from any thread.
+    // dropped indicates that an unprocessed message was replaced.
+    void notify(bool dropped = false);
+
+    // Calls process on each wake up until stop() is called or is_ok returns false.
+    // Events that arrive while process is running are coalesced into a single run.
+    void run(const std::function<void()>& process, const std::function<bool()>& is_ok);
+
+    // Makes run() return, can be called from any thread.
+    void stop();
+
+    Stats getStats(bool reset);
+
+private:
+    Params       params_;
+    Clock::duration min_period_;
+
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    bool              pending_ = false;
+    bool              stop_    = false;
+    Clock::time_point pending_since_;
+
+    uint64_t runs_    = 0;
+    uint64_t dropped_ = 0;
+    double   wait_ms_ = 0;
+};
+
+// Input that keeps only the latest posted message: a new message replaces
+// the unprocessed one as processing of a stale message only adds latency.
+template<typename T>
+class LatestInput
+{
+public:
+    explicit LatestInput(EventExecutor& executor):
+        executor_(executor)
+    {
+    }
+
+    LatestInput(const LatestInput&) = delete;
+    LatestInput& operator=(const LatestInput&) = delete;
+
+    // Stores the message and wakes up the executor, can be called from any thread.
+    void post(T msg)
+    {
+        bool dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            dropped   = has_msg_;
+            msg_      = std::move(msg);
+            has_msg_  = true;
+        }
+        executor_.notify(dropped);
+    }
+
+    // Takes the latest message, returns false if there is no new message since the last take.
+    bool take(T& msg)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_msg_)
+            return false;
+        msg      = std::move(msg_);
+        msg_     = T();
+        has_msg_ = false;
+        return true;
+    }
+
+private:
+    EventExecutor& executor_;
+
+    std::mutex mutex_;
+    T          msg_;
+    bool       has_msg_ = false;
+};
+
+} }
+
+#endif
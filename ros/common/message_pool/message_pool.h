@@ -0,0 +1,84 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_MESSAGE_POOL_H
+#define REDTAIL_MESSAGE_POOL_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace redtail
+{
+
+// Recycling pool of messages (or any other objects shared via boost::shared_ptr).
+// Published messages are referenced by the publisher queue and by intra-process
+// subscribers (nodelets), a message is reused once the pool holds the only reference,
+// i.e. all of them have released it. Reused messages keep their previous content
+// so std::vector fields (e.g. Image::data) are resized without reallocation
+// when the size does not change, and outputs can be written directly into them.
+// If all pooled messages are in use a new one is allocated and added to the pool
+// until it has max_size messages, after that the new messages are not pooled.
+// All methods can be called from any thread.
+template<typename T>
+class MessagePool
+{
+public:
+    using Ptr = boost::shared_ptr<T>;
+
+    struct Stats
+    {
+        uint64_t acquired  = 0;
+        // Messages allocated because all pooled ones were in use.
+        uint64_t allocated = 0;
+    };
+
+    explicit MessagePool(size_t max_size):
+        max_size_(max_size)
+    {
+    }
+
+    MessagePool(const MessagePool&) = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+    // Returns a message which is not referenced outside of the pool.
+    Ptr acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.acquired++;
+        // The count can only go down concurrently: nobody else can get
+        // a reference to a message which is referenced only by the pool.
+        for (const auto& msg: msgs_)
+        {
+            if (msg.use_count() == 1)
+                return msg;
+        }
+        stats_.allocated++;
+        auto msg = boost::make_shared<T>();
+        if (msgs_.size() < max_size_)
+            msgs_.push_back(msg);
+        return msg;
+    }
+
+    Stats getStats(bool reset)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto res = stats_;
+        if (reset)
+            stats_ = Stats();
+        return res;
+    }
+
+private:
+    size_t           max_size_;
+    std::mutex       mutex_;
+    std::vector<Ptr> msgs_;
+    Stats            stats_;
+};
+
+}
+
+#endif
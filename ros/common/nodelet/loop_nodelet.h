@@ -0,0 +1,97 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_LOOP_NODELET_H
+#define REDTAIL_LOOP_NODELET_H
+
+#include <exception>
+#include <functional>
+#include <thread>
+
+#include <nodelet/nodelet.h>
+
+#include "stop_signal.h"
+
+namespace redtail
+{
+
+// Nodelet for nodes which run their own processing loop, e.g. EventExecutor::run:
+// onInit must not block so the loop runs on a dedicated thread while subscription
+// callbacks are executed by the nodelet manager. Nodes loaded into the same manager
+// exchange messages as shared pointers without serialization and copying.
+// The loop gets the private node handle (same as ~ in the standalone node) and
+// must return once stop is signalled, which happens on unload or ROS shutdown.
+// Errors are reported by throwing (see NodeError): the exception is logged and only
+// this nodelet stops, other nodelets in the manager keep running.
+class LoopNodelet : public nodelet::Nodelet
+{
+public:
+    using Loop = std::function<void(ros::NodeHandle&, const StopSignal&)>;
+
+    explicit LoopNodelet(Loop loop):
+        loop_(std::move(loop))
+    {
+    }
+
+    ~LoopNodelet() override
+    {
+        stop_.stop();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+private:
+    void onInit() override
+    {
+        // The manager unloads nodelets on ROS shutdown so the destructor signals the stop in both cases.
+        thread_ = std::thread([this]
+            {
+                try
+                {
+                    loop_(getPrivateNodeHandle(), stop_);
+                }
+                catch (const std::exception& e)
+                {
+                    NODELET_FATAL("%s", e.what());
+                    NODELET_ERROR("Nodelet is stopped, other nodelets in the manager keep running.");
+                }
+            });
+    }
+
+private:
+    Loop        loop_;
+    StopSignal  stop_;
+    std::thread thread_;
+};
+
+// Runs the loop of the standalone node on the calling thread, subscription callbacks
+// must be executed by a spinner. The loop is stopped on ROS shutdown (e.g. Ctrl+C) and
+// the node is shut down once the loop returns. Returns non-zero if the loop has failed.
+inline int runNode(const LoopNodelet::Loop& loop, ros::NodeHandle& nh)
+{
+    StopSignal stop;
+    // ros::ok() does not notify anyone so the shutdown is converted to the signal on a helper thread.
+    std::thread shutdown_waiter([&stop]
+        {
+            ros::waitForShutdown();
+            stop.stop();
+        });
+    int res = 0;
+    try
+    {
+        loop(nh, stop);
+    }
+    catch (const std::exception& e)
+    {
+        ROS_FATAL("%s", e.what());
+        res = 1;
+    }
+    // The loop may return on its own (e.g. end of the video), this also releases the waiter.
+    ros::shutdown();
+    shutdown_waiter.join();
+    return res;
+}
+
+}
+
+#endif
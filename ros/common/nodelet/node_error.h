@@ -0,0 +1,38 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_NODE_ERROR_H
+#define REDTAIL_NODE_ERROR_H
+
+#include <cstdarg>
+#include <cstdio>
+#include <stdexcept>
+
+namespace redtail
+{
+
+// Fatal node error, e.g. invalid parameters or a model which can't be loaded.
+// Nodes throw it instead of calling ros::shutdown() so a nodelet stops only itself
+// and not every nodelet loaded into the same manager (see LoopNodelet and runNode).
+class NodeError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Throws NodeError with printf-style formatted message.
+[[noreturn]] inline void throwNodeError(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+inline void throwNodeError(const char* format, ...)
+{
+    char    msg[1024];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+    throw NodeError(msg);
+}
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_STOP_SIGNAL_H
+#define REDTAIL_STOP_SIGNAL_H
+
+#include <condition_variable>
+#include <mutex>
+
+namespace redtail
+{
+
+// Tells the node loop to return: set once on nodelet unload or ROS shutdown.
+// Loops which have nothing to do on their own thread (e.g. all the work is done
+// by subscription callbacks) block in wait() instead of polling the flag.
+class StopSignal
+{
+public:
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool isStopped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stopped_;
+    }
+
+    // Blocks until stop() is called.
+    void wait() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopped_; });
+    }
+
+    // Blocks until stop() is called or done() returns true, e.g. a worker thread of
+    // the loop has failed. The thread which changes the result of done() must call wake().
+    template<typename Pred>
+    void wait(Pred done) const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, &done] { return stopped_ || done(); });
+    }
+
+    // Makes wait(done) re-evaluate done(), does not stop the loop.
+    void wake() const
+    {
+        // Lock ensures the waiter is either blocked already or has not evaluated done() yet.
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_all();
+    }
+
+private:
+    mutable std::mutex              mutex_;
+    mutable std::condition_variable cv_;
+    bool                            stopped_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_BATCH_PREFETCHER_H
+#define CAFFE_ROS_BATCH_PREFETCHER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caffe_ros
+{
+
+// Selects up to max_images files (0 - all). Files are sorted first so the selection
+// does not depend on the directory order. With shuffle, a random subset in random order
+// is selected (seeded, so repeated runs select the same files), otherwise the files
+// are sampled uniformly which works well for directories of consecutive video frames.
+std::vector<std::string> sampleFiles(std::vector<std::string> files, int max_images, bool shuffle,
+                                     unsigned int seed = 0);
+
+// Loads batches of samples (e.g. calibration images) ahead of time: worker threads
+// load the files into a ring of batch buffers while the consumer processes the current batch.
+// Each batch holds batch_size samples of sample_size floats. Files which could not be loaded
+// are skipped, the last incomplete batch is dropped. With more than one thread the order
+// of samples within and across batches is not deterministic.
+class BatchPrefetcher
+{
+public:
+    // Loads the file into dst (sample_size floats), returns false if the file could not be loaded.
+    // Called concurrently from the worker threads.
+    using LoadFunction = std::function<bool(const std::string& file, float* dst)>;
+
+    // num_threads == 0 means use all hardware threads.
+    BatchPrefetcher(std::vector<std::string> files, int batch_size, size_t sample_size,
+                    int num_threads, LoadFunction load);
+    ~BatchPrefetcher();
+
+    BatchPrefetcher(const BatchPrefetcher&) = delete;
+    BatchPrefetcher& operator=(const BatchPrefetcher&) = delete;
+
+    // Releases the previous batch and waits for the next one. Returns batch_size * sample_size
+    // floats valid until the next call or null when there are no more complete batches.
+    const float* next();
+
+    int    getBatchSize() const  { return batch_size_; }
+    size_t getSampleSize() const { return sample_size_; }
+    int    getNumThreads() const { return (int)workers_.size(); }
+    // Number of files which could not be loaded so far.
+    size_t getNumSkipped() const;
+
+private:
+    void workerLoop();
+
+    // Must be called under the lock.
+    bool isDone() const { return next_file_ >= files_.size() && in_flight_ == 0; }
+
+private:
+    std::vector<std::string> files_;
+    int                      batch_size_;
+    size_t                   sample_size_;
+    LoadFunction             load_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cv_;
+    // Ring of batch buffers and the number of samples written to each of them.
+    std::vector<std::vector<float>> batches_;
+    std::vector<int>                filled_;
+    size_t                          next_file_   = 0;
+    int                             in_flight_   = 0;
+    // Samples are written in order: batch next_sample_ / batch_size_ goes to the ring
+    // slot of that index modulo the ring size once the consumer has released the slot.
+    size_t                          next_sample_ = 0;
+    // Index of the batch returned to (or awaited by) the consumer.
+    size_t                          consumed_    = 0;
+    bool                            has_current_ = false;
+    size_t                          skipped_     = 0;
+    bool                            stop_        = false;
+
+    std::vector<std::thread> workers_;
+};
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_BOX_TRACKER_H
+#define CAFFE_ROS_BOX_TRACKER_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "caffe_ros/yolo_prediction.h"
+
+namespace caffe_ros
+{
+
+// Propagates detected boxes between detector runs (median flow tracker).
+// Each box is covered by a grid of points which are tracked with OpenCV pyramidal
+// Lucas-Kanade optical flow on a downsampled grayscale image, forward and backward:
+// points with large forward-backward error or with windows which do not match
+// (normalized cross-correlation) are not reliable. The box is moved by
+// the median displacement of the reliable points and scaled by the median change
+// of the distances between them. Labels and probabilities of the boxes are kept.
+// Not thread safe.
+class BoxTracker
+{
+public:
+    struct Params
+    {
+        // Width of the downsampled image, the source is downsampled by an integer factor.
+        int   max_width    = 320;
+        int   levels       = 3;
+        // Lucas-Kanade window is (2 * win_radius + 1)^2 pixels of the downsampled image.
+        int   win_radius   = 4;
+        int   iterations   = 10;
+        // Tracked points per box along each dimension.
+        int   grid_size    = 5;
+        // Max forward-backward error of a reliable point, in downsampled image pixels.
+        float max_fb_error = 0.5f;
+        // Min normalized cross-correlation of the windows around the point in both images.
+        float min_ncc      = 0.8f;
+    };
+
+    explicit BoxTracker(const Params& params);
+
+    // Starts tracking boxes (in frame pixels) detected on the frame.
+    // frame is 8-bit 3 or 4 channel image.
+    void reset(const cv::Mat& frame, const std::vector<ObjectPrediction>& boxes);
+
+    // Moves the boxes to the frame, boxes is set to the tracked boxes clipped to the frame.
+    // Returns tracking confidence: the min fraction of reliable points of all boxes (1 if there are no boxes).
+    float track(const cv::Mat& frame, std::vector<ObjectPrediction>& boxes);
+
+private:
+    struct Box
+    {
+        int   label;
+        float prob;
+        // Box in downsampled image pixels.
+        float x;
+        float y;
+        float w;
+        float h;
+    };
+
+    // Computes downsampled grayscale image of the frame and its optical flow pyramid.
+    void prepare(const cv::Mat& frame, cv::Mat& gray, std::vector<cv::Mat>& pyr);
+    // Normalized cross-correlation of the windows around the point in the previous
+    // and the current image.
+    float windowNcc(const cv::Point2f& pt_prev, const cv::Point2f& pt_cur);
+
+private:
+    Params params_;
+
+    // Downsampling factor and size of the source frame.
+    int scale_   = 1;
+    int frame_w_ = 0;
+    int frame_h_ = 0;
+
+    cv::Mat              prev_;
+    cv::Mat              cur_;
+    std::vector<cv::Mat> prev_pyr_;
+    std::vector<cv::Mat> cur_pyr_;
+    std::vector<Box>     boxes_;
+
+    // Temporary buffers: tracked points of all boxes and the windows compared by NCC.
+    cv::Mat                  small_;
+    cv::Mat                  patch_prev_;
+    cv::Mat                  patch_cur_;
+    cv::Mat                  ncc_;
+    std::vector<cv::Point2f> pts_prev_;
+    std::vector<cv::Point2f> pts_cur_;
+    std::vector<cv::Point2f> pts_back_;
+    std::vector<uchar>       status_;
+    std::vector<uchar>       status_back_;
+    std::vector<float>       err_;
+    std::vector<int>         valid_;
+    std::vector<float>       dx_;
+    std::vector<float>       dy_;
+    std::vector<float>       ratios_;
+};
+
+}
+
+#endif
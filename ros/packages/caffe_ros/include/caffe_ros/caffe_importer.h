@@ -0,0 +1,120 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_CAFFE_IMPORTER_H
+#define CAFFE_ROS_CAFFE_IMPORTER_H
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------
+// Native importer of Caffe models (prototxt and binary caffemodel).
+// Does not depend on Caffe, protobuf, TensorRT or ROS so it can be
+// used by any backend as well as by offline tools.
+// -----------------------------------------------------------------
+namespace caffe_ros
+{
+
+// Message of text protobuf format (prototxt). Fields are kept in file order,
+// repeated fields have multiple entries. Values are kept as strings with quotes removed.
+struct PrototxtMessage
+{
+    std::vector<std::pair<std::string, std::string>>     values;
+    std::vector<std::pair<std::string, PrototxtMessage>> messages;
+
+    bool has(const std::string& name) const;
+
+    // Return the first value of the field or default value if the field is not present.
+    std::string getString(const std::string& name, const std::string& def = "") const;
+    int         getInt(const std::string& name, int def) const;
+    float       getFloat(const std::string& name, float def) const;
+    bool        getBool(const std::string& name, bool def) const;
+
+    // Return all values of the repeated field.
+    std::vector<std::string> getStrings(const std::string& name) const;
+    std::vector<int>         getInts(const std::string& name) const;
+    std::vector<float>       getFloats(const std::string& name) const;
+
+    // Returns the first message with the given name or null.
+    const PrototxtMessage*              getMessage(const std::string& name) const;
+    std::vector<const PrototxtMessage*> getMessages(const std::string& name) const;
+};
+
+// Parses prototxt, returns false and sets error on failure.
+bool parsePrototxt(std::istream& src, PrototxtMessage& msg, std::string& error);
+
+// Learned blob of a layer, the data is stored in the weight arena of the model.
+struct CaffeBlob
+{
+    std::vector<int> shape;
+    size_t           offset = 0;
+    size_t           count  = 0;
+};
+
+struct CaffeInput
+{
+    std::string      name;
+    std::vector<int> shape;
+};
+
+struct CaffeLayer
+{
+    std::string              name;
+    std::string              type;
+    std::vector<std::string> bottoms;
+    std::vector<std::string> tops;
+    // Complete layer definition from prototxt (layer specific parameters etc).
+    const PrototxtMessage*   def = nullptr;
+    std::vector<CaffeBlob>   blobs;
+};
+
+// Network graph in TEST phase and its learned parameters.
+// Layers are in prototxt order, Input layers and input fields of the net
+// are converted to network inputs.
+// All learned blobs are stored in a single contiguous weight arena.
+// The caffemodel is streamed directly into the arena: the file is never
+// read as a whole and blobs of layers which are not in the graph are skipped,
+// so at most one copy of the weights is kept in memory.
+class CaffeModel
+{
+public:
+    CaffeModel() = default;
+    // Layers refer to the parsed prototxt so the model can be moved but not copied.
+    CaffeModel(const CaffeModel&) = delete;
+    CaffeModel& operator=(const CaffeModel&) = delete;
+    CaffeModel(CaffeModel&&) = default;
+    CaffeModel& operator=(CaffeModel&&) = default;
+
+    // Loads the graph and, if model_path is not empty, its weights.
+    // Returns false and sets error on failure.
+    bool load(const std::string& prototxt_path, const std::string& model_path, std::string& error);
+
+    bool loadGraph(std::istream& prototxt, std::string& error);
+    // Must be called after loadGraph. size_hint (in bytes, usually the file size)
+    // is used to reserve the arena so it is never reallocated.
+    bool loadWeights(std::istream& model, size_t size_hint, std::string& error);
+
+    const std::string&             getName() const   { return name_; }
+    const std::vector<CaffeInput>& getInputs() const { return inputs_; }
+    const std::vector<CaffeLayer>& getLayers() const { return layers_; }
+
+    const float* getData(const CaffeBlob& blob) const { return arena_.data() + blob.offset; }
+    // Size of the weight arena in floats.
+    size_t       getWeightsSize() const { return arena_.size(); }
+
+    // Frees the weight arena, all blobs become empty.
+    void releaseWeights();
+
+private:
+    PrototxtMessage         net_;
+    std::string             name_;
+    std::vector<CaffeInput> inputs_;
+    std::vector<CaffeLayer> layers_;
+    std::vector<float>      arena_;
+};
+
+}
+
+#endif
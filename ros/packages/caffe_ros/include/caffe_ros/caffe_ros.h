@@ -4,77 +4,63 @@
 #ifndef CAFFE_ROS_CAFFE_ROS_H
 #define CAFFE_ROS_CAFFE_ROS_H
 
+#include <memory>
 #include <ros/ros.h>
 #include <sensor_msgs/Image.h>
-#include "caffe_ros/tensor_net.h"
+#include "caffe_ros/dnn_model.h"
+#include "caffe_ros/model_scheduler.h"
+#include "event_executor.h"
+#include "stop_signal.h"
 
 namespace caffe_ros
 {
-// Implements caffe_ros node.
+// Implements caffe_ros node, shared by the standalone node and the nodelet.
+// The node hosts one or more networks (see DnnModel) which share the camera
+// subscription, networks with the same input specs also share preprocessing.
 class CaffeRos
 {
 public:
-    CaffeRos();
+    // nh is the private node handle used for parameters and topics.
+    // If the models parameter (list of names) is set, parameters of each model are read
+    // from its namespace (e.g. ~trails/prototxt_path), otherwise the node runs a single model
+    // with parameters and output topic in nh namespace.
+    explicit CaffeRos(ros::NodeHandle& nh);
     ~CaffeRos() = default;
 
-    void spin();
+    // Processes camera images until stop is signalled. Subscription callbacks
+    // must be executed by the caller (spinner or nodelet manager).
+    // Images are preprocessed and submitted on the calling thread while outputs
+    // are published by a separate thread of each model, so consecutive frames are pipelined.
+    // Throws if the inference of any model fails.
+    void spin(const redtail::StopSignal& stop);
 
 private:
-    // Specifies whether to apply any post processing to the output of the DNN.
-    enum class PostProc
-    {
-        None = 0,
-        YOLO        // Compute object boxes from the output of YOLO DNN.
-    };
-
     // Default camera queue size. Recommended value is one as to make 
     // sure we process most recent image from the camera.
     const int DEFAULT_CAMERA_QUEUE_SIZE = 1;
-    // DNN output (publisher) queue. Value of 1 makes sure only most recent
-    // output gets published.
-    const int DEFAULT_DNN_QUEUE_SIZE    = 1;
 
-    // Current image being worked on.
-    sensor_msgs::Image::ConstPtr cur_img_;
+    // Wakes up processing when a new image arrives, limits the rate to the max rate of the models.
+    std::unique_ptr<redtail::executor::EventExecutor> executor_;
+    // The most recent camera image, older unprocessed images are dropped.
+    std::unique_ptr<redtail::executor::LatestInput<sensor_msgs::Image::ConstPtr>> image_input_;
 
-    // Publisher for the DNN output.
-    ros::Publisher  output_pub_;
     // Subscriber to camera capture topic (gscam).
     ros::Subscriber image_sub_;
-    // DNN predictor.
-    TensorNet net_;
-    
-    bool        debug_mode_;
-    std::string debug_dir_;
-
-    PostProc post_proc_;
 
-    // Probability and IOU thresholds used in object detection net (YOLO).
-    float obj_det_threshold_;
-    float iou_threshold_;
-    
-    // Max rate to run the node at (in Hz).
-    float max_rate_hz_;
+    std::vector<std::unique_ptr<DnnModel>> models_;
+    // Decides which models process the current frame and in what order.
+    ModelScheduler   scheduler_;
+    std::vector<int> due_;
+    // Preprocessed input of each group of models with the same input specs,
+    // null for the models which do not share the input with others.
+    std::vector<std::shared_ptr<SharedInput>> shared_inputs_;
 
 private:
-    sensor_msgs::Image::ConstPtr computeOutputs();
+    // Submits the image to the models due on this frame.
+    void computeOutputs(const sensor_msgs::Image::ConstPtr& img_msg);
 
     void imageCallback(const sensor_msgs::Image::ConstPtr& msg);
-
-    void setPostProcessing(const std::string& postProc)
-    {
-        if (postProc.size() == 0)
-            post_proc_ = PostProc::None;
-        else if (postProc == "YOLO")
-            post_proc_ = PostProc::YOLO;
-        else
-        {
-            ROS_FATAL("Post processing %s is not supported. Supported: YOLO", postProc.c_str());
-            ros::shutdown();
-        }
-    }
-    
 };  
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,78 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_CPU_BACKEND_H
+#define CAFFE_ROS_CPU_BACKEND_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "caffe_importer.h"
+#include "cpu_layers.h"
+#include "network_backend.h"
+
+namespace caffe_ros
+{
+
+// Executes Caffe networks on CPU in FP32, does not require CUDA or TensorRT.
+// Supported layers: Convolution, Pooling, InnerProduct, ReLU, Softmax, LRN,
+// Concat, Scale, BatchNorm, Eltwise and Dropout/Split (no-ops in inference).
+// All blobs are allocated when the network is loaded, the input and output
+// blobs are bound to the buffers of the request so they are not copied.
+class CpuBackend: public NetworkBackend
+{
+public:
+    CpuBackend() = default;
+    ~CpuBackend() = default;
+
+    void loadNetwork(ConstStr& prototxt_path, ConstStr& model_path,
+                     ConstStr& input_blob, ConstStr& output_blob,
+                     DataType data_type, bool use_cached_model) override;
+
+    BlobDims getInputDims() const override  { return blobs_[input_].dims; }
+    BlobDims getOutputDims() const override { return blobs_[output_].dims; }
+
+    void showProfile(bool on) override { debug_mode_ = on; }
+
+    std::string getName() const override { return "cpu"; }
+
+    void allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs) override;
+    void deallocate(InferenceBuffers& bufs) override;
+    void execute(InferenceBuffers& bufs) override;
+
+private:
+    struct Blob
+    {
+        std::string        name;
+        BlobDims           dims;
+        std::vector<float> data;
+    };
+
+    struct Step
+    {
+        std::string                 name;
+        std::unique_ptr<cpu::Layer> layer;
+        std::vector<int>            inputs;
+        int                         output;
+    };
+
+    // Convolution and inner product layers use the weights from the model directly.
+    CaffeModel        model_;
+    std::vector<Blob> blobs_;
+    // Data pointers of the blobs, the input blob points to the input buffer of the current request.
+    std::vector<float*>       blob_ptrs_;
+    std::vector<Step>         steps_;
+    // Inputs of the current step.
+    std::vector<const float*> step_in_;
+    // Temporary buffer shared by all layers.
+    std::vector<float>        workspace_;
+
+    int input_  = -1;
+    int output_ = -1;
+
+    bool debug_mode_ = false;
+};
+
+}
+
+#endif
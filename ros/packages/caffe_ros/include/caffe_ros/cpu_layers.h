@@ -0,0 +1,230 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_CPU_LAYERS_H
+#define CAFFE_ROS_CPU_LAYERS_H
+
+#include <vector>
+#include "network_backend.h"
+
+namespace caffe_ros { namespace cpu
+{
+
+// -----------------------------------------------------------------
+// Layers of the CPU backend. Blobs are in planar (CHW) format,
+// batch size is 1. Layers are multithreaded (cv::parallel_for_),
+// inner loops use GCC vector extensions.
+// -----------------------------------------------------------------
+class Layer
+{
+public:
+    virtual ~Layer() = default;
+
+    // Computes output dimensions and validates the parameters, returns false
+    // if the inputs are not supported. Called once when the network is created.
+    virtual bool reshape(const std::vector<BlobDims>& in, BlobDims& out) = 0;
+
+    // Temporary buffer size (in floats) required by forward.
+    virtual size_t getWorkspaceSize() const { return 0; }
+
+    // True if the output can be computed in place of the first input.
+    virtual bool supportsInPlace() const { return false; }
+
+    virtual void forward(const std::vector<const float*>& in, float* out, float* workspace) = 0;
+};
+
+// Learned parameters of a layer, points to the weight arena of the model
+// (see CaffeModel) which must outlive the layer.
+struct ConstWeights
+{
+    const float* data = nullptr;
+    size_t       size = 0;
+
+    bool empty() const { return size == 0; }
+};
+
+// Convolution with optional bias. Weights are in Caffe (OIHW) format.
+class ConvolutionLayer: public Layer
+{
+public:
+    struct Params
+    {
+        int num_output = 0;
+        int kernel_h   = 1;
+        int kernel_w   = 1;
+        int stride_h   = 1;
+        int stride_w   = 1;
+        int pad_h      = 0;
+        int pad_w      = 0;
+        int dilation_h = 1;
+        int dilation_w = 1;
+        int group      = 1;
+    };
+
+    ConvolutionLayer(const Params& params, ConstWeights weights, ConstWeights bias);
+
+    bool   reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    size_t getWorkspaceSize() const override;
+    void   forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    // True for 1x1 convolution which does not require im2col.
+    bool isPointwise() const;
+
+    Params       p_;
+    ConstWeights weights_;
+    ConstWeights bias_;
+    BlobDims     in_dims_;
+    BlobDims     out_dims_;
+};
+
+class PoolingLayer: public Layer
+{
+public:
+    enum class Method
+    {
+        kMax = 0,
+        kAverage
+    };
+
+    struct Params
+    {
+        Method method   = Method::kMax;
+        int    kernel_h = 1;
+        int    kernel_w = 1;
+        int    stride_h = 1;
+        int    stride_w = 1;
+        int    pad_h    = 0;
+        int    pad_w    = 0;
+        // Kernel covers the whole input.
+        bool   global   = false;
+    };
+
+    explicit PoolingLayer(const Params& params);
+
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    Params   p_;
+    BlobDims in_dims_;
+    BlobDims out_dims_;
+};
+
+// Fully connected layer, weights are (num_output x input size).
+class InnerProductLayer: public Layer
+{
+public:
+    InnerProductLayer(int num_output, ConstWeights weights, ConstWeights bias);
+
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    int          num_output_;
+    ConstWeights weights_;
+    ConstWeights bias_;
+    size_t       in_size_ = 0;
+};
+
+class ReLULayer: public Layer
+{
+public:
+    explicit ReLULayer(float negative_slope = 0);
+
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    bool supportsInPlace() const override { return true; }
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    float    negative_slope_;
+    BlobDims dims_;
+};
+
+// Softmax over channels.
+class SoftmaxLayer: public Layer
+{
+public:
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    BlobDims dims_;
+};
+
+// Local response normalization across channels.
+class LRNLayer: public Layer
+{
+public:
+    LRNLayer(int local_size, float alpha, float beta, float k);
+
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    int      local_size_;
+    float    alpha_;
+    float    beta_;
+    float    k_;
+    BlobDims dims_;
+};
+
+// Concatenation over channels.
+class ConcatLayer: public Layer
+{
+public:
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    std::vector<size_t> sizes_;
+};
+
+// Per-channel scale and bias: out = in * scale[c] + bias[c].
+// Caffe Scale and BatchNorm (in inference mode) layers are converted to this layer.
+class ScaleLayer: public Layer
+{
+public:
+    ScaleLayer(std::vector<float> scale, std::vector<float> bias);
+
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    bool supportsInPlace() const override { return true; }
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    std::vector<float> scale_;
+    std::vector<float> bias_;
+    BlobDims           dims_;
+};
+
+// Element-wise operation on inputs of the same dimensions.
+class EltwiseLayer: public Layer
+{
+public:
+    enum class Operation
+    {
+        kProd = 0,
+        kSum,
+        kMax
+    };
+
+    // Coefficients are used by kSum only, empty means all ones.
+    EltwiseLayer(Operation op, std::vector<float> coeffs);
+
+    bool reshape(const std::vector<BlobDims>& in, BlobDims& out) override;
+    bool supportsInPlace() const override { return true; }
+    void forward(const std::vector<const float*>& in, float* out, float* workspace) override;
+
+private:
+    Operation          op_;
+    std::vector<float> coeffs_;
+    size_t             size_ = 0;
+};
+
+// Computes C = A * B + bias, where A is (m x k), B is (k x n), C is (m x n),
+// all matrices are row-major, bias (m elements) can be null.
+void gemm(int m, int n, int k, const float* a, const float* b, const float* bias, float* c);
+
+} }
+
+#endif
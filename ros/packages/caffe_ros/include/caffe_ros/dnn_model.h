@@ -0,0 +1,196 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_DNN_MODEL_H
+#define CAFFE_ROS_DNN_MODEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include "caffe_ros/box_tracker.h"
+#include "caffe_ros/tensor_net.h"
+#include "caffe_ros/yolo_prediction.h"
+#include "motion_gate.h"
+#include "message_pool.h"
+#include "node_error.h"
+
+namespace caffe_ros
+{
+// Preprocessed camera frame shared by the models with the same input (see TensorNet::hasSameInput).
+// Filled by the first model which runs on the frame, reset by the node for each frame.
+struct SharedInput
+{
+    std::vector<float> data;
+    bool               ready = false;
+};
+
+// One network hosted by caffe_ros node with its post processing and output topic.
+// Frames are submitted by the node thread while outputs are published
+// by the output thread of the model, see start().
+class DnnModel
+{
+public:
+    // nh is the node handle of the model parameters, the output is published to
+    // output_topic (network/output relative to nh by default).
+    // name is used in log messages only, empty for a single model node.
+    DnnModel(ros::NodeHandle& nh, const std::string& name);
+    ~DnnModel();
+
+    const std::string& getName() const { return name_; }
+    // Max rate of the model (in Hz, 0 - not limited) and its priority, see ModelScheduler.
+    float getMaxRate() const  { return max_rate_hz_; }
+    int   getPriority() const { return priority_; }
+
+    const TensorNet& getNet() const { return net_; }
+    // Returns true if the frame can be submitted without waiting for the previous frames.
+    bool canSubmit() const { return net_.canSubmit(); }
+
+    // Starts and stops the output thread.
+    void start();
+    void stop();
+
+    // Submits the image for inference, the output is published by the output thread.
+    // If shared is not null the image is preprocessed into it unless it is ready.
+    // Rethrows the inference error of a previous frame, if any.
+    void computeOutputs(const sensor_msgs::Image::ConstPtr& img_msg, SharedInput* shared);
+
+    // Logs motion gate statistics once per motion_stats_period.
+    void logMotionStats();
+    // Logs output message statistics.
+    void logOutputStats();
+
+private:
+    // Specifies whether to apply any post processing to the output of the DNN.
+    enum class PostProc
+    {
+        None = 0,
+        YOLO        // Compute object boxes from the output of YOLO DNN.
+    };
+
+    // DNN output (publisher) queue. Value of 1 makes sure only most recent
+    // output gets published.
+    const int DEFAULT_DNN_QUEUE_SIZE = 1;
+
+    std::string name_;
+
+    // Publisher for the DNN output.
+    ros::Publisher  output_pub_;
+    // Output messages are recycled once published and released by subscribers.
+    std::unique_ptr<redtail::MessagePool<sensor_msgs::Image>> out_msg_pool_;
+    // DNN predictor.
+    TensorNet net_;
+
+    bool        debug_mode_;
+
+    PostProc post_proc_;
+
+    // Probability and IOU thresholds used in object detection net (YOLO).
+    float obj_det_threshold_;
+    float iou_threshold_;
+    // Decodes YOLO output, used by the output thread only.
+    YoloDecoder                   yolo_decoder_;
+    // Decoded boxes of the current frame, reused to avoid allocations.
+    std::vector<ObjectPrediction> yolo_preds_;
+    NmsParams                     nms_params_;
+    NonMaxSuppression             nms_;
+    std::vector<ObjectPrediction> nms_preds_;
+
+    // Max rate to run the model at (in Hz) and its priority.
+    float max_rate_hz_;
+    int   priority_;
+
+    // Skips inference on near-static frames, null if disabled.
+    std::unique_ptr<redtail::preprocessing::MotionGate> motion_gate_;
+    // The last computed output, republished for skipped frames. Accessed by the output thread only.
+    sensor_msgs::Image::ConstPtr last_out_msg_;
+    // Set when the first frame is submitted, after that skipped frames can reuse the last output.
+    bool has_output_ = false;
+    // Period (in seconds) of motion gate statistics output.
+    float         motion_stats_period_;
+    ros::WallTime last_stats_time_;
+
+    // Detect-then-track: the detector runs on every track_interval_-th frame, the boxes
+    // are tracked on the other frames. Null if tracking is disabled.
+    std::unique_ptr<BoxTracker> tracker_;
+    int                         track_interval_;
+    float                       track_min_confidence_;
+    // Frames tracked since the last detector frame, used by the submitting thread only.
+    int                         frames_since_detect_ = 0;
+    // Set by the output thread when the tracker loses the boxes.
+    std::atomic<bool>           force_detect_{false};
+    // Detector duty cycle and compute time since the last report, accessed by the output thread only.
+    struct TrackStats
+    {
+        uint64_t detected  = 0;
+        uint64_t tracked   = 0;
+        uint64_t lost      = 0;
+        // Output thread time: wait for the inference and post processing, or tracking.
+        double   detect_ms = 0;
+        double   track_ms  = 0;
+    };
+    TrackStats    track_stats_;
+    float         track_stats_period_;
+    ros::WallTime last_track_stats_time_;
+
+    // Frame submitted for inference (or skipped by the motion gate, or tracked) waiting to be published.
+    struct Pending
+    {
+        sensor_msgs::Image::ConstPtr img_msg;
+        // Output message from the pool, null for skipped and tracked frames.
+        sensor_msgs::Image::Ptr      out_msg;
+        TensorNet::Ticket            ticket = 0;
+        bool                         repeat = false;
+        // Boxes are tracked instead of running the detector.
+        bool                         track  = false;
+        ros::WallTime                start;
+    };
+
+    // Frames in submission order, consumed by the output thread.
+    std::deque<Pending>     pending_;
+    std::mutex              pending_mutex_;
+    std::condition_variable pending_cv_;
+    bool                    stop_output_ = false;
+    // First inference error of the output thread, the remaining frames are dropped.
+    std::exception_ptr      output_error_;
+    std::thread             output_thread_;
+
+private:
+    // Sets the output message size and returns its data as the network output buffer
+    // or null if the output is post processed.
+    float* prepareOutputMessage(sensor_msgs::Image& out_msg);
+    // Fills the output message from the DNN output for the given source image.
+    void createOutputMessage(const sensor_msgs::Image& img, const float* output, sensor_msgs::Image& out_msg);
+
+    // Moves the boxes of the previous frame to the image and writes them to the output message.
+    void createTrackedMessage(const sensor_msgs::Image& img, sensor_msgs::Image& out_msg);
+    // Writes the boxes (in ROI coordinates) to the output message.
+    void writeObjects(const std::vector<ObjectPrediction>& preds, const cv::Rect& roi, sensor_msgs::Image& out_msg);
+    // Input ROI of the image, the image data is not copied.
+    cv::Mat getRoiImage(const sensor_msgs::Image& img) const;
+    // Logs and resets tracking statistics.
+    void logTrackStats();
+
+    // Waits for pending frames and publishes their outputs in order.
+    void outputLoop();
+
+    void setPostProcessing(const std::string& postProc)
+    {
+        if (postProc.size() == 0)
+            post_proc_ = PostProc::None;
+        else if (postProc == "YOLO")
+            post_proc_ = PostProc::YOLO;
+        else
+        {
+            redtail::throwNodeError("Post processing %s is not supported. Supported: YOLO", postProc.c_str());
+        }
+    }
+};
+}
+
+#endif
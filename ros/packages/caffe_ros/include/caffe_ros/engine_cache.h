@@ -0,0 +1,81 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_ENGINE_CACHE_H
+#define CAFFE_ROS_ENGINE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace caffe_ros
+{
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false and sets error if the file could not be mapped.
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    const void* data() const { return data_; }
+    size_t      size() const { return size_; }
+
+private:
+    void*  data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 64-bit hash of the content of files and strings, used to key cached engines.
+// Not cryptographic, only detects changes of the inputs.
+class ContentHash
+{
+public:
+    void update(const void* data, size_t size);
+    // The size of the string is hashed too so the concatenation of the inputs is not ambiguous.
+    void update(const std::string& src);
+    // Hashes the content of the file (mapped, not copied).
+    bool updateFile(const std::string& path, std::string& error);
+
+    uint64_t get() const;
+    // 16 hex digits.
+    std::string toString() const;
+
+private:
+    uint64_t hash_ = 0x9E3779B97F4A7C15ull;
+    uint64_t size_ = 0;
+};
+
+// Directory of serialized engines, entries are named <name>.<key>.engine
+// where key is the hash of everything the engine is built from (see ContentHash).
+// Entries are written to a temporary file which is then renamed so several
+// nodes can share the directory and never read a partially written engine.
+class EngineCache
+{
+public:
+    explicit EngineCache(const std::string& dir);
+
+    const std::string& getDir() const { return dir_; }
+    std::string getPath(const std::string& name, const std::string& key) const;
+
+    // Maps the cached engine, returns false if there is no such entry.
+    bool load(const std::string& path, MappedFile& engine) const;
+    // Creates the directory if needed and writes the entry.
+    bool store(const std::string& path, const void* data, size_t size, std::string& error) const;
+    // Removes an entry which could not be used (e.g. failed to deserialize).
+    void remove(const std::string& path) const;
+
+private:
+    std::string dir_;
+};
+
+}
+
+#endif
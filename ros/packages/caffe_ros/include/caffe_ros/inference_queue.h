@@ -0,0 +1,154 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_INFERENCE_QUEUE_H
+#define CAFFE_ROS_INFERENCE_QUEUE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caffe_ros
+{
+
+// Input and output buffers of one in-flight frame. Host buffers are allocated
+// by the backend so it can use pinned or mapped memory, device pointers are backend specific.
+// out_dst is an optional caller buffer (e.g. data of the output message) set per frame,
+// if present the backend writes the output there instead of out_h.
+struct InferenceBuffers
+{
+    float* in_h    = nullptr;
+    float* out_h   = nullptr;
+    void*  in_d    = nullptr;
+    void*  out_d   = nullptr;
+    float* out_dst = nullptr;
+
+    float* output() const { return out_dst != nullptr ? out_dst : out_h; }
+};
+
+// Executes the network on a buffer set. allocate and deallocate are called by InferenceQueue
+// owner thread, execute - by InferenceQueue worker thread. Sizes are in floats.
+class InferenceBackend
+{
+public:
+    virtual ~InferenceBackend() = default;
+
+    virtual void allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs) = 0;
+    virtual void deallocate(InferenceBuffers& bufs) = 0;
+    // Computes bufs.output() from bufs.in_h.
+    virtual void execute(InferenceBuffers& bufs) = 0;
+};
+
+// Host-only backend that runs the function on host buffers, does not require CUDA.
+class HostInferenceBackend : public InferenceBackend
+{
+public:
+    using Function = std::function<void(const float* input, float* output)>;
+
+    explicit HostInferenceBackend(Function fn):
+        fn_(std::move(fn))
+    {
+    }
+
+    void allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs) override;
+    void deallocate(InferenceBuffers& bufs) override;
+    void execute(InferenceBuffers& bufs) override;
+
+private:
+    Function fn_;
+};
+
+// Asynchronous inference with N rotating buffer sets. submit() fills the input
+// of a free set on the calling thread and queues it for the worker thread
+// which executes the network, so preprocessing of the next frame overlaps
+// inference of the current one. Frames are executed in submission order.
+// A set is in use from submit() until release() of its ticket so at most N tickets
+// can be outstanding: submit() blocks while all sets are in use.
+// Backend errors (exceptions) are rethrown to the caller: allocation errors by the
+// constructor and execution errors by poll() of the failed ticket.
+// All methods can be called from any thread.
+class InferenceQueue
+{
+public:
+    using Ticket = uint64_t;
+
+    InferenceQueue(InferenceBackend& backend, size_t in_size, size_t out_size, int num_buffers);
+    ~InferenceQueue();
+
+    InferenceQueue(const InferenceQueue&) = delete;
+    InferenceQueue& operator=(const InferenceQueue&) = delete;
+
+    // Calls fill to write the network input and queues it for inference.
+    // If output is not null the network output is written there, the buffer
+    // must hold getOutputSize() floats and stay valid until release().
+    // Throws if the queue is stopped, also when it happens while waiting for a free buffer set.
+    Ticket submit(const std::function<void(float* input)>& fill, float* output = nullptr);
+
+    // Returns true if inference of the ticket has completed, if wait is true
+    // waits for completion first (throws if the queue is stopped while waiting).
+    // If the inference has failed, the ticket is released and the backend exception is rethrown.
+    bool poll(Ticket ticket, bool wait);
+
+    // Output of the completed ticket (the output buffer passed to submit if any), valid until release().
+    const float* getOutput(Ticket ticket) const;
+
+    // Returns buffer set of the ticket to the queue.
+    void release(Ticket ticket);
+
+    // Stops the worker thread and wakes up threads blocked in submit() and poll(),
+    // queued frames are not executed. Called by the destructor.
+    void stop();
+
+    int    getNumBuffers() const { return (int)slots_.size(); }
+    // Number of buffer sets available for submit() without waiting.
+    int    getNumFree() const;
+    size_t getInputSize() const  { return in_size_; }
+    size_t getOutputSize() const { return out_size_; }
+
+private:
+    enum class State
+    {
+        kFree = 0,
+        kFilling,
+        kQueued,
+        kDone
+    };
+
+    struct Slot
+    {
+        InferenceBuffers   bufs;
+        State              state  = State::kFree;
+        Ticket             ticket = 0;
+        // Set by the worker if execution has failed, rethrown by poll().
+        std::exception_ptr error;
+    };
+
+    // Must be called under the lock. Throws if the ticket is not in flight.
+    int findSlot(Ticket ticket) const;
+
+    void workerLoop();
+
+private:
+    InferenceBackend& backend_;
+    size_t            in_size_;
+    size_t            out_size_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cv_;
+    std::vector<Slot>       slots_;
+    // Slots waiting for execution in submission order.
+    std::deque<int>         queue_;
+    Ticket                  next_ticket_ = 1;
+    bool                    stop_        = false;
+
+    std::thread worker_;
+};
+
+}
+
+#endif
@@ -5,18 +5,25 @@
 #define CAFFE_ROS_INT8_CALIBRATOR_H
 
 #include <NvInfer.h>
+#include <memory>
 #include <string>
+#include <vector>
+#include <ros/ros.h>
+#include "batch_prefetcher.h"
 #include "internal_utils.h"
+#include "network_backend.h"
 
 namespace caffe_ros
 {
+// Calibration images are decoded and preprocessed ahead of time by a pool
+// of threads (see BatchPrefetcher) while TensorRT processes the current batch.
 class Int8EntropyCalibrator : public nvinfer1::IInt8EntropyCalibrator
 {
 public:
-    Int8EntropyCalibrator(ConstStr& src, ConstStr& calib_cache);
+    explicit Int8EntropyCalibrator(const Int8CalibParams& params);
     ~Int8EntropyCalibrator();
 
-    int  getBatchSize() const override { return 1; }
+    int  getBatchSize() const override { return batch_size_; }
     bool getBatch(void* bindings[], const char* names[], int nbBindings) override;
 
     const void* readCalibrationCache(size_t& length) override;
@@ -24,13 +31,23 @@ public:
 
     void setInputDims(nvinfer1::DimsCHW dims);
 
+    ConstStr& getSource() const    { return src_; }
+    ConstStr& getCacheFile() const { return calib_cache_; }
+
 private:
     std::string src_;
     std::string calib_cache_;
-    
-    std::deque<std::string> files_;
+    int         num_threads_;
+    int         batch_size_;
+
+    std::vector<std::string> files_;
 
     nvinfer1::DimsCHW dims_ = nvinfer1::DimsCHW(0, 0, 0);
+    std::unique_ptr<ImagePreprocessor> preproc_;
+    // Created on the first batch, after the input dimensions are set.
+    std::unique_ptr<BatchPrefetcher>   prefetcher_;
+    size_t                             num_batches_ = 0;
+    ros::WallTime                      start_time_;
 
     float* img_d_ = nullptr;
 };
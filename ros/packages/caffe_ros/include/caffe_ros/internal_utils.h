@@ -4,7 +4,9 @@
 #ifndef CAFFE_ROS_INTERNAL_UTILS_H
 #define CAFFE_ROS_INTERNAL_UTILS_H
 
+#include <memory>
 #include <opencv2/opencv.hpp>
+#include "image_preprocessor.h"
 
 namespace caffe_ros
 {
@@ -17,10 +19,12 @@ enum class InputFormat
     RGB
 };
 
-// Performs image preprocessing (resizing, scaling, format conversion etc)
-// that is done before feeding the image into the networ.
-cv::Mat preprocessImage(cv::Mat img, int dst_img_w, int dst_img_h, InputFormat inp_fmt, ConstStr& encoding,
-                        float inp_scale, float inp_shift);
+using ImagePreprocessor = redtail::preprocessing::ImagePreprocessor;
+
+// Creates image preprocessor (resizing, scaling, format conversion etc)
+// that is used before feeding the image into the network.
+std::unique_ptr<ImagePreprocessor> createImagePreprocessor(int dst_img_w, int dst_img_h, InputFormat inp_fmt,
+                                                           float inp_scale, float inp_shift);
 
 }
 
@@ -0,0 +1,66 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_MODEL_SCHEDULER_H
+#define CAFFE_ROS_MODEL_SCHEDULER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace caffe_ros
+{
+
+// Decides which of the networks hosted by one node process the current camera frame.
+// Each model has a max rate (a ceiling on the average rate) and a priority:
+// models due on a frame are returned in the order of decreasing priority,
+// models with equal priority - in the order they were added.
+// The caller submits the frame in that order and reports whether each model ran
+// or was skipped because the device was busy (see onRun and onBusy).
+// A busy model stays due so it runs on the next frame.
+class ModelScheduler
+{
+public:
+    struct Stats
+    {
+        uint64_t runs       = 0;
+        // Frames skipped because the model was not due yet (rate limit).
+        uint64_t rate_skips = 0;
+        // Frames skipped because the device was busy.
+        uint64_t busy_skips = 0;
+    };
+
+    // Returns the index of the model, max_rate_hz 0 - not limited.
+    int addModel(float max_rate_hz, int priority);
+
+    int getNumModels() const { return (int)models_.size(); }
+
+    // Max rate of all models, 0 if any of them is not limited.
+    float getMaxRate() const;
+
+    // Sets dst to the models due at time now (in seconds) in priority order.
+    void getDue(double now, std::vector<int>& dst);
+
+    void onRun(int model, double now);
+    void onBusy(int model);
+
+    Stats getStats(int model, bool reset);
+
+private:
+    struct Model
+    {
+        double period   = 0;
+        int    priority = 0;
+        // The model is due when now >= next_run.
+        double next_run = 0;
+        bool   started  = false;
+        Stats  stats;
+    };
+
+    std::vector<Model> models_;
+    // Model indices sorted by priority.
+    std::vector<int>   order_;
+};
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_NETWORK_BACKEND_H
+#define CAFFE_ROS_NETWORK_BACKEND_H
+
+#include <memory>
+#include <string>
+#include "inference_queue.h"
+#include "internal_utils.h"
+
+namespace caffe_ros
+{
+
+// Network data type. Backends may not support all types.
+enum class DataType
+{
+    kFLOAT = 0,
+    kHALF,
+    kINT8
+};
+
+DataType    parseDataType(const std::string& src);
+std::string toString(DataType src);
+
+// Blob dimensions, batch size is always 1.
+struct BlobDims
+{
+    int c = 0;
+    int h = 0;
+    int w = 0;
+
+    size_t size() const { return (size_t)c * h * w; }
+};
+
+// INT8 calibration settings, see Int8EntropyCalibrator.
+struct Int8CalibParams
+{
+    // Directory of calibration images or a single image, empty - use the calibration cache.
+    std::string src;
+    // Calibration cache file, empty - _int8_calib.cache in src directory.
+    std::string cache;
+    // Images per calibration batch.
+    int         batch_size = 1;
+    // Max number of images used for calibration (0 - all), see sampleFiles.
+    int         max_images = 0;
+    bool        shuffle    = false;
+    // Image loading threads, 0 - all hardware threads.
+    int         threads    = 0;
+};
+
+// Executes a network loaded from Caffe model files, used by TensorNet.
+// execute() (see InferenceBackend) runs the network on input/output buffers
+// in planar (CHW) format allocated by the backend.
+class NetworkBackend: public InferenceBackend
+{
+public:
+    virtual void loadNetwork(ConstStr& prototxt_path, ConstStr& model_path,
+                             ConstStr& input_blob, ConstStr& output_blob,
+                             DataType data_type, bool use_cached_model) = 0;
+
+    virtual BlobDims getInputDims() const  = 0;
+    virtual BlobDims getOutputDims() const = 0;
+
+    // Enables per-layer profiling, must be called after loadNetwork.
+    virtual void showProfile(bool on) = 0;
+
+    // Must be called before loadNetwork if INT8 data type is requested.
+    virtual void createInt8Calibrator(const Int8CalibParams& params);
+
+    // Directory of cached engines used when use_cached_model is set, empty - directory of the model.
+    // Must be called before loadNetwork, ignored by backends which do not build engines.
+    virtual void setEngineCacheDir(ConstStr& dir) {}
+
+    virtual std::string getName() const = 0;
+};
+
+// Creates backend by name: "tensorrt" or "cpu". Empty name selects TensorRT
+// if the package was built with it, CPU otherwise.
+std::unique_ptr<NetworkBackend> createNetworkBackend(ConstStr& name);
+
+}
+
+#endif
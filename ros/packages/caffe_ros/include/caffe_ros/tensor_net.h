@@ -5,48 +5,93 @@
 #define CAFFE_ROS_TENSOR_NET_H
 
 #include <ros/ros.h>
-#include <NvInfer.h>
 #include <opencv2/opencv.hpp>
 // REVIEW alexeyk: OpenCV that comes with JetPack 3.2 is compiled without CUDA support.
 // #include <opencv2/core/cuda.hpp>
 
-#include "int8_calibrator.h"
+#include "inference_queue.h"
+#include "network_backend.h"
+#include "node_error.h"
 
 namespace caffe_ros
 {
 
+// DNN executed by a network backend (TensorRT or CPU, see setBackend). Inference
+// is asynchronous: submit() preprocesses the image on the calling thread and
+// queues it for execution on a worker thread so the next frame can be
+// preprocessed while the current one is being executed.
+// forward() is a synchronous wrapper.
 class TensorNet
 {
 public:
+    using Ticket = InferenceQueue::Ticket;
+
     TensorNet();
     virtual ~TensorNet();
 
+    // Selects the backend by name (see createNetworkBackend), must be called before loadNetwork.
+    void setBackend(ConstStr& name);
+    std::string getBackendName() const { return backend_->getName(); }
+
     void loadNetwork(ConstStr& prototxt_path, ConstStr& model_path,
                      ConstStr& input_blob, ConstStr& output_blob,
-                     nvinfer1::DataType data_type, bool use_cached_model);
+                     DataType data_type, bool use_cached_model);
+
+    // Preprocesses the image and queues it for inference, blocks while all
+    // buffer sets are in use (see setNumBuffers). If output is not null the network
+    // output (C x H x W floats) is written there directly, see InferenceQueue::submit.
+    Ticket submit(const unsigned char* input, size_t w, size_t h, const std::string& encoding,
+                  float* output = nullptr);
+    // Queues input which was already preprocessed (e.g. by another network with the same
+    // input, see hasSameInput), input must hold getInputSize() floats.
+    Ticket submitPreprocessed(const float* input, float* output = nullptr);
+    // Preprocesses the image into dst (getInputSize() floats) without running the network.
+    void preprocess(const unsigned char* input, size_t w, size_t h, const std::string& encoding, float* dst);
+    // Returns true if submit does not have to wait for a free buffer set.
+    bool canSubmit() const { return queue_ == nullptr || queue_->getNumFree() > 0; }
+    // Returns true if both networks preprocess images the same way (size, format, scale, shift and ROI)
+    // so the preprocessed input of one of them can be fed to the other.
+    bool hasSameInput(const TensorNet& other) const;
+    // Returns true if inference has completed, waits for completion if wait is true.
+    bool poll(Ticket ticket, bool wait)     { return queue_->poll(ticket, wait); }
+    // Output of the completed ticket, valid until release().
+    const float* getOutput(Ticket ticket) const { return queue_->getOutput(ticket); }
+    void release(Ticket ticket)             { queue_->release(ticket); }
+
+    // Number of frames that can be in flight (submitted and not released),
+    // must be set before the first submit.
+    void setNumBuffers(int num_buffers)
+    {
+        ROS_ASSERT(num_buffers > 0);
+        ROS_ASSERT(queue_ == nullptr);
+        num_buffers_ = num_buffers;
+    }
 
+    // Synchronous inference, the output is available via getOutput().
     void forward(const unsigned char* input, size_t w, size_t h, const std::string& encoding);
 
-    int getInWidth() const    { return in_dims_.w(); }
-    int getInHeight() const   { return in_dims_.h(); }
-    int getInChannels() const { return in_dims_.c(); }
+    size_t getInputSize() const { return in_dims_.size(); }
+
+    int getInWidth() const    { return in_dims_.w; }
+    int getInHeight() const   { return in_dims_.h; }
+    int getInChannels() const { return in_dims_.c; }
 
-    int getOutWidth() const    { return out_dims_.w(); }
-    int getOutHeight() const   { return out_dims_.h(); }
-    int getOutChannels() const { return out_dims_.c(); }
+    int getOutWidth() const    { return out_dims_.w; }
+    int getOutHeight() const   { return out_dims_.h; }
+    int getOutChannels() const { return out_dims_.c; }
 
-    const float* getOutput() const { return out_h_; }
+    const float* getOutput() const { return getOutput(fwd_ticket_); }
 
     void setInputFormat(ConstStr& input_format)
     {
+        preproc_ = nullptr;
         if (input_format == "BGR")
             inp_fmt_ = InputFormat::BGR;
         else if (input_format == "RGB")
             inp_fmt_ = InputFormat::RGB;
         else
         {
-            ROS_FATAL("Input format %s is not supported. Supported formats: BGR and RGB", input_format.c_str());
-            ros::shutdown();
+            redtail::throwNodeError("Input format %s is not supported. Supported formats: BGR and RGB", input_format.c_str());
         }
     }
 
@@ -54,75 +99,87 @@ public:
     { 
         assert(std::isfinite(shift));
         inp_shift_ = shift;
+        preproc_   = nullptr;
     }
 
     void setScale(float scale) 
     { 
         assert(std::isfinite(scale));
         inp_scale_ = scale;
+        preproc_   = nullptr;
+    }
+
+    // Sets input region of interest (ROI) as fractions of the image size.
+    // Only ROI is preprocessed and fed to the network.
+    void setInputRoi(float top, float bottom, float left, float right)
+    {
+        ROS_ASSERT(0 <= top  && top  < bottom && bottom <= 1);
+        ROS_ASSERT(0 <= left && left < right  && right  <= 1);
+        inp_roi_ = cv::Rect2f(left, top, right - left, bottom - top);
+    }
+
+    // Returns input ROI in pixels for the image of the given size.
+    cv::Rect getInputRoi(int w, int h) const
+    {
+        auto roi = cv::Rect((int)std::round(inp_roi_.x * w),     (int)std::round(inp_roi_.y * h),
+                            (int)std::round(inp_roi_.width * w), (int)std::round(inp_roi_.height * h));
+        return roi & cv::Rect(0, 0, w, h);
     }
 
     void showProfile(bool on)
     {
-        assert(context_ != nullptr);
         debug_mode_ = on;
-        context_->setProfiler(on ? &s_profiler : nullptr);
+        backend_->showProfile(on);
     }
 
-    void createInt8Calibrator(ConstStr& int8_calib_src, ConstStr& int8_calib_cache);
+    // Must be called before loadNetwork, see NetworkBackend::setEngineCacheDir.
+    void setEngineCacheDir(ConstStr& dir)
+    {
+        if (backend_ == nullptr)
+            setBackend("");
+        backend_->setEngineCacheDir(dir);
+    }
+
+    // Must be called before loadNetwork.
+    void createInt8Calibrator(const Int8CalibParams& params)
+    {
+        if (backend_ == nullptr)
+            setBackend("");
+        backend_->createInt8Calibrator(params);
+    }
 
 protected:
+    // Creates the queue on the first submit.
+    void createQueue();
 
-    void profileModel(ConstStr& prototxt_path, ConstStr& model_path, nvinfer1::DataType data_type,
-                      ConstStr& input_blob, ConstStr& output_blob, std::ostream& model);
+    std::unique_ptr<NetworkBackend> backend_;
 
-    class Logger : public nvinfer1::ILogger
-    {
-        void log(Severity severity, const char *msg) override;
-    };
-    static Logger s_log;
-
-    class Profiler : public nvinfer1::IProfiler
-    {
-    public:
-        void printLayerTimes();
-    protected:
-        void reportLayerTime(const char *layerName, float ms) override;
-    private:
-        using Record = std::pair<std::string, float>;
-        std::vector<Record> profile_;
-    };
-    static Profiler s_profiler;
-
-    nvinfer1::IRuntime*          infer_;
-    nvinfer1::ICudaEngine*       engine_;
-    nvinfer1::IExecutionContext* context_;
-    
-    nvinfer1::DimsCHW in_dims_;
-    nvinfer1::DimsCHW out_dims_;
+    BlobDims in_dims_;
+    BlobDims out_dims_;
 
     // DNN input format.
     InputFormat inp_fmt_ = InputFormat::BGR;
 
+    std::unique_ptr<ImagePreprocessor> preproc_;
     cv::Mat in_h_;
-    cv::Mat in_final_h_;
-    float* in_d_  = nullptr;
-    float* out_h_ = nullptr;
-    float* out_d_ = nullptr;
+
+    int num_buffers_ = 2;
+    // Created on the first submit.
+    std::unique_ptr<InferenceQueue> queue_;
+    // Ticket of the last forward() call.
+    Ticket fwd_ticket_ = 0;
 
     float inp_shift_ = 0;
     float inp_scale_ = 1;
 
+    // Input ROI, by default the whole image.
+    cv::Rect2f inp_roi_ = cv::Rect2f(0, 0, 1, 1);
+
     // This is a separate flag from ROS_DEBUG to enable only specific profiling
     // of data preparation and DNN feed forward.
     bool debug_mode_ = false;
-
-    std::unique_ptr<Int8EntropyCalibrator> int8_calib_;
 };
 
-nvinfer1::DataType parseDataType(const std::string& src);
-std::string        toString(nvinfer1::DataType src);
-
 }
 
 #endif
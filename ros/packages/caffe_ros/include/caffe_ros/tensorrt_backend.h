@@ -0,0 +1,96 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef CAFFE_ROS_TENSORRT_BACKEND_H
+#define CAFFE_ROS_TENSORRT_BACKEND_H
+
+#include <ros/ros.h>
+#include <NvInfer.h>
+
+#include "int8_calibrator.h"
+#include "network_backend.h"
+
+namespace caffe_ros
+{
+
+// TensorRT backend: input buffers are in pinned memory, outputs are in mapped memory.
+class TensorRTBackend: public NetworkBackend
+{
+public:
+    TensorRTBackend() = default;
+    ~TensorRTBackend() = default;
+
+    void loadNetwork(ConstStr& prototxt_path, ConstStr& model_path,
+                     ConstStr& input_blob, ConstStr& output_blob,
+                     DataType data_type, bool use_cached_model) override;
+
+    BlobDims getInputDims() const override  { return in_dims_; }
+    BlobDims getOutputDims() const override { return out_dims_; }
+
+    void showProfile(bool on) override
+    {
+        assert(context_ != nullptr);
+        debug_mode_ = on;
+        context_->setProfiler(on ? &s_profiler : nullptr);
+    }
+
+    void createInt8Calibrator(const Int8CalibParams& params) override;
+
+    void setEngineCacheDir(ConstStr& dir) override { engine_cache_dir_ = dir; }
+
+    std::string getName() const override { return "tensorrt"; }
+
+    void allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs) override;
+    void deallocate(InferenceBuffers& bufs) override;
+    void execute(InferenceBuffers& bufs) override;
+
+protected:
+    // Builds the engine and returns it serialized, the caller destroys it.
+    nvinfer1::IHostMemory* profileModel(ConstStr& prototxt_path, ConstStr& model_path, DataType data_type,
+                                        ConstStr& input_blob, ConstStr& output_blob);
+
+    // Calibration batches must fit into the max batch size, inference still uses batch size 1.
+    int getMaxBatchSize(DataType data_type) const;
+
+    // Hash of the model files, data type, max batch size, INT8 calibration cache, TensorRT, CUDA and GPU versions.
+    std::string getEngineKey(ConstStr& prototxt_path, ConstStr& model_path,
+                             ConstStr& input_blob, ConstStr& output_blob, DataType data_type);
+    // Loads the engine from the cache (see EngineCache), builds and caches it on a miss.
+    void loadCachedEngine(ConstStr& prototxt_path, ConstStr& model_path,
+                          ConstStr& input_blob, ConstStr& output_blob, DataType data_type);
+
+    class Logger : public nvinfer1::ILogger
+    {
+        void log(Severity severity, const char *msg) override;
+    };
+    static Logger s_log;
+
+    class Profiler : public nvinfer1::IProfiler
+    {
+    public:
+        void printLayerTimes();
+    protected:
+        void reportLayerTime(const char *layerName, float ms) override;
+    private:
+        using Record = std::pair<std::string, float>;
+        std::vector<Record> profile_;
+    };
+    static Profiler s_profiler;
+
+    nvinfer1::IRuntime*          infer_   = nullptr;
+    nvinfer1::ICudaEngine*       engine_  = nullptr;
+    nvinfer1::IExecutionContext* context_ = nullptr;
+
+    BlobDims in_dims_;
+    BlobDims out_dims_;
+
+    bool debug_mode_ = false;
+
+    std::string engine_cache_dir_;
+
+    std::unique_ptr<Int8EntropyCalibrator> int8_calib_;
+};
+
+}
+
+#endif
@@ -4,6 +4,11 @@
 #ifndef CAFFE_ROS_YOLO_PREDICTION_H
 #define CAFFE_ROS_YOLO_PREDICTION_H
 
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace caffe_ros
 {
     struct ObjectPrediction
@@ -16,110 +21,146 @@ namespace caffe_ros
         int   h;
     };
 
-    std::vector<ObjectPrediction> getYoloPredictions(const float* predictions, size_t num_preds, int w_in, int h_in,
-                                                     float prob_threshold = 0.1)
+    // Layout of YOLO network output.
+    enum class YoloVersion
     {
-        assert(predictions != nullptr);
-        assert(num_preds > 0);
-        assert(w_in > 0);
-        assert(h_in > 0);
-        assert(0 < prob_threshold && prob_threshold <= 1);
-
-        const int grid_size     = 7;
-        const int num_lab       = 20;
-        const int num_box       = 2;
-        const int num_box_coord = 4;
-
-        assert(num_preds == grid_size * grid_size * (num_box * (num_box_coord  + 1) + num_lab));
-
-        std::vector<ObjectPrediction> res;
-        size_t icell = 0;
-        for (int row = 0; row < grid_size; row++)
-        {
-            for (int col = 0; col < grid_size; col++, icell++)
-            {
-                // Find max conditional class probability for the current cell.
-                auto cell_preds = predictions + icell * num_lab;
-                auto it_max = std::max_element(cell_preds, cell_preds + num_lab);
-                int  imax_p = it_max - cell_preds;
-                assert(0 <= imax_p && imax_p < num_lab);
-                float max_p = *(it_max);
-                // Find a box with a max condidence prediction.
-                auto  cell_box_scores = predictions + grid_size * grid_size * num_lab + icell * num_box;
-                auto  it_box_max = std::max_element(cell_box_scores, cell_box_scores + num_box);
-                int   imax_box   = it_box_max - cell_box_scores;
-                assert(0 <= imax_box && imax_box < num_box);
-                float box_score  = *(it_box_max);
-                // Skip entries with conditional class probability below the threshold.
-                if (box_score * max_p < prob_threshold)
-                    continue;
-                // Save box for the current cell.
-                auto cell_box_coords = predictions + grid_size * grid_size * (num_lab + num_box) + (icell * num_box + imax_box) * num_box_coord;
-                float x = (cell_box_coords[0] + col) / grid_size * w_in;
-                float y = (cell_box_coords[1] + row) / grid_size * h_in;
-                float w = std::max(cell_box_coords[2], 0.0f);
-                float h = std::max(cell_box_coords[3], 0.0f);
-                // Square the w/h as it was trained like that in YOLO.
-                w *= w * w_in;
-                h *= h * h_in;
-                // x,y is the center of the box, find top left corner.
-                x -= w / 2;
-                y -= h / 2;
-                // Make sure box coordinates are in the valid range.
-                x  = std::min(std::max(x, 0.0f), (float)w_in - 1);
-                y  = std::min(std::max(y, 0.0f), (float)h_in - 1);
-                w  = std::min(w, w_in - x);
-                h  = std::min(h, h_in - y);
-                ObjectPrediction cur;
-                cur.label = imax_p;
-                cur.prob  = box_score * max_p;
-                cur.x = (int)x;
-                cur.y = (int)y;
-                cur.w = (int)w;
-                cur.h = (int)h;
-                assert(0 <= cur.x && cur.x <  w_in);
-                assert(0 <= cur.y && cur.y <  h_in);
-                assert(0 <  cur.x + cur.w && cur.x + cur.w <= w_in);
-                assert(0 <  cur.y + cur.h && cur.y + cur.h <= h_in);
-                res.push_back(cur);
-            }
-        }
-        assert(icell == grid_size * grid_size);
-        return res;
-    }
-
-    // Filter objects according to IOU threshold.
-    std::vector<ObjectPrediction> filterByIOU(std::vector<ObjectPrediction> src, float iou_threshold = 0.5)
+        // Class probabilities, box confidences and box coordinates of the whole grid (fully connected output).
+        V1,
+        // Per anchor channels (x, y, w, h, objectness, class scores) of CxHxW output,
+        // softmax class scores, anchors in grid cells.
+        V2,
+        // Same as V2 with independent (sigmoid) class scores and anchors in network input pixels.
+        // Multiple scales are concatenated in the output.
+        V3
+    };
+
+    // Parses v1, v2 or v3, returns false if the name is not valid.
+    bool parseYoloVersion(const std::string& name, YoloVersion& version);
+
+    struct YoloParams
+    {
+        YoloVersion        version     = YoloVersion::V1;
+        int                num_classes = 20;
+        // Boxes (anchors) per grid cell at each scale.
+        int                num_boxes   = 2;
+        // Grid size of each output scale (in output order), V1 and V2 have a single scale.
+        std::vector<int>   grid_sizes {7};
+        // Width and height of the anchors: num_boxes pairs per scale, scales in the order of grid_sizes.
+        // Not used by V1.
+        std::vector<float> anchors;
+        // Network input size, V3 anchors are normalized by it.
+        int                input_w     = 0;
+        int                input_h     = 0;
+    };
+
+    // Decodes object boxes from YOLO output. Cells are rejected by objectness
+    // (box confidence, 4 cells at once) before class scores are computed so the cost
+    // is proportional to the number of candidate boxes. If most of the cells are
+    // candidates, class scores of the whole grid are computed using vectorized softmax.
+    // The decoder keeps temporary buffers so it must not be used concurrently.
+    class YoloDecoder
     {
-        assert(0 < iou_threshold && iou_threshold <= 1);
-        
-        // Filter out overlapping boxes.
-        size_t i1 = 0;
-        while (i1 < src.size())
+    public:
+        YoloDecoder() = default;
+
+        // Returns false and sets error if the parameters are not valid.
+        bool init(const YoloParams& params, std::string& error);
+
+        const YoloParams& getParams() const { return params_; }
+        // Number of values in the network output.
+        size_t getOutputSize() const;
+
+        // Appends boxes with probability >= prob_threshold to dst. Boxes are in
+        // w_in x h_in image coordinates, ordered by scale, anchor and cell (row-major).
+        // Boxes with empty area (after clipping to the image) are dropped.
+        void decode(const float* output, int w_in, int h_in, float prob_threshold,
+                    std::vector<ObjectPrediction>& dst);
+
+    private:
+        void decodeV1(const float* output, int w_in, int h_in, float prob_threshold,
+                      std::vector<ObjectPrediction>& dst) const;
+        void decodeScale(const float* output, int grid, const float* anchors, int w_in, int h_in,
+                         float prob_threshold, std::vector<ObjectPrediction>& dst);
+        // Computes max class score, its label and, for softmax, sum(exp(score - max)) of all cells.
+        void computeClassScores(const float* scores, int plane, bool softmax);
+
+        YoloParams params_;
+        // Candidate cells of the current anchor and class scores of the current cell.
+        std::vector<int>   candidates_;
+        std::vector<float> scores_;
+        // Class scores of all cells of the current anchor.
+        std::vector<float> class_max_;
+        std::vector<float> class_sum_;
+        std::vector<int>   class_label_;
+    };
+
+    struct NmsParams
+    {
+        // Box is removed if it overlaps a box with higher score by more than iou_threshold.
+        float iou_threshold  = 0.5f;
+        // Boxes of different classes suppress each other.
+        bool  class_agnostic = false;
+        // Soft-NMS (Gaussian): instead of removing overlapping boxes their scores are
+        // multiplied by exp(-iou^2 / soft_sigma).
+        bool  soft           = false;
+        float soft_sigma     = 0.5f;
+        // Boxes with (decayed) score below min_score are removed.
+        float min_score      = 0.001f;
+    };
+
+    // Non-maximum suppression. Boxes of each class (or all boxes in class agnostic mode)
+    // are processed in the order of decreasing score and each box is compared only with
+    // the kept boxes which share a cell of a uniform grid (spatial index) with it,
+    // so the cost is nearly linear in the number of boxes.
+    // Buffers are reused between calls so it must not be used concurrently.
+    class NonMaxSuppression
+    {
+    public:
+        // Writes kept boxes to dst in src order, for soft-NMS with decayed scores.
+        void apply(const std::vector<ObjectPrediction>& src, const NmsParams& params,
+                   std::vector<ObjectPrediction>& dst);
+
+    private:
+        // Builds an empty grid for boxes order_[begin, end).
+        void buildGrid(const std::vector<ObjectPrediction>& src, size_t begin, size_t end);
+        void applyHard(const std::vector<ObjectPrediction>& src, const NmsParams& params, size_t begin, size_t end);
+        void applySoft(const std::vector<ObjectPrediction>& src, const NmsParams& params, size_t begin, size_t end);
+        void keep(const std::vector<ObjectPrediction>& src, int ibox);
+        // Calls fn(j) for each kept box j which shares a grid cell with the box until fn returns false.
+        template<typename Fn>
+        void forEachNeighbour(const ObjectPrediction& box, Fn fn);
+        void getCells(const ObjectPrediction& box, int& cx0, int& cy0, int& cx1, int& cy1) const;
+
+        // Uniform grid over the bounding rectangle of the boxes, each cell has
+        // a linked list of kept boxes which overlap it.
+        struct Node
         {
-            auto   b1 = src[i1];
-            size_t i2 = i1 + 1;
-            while (i2 < src.size())
-            {
-                auto  b2 = src[i2];
-                float b_union = b1.w * b1.h + b2.w * b2.h;
-                assert(b_union > 0);
-                float wi = std::max(std::min(b1.x + b1.w - b2.x, b2.x + b2.w - b1.x), 0);
-                float hi = std::max(std::min(b1.y + b1.h - b2.y, b2.y + b2.h - b1.y), 0);
-                float b_intersect = wi * hi;
-                assert(0 <= b_intersect && b_intersect <= b_union);
-                float iou = b_intersect / (b_union - b_intersect);
-                // Remove box with IOU above threshold (e.g. "ambiguous" or "duplicate" box).
-                if (iou > iou_threshold)
-                    src.erase(src.begin() + i2);
-                else
-                    i2++;
-            }
-            i1++;
-        }
-
-        return src;
-    }
+            int box;
+            int next;
+        };
+        int               x0_     = 0;
+        int               y0_     = 0;
+        int               cell_w_ = 1;
+        int               cell_h_ = 1;
+        int               grid_w_ = 0;
+        int               grid_h_ = 0;
+        std::vector<int>  cell_heads_;
+        std::vector<Node> nodes_;
+
+        std::vector<float> scores_;
+        // Boxes sorted by class and score.
+        std::vector<std::pair<uint64_t, int>> sort_keys_;
+        std::vector<int>   order_;
+        // Index of the box in the kept list or -1.
+        std::vector<int>   kept_idx_;
+        int                num_kept_ = 0;
+        // Soft-NMS: number of kept boxes already applied to the box score.
+        std::vector<int>   version_;
+        std::vector<std::pair<float, int>> heap_;
+        // Id of the last query which visited the box, used to visit boxes in several cells once.
+        std::vector<int>   visited_;
+        int                query_ = 0;
+    };
 }
 
 #endif
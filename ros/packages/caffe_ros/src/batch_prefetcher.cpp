@@ -0,0 +1,126 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/batch_prefetcher.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <random>
+
+namespace caffe_ros
+{
+
+std::vector<std::string> sampleFiles(std::vector<std::string> files, int max_images, bool shuffle,
+                                     unsigned int seed)
+{
+    std::sort(files.begin(), files.end());
+    if (shuffle)
+    {
+        std::mt19937 rng(seed);
+        std::shuffle(files.begin(), files.end(), rng);
+    }
+    size_t n = files.size();
+    if (max_images <= 0 || (size_t)max_images >= n)
+        return files;
+    if (shuffle)
+    {
+        files.resize(max_images);
+        return files;
+    }
+    std::vector<std::string> res(max_images);
+    for (size_t i = 0; i < res.size(); i++)
+        res[i] = std::move(files[i * n / max_images]);
+    return res;
+}
+
+BatchPrefetcher::BatchPrefetcher(std::vector<std::string> files, int batch_size, size_t sample_size,
+                                 int num_threads, LoadFunction load)
+    : files_(std::move(files)), batch_size_(batch_size), sample_size_(sample_size), load_(std::move(load))
+{
+    assert(batch_size_ > 0);
+    assert(num_threads >= 0);
+    if (num_threads == 0)
+        num_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    // No point in more threads than files.
+    num_threads = std::max(std::min(num_threads, (int)files_.size()), 1);
+    // Enough buffers to keep all threads busy while the consumer holds the current batch.
+    int num_batches = std::max((num_threads + batch_size_ - 1) / batch_size_ + 1, 2);
+    batches_.resize(num_batches, std::vector<float>(batch_size_ * sample_size_));
+    filled_.resize(num_batches, 0);
+
+    for (int i = 0; i < num_threads; i++)
+        workers_.emplace_back(&BatchPrefetcher::workerLoop, this);
+}
+
+BatchPrefetcher::~BatchPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& w: workers_)
+        w.join();
+}
+
+const float* BatchPrefetcher::next()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (has_current_)
+    {
+        filled_[consumed_ % batches_.size()] = 0;
+        consumed_++;
+        has_current_ = false;
+        cv_.notify_all();
+    }
+    size_t slot = consumed_ % batches_.size();
+    cv_.wait(lock, [&] { return filled_[slot] == batch_size_ || isDone(); });
+    if (filled_[slot] < batch_size_)
+        return nullptr;
+    has_current_ = true;
+    return batches_[slot].data();
+}
+
+size_t BatchPrefetcher::getNumSkipped() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return skipped_;
+}
+
+void BatchPrefetcher::workerLoop()
+{
+    // Samples are loaded to a local buffer as the destination slot is known only
+    // after the load succeeds, the copy is negligible compared to decoding.
+    std::vector<float> sample(sample_size_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_ && next_file_ < files_.size())
+    {
+        const auto& file = files_[next_file_++];
+        in_flight_++;
+        lock.unlock();
+        bool loaded = load_(file, sample.data());
+        lock.lock();
+
+        if (loaded)
+        {
+            cv_.wait(lock, [&] { return stop_ || next_sample_ / batch_size_ < consumed_ + batches_.size(); });
+            if (!stop_)
+            {
+                size_t s    = next_sample_++;
+                size_t slot = (s / batch_size_) % batches_.size();
+                lock.unlock();
+                std::memcpy(batches_[slot].data() + (s % batch_size_) * sample_size_, sample.data(),
+                            sample_size_ * sizeof(float));
+                lock.lock();
+                filled_[slot]++;
+            }
+        }
+        else
+            skipped_++;
+        in_flight_--;
+        cv_.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,173 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/box_tracker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <opencv2/video/tracking.hpp>
+
+namespace caffe_ros
+{
+
+// Lucas-Kanade stops iterating when the point moves by less than this (in pixels).
+static const double kMinStep = 0.01;
+
+static float median(std::vector<float>& v)
+{
+    assert(!v.empty());
+    auto mid = v.begin() + v.size() / 2;
+    std::nth_element(v.begin(), mid, v.end());
+    return *mid;
+}
+
+BoxTracker::BoxTracker(const Params& params):
+    params_(params)
+{
+    assert(params_.max_width >= 2);
+    assert(params_.levels > 0);
+    assert(params_.win_radius > 0);
+    assert(params_.iterations > 0);
+    assert(params_.grid_size > 0);
+    assert(params_.max_fb_error > 0);
+    assert(params_.min_ncc <= 1);
+}
+
+void BoxTracker::prepare(const cv::Mat& frame, cv::Mat& gray, std::vector<cv::Mat>& pyr)
+{
+    assert(frame.depth() == CV_8U && (frame.channels() == 3 || frame.channels() == 4));
+    assert(frame.cols >= 2 && frame.rows >= 2);
+
+    frame_w_ = frame.cols;
+    frame_h_ = frame.rows;
+    scale_   = std::max((frame.cols + params_.max_width - 1) / params_.max_width, 1);
+    // Color is downsampled first so the conversion runs on the small image.
+    // Channel order does not matter for tracking.
+    cv::resize(frame, small_, cv::Size(std::max(frame.cols / scale_, 2), std::max(frame.rows / scale_, 2)),
+               0, 0, cv::INTER_AREA);
+    cv::cvtColor(small_, gray, frame.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+    // The pyramid is reused by forward and backward tracking of the frame.
+    int win = 2 * params_.win_radius + 1;
+    cv::buildOpticalFlowPyramid(gray, pyr, cv::Size(win, win), params_.levels - 1);
+}
+
+float BoxTracker::windowNcc(const cv::Point2f& pt_prev, const cv::Point2f& pt_cur)
+{
+    int win = 2 * params_.win_radius + 1;
+    cv::getRectSubPix(prev_, cv::Size(win, win), pt_prev, patch_prev_);
+    cv::getRectSubPix(cur_,  cv::Size(win, win), pt_cur,  patch_cur_);
+    cv::matchTemplate(patch_prev_, patch_cur_, ncc_, cv::TM_CCOEFF_NORMED);
+    return ncc_.at<float>(0, 0);
+}
+
+void BoxTracker::reset(const cv::Mat& frame, const std::vector<ObjectPrediction>& boxes)
+{
+    prepare(frame, prev_, prev_pyr_);
+    boxes_.clear();
+    float s = 1.0f / scale_;
+    for (const auto& b: boxes)
+        boxes_.push_back({b.label, b.prob, b.x * s, b.y * s, b.w * s, b.h * s});
+}
+
+float BoxTracker::track(const cv::Mat& frame, std::vector<ObjectPrediction>& boxes)
+{
+    float conf = 1;
+    if (frame.cols != frame_w_ || frame.rows != frame_h_ || prev_.empty())
+    {
+        // Boxes can't be tracked between frames of different size.
+        conf = 0;
+    }
+    else if (!boxes_.empty())
+    {
+        prepare(frame, cur_, cur_pyr_);
+        // Grid points of all boxes are tracked in one call, forward and backward.
+        const int n = params_.grid_size;
+        pts_prev_.clear();
+        for (const auto& b: boxes_)
+        {
+            for (int gy = 0; gy < n; gy++)
+            {
+                for (int gx = 0; gx < n; gx++)
+                    pts_prev_.emplace_back(b.x + (gx + 0.5f) * b.w / n, b.y + (gy + 0.5f) * b.h / n);
+            }
+        }
+        int  win = 2 * params_.win_radius + 1;
+        auto criteria = cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, params_.iterations, kMinStep);
+        cv::calcOpticalFlowPyrLK(prev_pyr_, cur_pyr_, pts_prev_, pts_cur_, status_, err_,
+                                 cv::Size(win, win), params_.levels - 1, criteria);
+        cv::calcOpticalFlowPyrLK(cur_pyr_, prev_pyr_, pts_cur_, pts_back_, status_back_, err_,
+                                 cv::Size(win, win), params_.levels - 1, criteria);
+
+        for (size_t ib = 0; ib < boxes_.size(); ib++)
+        {
+            auto& b = boxes_[ib];
+            // Reliable points: tracked both ways, returned close to the start and windows match.
+            valid_.clear();
+            for (size_t i = ib * n * n; i < (ib + 1) * n * n; i++)
+            {
+                if (!status_[i] || !status_back_[i])
+                    continue;
+                auto fb = pts_back_[i] - pts_prev_[i];
+                if (std::hypot(fb.x, fb.y) > params_.max_fb_error)
+                    continue;
+                // Windows of a consistent but wrong match (e.g. after a scene change) do not correlate.
+                if (windowNcc(pts_prev_[i], pts_cur_[i]) < params_.min_ncc)
+                    continue;
+                valid_.push_back((int)i);
+            }
+            conf = std::min(conf, (float)valid_.size() / (n * n));
+            if (valid_.empty())
+                continue;
+
+            dx_.clear();
+            dy_.clear();
+            ratios_.clear();
+            for (size_t i = 0; i < valid_.size(); i++)
+            {
+                const auto& p0 = pts_prev_[valid_[i]];
+                const auto& p1 = pts_cur_[valid_[i]];
+                dx_.push_back(p1.x - p0.x);
+                dy_.push_back(p1.y - p0.y);
+                for (size_t k = i + 1; k < valid_.size(); k++)
+                {
+                    const auto& q0 = pts_prev_[valid_[k]];
+                    const auto& q1 = pts_cur_[valid_[k]];
+                    float d_prev = std::hypot(q0.x - p0.x, q0.y - p0.y);
+                    float d_cur  = std::hypot(q1.x - p1.x, q1.y - p1.y);
+                    if (d_prev > 1e-3f)
+                        ratios_.push_back(d_cur / d_prev);
+                }
+            }
+            float s  = ratios_.empty() ? 1.0f : median(ratios_);
+            float cx = b.x + 0.5f * b.w + median(dx_);
+            float cy = b.y + 0.5f * b.h + median(dy_);
+            b.w *= s;
+            b.h *= s;
+            b.x  = cx - 0.5f * b.w;
+            b.y  = cy - 0.5f * b.h;
+        }
+        std::swap(prev_, cur_);
+        std::swap(prev_pyr_, cur_pyr_);
+    }
+    else
+    {
+        // Nothing to track, the frame becomes the reference for the next one.
+        prepare(frame, prev_, prev_pyr_);
+    }
+
+    // Boxes are returned in frame pixels clipped to the frame.
+    boxes.clear();
+    for (const auto& b: boxes_)
+    {
+        int x0 = std::max((int)std::round(b.x * scale_), 0);
+        int y0 = std::max((int)std::round(b.y * scale_), 0);
+        int x1 = std::min((int)std::round((b.x + b.w) * scale_), frame_w_);
+        int y1 = std::min((int)std::round((b.y + b.h) * scale_), frame_h_);
+        if (x1 > x0 && y1 > y0)
+            boxes.push_back({b.label, b.prob, x0, y0, x1 - x0, y1 - y0});
+    }
+    return conf;
+}
+
+}
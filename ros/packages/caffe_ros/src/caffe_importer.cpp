@@ -0,0 +1,696 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/caffe_importer.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
+
+namespace caffe_ros
+{
+
+// -----------------------------------------------------------------
+// Prototxt.
+// -----------------------------------------------------------------
+bool PrototxtMessage::has(const std::string& name) const
+{
+    for (const auto& v: values)
+    {
+        if (v.first == name)
+            return true;
+    }
+    return getMessage(name) != nullptr;
+}
+
+std::string PrototxtMessage::getString(const std::string& name, const std::string& def) const
+{
+    for (const auto& v: values)
+    {
+        if (v.first == name)
+            return v.second;
+    }
+    return def;
+}
+
+int PrototxtMessage::getInt(const std::string& name, int def) const
+{
+    auto s = getString(name);
+    return s.empty() ? def : std::stoi(s);
+}
+
+float PrototxtMessage::getFloat(const std::string& name, float def) const
+{
+    auto s = getString(name);
+    return s.empty() ? def : std::stof(s);
+}
+
+bool PrototxtMessage::getBool(const std::string& name, bool def) const
+{
+    auto s = getString(name);
+    return s.empty() ? def : (s == "true" || s == "1");
+}
+
+std::vector<std::string> PrototxtMessage::getStrings(const std::string& name) const
+{
+    std::vector<std::string> res;
+    for (const auto& v: values)
+    {
+        if (v.first == name)
+            res.push_back(v.second);
+    }
+    return res;
+}
+
+std::vector<int> PrototxtMessage::getInts(const std::string& name) const
+{
+    std::vector<int> res;
+    for (const auto& s: getStrings(name))
+        res.push_back(std::stoi(s));
+    return res;
+}
+
+std::vector<float> PrototxtMessage::getFloats(const std::string& name) const
+{
+    std::vector<float> res;
+    for (const auto& s: getStrings(name))
+        res.push_back(std::stof(s));
+    return res;
+}
+
+const PrototxtMessage* PrototxtMessage::getMessage(const std::string& name) const
+{
+    for (const auto& m: messages)
+    {
+        if (m.first == name)
+            return &m.second;
+    }
+    return nullptr;
+}
+
+std::vector<const PrototxtMessage*> PrototxtMessage::getMessages(const std::string& name) const
+{
+    std::vector<const PrototxtMessage*> res;
+    for (const auto& m: messages)
+    {
+        if (m.first == name)
+            res.push_back(&m.second);
+    }
+    return res;
+}
+
+namespace
+{
+class PrototxtParser
+{
+public:
+    explicit PrototxtParser(std::istream& src):
+        src_(std::istreambuf_iterator<char>(src), std::istreambuf_iterator<char>())
+    {
+    }
+
+    bool parse(PrototxtMessage& msg, std::string& error)
+    {
+        if (!parseFields(msg, '\0'))
+        {
+            error = error_ + " (line " + std::to_string(line_) + ")";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Parses fields until the closing brace (or end of input if close is 0).
+    bool parseFields(PrototxtMessage& msg, char close)
+    {
+        while (true)
+        {
+            skipSpace();
+            if (pos_ == src_.size())
+                return close == '\0' ? true : fail("unexpected end of input");
+            if (src_[pos_] == close)
+            {
+                pos_++;
+                return true;
+            }
+            std::string name;
+            if (!readToken(name) || !isIdentifier(name))
+                return fail("field name expected");
+            skipSpace();
+            bool has_colon = consume(':');
+            skipSpace();
+            if (consume('{') || consume('<'))
+            {
+                msg.messages.emplace_back(name, PrototxtMessage());
+                if (!parseFields(msg.messages.back().second, src_[pos_ - 1] == '{' ? '}' : '>'))
+                    return false;
+            }
+            else if (!has_colon)
+                return fail("':' expected after " + name);
+            else if (consume('['))
+            {
+                // List of scalar values: name: [v1, v2, ...].
+                while (true)
+                {
+                    skipSpace();
+                    if (consume(']'))
+                        break;
+                    std::string value;
+                    if (!readValue(value))
+                        return false;
+                    msg.values.emplace_back(name, value);
+                    skipSpace();
+                    consume(',');
+                }
+            }
+            else
+            {
+                std::string value;
+                if (!readValue(value))
+                    return false;
+                msg.values.emplace_back(name, value);
+            }
+            skipSpace();
+            // Fields can be separated by ',' or ';'.
+            if (!consume(','))
+                consume(';');
+        }
+    }
+
+    bool readValue(std::string& value)
+    {
+        if (pos_ < src_.size() && (src_[pos_] == '"' || src_[pos_] == '\''))
+        {
+            // Adjacent string literals are concatenated.
+            value.clear();
+            while (pos_ < src_.size() && (src_[pos_] == '"' || src_[pos_] == '\''))
+            {
+                char quote = src_[pos_++];
+                while (pos_ < src_.size() && src_[pos_] != quote)
+                {
+                    if (src_[pos_] == '\n')
+                        return fail("unterminated string");
+                    if (src_[pos_] == '\\' && pos_ + 1 < src_.size())
+                        pos_++;
+                    value += src_[pos_++];
+                }
+                if (!consume(quote))
+                    return fail("unterminated string");
+                skipSpace();
+            }
+            return true;
+        }
+        if (!readToken(value))
+            return fail("value expected");
+        return true;
+    }
+
+    // Reads identifier, number or enum value.
+    bool readToken(std::string& token)
+    {
+        size_t start = pos_;
+        while (pos_ < src_.size() &&
+               (std::isalnum((unsigned char)src_[pos_]) || std::strchr("_.+-", src_[pos_]) != nullptr))
+            pos_++;
+        token = src_.substr(start, pos_ - start);
+        return !token.empty();
+    }
+
+    static bool isIdentifier(const std::string& s)
+    {
+        return std::isalpha((unsigned char)s[0]) || s[0] == '_';
+    }
+
+    void skipSpace()
+    {
+        while (pos_ < src_.size())
+        {
+            if (src_[pos_] == '#')
+            {
+                while (pos_ < src_.size() && src_[pos_] != '\n')
+                    pos_++;
+            }
+            else if (std::isspace((unsigned char)src_[pos_]))
+            {
+                if (src_[pos_] == '\n')
+                    line_++;
+                pos_++;
+            }
+            else
+                break;
+        }
+    }
+
+    bool consume(char c)
+    {
+        if (pos_ < src_.size() && src_[pos_] == c)
+        {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool fail(const std::string& error)
+    {
+        if (error_.empty())
+            error_ = error;
+        return false;
+    }
+
+private:
+    std::string src_;
+    size_t      pos_  = 0;
+    int         line_ = 1;
+    std::string error_;
+};
+}
+
+bool parsePrototxt(std::istream& src, PrototxtMessage& msg, std::string& error)
+{
+    return PrototxtParser(src).parse(msg, error);
+}
+
+
+// -----------------------------------------------------------------
+// Binary caffemodel (protobuf wire format). The file is read as a stream,
+// only the fields required to get learned blobs are decoded, the rest
+// (including the layer definitions duplicated from prototxt) is skipped.
+// -----------------------------------------------------------------
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    #error Caffe model reader requires little-endian platform.
+#endif
+
+namespace
+{
+enum WireType
+{
+    kVarint    = 0,
+    kFixed64   = 1,
+    kDelimited = 2,
+    kFixed32   = 5
+};
+
+// caffe.proto field numbers.
+const int kNetLayerField     = 100; // NetParameter.layer (LayerParameter).
+const int kNetV1LayerField   = 2;   // NetParameter.layers (V1LayerParameter).
+const int kLayerNameField    = 1;   // LayerParameter.name.
+const int kLayerBlobsField   = 7;   // LayerParameter.blobs.
+const int kV1LayerNameField  = 4;   // V1LayerParameter.name.
+const int kV1LayerBlobsField = 6;   // V1LayerParameter.blobs.
+const int kBlobNumField      = 1;   // BlobProto legacy 4D shape: num, channels, height, width.
+const int kBlobWidthField    = 4;
+const int kBlobDataField     = 5;   // BlobProto.data (packed float).
+const int kBlobShapeField    = 7;   // BlobProto.shape (BlobShape).
+const int kBlobDoubleField   = 8;   // BlobProto.double_data.
+const int kShapeDimField     = 1;   // BlobShape.dim (packed int64).
+
+// End position of the top level message which is read until the end of the stream.
+const uint64_t kStreamEnd = UINT64_MAX;
+
+class WireReader
+{
+public:
+    explicit WireReader(std::istream& src):
+        src_(src)
+    {
+    }
+
+    // True if the message or field that ends at the given position is read.
+    bool done(uint64_t end)
+    {
+        return end == kStreamEnd ? src_.peek() == std::char_traits<char>::eof() : pos_ >= end;
+    }
+
+    bool readVarint(uint64_t& v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            int c = src_.get();
+            if (c == std::char_traits<char>::eof())
+                return false;
+            pos_++;
+            v |= (uint64_t)(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool readTag(int& field, int& type)
+    {
+        uint64_t tag;
+        if (!readVarint(tag))
+            return false;
+        field = (int)(tag >> 3);
+        type  = (int)(tag & 7);
+        return true;
+    }
+
+    // Reads the length of delimited field which must fit into the enclosing message.
+    bool readLength(uint64_t end, uint64_t& size)
+    {
+        return readVarint(size) && (end == kStreamEnd || size <= end - pos_);
+    }
+
+    bool readBytes(void* dst, size_t size)
+    {
+        src_.read(static_cast<char*>(dst), size);
+        pos_ += size;
+        return (size_t)src_.gcount() == size;
+    }
+
+    bool skipBytes(uint64_t size)
+    {
+        src_.ignore(size);
+        pos_ += size;
+        return (uint64_t)src_.gcount() == size;
+    }
+
+    bool skip(int type, uint64_t end)
+    {
+        uint64_t v;
+        switch (type)
+        {
+        case kVarint:    return readVarint(v);
+        case kFixed64:   return skipBytes(8);
+        case kDelimited: return readLength(end, v) && skipBytes(v);
+        case kFixed32:   return skipBytes(4);
+        default:         return false;
+        }
+    }
+
+    uint64_t pos() const { return pos_; }
+
+private:
+    std::istream& src_;
+    uint64_t      pos_ = 0;
+};
+
+// Appends float or double values (packed or not) directly to the arena.
+bool readData(WireReader& r, int type, bool is_double, uint64_t end, std::vector<float>& arena)
+{
+    const size_t value_size = is_double ? sizeof(double) : sizeof(float);
+    uint64_t size = value_size;
+    if (type == kDelimited)
+    {
+        if (!r.readLength(end, size) || size % value_size != 0)
+            return false;
+    }
+    else if (type != (is_double ? kFixed64 : kFixed32))
+        return false;
+
+    size_t count = (size_t)(size / value_size);
+    size_t start = arena.size();
+    arena.resize(start + count);
+    if (!is_double)
+        return r.readBytes(arena.data() + start, size);
+    // Doubles are converted in chunks.
+    double buf[1024];
+    for (size_t i = 0; i < count; i += 1024)
+    {
+        size_t n = std::min(count - i, (size_t)1024);
+        if (!r.readBytes(buf, n * sizeof(double)))
+            return false;
+        std::copy(buf, buf + n, arena.begin() + start + i);
+    }
+    return true;
+}
+
+bool readDims(WireReader& r, int type, uint64_t end, std::vector<int>& dst)
+{
+    uint64_t v;
+    if (type == kVarint)
+    {
+        if (!r.readVarint(v))
+            return false;
+        dst.push_back((int)v);
+        return true;
+    }
+    uint64_t size;
+    if (type != kDelimited || !r.readLength(end, size))
+        return false;
+    uint64_t packed_end = r.pos() + size;
+    while (!r.done(packed_end))
+    {
+        if (!r.readVarint(v))
+            return false;
+        dst.push_back((int)v);
+    }
+    return true;
+}
+
+bool readBlob(WireReader& r, uint64_t end, std::vector<float>& arena, CaffeBlob& blob)
+{
+    std::vector<int> legacy_shape(4, 0);
+    blob.offset = arena.size();
+    int field, type;
+    while (!r.done(end))
+    {
+        if (!r.readTag(field, type))
+            return false;
+        bool ok = true;
+        uint64_t size;
+        // Models contain either data or double_data.
+        if (field == kBlobDataField || field == kBlobDoubleField)
+            ok = readData(r, type, field == kBlobDoubleField, end, arena);
+        else if (field == kBlobShapeField && type == kDelimited)
+        {
+            ok = r.readLength(end, size);
+            uint64_t shape_end = r.pos() + size;
+            while (ok && !r.done(shape_end))
+            {
+                ok = r.readTag(field, type);
+                if (ok)
+                    ok = field == kShapeDimField ? readDims(r, type, shape_end, blob.shape) : r.skip(type, shape_end);
+            }
+        }
+        else if (field >= kBlobNumField && field <= kBlobWidthField && type == kVarint)
+        {
+            uint64_t v;
+            ok = r.readVarint(v);
+            legacy_shape[field - kBlobNumField] = (int)v;
+        }
+        else
+            ok = r.skip(type, end);
+        if (!ok)
+            return false;
+    }
+    blob.count = arena.size() - blob.offset;
+    if (blob.shape.empty())
+        blob.shape = legacy_shape;
+    return true;
+}
+
+bool readLayer(WireReader& r, uint64_t end, bool is_v1, const std::unordered_map<std::string, size_t>& layer_map,
+               std::vector<CaffeLayer>& layers, std::vector<float>& arena)
+{
+    const int name_field  = is_v1 ? kV1LayerNameField  : kLayerNameField;
+    const int blobs_field = is_v1 ? kV1LayerBlobsField : kLayerBlobsField;
+    const size_t arena_start = arena.size();
+
+    // Index of the layer in the graph, layers.size() if the layer is not used.
+    size_t index  = layers.size();
+    bool   unused = false;
+    std::vector<CaffeBlob> blobs;
+    int field, type;
+    while (!r.done(end))
+    {
+        if (!r.readTag(field, type))
+            return false;
+        bool ok = true;
+        uint64_t size;
+        if (field == name_field && type == kDelimited)
+        {
+            std::string name;
+            ok = r.readLength(end, size);
+            if (ok)
+            {
+                name.resize((size_t)size);
+                ok = r.readBytes(&name[0], name.size());
+            }
+            auto it = layer_map.find(name);
+            index   = it != layer_map.end() ? it->second : layers.size();
+            unused  = index == layers.size();
+        }
+        // Blobs of the layers which are not in the graph (e.g. used only in training) are skipped.
+        else if (field == blobs_field && type == kDelimited && !unused)
+        {
+            blobs.emplace_back();
+            ok = r.readLength(end, size) && readBlob(r, r.pos() + size, arena, blobs.back());
+        }
+        else
+            ok = r.skip(type, end);
+        if (!ok)
+            return false;
+    }
+    // Name may follow the blobs (the order of fields is not guaranteed) so
+    // the blobs are dropped from the end of the arena if the layer is not used.
+    if (index == layers.size() || !layers[index].blobs.empty())
+        arena.resize(arena_start);
+    else
+        layers[index].blobs = std::move(blobs);
+    return true;
+}
+
+bool isTrainOnly(const PrototxtMessage& layer)
+{
+    for (auto inc: layer.getMessages("include"))
+    {
+        if (inc->getString("phase") == "TRAIN")
+            return true;
+    }
+    for (auto exc: layer.getMessages("exclude"))
+    {
+        if (exc->getString("phase") == "TEST")
+            return true;
+    }
+    return false;
+}
+}
+
+// -----------------------------------------------------------------
+// CaffeModel.
+// -----------------------------------------------------------------
+bool CaffeModel::load(const std::string& prototxt_path, const std::string& model_path, std::string& error)
+{
+    std::ifstream prototxt(prototxt_path);
+    if (!prototxt)
+    {
+        error = "could not open " + prototxt_path;
+        return false;
+    }
+    if (!loadGraph(prototxt, error))
+    {
+        error = prototxt_path + ": " + error;
+        return false;
+    }
+    if (model_path.empty())
+        return true;
+
+    std::ifstream model(model_path, std::ios::binary | std::ios::ate);
+    if (!model)
+    {
+        error = "could not open " + model_path;
+        return false;
+    }
+    size_t size = (size_t)model.tellg();
+    model.seekg(0);
+    if (!loadWeights(model, size, error))
+    {
+        error = model_path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool CaffeModel::loadGraph(std::istream& prototxt, std::string& error)
+{
+    *this = CaffeModel();
+    if (!parsePrototxt(prototxt, net_, error))
+        return false;
+    name_ = net_.getString("name");
+
+    // Inputs defined by the net fields: input with input_shape or 4D input_dim.
+    auto inputs = net_.getStrings("input");
+    auto shapes = net_.getMessages("input_shape");
+    auto dims   = net_.getInts("input_dim");
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        CaffeInput input;
+        input.name = inputs[i];
+        if (i < shapes.size())
+            input.shape = shapes[i]->getInts("dim");
+        else if (dims.size() >= 4 * (i + 1))
+            input.shape.assign(dims.begin() + 4 * i, dims.begin() + 4 * (i + 1));
+        inputs_.push_back(std::move(input));
+    }
+
+    if (net_.has("layers"))
+    {
+        error = "V1 layer definitions are not supported, use Caffe upgrade_net_proto_text tool to upgrade the model";
+        return false;
+    }
+    std::unordered_map<std::string, size_t> names;
+    for (auto def: net_.getMessages("layer"))
+    {
+        if (isTrainOnly(*def))
+            continue;
+        CaffeLayer layer;
+        layer.name    = def->getString("name");
+        layer.type    = def->getString("type");
+        layer.bottoms = def->getStrings("bottom");
+        layer.tops    = def->getStrings("top");
+        layer.def     = def;
+        if (layer.type == "Input")
+        {
+            auto p      = def->getMessage("input_param");
+            auto shapes = p != nullptr ? p->getMessages("shape") : std::vector<const PrototxtMessage*>();
+            // Single shape is used for all tops.
+            for (size_t i = 0; i < layer.tops.size(); i++)
+            {
+                CaffeInput input;
+                input.name = layer.tops[i];
+                if (!shapes.empty())
+                    input.shape = shapes[std::min(i, shapes.size() - 1)]->getInts("dim");
+                inputs_.push_back(std::move(input));
+            }
+            continue;
+        }
+        if (!names.emplace(layer.name, layers_.size()).second)
+        {
+            error = "duplicate layer name " + layer.name;
+            return false;
+        }
+        layers_.push_back(std::move(layer));
+    }
+    return true;
+}
+
+bool CaffeModel::loadWeights(std::istream& model, size_t size_hint, std::string& error)
+{
+    releaseWeights();
+    // The weights take no more space than the file, so the arena is never reallocated
+    // while reading. Pages of the arena which are not used are not touched.
+    arena_.reserve(size_hint / sizeof(float));
+
+    std::unordered_map<std::string, size_t> names;
+    for (size_t i = 0; i < layers_.size(); i++)
+        names[layers_[i].name] = i;
+
+    WireReader r(model);
+    int field, type;
+    while (!r.done(kStreamEnd))
+    {
+        bool ok = r.readTag(field, type);
+        uint64_t size;
+        if (ok && (field == kNetLayerField || field == kNetV1LayerField) && type == kDelimited)
+        {
+            ok = r.readLength(kStreamEnd, size) &&
+                 readLayer(r, r.pos() + size, field == kNetV1LayerField, names, layers_, arena_);
+        }
+        else if (ok)
+            ok = r.skip(type, kStreamEnd);
+        if (!ok)
+        {
+            error = "invalid caffemodel at offset " + std::to_string(r.pos());
+            releaseWeights();
+            return false;
+        }
+    }
+    return true;
+}
+
+void CaffeModel::releaseWeights()
+{
+    std::vector<float>().swap(arena_);
+    for (auto& layer: layers_)
+        layer.blobs.clear();
+}
+
+}
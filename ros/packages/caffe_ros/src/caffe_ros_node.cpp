@@ -2,12 +2,23 @@
 // Full license terms provided in LICENSE.md file.
 
 #include "caffe_ros/caffe_ros.h"
+#include "loop_nodelet.h"
 
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "caffe_ros");
+    ros::NodeHandle nh("~");
 
-    caffe_ros::CaffeRos caffe_r;
-    caffe_r.spin();
-    return 0;
+    // DNN needs only the most recent image and GPU can process only one batch at a time
+    // so there is no need for more than one callback thread.
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+    int res = redtail::runNode([](ros::NodeHandle& nh, const redtail::StopSignal& stop)
+        {
+            caffe_ros::CaffeRos caffe_r(nh);
+            caffe_r.spin(stop);
+        },
+        nh);
+    spinner.stop();
+    return res;
 }
@@ -0,0 +1,26 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <pluginlib/class_list_macros.h>
+
+#include "caffe_ros/caffe_ros.h"
+#include "loop_nodelet.h"
+
+namespace caffe_ros
+{
+class CaffeRosNodelet : public redtail::LoopNodelet
+{
+public:
+    CaffeRosNodelet():
+        LoopNodelet([](ros::NodeHandle& nh, const redtail::StopSignal& stop)
+            {
+                // Network is loaded on the nodelet thread so onInit does not block the manager.
+                CaffeRos caffe_r(nh);
+                caffe_r.spin(stop);
+            })
+    {
+    }
+};
+}
+
+PLUGINLIB_EXPORT_CLASS(caffe_ros::CaffeRosNodelet, nodelet::Nodelet)
@@ -0,0 +1,390 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/cpu_backend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <opencv2/core.hpp>
+#include <ros/ros.h>
+#include "node_error.h"
+
+namespace caffe_ros
+{
+
+using namespace cpu;
+
+// Reads spatial parameter which is either repeated field with 1 (same for
+// both dimensions) or 2 values, or a pair of fields for height and width.
+static void getSpatialParam(const PrototxtMessage& p, const std::string& name, const std::string& name_h,
+                            const std::string& name_w, int def, int& h, int& w)
+{
+    auto vals = p.getInts(name);
+    h = vals.empty() ? def : vals[0];
+    w = vals.size() > 1 ? vals[1] : h;
+    h = p.getInt(name_h, h);
+    w = p.getInt(name_w, w);
+}
+
+// Returns values of constant filler (Caffe default for parameters not present in the model).
+static bool getConstantFiller(const PrototxtMessage* filler, float def, size_t count, std::vector<float>& dst)
+{
+    float value = def;
+    if (filler != nullptr)
+    {
+        if (filler->getString("type", "constant") != "constant")
+            return false;
+        value = filler->getFloat("value", 0);
+    }
+    dst.assign(count, value);
+    return true;
+}
+
+// Creates layer from its definition, learned blobs and input dimensions.
+// Large weights (convolution and inner product) are used directly from the weight arena of the model.
+// Returns null and sets error if the layer is not supported.
+static std::unique_ptr<Layer> createLayer(const CaffeModel& model, const CaffeLayer& layer,
+                                          const std::vector<BlobDims>& in_dims, std::string& error)
+{
+    static const PrototxtMessage s_empty;
+    const auto& type  = layer.type;
+    const auto& blobs = layer.blobs;
+    auto getParams = [&](const std::string& name)
+        {
+            auto p = layer.def->getMessage(name);
+            return p != nullptr ? p : &s_empty;
+        };
+    auto getWeights = [&](size_t i)
+        {
+            ConstWeights res;
+            if (i < blobs.size())
+            {
+                res.data = model.getData(blobs[i]);
+                res.size = blobs[i].count;
+            }
+            return res;
+        };
+    auto getBlob = [&](size_t i)
+        {
+            auto w = getWeights(i);
+            return std::vector<float>(w.data, w.data + w.size);
+        };
+
+    if (type == "Convolution")
+    {
+        auto p = getParams("convolution_param");
+        if (p->getInt("axis", 1) != 1)
+        {
+            error = "only axis 1 is supported";
+            return nullptr;
+        }
+        ConvolutionLayer::Params params;
+        params.num_output = p->getInt("num_output", 0);
+        params.group      = p->getInt("group", 1);
+        getSpatialParam(*p, "kernel_size", "kernel_h", "kernel_w", 1, params.kernel_h,   params.kernel_w);
+        getSpatialParam(*p, "stride",      "stride_h", "stride_w", 1, params.stride_h,   params.stride_w);
+        getSpatialParam(*p, "pad",         "pad_h",    "pad_w",    0, params.pad_h,      params.pad_w);
+        getSpatialParam(*p, "dilation",    "",         "",         1, params.dilation_h, params.dilation_w);
+        bool bias_term = p->getBool("bias_term", true);
+        return std::make_unique<ConvolutionLayer>(params, getWeights(0), bias_term ? getWeights(1) : ConstWeights());
+    }
+    if (type == "Pooling")
+    {
+        auto p = getParams("pooling_param");
+        PoolingLayer::Params params;
+        auto method = p->getString("pool", "MAX");
+        if (method == "MAX")
+            params.method = PoolingLayer::Method::kMax;
+        else if (method == "AVE")
+            params.method = PoolingLayer::Method::kAverage;
+        else
+        {
+            error = method + " pooling is not supported";
+            return nullptr;
+        }
+        getSpatialParam(*p, "kernel_size", "kernel_h", "kernel_w", 1, params.kernel_h, params.kernel_w);
+        getSpatialParam(*p, "stride",      "stride_h", "stride_w", 1, params.stride_h, params.stride_w);
+        getSpatialParam(*p, "pad",         "pad_h",    "pad_w",    0, params.pad_h,    params.pad_w);
+        params.global = p->getBool("global_pooling", false);
+        return std::make_unique<PoolingLayer>(params);
+    }
+    if (type == "InnerProduct")
+    {
+        auto p = getParams("inner_product_param");
+        if (p->getInt("axis", 1) != 1 || p->getBool("transpose", false))
+        {
+            error = "only axis 1 without transpose is supported";
+            return nullptr;
+        }
+        bool bias_term = p->getBool("bias_term", true);
+        return std::make_unique<InnerProductLayer>(p->getInt("num_output", 0), getWeights(0),
+                                                   bias_term ? getWeights(1) : ConstWeights());
+    }
+    if (type == "ReLU")
+        return std::make_unique<ReLULayer>(getParams("relu_param")->getFloat("negative_slope", 0));
+    if (type == "Softmax")
+    {
+        if (getParams("softmax_param")->getInt("axis", 1) != 1)
+        {
+            error = "only axis 1 is supported";
+            return nullptr;
+        }
+        return std::make_unique<SoftmaxLayer>();
+    }
+    if (type == "LRN")
+    {
+        auto p = getParams("lrn_param");
+        if (p->getString("norm_region", "ACROSS_CHANNELS") != "ACROSS_CHANNELS")
+        {
+            error = "only ACROSS_CHANNELS normalization is supported";
+            return nullptr;
+        }
+        return std::make_unique<LRNLayer>(p->getInt("local_size", 5), p->getFloat("alpha", 1),
+                                          p->getFloat("beta", 0.75f), p->getFloat("k", 1));
+    }
+    if (type == "Concat")
+    {
+        auto p = getParams("concat_param");
+        if (p->getInt("axis", p->getInt("concat_dim", 1)) != 1)
+        {
+            error = "only axis 1 is supported";
+            return nullptr;
+        }
+        return std::make_unique<ConcatLayer>();
+    }
+    if (type == "Scale")
+    {
+        auto p = getParams("scale_param");
+        int num_axes = p->getInt("num_axes", 1);
+        if (in_dims.size() != 1 || p->getInt("axis", 1) != 1 || (num_axes != 0 && num_axes != 1))
+        {
+            error = "only learned per-channel or scalar scale is supported";
+            return nullptr;
+        }
+        size_t num_c = (size_t)in_dims[0].c;
+        auto scale   = getBlob(0);
+        // Parameters with zero learning rate may be missing from the model,
+        // in which case they are set by fillers (Caffe default is identity).
+        if (scale.empty() && !getConstantFiller(p->getMessage("filler"), 1, num_c, scale))
+        {
+            error = "scale is not in the model and its filler is not constant";
+            return nullptr;
+        }
+        std::vector<float> bias;
+        if (p->getBool("bias_term", false))
+        {
+            bias = getBlob(1);
+            if (bias.empty() && !getConstantFiller(p->getMessage("bias_filler"), 0, num_c, bias))
+            {
+                error = "bias is not in the model and its filler is not constant";
+                return nullptr;
+            }
+        }
+        // Scalar parameters are broadcast to all channels.
+        if (scale.size() == 1)
+            scale.assign(num_c, scale[0]);
+        if (bias.size() == 1)
+            bias.assign(num_c, bias[0]);
+        return std::make_unique<ScaleLayer>(std::move(scale), std::move(bias));
+    }
+    if (type == "BatchNorm")
+    {
+        // Inference mode: normalization by global statistics is folded into per-channel scale and bias.
+        if (blobs.size() < 3 || blobs[0].count != blobs[1].count || blobs[2].count == 0)
+        {
+            error = "mean, variance and scale factor blobs are required";
+            return nullptr;
+        }
+        float eps    = getParams("batch_norm_param")->getFloat("eps", 1e-5f);
+        float sf     = model.getData(blobs[2])[0];
+        float factor = sf == 0 ? 0 : 1 / sf;
+        auto  scale  = getBlob(1);
+        auto  bias   = getBlob(0);
+        for (size_t c = 0; c < scale.size(); c++)
+        {
+            scale[c] = 1 / std::sqrt(scale[c] * factor + eps);
+            bias[c]  = -bias[c] * factor * scale[c];
+        }
+        return std::make_unique<ScaleLayer>(std::move(scale), std::move(bias));
+    }
+    if (type == "Eltwise")
+    {
+        auto p  = getParams("eltwise_param");
+        auto op = p->getString("operation", "SUM");
+        if (op == "SUM")
+            return std::make_unique<EltwiseLayer>(EltwiseLayer::Operation::kSum, p->getFloats("coeff"));
+        if (op == "PROD")
+            return std::make_unique<EltwiseLayer>(EltwiseLayer::Operation::kProd, std::vector<float>());
+        if (op == "MAX")
+            return std::make_unique<EltwiseLayer>(EltwiseLayer::Operation::kMax, std::vector<float>());
+        error = op + " operation is not supported";
+        return nullptr;
+    }
+    error = "layer type is not supported";
+    return nullptr;
+}
+
+void CpuBackend::loadNetwork(ConstStr& prototxt_path, ConstStr& model_path,
+                             ConstStr& input_blob, ConstStr& output_blob,
+                             DataType data_type, bool use_cached_model)
+{
+    if (data_type != DataType::kFLOAT)
+        ROS_WARN("CPU backend supports only FP32, %s data type is ignored.", toString(data_type).c_str());
+
+    std::string error;
+    if (!model_.load(prototxt_path, model_path, error))
+    {
+        redtail::throwNodeError("Failed to load model: %s", error.c_str());
+    }
+    ROS_INFO("Loaded model from: %s, %s", prototxt_path.c_str(), model_path.c_str());
+
+    // Current blob for each name, in-place layers rebind names.
+    std::unordered_map<std::string, int> blob_map;
+    auto addBlob = [&](const std::string& name, const BlobDims& dims)
+        {
+            blobs_.push_back(Blob{name, dims, {}});
+            blob_map[name] = (int)blobs_.size() - 1;
+            return (int)blobs_.size() - 1;
+        };
+
+    const auto& inputs = model_.getInputs();
+    if (inputs.size() != 1 || inputs[0].name != input_blob)
+    {
+        redtail::throwNodeError("Network must have single input %s.", input_blob.c_str());
+    }
+    auto shape = inputs[0].shape;
+    if (shape.size() == 4)
+    {
+        if (shape[0] != 1)
+            ROS_WARN("CPU backend supports only batch size 1, input batch size %d is ignored.", shape[0]);
+        shape.erase(shape.begin());
+    }
+    if (shape.size() != 3)
+    {
+        redtail::throwNodeError("Input %s must be 3D or 4D.", input_blob.c_str());
+    }
+    BlobDims input_dims;
+    input_dims.c = shape[0];
+    input_dims.h = shape[1];
+    input_dims.w = shape[2];
+    input_ = addBlob(input_blob, input_dims);
+
+    for (const auto& layer: model_.getLayers())
+    {
+        const auto& name = layer.name;
+        const auto& type = layer.type;
+        std::vector<int>      in_idx;
+        std::vector<BlobDims> in_dims;
+        for (const auto& b: layer.bottoms)
+        {
+            auto it = blob_map.find(b);
+            if (it == blob_map.end())
+            {
+                redtail::throwNodeError("Layer %s: unknown input %s.", name.c_str(), b.c_str());
+            }
+            in_idx.push_back(it->second);
+            in_dims.push_back(blobs_[it->second].dims);
+        }
+        // Layers which do nothing in inference: tops are aliases of the bottom.
+        if (type == "Dropout" || type == "Split")
+        {
+            ROS_ASSERT(in_idx.size() == 1);
+            for (const auto& t: layer.tops)
+                blob_map[t] = in_idx[0];
+            continue;
+        }
+        if (type == "Silence")
+            continue;
+
+        auto cpu_layer = createLayer(model_, layer, in_dims, error);
+        BlobDims out_dims;
+        if (cpu_layer != nullptr && layer.tops.size() != 1)
+            error = "layer must have exactly one output";
+        else if (cpu_layer != nullptr && !cpu_layer->reshape(in_dims, out_dims))
+            error = "invalid parameters, weights or inputs";
+        else if (cpu_layer != nullptr)
+            error.clear();
+        if (cpu_layer == nullptr || !error.empty())
+        {
+            redtail::throwNodeError("Layer %s (%s) is not supported by CPU backend: %s.", name.c_str(), type.c_str(), error.c_str());
+        }
+        workspace_.resize(std::max(workspace_.size(), cpu_layer->getWorkspaceSize()));
+
+        Step step;
+        step.name   = name;
+        step.inputs = in_idx;
+        if (!layer.bottoms.empty() && layer.tops[0] == layer.bottoms[0] && cpu_layer->supportsInPlace())
+            step.output = in_idx[0];
+        else
+            step.output = addBlob(layer.tops[0], out_dims);
+        step.layer = std::move(cpu_layer);
+        steps_.push_back(std::move(step));
+    }
+
+    auto out_it = blob_map.find(output_blob);
+    if (out_it == blob_map.end())
+    {
+        redtail::throwNodeError("Could not find output blob: %s", output_blob.c_str());
+    }
+    output_ = out_it->second;
+
+    // Allocate all blobs but the input and output which are bound to the request buffers.
+    size_t total_size = workspace_.size();
+    for (int i = 0; i < (int)blobs_.size(); i++)
+    {
+        if (i != input_ && i != output_)
+        {
+            blobs_[i].data.resize(blobs_[i].dims.size());
+            total_size += blobs_[i].data.size();
+        }
+        blob_ptrs_.push_back(blobs_[i].data.data());
+    }
+    ROS_INFO("Created CPU network: %zu layers, %.1f MB of weights, %.1f MB of blobs, %d threads.", steps_.size(),
+             model_.getWeightsSize() * sizeof(float) / (1024.0 * 1024.0),
+             total_size * sizeof(float) / (1024.0 * 1024.0), cv::getNumThreads());
+
+    const auto& in_dims  = getInputDims();
+    const auto& out_dims = getOutputDims();
+    ROS_INFO("Input : (W:%4d, H:%4d, C:%4d).", in_dims.w, in_dims.h, in_dims.c);
+    ROS_INFO("Output: (W:%4d, H:%4d, C:%4d).", out_dims.w, out_dims.h, out_dims.c);
+}
+
+void CpuBackend::allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs)
+{
+    bufs.in_h  = new float[in_size];
+    bufs.out_h = new float[out_size];
+}
+
+void CpuBackend::deallocate(InferenceBuffers& bufs)
+{
+    delete[] bufs.in_h;
+    delete[] bufs.out_h;
+    bufs = InferenceBuffers();
+}
+
+void CpuBackend::execute(InferenceBuffers& bufs)
+{
+    auto start = ros::WallTime::now();
+    // The last layer writes directly to the output buffer. In case of a network
+    // without layers (output is input) the input is copied.
+    if (output_ == input_)
+        std::memcpy(bufs.output(), bufs.in_h, blobs_[input_].dims.size() * sizeof(float));
+    blob_ptrs_[input_]  = bufs.in_h;
+    blob_ptrs_[output_] = bufs.output();
+    for (auto& step: steps_)
+    {
+        auto layer_start = ros::WallTime::now();
+        step_in_.clear();
+        for (int i: step.inputs)
+            step_in_.push_back(blob_ptrs_[i]);
+        step.layer->forward(step_in_, blob_ptrs_[step.output], workspace_.data());
+        if (debug_mode_)
+            ROS_DEBUG("%-40.40s %4.3fms", step.name.c_str(), (ros::WallTime::now() - layer_start).toSec() * 1000);
+    }
+    if (debug_mode_)
+        ROS_INFO("All layers  : %4.3f", (ros::WallTime::now() - start).toSec() * 1000);
+    ROS_DEBUG("Forward out (first 3 values): [%.4f, %.4f, %.4f]", bufs.output()[0], bufs.output()[1], bufs.output()[2]);
+}
+
+}
@@ -0,0 +1,595 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/cpu_layers.h"
+#include "cpu_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace caffe_ros { namespace cpu
+{
+
+using namespace redtail::cpu;
+
+// -----------------------------------------------------------------
+// GEMM. C is computed in tiles of kMc x kNc, each tile is a parallel task.
+// B block of kKc x kNc is packed into panels of kNr columns which
+// are kept in L1 while the micro-kernel runs over kMr rows of A.
+// -----------------------------------------------------------------
+static const int kMr = 4;
+static const int kNr = 8;
+static const int kMc = 64;
+static const int kNc = 512;
+static const int kKc = 256;
+
+// Packs (kc x nc) block of B into panels of [kc][kNr], the last panel is zero padded.
+static void packB(const float* b, int ldb, int kc, int nc, float* dst)
+{
+    for (int j = 0; j < nc; j += kNr)
+    {
+        int nr = std::min(kNr, nc - j);
+        for (int k = 0; k < kc; k++, dst += kNr)
+        {
+            const float* src = b + (size_t)k * ldb + j;
+            int jj = 0;
+            for (; jj < nr; jj++)
+                dst[jj] = src[jj];
+            for (; jj < kNr; jj++)
+                dst[jj] = 0;
+        }
+    }
+}
+
+// Adds product of Mr rows of A (kc elements each) and packed B panel to Mr x nr tile of C.
+template<int Mr>
+static inline void microKernel(const float* a, int lda, const float* bp, int kc, float* c, int ldc, int nr)
+{
+    float4v acc[Mr][2] = {};
+    for (int k = 0; k < kc; k++, bp += kNr)
+    {
+        float4v b0 = loadu(bp);
+        float4v b1 = loadu(bp + 4);
+        for (int i = 0; i < Mr; i++)
+        {
+            float4v av = float4v{} + a[(size_t)i * lda + k];
+            acc[i][0] += av * b0;
+            acc[i][1] += av * b1;
+        }
+    }
+    for (int i = 0; i < Mr; i++)
+    {
+        float* ci = c + (size_t)i * ldc;
+        if (nr == kNr)
+        {
+            storeu(ci,     loadu(ci)     + acc[i][0]);
+            storeu(ci + 4, loadu(ci + 4) + acc[i][1]);
+        }
+        else
+        {
+            float res[kNr];
+            std::memcpy(res, acc[i], sizeof(res));
+            for (int j = 0; j < nr; j++)
+                ci[j] += res[j];
+        }
+    }
+}
+
+void gemm(int m, int n, int k, const float* a, const float* b, const float* bias, float* c)
+{
+    assert(m > 0 && n > 0 && k > 0);
+    const int num_mb = (m + kMc - 1) / kMc;
+    const int num_nb = (n + kNc - 1) / kNc;
+    parallelForStripes(num_mb * num_nb, 0, [&](int start, int end)
+    {
+        std::vector<float> packed((size_t)kKc * (kNc + kNr));
+        for (int t = start; t < end; t++)
+        {
+            const int m0 = (t / num_nb) * kMc;
+            const int n0 = (t % num_nb) * kNc;
+            const int mc = std::min(kMc, m - m0);
+            const int nc = std::min(kNc, n - n0);
+            for (int i = 0; i < mc; i++)
+            {
+                float* ci = c + (size_t)(m0 + i) * n + n0;
+                std::fill(ci, ci + nc, bias != nullptr ? bias[m0 + i] : 0.0f);
+            }
+            for (int k0 = 0; k0 < k; k0 += kKc)
+            {
+                const int kc = std::min(kKc, k - k0);
+                packB(b + (size_t)k0 * n + n0, n, kc, nc, packed.data());
+                for (int j = 0; j < nc; j += kNr)
+                {
+                    const float* bp = packed.data() + (size_t)(j / kNr) * kc * kNr;
+                    const int    nr = std::min(kNr, nc - j);
+                    for (int i = 0; i < mc; i += kMr)
+                    {
+                        const float* ap = a + (size_t)(m0 + i) * k + k0;
+                        float*       cp = c + (size_t)(m0 + i) * n + n0 + j;
+                        switch (std::min(kMr, mc - i))
+                        {
+                        case 4: microKernel<4>(ap, k, bp, kc, cp, n, nr); break;
+                        case 3: microKernel<3>(ap, k, bp, kc, cp, n, nr); break;
+                        case 2: microKernel<2>(ap, k, bp, kc, cp, n, nr); break;
+                        case 1: microKernel<1>(ap, k, bp, kc, cp, n, nr); break;
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// -----------------------------------------------------------------
+// Convolution: im2col followed by GEMM, 1x1 convolutions use the input directly.
+// -----------------------------------------------------------------
+ConvolutionLayer::ConvolutionLayer(const Params& params, ConstWeights weights, ConstWeights bias):
+    p_(params), weights_(weights), bias_(bias)
+{
+}
+
+bool ConvolutionLayer::isPointwise() const
+{
+    return p_.kernel_h == 1 && p_.kernel_w == 1 && p_.stride_h == 1 && p_.stride_w == 1 &&
+           p_.pad_h == 0 && p_.pad_w == 0;
+}
+
+bool ConvolutionLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() != 1 || p_.num_output <= 0 || p_.group <= 0)
+        return false;
+    if (p_.kernel_h <= 0 || p_.kernel_w <= 0 || p_.stride_h <= 0 || p_.stride_w <= 0 ||
+        p_.dilation_h <= 0 || p_.dilation_w <= 0 || p_.pad_h < 0 || p_.pad_w < 0)
+        return false;
+    const auto& d = in[0];
+    if (d.c % p_.group != 0 || p_.num_output % p_.group != 0)
+        return false;
+    size_t kernel_size = (size_t)(d.c / p_.group) * p_.kernel_h * p_.kernel_w;
+    if (weights_.size != p_.num_output * kernel_size)
+        return false;
+    if (!bias_.empty() && bias_.size != (size_t)p_.num_output)
+        return false;
+
+    int ext_h = p_.dilation_h * (p_.kernel_h - 1) + 1;
+    int ext_w = p_.dilation_w * (p_.kernel_w - 1) + 1;
+    out.c = p_.num_output;
+    out.h = (d.h + 2 * p_.pad_h - ext_h) / p_.stride_h + 1;
+    out.w = (d.w + 2 * p_.pad_w - ext_w) / p_.stride_w + 1;
+    if (out.h <= 0 || out.w <= 0)
+        return false;
+    in_dims_  = d;
+    out_dims_ = out;
+    return true;
+}
+
+size_t ConvolutionLayer::getWorkspaceSize() const
+{
+    if (isPointwise())
+        return 0;
+    return (size_t)(in_dims_.c / p_.group) * p_.kernel_h * p_.kernel_w * out_dims_.h * out_dims_.w;
+}
+
+void ConvolutionLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    const int    in_c      = in_dims_.c / p_.group;
+    const int    out_c     = p_.num_output / p_.group;
+    const int    in_h      = in_dims_.h;
+    const int    in_w      = in_dims_.w;
+    const int    out_h     = out_dims_.h;
+    const int    out_w     = out_dims_.w;
+    const size_t in_plane  = (size_t)in_h * in_w;
+    const size_t out_plane = (size_t)out_h * out_w;
+    const int    ksize     = p_.kernel_h * p_.kernel_w;
+    const int    k         = in_c * ksize;
+
+    for (int g = 0; g < p_.group; g++)
+    {
+        const float* src = in[0] + g * in_c * in_plane;
+        const float* col = src;
+        if (!isPointwise())
+        {
+            // Each row of the column matrix is the input plane shifted by the kernel tap.
+            parallelForStripes(k, 0, [&](int start, int end)
+            {
+                for (int row = start; row < end; row++)
+                {
+                    const int    ic    = row / ksize;
+                    const int    ky    = (row % ksize) / p_.kernel_w;
+                    const int    kx    = row % p_.kernel_w;
+                    const float* plane = src + ic * in_plane;
+                    float*       dst   = workspace + (size_t)row * out_plane;
+                    for (int oy = 0; oy < out_h; oy++)
+                    {
+                        int iy = oy * p_.stride_h - p_.pad_h + ky * p_.dilation_h;
+                        if (iy < 0 || iy >= in_h)
+                        {
+                            std::fill(dst, dst + out_w, 0.0f);
+                            dst += out_w;
+                            continue;
+                        }
+                        const float* src_row = plane + (size_t)iy * in_w;
+                        int ix = -p_.pad_w + kx * p_.dilation_w;
+                        for (int ox = 0; ox < out_w; ox++, ix += p_.stride_w)
+                            *dst++ = (ix >= 0 && ix < in_w) ? src_row[ix] : 0.0f;
+                    }
+                }
+            });
+            col = workspace;
+        }
+        gemm(out_c, (int)out_plane, k, weights_.data + (size_t)g * out_c * k, col,
+             bias_.empty() ? nullptr : bias_.data + g * out_c, out + g * out_c * out_plane);
+    }
+}
+
+// -----------------------------------------------------------------
+// Pooling, output size and padding are computed the same way as in Caffe.
+// -----------------------------------------------------------------
+PoolingLayer::PoolingLayer(const Params& params):
+    p_(params)
+{
+}
+
+bool PoolingLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() != 1)
+        return false;
+    const auto& d = in[0];
+    if (p_.global)
+    {
+        p_.kernel_h = d.h;
+        p_.kernel_w = d.w;
+        p_.stride_h = p_.stride_w = 1;
+        p_.pad_h    = p_.pad_w    = 0;
+    }
+    if (p_.kernel_h <= 0 || p_.kernel_w <= 0 || p_.stride_h <= 0 || p_.stride_w <= 0 ||
+        p_.pad_h < 0 || p_.pad_h >= p_.kernel_h || p_.pad_w < 0 || p_.pad_w >= p_.kernel_w)
+        return false;
+
+    out.c = d.c;
+    out.h = (int)std::ceil((float)(d.h + 2 * p_.pad_h - p_.kernel_h) / p_.stride_h) + 1;
+    out.w = (int)std::ceil((float)(d.w + 2 * p_.pad_w - p_.kernel_w) / p_.stride_w) + 1;
+    // The last pooling window must start inside the image.
+    if (p_.pad_h > 0 && (out.h - 1) * p_.stride_h >= d.h + p_.pad_h)
+        out.h--;
+    if (p_.pad_w > 0 && (out.w - 1) * p_.stride_w >= d.w + p_.pad_w)
+        out.w--;
+    if (out.h <= 0 || out.w <= 0)
+        return false;
+    in_dims_  = d;
+    out_dims_ = out;
+    return true;
+}
+
+void PoolingLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    const int in_h  = in_dims_.h;
+    const int in_w  = in_dims_.w;
+    const int out_h = out_dims_.h;
+    const int out_w = out_dims_.w;
+    parallelForStripes(in_dims_.c, 0, [&](int start, int end)
+    {
+        for (int c = start; c < end; c++)
+        {
+            const float* src = in[0] + (size_t)c * in_h * in_w;
+            float*       dst = out + (size_t)c * out_h * out_w;
+            for (int oy = 0; oy < out_h; oy++)
+            {
+                int y_start = oy * p_.stride_h - p_.pad_h;
+                int y_end   = std::min(y_start + p_.kernel_h, in_h + p_.pad_h);
+                for (int ox = 0; ox < out_w; ox++)
+                {
+                    int x_start = ox * p_.stride_w - p_.pad_w;
+                    int x_end   = std::min(x_start + p_.kernel_w, in_w + p_.pad_w);
+                    // Average pooling divides by the window size including padding, as Caffe does.
+                    int pool_size = (y_end - y_start) * (x_end - x_start);
+                    int y0 = std::max(y_start, 0);
+                    int x0 = std::max(x_start, 0);
+                    int y1 = std::min(y_end, in_h);
+                    int x1 = std::min(x_end, in_w);
+                    float res = p_.method == Method::kMax ? -std::numeric_limits<float>::max() : 0.0f;
+                    for (int y = y0; y < y1; y++)
+                    {
+                        const float* row = src + (size_t)y * in_w;
+                        if (p_.method == Method::kMax)
+                        {
+                            for (int x = x0; x < x1; x++)
+                                res = std::max(res, row[x]);
+                        }
+                        else
+                        {
+                            for (int x = x0; x < x1; x++)
+                                res += row[x];
+                        }
+                    }
+                    *dst++ = p_.method == Method::kMax ? res : res / pool_size;
+                }
+            }
+        }
+    });
+}
+
+// -----------------------------------------------------------------
+// Inner product.
+// -----------------------------------------------------------------
+static inline float dot(const float* x, const float* y, size_t n)
+{
+    // Independent accumulators to hide FMA latency.
+    float4v acc[4] = {};
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int j = 0; j < 4; j++)
+            acc[j] += loadu(x + i + 4 * j) * loadu(y + i + 4 * j);
+    }
+    float4v sum = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    float   res = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    for (; i < n; i++)
+        res += x[i] * y[i];
+    return res;
+}
+
+InnerProductLayer::InnerProductLayer(int num_output, ConstWeights weights, ConstWeights bias):
+    num_output_(num_output), weights_(weights), bias_(bias)
+{
+}
+
+bool InnerProductLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() != 1 || num_output_ <= 0)
+        return false;
+    in_size_ = in[0].size();
+    if (weights_.size != num_output_ * in_size_)
+        return false;
+    if (!bias_.empty() && bias_.size != (size_t)num_output_)
+        return false;
+    out.c = num_output_;
+    out.h = 1;
+    out.w = 1;
+    return true;
+}
+
+void InnerProductLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    parallelForStripes(num_output_, 0, [&](int start, int end)
+    {
+        for (int i = start; i < end; i++)
+        {
+            float res = dot(weights_.data + (size_t)i * in_size_, in[0], in_size_);
+            out[i] = bias_.empty() ? res : res + bias_.data[i];
+        }
+    });
+}
+
+// -----------------------------------------------------------------
+// Element-wise layers.
+// -----------------------------------------------------------------
+ReLULayer::ReLULayer(float negative_slope):
+    negative_slope_(negative_slope)
+{
+}
+
+bool ReLULayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() != 1)
+        return false;
+    dims_ = out = in[0];
+    return true;
+}
+
+void ReLULayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    const float slope = negative_slope_;
+    parallelForStripes(dims_.c, 0, [&](int start, int end)
+    {
+        size_t plane = (size_t)dims_.h * dims_.w;
+        const float* src = in[0] + start * plane;
+        float*       dst = out + start * plane;
+        for (size_t i = 0; i < (end - start) * plane; i++)
+            dst[i] = src[i] > 0 ? src[i] : src[i] * slope;
+    });
+}
+
+ScaleLayer::ScaleLayer(std::vector<float> scale, std::vector<float> bias):
+    scale_(std::move(scale)), bias_(std::move(bias))
+{
+}
+
+bool ScaleLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() != 1 || scale_.size() != (size_t)in[0].c)
+        return false;
+    if (!bias_.empty() && bias_.size() != scale_.size())
+        return false;
+    dims_ = out = in[0];
+    return true;
+}
+
+void ScaleLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    parallelForStripes(dims_.c, 0, [&](int start, int end)
+    {
+        size_t plane = (size_t)dims_.h * dims_.w;
+        for (int c = start; c < end; c++)
+        {
+            const float* src = in[0] + c * plane;
+            float*       dst = out + c * plane;
+            const float  s   = scale_[c];
+            const float  b   = bias_.empty() ? 0.0f : bias_[c];
+            for (size_t i = 0; i < plane; i++)
+                dst[i] = src[i] * s + b;
+        }
+    });
+}
+
+EltwiseLayer::EltwiseLayer(Operation op, std::vector<float> coeffs):
+    op_(op), coeffs_(std::move(coeffs))
+{
+}
+
+bool EltwiseLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() < 2)
+        return false;
+    for (const auto& d: in)
+    {
+        if (d.c != in[0].c || d.h != in[0].h || d.w != in[0].w)
+            return false;
+    }
+    if (coeffs_.empty())
+        coeffs_.assign(in.size(), 1.0f);
+    if (coeffs_.size() != in.size())
+        return false;
+    size_ = in[0].size();
+    out   = in[0];
+    return true;
+}
+
+void EltwiseLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    const int num_in = (int)in.size();
+    parallelForStripes((int)((size_ + 1023) / 1024), 0, [&](int start, int end)
+    {
+        size_t i_start = (size_t)start * 1024;
+        size_t i_end   = std::min((size_t)end * 1024, size_);
+        for (size_t i = i_start; i < i_end; i++)
+        {
+            // Out may alias the first input, so it is read first.
+            float res = op_ == Operation::kSum ? in[0][i] * coeffs_[0] : in[0][i];
+            for (int j = 1; j < num_in; j++)
+            {
+                switch (op_)
+                {
+                case Operation::kProd: res *= in[j][i]; break;
+                case Operation::kSum:  res += in[j][i] * coeffs_[j]; break;
+                case Operation::kMax:  res = std::max(res, in[j][i]); break;
+                }
+            }
+            out[i] = res;
+        }
+    });
+}
+
+// -----------------------------------------------------------------
+// Channel-wise layers.
+// -----------------------------------------------------------------
+bool SoftmaxLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.size() != 1)
+        return false;
+    dims_ = out = in[0];
+    return true;
+}
+
+void SoftmaxLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    const size_t plane = (size_t)dims_.h * dims_.w;
+    const int    num_c = dims_.c;
+    parallelForStripes((int)plane, 0, [&](int start, int end)
+    {
+        for (int i = start; i < end; i++)
+        {
+            const float* src = in[0] + i;
+            float*       dst = out + i;
+            float max_v = src[0];
+            for (int c = 1; c < num_c; c++)
+                max_v = std::max(max_v, src[c * plane]);
+            float sum = 0;
+            for (int c = 0; c < num_c; c++)
+            {
+                dst[c * plane] = std::exp(src[c * plane] - max_v);
+                sum += dst[c * plane];
+            }
+            for (int c = 0; c < num_c; c++)
+                dst[c * plane] /= sum;
+        }
+    });
+}
+
+LRNLayer::LRNLayer(int local_size, float alpha, float beta, float k):
+    local_size_(local_size), alpha_(alpha), beta_(beta), k_(k)
+{
+}
+
+bool LRNLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    // Caffe requires odd window size.
+    if (in.size() != 1 || local_size_ <= 0 || local_size_ % 2 == 0)
+        return false;
+    dims_ = out = in[0];
+    return true;
+}
+
+void LRNLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    const size_t plane = (size_t)dims_.h * dims_.w;
+    const int    num_c = dims_.c;
+    const int    half  = (local_size_ - 1) / 2;
+    const float  alpha = alpha_ / local_size_;
+    // Sum of squares over the channel window is updated incrementally
+    // while the window slides over channels, pixels are processed in blocks of 256.
+    parallelForStripes((int)((plane + 255) / 256), 0, [&](int start, int end)
+    {
+        for (int block = start; block < end; block++)
+        {
+            size_t i_start = (size_t)block * 256;
+            size_t n       = std::min(plane - i_start, (size_t)256);
+            float  sum[256] = {};
+            for (int c = 0; c < std::min(half, num_c); c++)
+            {
+                const float* src = in[0] + c * plane + i_start;
+                for (size_t i = 0; i < n; i++)
+                    sum[i] += src[i] * src[i];
+            }
+            for (int c = 0; c < num_c; c++)
+            {
+                if (c + half < num_c)
+                {
+                    const float* add = in[0] + (c + half) * plane + i_start;
+                    for (size_t i = 0; i < n; i++)
+                        sum[i] += add[i] * add[i];
+                }
+                if (c - half - 1 >= 0)
+                {
+                    const float* sub = in[0] + (c - half - 1) * plane + i_start;
+                    for (size_t i = 0; i < n; i++)
+                        sum[i] -= sub[i] * sub[i];
+                }
+                const float* src = in[0] + c * plane + i_start;
+                float*       dst = out + c * plane + i_start;
+                for (size_t i = 0; i < n; i++)
+                    dst[i] = src[i] * std::pow(k_ + alpha * sum[i], -beta_);
+            }
+        }
+    });
+}
+
+bool ConcatLayer::reshape(const std::vector<BlobDims>& in, BlobDims& out)
+{
+    if (in.empty())
+        return false;
+    out = in[0];
+    out.c = 0;
+    sizes_.clear();
+    for (const auto& d: in)
+    {
+        if (d.h != in[0].h || d.w != in[0].w)
+            return false;
+        out.c += d.c;
+        sizes_.push_back(d.size());
+    }
+    return true;
+}
+
+void ConcatLayer::forward(const std::vector<const float*>& in, float* out, float* workspace)
+{
+    // Batch size is 1 so channel concatenation is a concatenation of the buffers.
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        std::memcpy(out, in[i], sizes_[i] * sizeof(float));
+        out += sizes_[i];
+    }
+}
+
+} }
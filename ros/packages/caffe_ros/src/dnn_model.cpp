@@ -0,0 +1,561 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/dnn_model.h"
+
+#include <opencv2/opencv.hpp>
+
+namespace caffe_ros
+{
+DnnModel::DnnModel(ros::NodeHandle& nh, const std::string& name):
+    name_(name)
+{
+    std::string prototxt_path;
+    std::string model_path;
+    std::string input_layer;
+    std::string output_layer;
+    std::string output_topic;
+    std::string inp_fmt;
+    std::string post_proc;
+    std::string data_type_s;
+    Int8CalibParams int8_calib;
+    std::string backend;
+    std::string engine_cache_dir;
+    bool        use_FP16;
+    float       inp_scale;
+    float       inp_shift;
+    int         dnn_queue_size;
+    bool        use_cached_model;
+    float       roi_top;
+    float       roi_bottom;
+    float       roi_left;
+    float       roi_right;
+    float       motion_threshold;
+    int         motion_max_skip;
+    int         inference_buffers;
+    int         track_max_width;
+    std::string yolo_version;
+    int         yolo_classes;
+    int         yolo_boxes;
+    std::vector<int>   yolo_grid;
+    std::vector<float> yolo_anchors;
+
+    nh.param<std::string>("prototxt_path", prototxt_path, "");
+    nh.param<std::string>("model_path",    model_path, "");
+    nh.param<std::string>("input_layer",   input_layer, "data");
+    nh.param<std::string>("output_layer",  output_layer, "prob");
+    // Relative names are resolved in the model namespace.
+    nh.param<std::string>("output_topic",  output_topic, "network/output");
+    nh.param<std::string>("inp_fmt",       inp_fmt, "BGR");
+    nh.param<std::string>("post_proc",     post_proc, "");
+    nh.param<std::string>("data_type",     data_type_s, "fp16");
+    nh.param<std::string>("int8_calib_src",   int8_calib.src,   "");
+    nh.param<std::string>("int8_calib_cache", int8_calib.cache, "");
+    // INT8 calibration images per batch, max number of images (0 - all, sampled uniformly
+    // or randomly if shuffled) and image loading threads (0 - all hardware threads).
+    nh.param("int8_calib_batch_size", int8_calib.batch_size, 1);
+    nh.param("int8_calib_max_images", int8_calib.max_images, 0);
+    nh.param("int8_calib_shuffle",    int8_calib.shuffle,    false);
+    nh.param("int8_calib_threads",    int8_calib.threads,    0);
+    // Network backend: tensorrt or cpu, empty selects TensorRT if available.
+    nh.param<std::string>("backend",       backend, "");
+
+    // Backward compatibility: (use_FP16 == false) means use FP32.
+    nh.param("use_fp16",  use_FP16, true);
+    data_type_s = use_FP16 ? data_type_s : "fp32";
+
+    nh.param("inp_scale", inp_scale, 1.0f);
+    nh.param("inp_shift", inp_shift, 0.0f);
+    nh.param("dnn_queue_size",    dnn_queue_size,    DEFAULT_DNN_QUEUE_SIZE);
+    nh.param("obj_det_threshold", obj_det_threshold_, 0.15f);
+    nh.param("iou_threshold",     iou_threshold_,     0.2f);
+    // Boxes of different classes suppress each other only in class agnostic mode.
+    nh.param("nms_class_agnostic", nms_params_.class_agnostic, false);
+    // Soft-NMS decays scores of overlapping boxes instead of removing them.
+    nh.param("nms_soft",           nms_params_.soft,           false);
+    nh.param("nms_soft_sigma",     nms_params_.soft_sigma,     0.5f);
+    // YOLO output layout: v1, v2 or v3 (see yolo_prediction.h), number of classes and boxes per grid cell.
+    nh.param<std::string>("yolo_version", yolo_version, "v1");
+    nh.param("yolo_classes",      yolo_classes, 20);
+    nh.param("yolo_boxes",        yolo_boxes,   2);
+    // Grid size of each output scale, defaults to 7 for v1 and to the output height for v2 and v3.
+    nh.param("yolo_grid",         yolo_grid,    std::vector<int>());
+    // Anchor width and height pairs, in grid cells for v2 and in network input pixels for v3.
+    nh.param("yolo_anchors",      yolo_anchors, std::vector<float>());
+    nh.param("max_rate_hz",       max_rate_hz_, 30.0f);
+    // Models with higher priority are submitted first, lower priority models skip frames
+    // while all of their inference buffers are in use.
+    nh.param("priority",          priority_,    0);
+    nh.param("debug_mode",        debug_mode_,      false);
+    nh.param("use_cached_model",  use_cached_model, true);
+    // Built engines are cached in engine_cache_dir (empty - directory of the model) keyed by the hash
+    // of the model files, data type, INT8 calibration cache and TensorRT version.
+    nh.param<std::string>("engine_cache_dir", engine_cache_dir, "");
+    // Region of interest as fractions of the image, e.g. a row band that excludes sky.
+    nh.param("roi_top",           roi_top,    0.0f);
+    nh.param("roi_bottom",        roi_bottom, 1.0f);
+    nh.param("roi_left",          roi_left,   0.0f);
+    nh.param("roi_right",         roi_right,  1.0f);
+    // Motion gating: frames which differ from the last processed frame by less than motion_threshold
+    // (mean absolute intensity difference of downsampled ROI, 0..255, 0 - disabled) are not run
+    // through DNN, the last output is republished with the new frame stamp instead.
+    // At most motion_max_skip consecutive frames are skipped.
+    nh.param("motion_threshold",    motion_threshold,     0.0f);
+    nh.param("motion_max_skip",     motion_max_skip,      10);
+    nh.param("motion_stats_period", motion_stats_period_, 10.0f);
+    // Number of frames in flight: preprocessing of the next frame overlaps inference of the current one.
+    nh.param("inference_buffers",   inference_buffers,    2);
+    // Detect-then-track (YOLO only): the detector runs on every track_interval-th frame
+    // (1 - on every frame, tracking disabled), boxes are moved by the tracker on the other frames.
+    // The detector also runs when the fraction of reliably tracked points of a box drops below track_min_confidence.
+    nh.param("track_interval",       track_interval_,       1);
+    nh.param("track_min_confidence", track_min_confidence_, 0.5f);
+    // Width of the downsampled grayscale image used by the tracker.
+    nh.param("track_max_width",      track_max_width,       320);
+    nh.param("track_stats_period",   track_stats_period_,   10.0f);
+
+    if (!name_.empty())
+        ROS_INFO("Name  : %s", name_.c_str());
+    ROS_INFO("Proto : %s", prototxt_path.c_str());
+    ROS_INFO("Model : %s", model_path.c_str());
+    ROS_INFO("Input : %s", input_layer.c_str());
+    ROS_INFO("Output: %s", output_layer.c_str());
+    ROS_INFO("Topic : %s", output_topic.c_str());
+    ROS_INFO("In Fmt: %s", inp_fmt.c_str());
+    ROS_INFO("DType : %s", data_type_s.c_str());
+    ROS_INFO("Backnd: %s", backend.empty() ? "default" : backend.c_str());
+    ROS_INFO("Scale : %.4f", inp_scale);
+    ROS_INFO("Shift : %.2f", inp_shift);
+    ROS_INFO("DNN Q : %d", dnn_queue_size);
+    ROS_INFO("Post P: %s", post_proc.empty() ? "none" : post_proc.c_str());
+    ROS_INFO("Obj T : %.2f", obj_det_threshold_);
+    ROS_INFO("IOU T : %.2f", iou_threshold_);
+    ROS_INFO("NMS   : %s, %s (sigma %.2f)", nms_params_.class_agnostic ? "class agnostic" : "per class",
+             nms_params_.soft ? "soft" : "hard", nms_params_.soft_sigma);
+    if (post_proc == "YOLO")
+    {
+        ROS_INFO("YOLO  : %s (classes %d, boxes %d, scales %zu)", yolo_version.c_str(), yolo_classes, yolo_boxes,
+                 std::max(yolo_grid.size(), (size_t)1));
+    }
+    ROS_INFO("Rate  : %.1f", max_rate_hz_);
+    ROS_INFO("Prio  : %d", priority_);
+    ROS_INFO("Debug : %s", debug_mode_ ? "yes" : "no");
+    ROS_INFO("Cache : %s", !use_cached_model ? "no" : engine_cache_dir.empty() ? "model directory" : engine_cache_dir.c_str());
+    ROS_INFO("ROI   : (%.2f, %.2f, %.2f, %.2f)", roi_top, roi_bottom, roi_left, roi_right);
+    ROS_INFO("Motion: %s (threshold %.2f, max skip %d)", motion_threshold > 0 ? "yes" : "no",
+             motion_threshold, motion_max_skip);
+    ROS_INFO("Bufs  : %d", inference_buffers);
+    ROS_INFO("Track : %s (interval %d, min confidence %.2f, width %d)", track_interval_ > 1 ? "yes" : "no",
+             track_interval_, track_min_confidence_, track_max_width);
+    ROS_INFO("INT8 calib src  : %s", int8_calib.src.c_str());
+    ROS_INFO("INT8 calib cache: %s", int8_calib.cache.c_str());
+    ROS_INFO("INT8 calib batch: %d (max images %d, %s, threads %d)", int8_calib.batch_size, int8_calib.max_images,
+             int8_calib.shuffle ? "shuffled" : "in order", int8_calib.threads);
+    //
+    ROS_WARN("The use_FP16 parameter is deprecated though still supported. "
+             "Please use data_type instead as use_FP16 will be removed in future release.");
+
+    setPostProcessing(post_proc);
+
+    auto data_type = parseDataType(data_type_s);
+
+    net_.setBackend(backend);
+    net_.setEngineCacheDir(engine_cache_dir);
+    if (data_type == DataType::kINT8)
+        net_.createInt8Calibrator(int8_calib);
+
+    net_.loadNetwork(prototxt_path, model_path, input_layer, output_layer,
+                     data_type, use_cached_model);
+    net_.setInputFormat(inp_fmt);
+    net_.setScale(inp_scale);
+    net_.setShift(inp_shift);
+    net_.setInputRoi(roi_top, roi_bottom, roi_left, roi_right);
+    if (inference_buffers < 1)
+    {
+        redtail::throwNodeError("Invalid inference_buffers: %d, must be >= 1.", inference_buffers);
+    }
+    net_.setNumBuffers(std::max(inference_buffers, 1));
+    if (max_rate_hz_ < 0)
+    {
+        redtail::throwNodeError("Invalid max_rate_hz: %.1f, must be >= 0.", max_rate_hz_);
+    }
+    if (post_proc_ == PostProc::YOLO)
+    {
+        if (iou_threshold_ <= 0 || iou_threshold_ > 1 || nms_params_.soft_sigma <= 0)
+        {
+            redtail::throwNodeError("Invalid NMS settings: iou_threshold must be in (0, 1] and nms_soft_sigma > 0.");
+        }
+        nms_params_.iou_threshold = iou_threshold_;
+        // Boxes decayed by soft-NMS below the detection threshold are removed.
+        nms_params_.min_score     = obj_det_threshold_;
+
+        YoloParams yolo_params;
+        yolo_params.num_classes = yolo_classes;
+        yolo_params.num_boxes   = yolo_boxes;
+        yolo_params.anchors     = yolo_anchors;
+        yolo_params.input_w     = net_.getInWidth();
+        yolo_params.input_h     = net_.getInHeight();
+        std::string error;
+        bool valid = parseYoloVersion(yolo_version, yolo_params.version);
+        if (!valid)
+            error = "unsupported version " + yolo_version;
+        if (!yolo_grid.empty())
+            yolo_params.grid_sizes = yolo_grid;
+        else if (yolo_params.version != YoloVersion::V1)
+            yolo_params.grid_sizes = {net_.getOutHeight()};
+        valid = valid && yolo_decoder_.init(yolo_params, error);
+        size_t out_size = (size_t)net_.getOutChannels() * net_.getOutHeight() * net_.getOutWidth();
+        if (valid && yolo_decoder_.getOutputSize() != out_size)
+        {
+            error = "network output size " + std::to_string(out_size) + " does not match expected size " +
+                    std::to_string(yolo_decoder_.getOutputSize());
+            valid = false;
+        }
+        if (!valid)
+        {
+            redtail::throwNodeError("Invalid YOLO settings: %s.", error.c_str());
+        }
+    }
+    if (debug_mode_)
+        net_.showProfile(true);
+
+    if (motion_threshold < 0 || motion_max_skip < 0)
+    {
+        redtail::throwNodeError("Invalid motion gating settings: motion_threshold and motion_max_skip must be >= 0.");
+    }
+    if (motion_threshold > 0)
+    {
+        redtail::preprocessing::MotionGate::Params motion_params;
+        motion_params.threshold = motion_threshold;
+        motion_params.max_skip  = motion_max_skip;
+        motion_gate_ = std::make_unique<redtail::preprocessing::MotionGate>(motion_params);
+    }
+
+    if (track_interval_ < 1 || track_max_width < 16)
+    {
+        redtail::throwNodeError("Invalid tracking settings: track_interval must be >= 1 and track_max_width >= 16.");
+    }
+    if (track_interval_ > 1)
+    {
+        if (post_proc_ != PostProc::YOLO)
+        {
+            redtail::throwNodeError("Tracking (track_interval > 1) requires YOLO post processing.");
+        }
+        BoxTracker::Params track_params;
+        track_params.max_width = std::max(track_max_width, 16);
+        tracker_ = std::make_unique<BoxTracker>(track_params);
+    }
+
+    output_pub_ = nh.advertise<sensor_msgs::Image>(output_topic, dnn_queue_size);
+    // Messages are held by the frames in flight, the publisher queue and the last output.
+    out_msg_pool_ = std::make_unique<redtail::MessagePool<sensor_msgs::Image>>(inference_buffers + dnn_queue_size + 2);
+}
+
+DnnModel::~DnnModel()
+{
+    stop();
+}
+
+void DnnModel::start()
+{
+    ROS_ASSERT(!output_thread_.joinable());
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        stop_output_ = false;
+    }
+    last_stats_time_       = ros::WallTime::now();
+    last_track_stats_time_ = last_stats_time_;
+    output_thread_         = std::thread(&DnnModel::outputLoop, this);
+}
+
+void DnnModel::stop()
+{
+    if (!output_thread_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        stop_output_ = true;
+    }
+    pending_cv_.notify_all();
+    output_thread_.join();
+}
+
+void DnnModel::logMotionStats()
+{
+    if (motion_gate_ == nullptr || motion_stats_period_ <= 0 ||
+        (ros::WallTime::now() - last_stats_time_).toSec() < motion_stats_period_)
+    {
+        return;
+    }
+    ROS_INFO("%sMotion gate: %s", name_.empty() ? "" : (name_ + ": ").c_str(),
+             redtail::preprocessing::toString(motion_gate_->getStats(true)).c_str());
+    last_stats_time_ = ros::WallTime::now();
+}
+
+void DnnModel::logOutputStats()
+{
+    auto pool_stats = out_msg_pool_->getStats(false);
+    ROS_INFO("%sOutput messages: %lu published, %lu allocated.", name_.empty() ? "" : (name_ + ": ").c_str(),
+             (unsigned long)pool_stats.acquired, (unsigned long)pool_stats.allocated);
+    // Called after the output thread is stopped.
+    if (tracker_ != nullptr)
+        logTrackStats();
+}
+
+void DnnModel::outputLoop()
+{
+    while (true)
+    {
+        Pending p;
+        {
+            std::unique_lock<std::mutex> lock(pending_mutex_);
+            pending_cv_.wait(lock, [this] { return stop_output_ || !pending_.empty(); });
+            if (stop_output_)
+                return;
+            p = pending_.front();
+            pending_.pop_front();
+            if (output_error_ != nullptr)
+            {
+                // Frames submitted after the error are dropped, their buffers must still be released.
+                if (!p.repeat && !p.track)
+                {
+                    lock.unlock();
+                    try
+                    {
+                        net_.poll(p.ticket, true);
+                        net_.release(p.ticket);
+                    }
+                    catch (const std::exception&)
+                    {
+                        // Failed ticket is released by poll.
+                    }
+                }
+                continue;
+            }
+        }
+
+        const auto& img = *p.img_msg;
+        if (p.repeat)
+        {
+            // Skipped by the motion gate: the previous frame is published before this one
+            // so last_out_msg_ is already set.
+            ROS_ASSERT(last_out_msg_ != nullptr);
+            // Assignment reuses the buffers of the pooled message.
+            auto out_msg = out_msg_pool_->acquire();
+            *out_msg = *last_out_msg_;
+            out_msg->header.stamp    = img.header.stamp;
+            out_msg->header.frame_id = img.header.frame_id;
+            output_pub_.publish(out_msg);
+            continue;
+        }
+
+        sensor_msgs::Image::Ptr out_msg;
+        if (p.track)
+        {
+            // Boxes of the previous frame are moved by the tracker instead of running the detector.
+            auto start = ros::WallTime::now();
+            out_msg = out_msg_pool_->acquire();
+            createTrackedMessage(img, *out_msg);
+            track_stats_.tracked++;
+            track_stats_.track_ms += (ros::WallTime::now() - start).toSec() * 1000;
+        }
+        else
+        {
+            // Detector time excludes the wait in the pending queue behind the previous frames.
+            auto start = ros::WallTime::now();
+            try
+            {
+                net_.poll(p.ticket, true);
+            }
+            catch (const std::exception&)
+            {
+                // The ticket is released by poll, the error is rethrown on the next submit.
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                output_error_ = std::current_exception();
+                continue;
+            }
+            out_msg = p.out_msg;
+            createOutputMessage(img, net_.getOutput(p.ticket), *out_msg);
+            net_.release(p.ticket);
+            if (tracker_ != nullptr)
+            {
+                track_stats_.detected++;
+                track_stats_.detect_ms += (ros::WallTime::now() - start).toSec() * 1000;
+            }
+        }
+        if (motion_gate_ != nullptr)
+        {
+            motion_gate_->addComputeTime((ros::WallTime::now() - p.start).toSec() * 1000);
+            last_out_msg_ = out_msg;
+        }
+        output_pub_.publish(out_msg);
+        if (tracker_ != nullptr && track_stats_period_ > 0 &&
+            (ros::WallTime::now() - last_track_stats_time_).toSec() >= track_stats_period_)
+        {
+            logTrackStats();
+        }
+    }
+}
+
+void DnnModel::computeOutputs(const sensor_msgs::Image::ConstPtr& img_msg, SharedInput* shared)
+{
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (output_error_ != nullptr)
+            std::rethrow_exception(output_error_);
+    }
+    const auto& img = *img_msg;
+    Pending p;
+    p.img_msg = img_msg;
+    p.start   = ros::WallTime::now();
+    if (motion_gate_ != nullptr)
+    {
+        // Only ROI is checked as the rest of the image does not affect the output.
+        p.repeat = !motion_gate_->update(getRoiImage(img)) && has_output_;
+    }
+    if (!p.repeat && tracker_ != nullptr)
+    {
+        // Detector runs on every track_interval-th frame or when the tracker lost the boxes.
+        bool lost = force_detect_.exchange(false);
+        p.track   = has_output_ && !lost && frames_since_detect_ + 1 < track_interval_;
+        frames_since_detect_ = p.track ? frames_since_detect_ + 1 : 0;
+    }
+    // Blocks while all inference buffers are in use, i.e. the output thread falls behind.
+    if (!p.repeat && !p.track)
+    {
+        p.out_msg = out_msg_pool_->acquire();
+        float* output = prepareOutputMessage(*p.out_msg);
+        if (shared == nullptr)
+            p.ticket = net_.submit(img.data.data(), img.width, img.height, img.encoding, output);
+        else
+        {
+            if (!shared->ready)
+            {
+                shared->data.resize(net_.getInputSize());
+                net_.preprocess(img.data.data(), img.width, img.height, img.encoding, shared->data.data());
+                shared->ready = true;
+            }
+            ROS_ASSERT(shared->data.size() == net_.getInputSize());
+            p.ticket = net_.submitPreprocessed(shared->data.data(), output);
+        }
+        has_output_ = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_.push_back(p);
+    }
+    pending_cv_.notify_all();
+}
+
+float* DnnModel::prepareOutputMessage(sensor_msgs::Image& out_msg)
+{
+    if (post_proc_ != PostProc::None)
+        return nullptr;
+    // Use single precision multidimensional array to represent outputs.
+    // This can be useful in case DNN output is multidimensional such as in segmentation networks.
+    // Note that encoding may not be compatible with other ROS code that uses Image in case number of channels > 4.
+    // For classification nets, TensorRT uses 'c' dimension to reperesent number of classes.
+    out_msg.encoding = "32FC" + std::to_string(net_.getOutChannels());
+    out_msg.width    = net_.getOutWidth();
+    out_msg.height   = net_.getOutHeight();
+    out_msg.step     = out_msg.width * net_.getOutChannels() * sizeof(float);
+    // Does not reallocate when the message is reused. The network writes the output directly to the message.
+    out_msg.data.resize(out_msg.step * out_msg.height);
+    return reinterpret_cast<float*>(out_msg.data.data());
+}
+
+void DnnModel::createOutputMessage(const sensor_msgs::Image& img, const float* output, sensor_msgs::Image& out_msg)
+{
+    // Set stamp and frame id to the same value as source image so we can synchronize with other nodes if needed.
+    out_msg.header.stamp.sec  = img.header.stamp.sec;
+    out_msg.header.stamp.nsec = img.header.stamp.nsec;
+    out_msg.header.frame_id   = img.header.frame_id;
+
+    if (post_proc_ == PostProc::None)
+    {
+        // The output is already in the message (see prepareOutputMessage).
+        ROS_ASSERT(output == reinterpret_cast<const float*>(out_msg.data.data()));
+    }
+    else if (post_proc_ == PostProc::YOLO)
+    {
+        // Get bounding boxes and apply IOU filter.
+        // Boxes are computed in ROI coordinates and then moved to image coordinates.
+        auto roi   = net_.getInputRoi(img.width, img.height);
+        yolo_preds_.clear();
+        yolo_decoder_.decode(output, roi.width, roi.height, obj_det_threshold_, yolo_preds_);
+        nms_.apply(yolo_preds_, nms_params_, nms_preds_);
+        // The detected boxes are tracked on the following frames.
+        if (tracker_ != nullptr)
+            tracker_->reset(getRoiImage(img), nms_preds_);
+        writeObjects(nms_preds_, roi, out_msg);
+    }
+    else
+    {
+        // Should not happen, yeah... post processing is validated by the constructor.
+        ROS_ASSERT_MSG(false, "Invalid post processing.");
+    }
+}
+
+void DnnModel::createTrackedMessage(const sensor_msgs::Image& img, sensor_msgs::Image& out_msg)
+{
+    ROS_ASSERT(tracker_ != nullptr);
+    out_msg.header.stamp.sec  = img.header.stamp.sec;
+    out_msg.header.stamp.nsec = img.header.stamp.nsec;
+    out_msg.header.frame_id   = img.header.frame_id;
+
+    float conf = tracker_->track(getRoiImage(img), nms_preds_);
+    // The detector runs on the next submitted frame if the boxes are lost.
+    if (conf < track_min_confidence_)
+    {
+        force_detect_ = true;
+        track_stats_.lost++;
+    }
+    writeObjects(nms_preds_, net_.getInputRoi(img.width, img.height), out_msg);
+}
+
+cv::Mat DnnModel::getRoiImage(const sensor_msgs::Image& img) const
+{
+    auto img_h = cv::Mat((int)img.height, (int)img.width, img.encoding == "bgra8" ? CV_8UC4 : CV_8UC3,
+                         (void*)img.data.data());
+    return img_h(net_.getInputRoi(img.width, img.height));
+}
+
+void DnnModel::writeObjects(const std::vector<ObjectPrediction>& preds, const cv::Rect& roi, sensor_msgs::Image& out_msg)
+{
+    // YOLO output is represented as a matrix where each row is
+    // a predicted object vector of size 6: label, prob and 4 bounding box coordinates.
+    const int num_col = 6;
+    out_msg.encoding = "32FC1";
+    out_msg.width    = num_col;
+    out_msg.height   = preds.size();
+    out_msg.step     = out_msg.width * sizeof(float);
+    out_msg.data.resize(out_msg.step * out_msg.height);
+    // Results are written directly to the message. Label and coords are converted to float.
+    auto dst = reinterpret_cast<float*>(out_msg.data.data());
+    for (const auto& p: preds)
+    {
+        dst[0] = (float)p.label;
+        dst[1] = p.prob;
+        dst[2] = (float)(p.x + roi.x);
+        dst[3] = (float)(p.y + roi.y);
+        dst[4] = (float)p.w;
+        dst[5] = (float)p.h;
+        dst   += num_col;
+    }
+}
+
+void DnnModel::logTrackStats()
+{
+    auto& st = track_stats_;
+    uint64_t frames = st.detected + st.tracked;
+    ROS_INFO("%sTracking: detector ran on %lu of %lu frames (duty cycle %.1f%%), boxes lost %lu times, "
+             "detector %.2fms, tracker %.2fms per frame, total compute %.0fms",
+             name_.empty() ? "" : (name_ + ": ").c_str(), (unsigned long)st.detected, (unsigned long)frames,
+             frames > 0 ? 100.0 * st.detected / frames : 0.0, (unsigned long)st.lost,
+             st.detected > 0 ? st.detect_ms / st.detected : 0.0, st.tracked > 0 ? st.track_ms / st.tracked : 0.0,
+             st.detect_ms + st.track_ms);
+    st = TrackStats();
+    last_track_stats_time_ = ros::WallTime::now();
+}
+
+}
@@ -0,0 +1,199 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/engine_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace caffe_ros
+{
+
+static std::string errnoString(const std::string& what, const std::string& path)
+{
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+bool MappedFile::open(const std::string& path, std::string& error)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = errnoString("Could not open", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        error = errnoString("Could not stat", path);
+        ::close(fd);
+        return false;
+    }
+    size_ = (size_t)st.st_size;
+    // mmap does not accept empty mappings, an empty file is mapped to nullptr.
+    if (size_ > 0)
+    {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            error = errnoString("Could not map", path);
+            size_ = 0;
+            ::close(fd);
+            return false;
+        }
+        data_ = data;
+        // The whole file is read sequentially (hashing or deserialization).
+        madvise(data_, size_, MADV_SEQUENTIAL);
+        madvise(data_, size_, MADV_WILLNEED);
+    }
+    // The mapping stays valid after the descriptor is closed.
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_ != nullptr)
+        munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+void ContentHash::update(const void* data, size_t size)
+{
+    const uint64_t k1 = 0x87C37B91114253D5ull;
+    const uint64_t k2 = 0x4CF5AD432745937Full;
+
+    auto src = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, src + i, 8);
+        hash_ = rotl(hash_ ^ (w * k1), 31) * k2;
+    }
+    if (i < size)
+    {
+        uint64_t w = 0;
+        std::memcpy(&w, src + i, size - i);
+        hash_ = rotl(hash_ ^ (w * k1), 31) * k2;
+    }
+    size_ += size;
+}
+
+void ContentHash::update(const std::string& src)
+{
+    uint64_t size = src.size();
+    update(&size, sizeof(size));
+    update(src.data(), src.size());
+}
+
+bool ContentHash::updateFile(const std::string& path, std::string& error)
+{
+    MappedFile file;
+    if (!file.open(path, error))
+        return false;
+    uint64_t size = file.size();
+    update(&size, sizeof(size));
+    update(file.data(), file.size());
+    return true;
+}
+
+uint64_t ContentHash::get() const
+{
+    // Finalization mix so every input bit affects every output bit.
+    uint64_t h = hash_ ^ size_;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+std::string ContentHash::toString() const
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)get());
+    return buf;
+}
+
+EngineCache::EngineCache(const std::string& dir)
+    : dir_(dir.empty() ? "." : dir)
+{
+}
+
+std::string EngineCache::getPath(const std::string& name, const std::string& key) const
+{
+    return dir_ + "/" + name + "." + key + ".engine";
+}
+
+bool EngineCache::load(const std::string& path, MappedFile& engine) const
+{
+    std::string error;
+    return engine.open(path, error) && engine.size() > 0;
+}
+
+// Creates the directory and its parents (mkdir -p).
+static bool createDirs(const std::string& dir, std::string& error)
+{
+    for (size_t pos = 1; pos <= dir.size(); pos++)
+    {
+        if (pos < dir.size() && dir[pos] != '/')
+            continue;
+        auto cur = dir.substr(0, pos);
+        if (mkdir(cur.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            error = errnoString("Could not create directory", cur);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EngineCache::store(const std::string& path, const void* data, size_t size, std::string& error) const
+{
+    if (!createDirs(dir_, error))
+        return false;
+
+    auto tmp_path = path + ".tmp" + std::to_string(getpid());
+    FILE* file    = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        error = errnoString("Could not create", tmp_path);
+        return false;
+    }
+    bool ok = std::fwrite(data, 1, size, file) == size;
+    ok      = std::fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        error = errnoString("Could not write", tmp_path);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        error = errnoString("Could not rename to", path);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void EngineCache::remove(const std::string& path) const
+{
+    std::remove(path.c_str());
+}
+
+}
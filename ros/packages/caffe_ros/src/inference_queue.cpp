@@ -0,0 +1,218 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/inference_queue.h"
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+namespace caffe_ros
+{
+
+void HostInferenceBackend::allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs)
+{
+    bufs.in_h  = new float[in_size];
+    bufs.out_h = new float[out_size];
+}
+
+void HostInferenceBackend::deallocate(InferenceBuffers& bufs)
+{
+    delete[] bufs.in_h;
+    delete[] bufs.out_h;
+    bufs = InferenceBuffers();
+}
+
+void HostInferenceBackend::execute(InferenceBuffers& bufs)
+{
+    fn_(bufs.in_h, bufs.output());
+}
+
+InferenceQueue::InferenceQueue(InferenceBackend& backend, size_t in_size, size_t out_size, int num_buffers):
+    backend_(backend), in_size_(in_size), out_size_(out_size), slots_(num_buffers)
+{
+    assert(in_size_ > 0 && out_size_ > 0);
+    assert(num_buffers > 0);
+    try
+    {
+        for (auto& slot: slots_)
+            backend_.allocate(in_size_, out_size_, slot.bufs);
+    }
+    catch (...)
+    {
+        // Buffers of not allocated sets are null so all sets can be deallocated.
+        for (auto& slot: slots_)
+            backend_.deallocate(slot.bufs);
+        throw;
+    }
+    worker_ = std::thread(&InferenceQueue::workerLoop, this);
+}
+
+InferenceQueue::~InferenceQueue()
+{
+    stop();
+    for (auto& slot: slots_)
+        backend_.deallocate(slot.bufs);
+}
+
+void InferenceQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable())
+        worker_.join();
+}
+
+int InferenceQueue::findSlot(Ticket ticket) const
+{
+    for (size_t i = 0; i < slots_.size(); i++)
+    {
+        if (slots_[i].state != State::kFree && slots_[i].ticket == ticket)
+            return (int)i;
+    }
+    throw std::invalid_argument("InferenceQueue: ticket " + std::to_string(ticket) + " is not submitted or already released.");
+}
+
+int InferenceQueue::getNumFree() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int res = 0;
+    for (const auto& slot: slots_)
+    {
+        if (slot.state == State::kFree)
+            res++;
+    }
+    return res;
+}
+
+InferenceQueue::Ticket InferenceQueue::submit(const std::function<void(float* input)>& fill, float* output)
+{
+    int    islot;
+    Ticket ticket;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, &islot]
+            {
+                if (stop_)
+                    return true;
+                for (islot = 0; islot < (int)slots_.size(); islot++)
+                {
+                    if (slots_[islot].state == State::kFree)
+                        return true;
+                }
+                return false;
+            });
+        if (stop_)
+            throw std::runtime_error("InferenceQueue: stopped, the frame can't be submitted.");
+        ticket = next_ticket_++;
+        slots_[islot].state  = State::kFilling;
+        slots_[islot].ticket = ticket;
+        slots_[islot].bufs.out_dst = output;
+    }
+    // The slot is owned by this thread while filling, no lock is needed.
+    try
+    {
+        fill(slots_[islot].bufs.in_h);
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[islot].state = State::kFree;
+            slots_[islot].bufs.out_dst = nullptr;
+        }
+        cv_.notify_all();
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[islot].state = State::kQueued;
+        queue_.push_back(islot);
+    }
+    cv_.notify_all();
+    return ticket;
+}
+
+bool InferenceQueue::poll(Ticket ticket, bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    int islot = findSlot(ticket);
+    if (wait)
+    {
+        // Queued frames are not executed after stop.
+        cv_.wait(lock, [this, islot] { return stop_ || slots_[islot].state == State::kDone; });
+        if (slots_[islot].state != State::kDone)
+            throw std::runtime_error("InferenceQueue: stopped before the frame was executed.");
+    }
+    auto& slot = slots_[islot];
+    if (slot.state != State::kDone)
+        return false;
+    if (slot.error != nullptr)
+    {
+        // The output is not valid so the caller can't use the ticket anymore.
+        auto error = slot.error;
+        slot.error = nullptr;
+        slot.state = State::kFree;
+        slot.bufs.out_dst = nullptr;
+        lock.unlock();
+        cv_.notify_all();
+        std::rethrow_exception(error);
+    }
+    return true;
+}
+
+const float* InferenceQueue::getOutput(Ticket ticket) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int islot = findSlot(ticket);
+    assert(slots_[islot].state == State::kDone);
+    return slots_[islot].bufs.output();
+}
+
+void InferenceQueue::release(Ticket ticket)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int islot = findSlot(ticket);
+        assert(slots_[islot].state == State::kDone);
+        slots_[islot].state = State::kFree;
+        slots_[islot].bufs.out_dst = nullptr;
+    }
+    cv_.notify_all();
+}
+
+void InferenceQueue::workerLoop()
+{
+    while (true)
+    {
+        int islot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_)
+                return;
+            islot = queue_.front();
+            queue_.pop_front();
+        }
+        // Queued slot is not accessed by other threads until it is done.
+        std::exception_ptr error;
+        try
+        {
+            backend_.execute(slots_[islot].bufs);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[islot].state = State::kDone;
+            slots_[islot].error = error;
+        }
+        cv_.notify_all();
+    }
+}
+
+}
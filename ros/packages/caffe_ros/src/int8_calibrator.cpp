@@ -7,23 +7,28 @@
 #include <cuda_runtime_api.h>
 #include <opencv2/opencv.hpp>
 #include <ros/ros.h>
+#include "node_error.h"
 
 namespace fs = boost::filesystem;
 
 namespace caffe_ros
 {
 
-Int8EntropyCalibrator::Int8EntropyCalibrator(ConstStr& src, ConstStr& calib_cache)
-    : src_(src), calib_cache_(calib_cache)
+Int8EntropyCalibrator::Int8EntropyCalibrator(const Int8CalibParams& params)
+    : src_(params.src), calib_cache_(params.cache), num_threads_(params.threads), batch_size_(params.batch_size)
 {
+    if (batch_size_ < 1 || params.max_images < 0 || num_threads_ < 0)
+    {
+        redtail::throwNodeError("INT8 calibrator: invalid batch size %d, max images %d or threads %d.",
+                                batch_size_, params.max_images, num_threads_);
+    }
     if (!src_.empty())
     {
         // If calibration source is not empty then it should be either directory
         // or single image file.
         if (!fs::is_directory(src_) && !fs::is_regular_file(src_))
         {
-            ROS_FATAL("INT8 calibrator: not supported source \"%s\". Use directory or regular file name.", src_.c_str());
-            ros::shutdown();
+            redtail::throwNodeError("INT8 calibrator: not supported source \"%s\". Use directory or regular file name.", src_.c_str());
         }
         // Set calibration file cache if it's empty.
         if (calib_cache_.empty())
@@ -32,10 +37,20 @@ Int8EntropyCalibrator::Int8EntropyCalibrator(ConstStr& src, ConstStr& calib_cach
         if (fs::is_directory(src_))
         {
             for(const auto& entry: boost::make_iterator_range(fs::directory_iterator(src_), {}))
-                files_.push_back(entry.path().string());
+            {
+                // Skip subdirectories and calibration caches (the default one is in this directory).
+                if (fs::is_regular_file(entry.path()) && entry.path().extension() != ".cache")
+                    files_.push_back(entry.path().string());
+            }
         }
         else
             files_.push_back(src_);
+        size_t total = files_.size();
+        files_ = sampleFiles(std::move(files_), params.max_images, params.shuffle);
+        // Batches must be complete, a batch larger than the number of images would leave none.
+        batch_size_ = std::max(std::min(batch_size_, (int)files_.size()), 1);
+        ROS_INFO("INT8 calibrator: using %zu of %zu images%s, batch size %d.", files_.size(), total,
+                 params.shuffle ? " (shuffled)" : "", batch_size_);
     }
 }
 
@@ -51,17 +66,45 @@ bool Int8EntropyCalibrator::getBatch(void* bindings[], const char* names[], int
     if (files_.size() == 0)
         return false;
 
-    auto file = files_.front();
-    files_.pop_front();
-    ROS_DEBUG("INT8 calibrator: using \"%s\" as a source.", file.c_str());
-    auto img = cv::imread(file, cv::IMREAD_COLOR);
-    auto img_h = preprocessImage(img, dims_.w(), dims_.h(), InputFormat::BGR, "bgr8", 1, 0);
-    // Copy to the device.
-    ROS_ASSERT(img_h.isContinuous());
     ROS_ASSERT(nbBindings == 1);
     ROS_ASSERT(std::string("data") == names[0]);
+    if (prefetcher_ == nullptr)
+    {
+        ROS_ASSERT(preproc_ != nullptr);
+        // Images are decoded and preprocessed on the prefetcher threads,
+        // the preprocessor is thread safe and runs single-threaded in each of them.
+        auto load = [this](const std::string& file, float* dst)
+            {
+                auto img = cv::imread(file, cv::IMREAD_COLOR);
+                if (img.empty())
+                {
+                    ROS_WARN("INT8 calibrator: could not read image \"%s\", skipped.", file.c_str());
+                    return false;
+                }
+                ROS_DEBUG("INT8 calibrator: using \"%s\" as a source.", file.c_str());
+                preproc_->process(img, "bgr8", dst);
+                return true;
+            };
+        size_t sample_size = (size_t)dims_.c() * dims_.h() * dims_.w();
+        prefetcher_  = std::make_unique<BatchPrefetcher>(files_, batch_size_, sample_size, num_threads_, load);
+        start_time_  = ros::WallTime::now();
+        ROS_INFO("INT8 calibrator: loading images with %d threads.", prefetcher_->getNumThreads());
+    }
 
-    size_t size = dims_.c() * dims_.h() * dims_.w() * sizeof(float);
+    auto batch_h = prefetcher_->next();
+    if (batch_h == nullptr)
+    {
+        ROS_INFO("INT8 calibrator: %zu batches in %.1f s, %zu images skipped.", num_batches_,
+                 (ros::WallTime::now() - start_time_).toSec(), prefetcher_->getNumSkipped());
+        // Stop the threads, no more batches.
+        prefetcher_.reset();
+        files_.clear();
+        return false;
+    }
+    num_batches_++;
+
+    // Copy to the device.
+    size_t size = batch_size_ * prefetcher_->getSampleSize() * sizeof(float);
     if (img_d_ == nullptr)
     {
         if (cudaMalloc((void**)&img_d_, size) != cudaSuccess)
@@ -70,9 +113,9 @@ bool Int8EntropyCalibrator::getBatch(void* bindings[], const char* names[], int
             return false;
         }
     }
-    if (cudaMemcpy(img_d_, img_h.ptr<float>(0), size, cudaMemcpyHostToDevice) != cudaSuccess)
+    if (cudaMemcpy(img_d_, batch_h, size, cudaMemcpyHostToDevice) != cudaSuccess)
     {
-        ROS_FATAL("INT8 calibrator: could not copy data to device, error: %u.", cudaGetLastError());
+        ROS_ERROR("INT8 calibrator: could not copy data to device, error: %u.", cudaGetLastError());
         return false;
     }
     bindings[0] = img_d_;
@@ -112,6 +155,12 @@ void Int8EntropyCalibrator::writeCalibrationCache(const void* cache, size_t leng
 void Int8EntropyCalibrator::setInputDims(nvinfer1::DimsCHW dims)
 {
     dims_ = dims;
+    namespace pp = redtail::preprocessing;
+    // Same preprocessing as createImagePreprocessor(w, h, BGR, 1, 0) but single-threaded
+    // as images are processed in parallel by the prefetcher.
+    preproc_ = std::make_unique<ImagePreprocessor>(dims_.w(), dims_.h(), pp::ChannelOrder::kBGR,
+                                                   pp::Interpolation::kCubic, 1, 0, 1);
+    prefetcher_.reset();
     // Free image device cache.
     if (img_d_ != nullptr)
         cudaFree(img_d_);
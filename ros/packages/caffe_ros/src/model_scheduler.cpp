@@ -0,0 +1,77 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/model_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace caffe_ros
+{
+
+int ModelScheduler::addModel(float max_rate_hz, int priority)
+{
+    assert(max_rate_hz >= 0);
+    Model m;
+    m.period   = max_rate_hz > 0 ? 1.0 / max_rate_hz : 0;
+    m.priority = priority;
+    models_.push_back(m);
+
+    order_.resize(models_.size());
+    for (size_t i = 0; i < order_.size(); i++)
+        order_[i] = (int)i;
+    std::stable_sort(order_.begin(), order_.end(),
+                     [this](int a, int b) { return models_[a].priority > models_[b].priority; });
+    return (int)models_.size() - 1;
+}
+
+float ModelScheduler::getMaxRate() const
+{
+    double min_period = -1;
+    for (const auto& m: models_)
+    {
+        if (m.period == 0)
+            return 0;
+        min_period = min_period < 0 ? m.period : std::min(min_period, m.period);
+    }
+    return min_period > 0 ? (float)(1.0 / min_period) : 0;
+}
+
+void ModelScheduler::getDue(double now, std::vector<int>& dst)
+{
+    dst.clear();
+    for (int i: order_)
+    {
+        auto& m = models_[i];
+        if (m.started && now < m.next_run)
+            m.stats.rate_skips++;
+        else
+            dst.push_back(i);
+    }
+}
+
+void ModelScheduler::onRun(int model, double now)
+{
+    auto& m = models_.at(model);
+    // Runs are kept on the period grid so the camera frame jitter does not lower the rate,
+    // the grid is moved when the model is late by more than half of the period (e.g. after a busy frame).
+    m.next_run = m.started ? std::max(m.next_run + m.period, now + 0.5 * m.period) : now + m.period;
+    m.started  = true;
+    m.stats.runs++;
+}
+
+void ModelScheduler::onBusy(int model)
+{
+    models_.at(model).stats.busy_skips++;
+}
+
+ModelScheduler::Stats ModelScheduler::getStats(int model, bool reset)
+{
+    auto& m   = models_.at(model);
+    auto  res = m.stats;
+    if (reset)
+        m.stats = Stats();
+    return res;
+}
+
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/network_backend.h"
+#include "caffe_ros/cpu_backend.h"
+#ifdef CAFFE_ROS_WITH_TENSORRT
+    #include "caffe_ros/tensorrt_backend.h"
+#endif
+
+#include <ros/ros.h>
+#include <boost/algorithm/string.hpp>
+#include "node_error.h"
+
+namespace caffe_ros
+{
+
+void NetworkBackend::createInt8Calibrator(const Int8CalibParams& params)
+{
+    ROS_WARN("INT8 calibration is not supported by %s backend.", getName().c_str());
+}
+
+std::unique_ptr<NetworkBackend> createNetworkBackend(ConstStr& name)
+{
+#ifdef CAFFE_ROS_WITH_TENSORRT
+    if (name.empty() || boost::iequals(name, "tensorrt"))
+        return std::make_unique<TensorRTBackend>();
+#else
+    if (boost::iequals(name, "tensorrt"))
+    {
+        redtail::throwNodeError("caffe_ros was built without TensorRT, use cpu backend instead.");
+    }
+#endif
+    if (name.empty() || boost::iequals(name, "cpu"))
+        return std::make_unique<CpuBackend>();
+
+    redtail::throwNodeError("Invalid backend: %s. Supported backends: tensorrt, cpu.", name.c_str());
+}
+
+DataType parseDataType(const std::string& src)
+{
+    if (boost::iequals(src, "FP32"))
+        return DataType::kFLOAT;
+    if (boost::iequals(src, "FP16"))
+        return DataType::kHALF;
+    if (boost::iequals(src, "INT8"))
+        return DataType::kINT8;
+    else
+    {
+        redtail::throwNodeError("Invalid data type: %s. Supported data types: FP32, FP16, INT8.", src.c_str());
+    }
+}
+
+std::string toString(DataType src)
+{
+    switch (src)
+    {
+    case DataType::kFLOAT:
+        return "FP32";
+    case DataType::kHALF:
+        return "FP16";
+    case DataType::kINT8:
+        return "INT8";
+    default:
+        return "<Unknown>";
+    }
+}
+
+}
@@ -0,0 +1,369 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <cstring>
+#include <boost/filesystem.hpp>
+#include <NvInfer.h>
+#include <NvCaffeParser.h>
+#include <cuda_runtime.h>
+#include "caffe_ros/engine_cache.h"
+#include "caffe_ros/tensorrt_backend.h"
+#include "node_error.h"
+
+namespace caffe_ros
+{
+
+using namespace nvinfer1;
+namespace fs = boost::filesystem;
+
+// Part of the cached engine key, must be changed when the builder settings
+// in profileModel change so the engines built with the old settings are not used.
+static const int kEngineBuildVersion = 1;
+
+TensorRTBackend::Logger   TensorRTBackend::s_log;
+TensorRTBackend::Profiler TensorRTBackend::s_profiler;
+
+static DimsCHW DimsToCHW(Dims dims)
+{
+    ROS_ASSERT(dims.nbDims == 3);
+    ROS_ASSERT(dims.type[0] == DimensionType::kCHANNEL);
+    ROS_ASSERT(dims.type[1] == DimensionType::kSPATIAL);
+    ROS_ASSERT(dims.type[2] == DimensionType::kSPATIAL);
+    return DimsCHW(dims.d[0], dims.d[1], dims.d[2]);
+}
+
+static BlobDims DimsToBlobDims(Dims dims)
+{
+    auto chw = DimsToCHW(dims);
+    BlobDims res;
+    res.c = chw.c();
+    res.h = chw.h();
+    res.w = chw.w();
+    return res;
+}
+
+void TensorRTBackend::Logger::log(Severity severity, const char *msg)
+{
+    if (severity != Severity::kINFO)
+        ROS_INFO("[TensorRT] %s", msg);
+}
+
+void TensorRTBackend::Profiler::reportLayerTime(const char *layerName, float ms)
+{
+    auto record = std::find_if(profile_.begin(), profile_.end(), [&](const Record &r) { return r.first == layerName; });
+    if (record == profile_.end())
+        profile_.push_back(std::make_pair(layerName, ms));
+    else
+        record->second = ms;
+}
+
+void TensorRTBackend::Profiler::printLayerTimes()
+{
+    float total_time = 0;
+    for (size_t i = 0; i < profile_.size(); i++)
+    {
+        //ROS_INFO("%-40.40s %4.3fms", profile_[i].first.c_str(), profile_[i].second);
+        total_time += profile_[i].second;
+    }
+    ROS_INFO("All layers  : %4.3f", total_time);
+}
+
+void TensorRTBackend::allocate(size_t in_size, size_t out_size, InferenceBuffers& bufs)
+{
+    // Pinned memory for the input to speed up the copy to the device.
+    size_t in_size_bytes = in_size * sizeof(float);
+    if (cudaHostAlloc(&bufs.in_h, in_size_bytes, cudaHostAllocDefault) != cudaSuccess ||
+        cudaMalloc(&bufs.in_d, in_size_bytes) != cudaSuccess)
+    {
+        redtail::throwNodeError("Could not allocate %zu bytes for the input, error: %u.", in_size_bytes, cudaGetLastError());
+    }
+    // Mapped memory for the outputs.
+    size_t out_size_bytes = out_size * sizeof(float);
+    if (cudaHostAlloc(&bufs.out_h, out_size_bytes, cudaHostAllocMapped) != cudaSuccess)
+    {
+        redtail::throwNodeError("Could not allocate %zu bytes for the output, error: %u.", out_size_bytes, cudaGetLastError());
+    }
+    if (cudaHostGetDevicePointer(&bufs.out_d, bufs.out_h, 0) != cudaSuccess)
+    {
+        redtail::throwNodeError("Could not get device pointer for the output, error: %u.", cudaGetLastError());
+    }
+}
+
+void TensorRTBackend::deallocate(InferenceBuffers& bufs)
+{
+    cudaError_t err = cudaSuccess;
+    if (bufs.in_d != nullptr && (err = cudaFree(bufs.in_d)) != cudaSuccess)
+        ROS_WARN("cudaFree returned %d", (int)err);
+    if (bufs.in_h != nullptr && (err = cudaFreeHost(bufs.in_h)) != cudaSuccess)
+        ROS_WARN("cudaFreeHost returned %d", (int)err);
+    if (bufs.out_h != nullptr && (err = cudaFreeHost(bufs.out_h)) != cudaSuccess)
+        ROS_WARN("cudaFreeHost returned %d", (int)err);
+    bufs = InferenceBuffers();
+}
+
+void TensorRTBackend::execute(InferenceBuffers& bufs)
+{
+    // Copy to the device.
+    size_t in_size_bytes = in_dims_.size() * sizeof(float);
+    if (cudaMemcpy(bufs.in_d, bufs.in_h, in_size_bytes, cudaMemcpyHostToDevice) != cudaSuccess)
+    {
+        redtail::throwNodeError("Could not copy data to device, error: %u.", cudaGetLastError());
+    }
+
+    void* bindings[] = {bufs.in_d, bufs.out_d};
+    if (!context_->execute(1, bindings))
+    {
+        redtail::throwNodeError("TensorRT inference failed.");
+    }
+    if (debug_mode_)
+        s_profiler.printLayerTimes();
+    // The engine writes to the mapped output buffer, caller buffer is not mapped so the output is copied once.
+    if (bufs.out_dst != nullptr)
+        std::memcpy(bufs.out_dst, bufs.out_h, out_dims_.size() * sizeof(float));
+    ROS_DEBUG("Forward out (first 3 values): [%.4f, %.4f, %.4f]", bufs.output()[0], bufs.output()[1], bufs.output()[2]);
+}
+
+IHostMemory* TensorRTBackend::profileModel(ConstStr& prototxt_path, ConstStr& model_path, caffe_ros::DataType data_type,
+                                           ConstStr& input_blob, ConstStr& output_blob)
+{
+    auto builder = createInferBuilder(s_log);
+    auto network = builder->createNetwork();
+
+    // Set TRT autotuner parameters.
+    builder->setMinFindIterations(3);
+    builder->setAverageFindIterations(2);
+
+    auto parser = nvcaffeparser1::createCaffeParser();
+
+    auto model_data_type = caffe_ros::DataType::kFLOAT;
+    // Check for FP16.
+    bool has_fast_FP16 = builder->platformHasFastFp16();
+    ROS_INFO("Hardware support of fast FP16: %s.", has_fast_FP16 ? "yes" : "no");
+    if (has_fast_FP16)
+    {
+        if (data_type == caffe_ros::DataType::kHALF)
+        {
+            model_data_type = caffe_ros::DataType::kHALF;
+            builder->setHalf2Mode(true);
+        }
+        else
+            ROS_INFO("... however, FP16 will not be used for this model.");
+    }
+    // Check for Int8.
+    bool has_fast_int8 = builder->platformHasFastInt8();
+    ROS_INFO("Hardware support of fast INT8: %s.", has_fast_int8 ? "yes" : "no");
+    if (has_fast_int8)
+    {
+        if (data_type == caffe_ros::DataType::kINT8)
+        {
+            ROS_ASSERT(int8_calib_ != nullptr);
+            model_data_type = caffe_ros::DataType::kINT8;
+            builder->setInt8Mode(true);
+            builder->setInt8Calibrator(int8_calib_.get());
+        }
+        else
+            ROS_INFO("... however, INT8 will not be used for this model.");
+    }
+
+    ROS_INFO("Using %s model data type.", toString(model_data_type).c_str());
+    // Note: for INT8 models parsing, data type must be set to FP32, see TRT docs.
+    auto blob_finder = parser->parse(prototxt_path.c_str(), model_path.c_str(), *network,
+                                     model_data_type == caffe_ros::DataType::kHALF ? nvinfer1::DataType::kHALF : nvinfer1::DataType::kFLOAT);
+    if (blob_finder == nullptr)
+    {
+        redtail::throwNodeError("Failed to parse network: %s, %s", prototxt_path.c_str(), model_path.c_str());
+    }
+    ROS_INFO("Loaded model from: %s, %s", prototxt_path.c_str(), model_path.c_str());
+
+    // Need to set input dimensions for INT8 calibrator.
+    if (data_type == caffe_ros::DataType::kINT8)
+    {
+        auto in_b = blob_finder->find(input_blob.c_str());
+        if (in_b == nullptr)
+        {
+            redtail::throwNodeError("Could not find input blob: %s", input_blob.c_str());
+        }
+        int8_calib_->setInputDims(DimsToCHW(in_b->getDimensions()));
+    }
+
+    // Find output blob and mark it as a network output.
+    auto out_b = blob_finder->find(output_blob.c_str());
+    if (out_b == nullptr)
+    {
+        redtail::throwNodeError("Could not find output blob: %s", output_blob.c_str());
+    }
+    network->markOutput(*out_b);
+
+    // Build model.
+    // REVIEW alexeyk: make configurable?
+    // Note: FP16 requires batch size to be even, TensorRT will switch automatically when building an engine.
+    builder->setMaxBatchSize(getMaxBatchSize(model_data_type));
+    builder->setMaxWorkspaceSize(16 * 1024 * 1024);
+
+    ROS_INFO("Building CUDA engine...");
+    auto engine = builder->buildCudaEngine(*network);
+    if (engine == nullptr)
+    {
+        redtail::throwNodeError("Failed to build CUDA engine.");
+    }
+
+    IHostMemory* model_ptr = engine->serialize();
+    ROS_ASSERT(model_ptr != nullptr);
+
+    ROS_INFO("Done building.");
+
+    // Cleanup.
+    network->destroy();
+    parser->destroy();
+    engine->destroy();
+    builder->destroy();
+
+    return model_ptr;
+}
+
+int TensorRTBackend::getMaxBatchSize(caffe_ros::DataType data_type) const
+{
+    bool calibrate = data_type == caffe_ros::DataType::kINT8 && !int8_calib_->getSource().empty();
+    return calibrate ? int8_calib_->getBatchSize() : 1;
+}
+
+std::string TensorRTBackend::getEngineKey(ConstStr& prototxt_path, ConstStr& model_path,
+                                          ConstStr& input_blob, ConstStr& output_blob,
+                                          caffe_ros::DataType data_type)
+{
+    // Everything the engine is built from: model files, build settings, calibration and runtime.
+    ContentHash hash;
+    std::string error;
+    if (!hash.updateFile(prototxt_path, error) || !hash.updateFile(model_path, error))
+    {
+        redtail::throwNodeError("Could not read the model: %s", error.c_str());
+    }
+    hash.update(input_blob);
+    hash.update(output_blob);
+    hash.update(toString(data_type));
+    // Engine built for calibration has larger max batch size and is not reused for inference.
+    hash.update(std::to_string(getMaxBatchSize(data_type)));
+    hash.update(std::to_string(kEngineBuildVersion));
+    hash.update(std::to_string(getInferLibVersion()));
+    int cuda_version = 0;
+    cudaRuntimeGetVersion(&cuda_version);
+    hash.update(std::to_string(cuda_version));
+    // Engines are specific to the GPU they were built on.
+    int            device = 0;
+    cudaDeviceProp props;
+    if (cudaGetDevice(&device) == cudaSuccess && cudaGetDeviceProperties(&props, device) == cudaSuccess)
+        hash.update(std::string(props.name) + " " + std::to_string(props.major) + "." + std::to_string(props.minor));
+    if (data_type == caffe_ros::DataType::kINT8)
+    {
+        ROS_ASSERT(int8_calib_ != nullptr);
+        // Calibration is keyed by its cache, the source is used only until the cache is written.
+        if (!hash.updateFile(int8_calib_->getCacheFile(), error))
+            hash.update(int8_calib_->getSource());
+    }
+    return hash.toString();
+}
+
+void TensorRTBackend::loadCachedEngine(ConstStr& prototxt_path, ConstStr& model_path,
+                                       ConstStr& input_blob, ConstStr& output_blob,
+                                       caffe_ros::DataType data_type)
+{
+    auto start = ros::WallTime::now();
+
+    EngineCache cache(engine_cache_dir_.empty() ? fs::path(model_path).parent_path().string() : engine_cache_dir_);
+    auto name = fs::path(model_path).stem().string();
+    auto path = cache.getPath(name, getEngineKey(prototxt_path, model_path, input_blob, output_blob, data_type));
+    auto key_ms = (ros::WallTime::now() - start).toSec() * 1000;
+
+    // Calibration source means the calibration is requested (see Int8EntropyCalibrator) so the engine is rebuilt.
+    bool calibrate = data_type == caffe_ros::DataType::kINT8 && !int8_calib_->getSource().empty();
+    if (!calibrate)
+    {
+        // The engine is deserialized directly from the mapped file.
+        MappedFile cached;
+        if (cache.load(path, cached))
+        {
+            engine_ = infer_->deserializeCudaEngine(cached.data(), cached.size(), nullptr);
+            if (engine_ != nullptr)
+            {
+                ROS_INFO("Engine cache hit : %s (%.1f MB, key %.1f ms, load %.1f ms)", path.c_str(),
+                         cached.size() / (1024.0 * 1024.0), key_ms, (ros::WallTime::now() - start).toSec() * 1000 - key_ms);
+                return;
+            }
+            ROS_WARN("Could not deserialize cached engine %s, it will be rebuilt.", path.c_str());
+            cache.remove(path);
+        }
+    }
+    ROS_INFO("Engine cache miss: %s (%s)", path.c_str(), calibrate ? "calibration requested" : "not found");
+
+    auto model = profileModel(prototxt_path, model_path, data_type, input_blob, output_blob);
+    // Calibration has written its cache which is a part of the key.
+    if (calibrate)
+        path = cache.getPath(name, getEngineKey(prototxt_path, model_path, input_blob, output_blob, data_type));
+    std::string error;
+    if (getMaxBatchSize(data_type) > 1)
+    {
+        // Calibration requests always rebuild, the batch 1 engine is built and cached on the next start.
+        ROS_INFO("Engine built for calibration batch size %d is not cached.", getMaxBatchSize(data_type));
+    }
+    else if (cache.store(path, model->data(), model->size(), error))
+    {
+        ROS_INFO("Saved engine to: %s (%.1f MB, built in %.1f s)", path.c_str(),
+                 model->size() / (1024.0 * 1024.0), (ros::WallTime::now() - start).toSec());
+    }
+    else
+        ROS_WARN("Could not save engine to the cache: %s", error.c_str());
+
+    engine_ = infer_->deserializeCudaEngine(model->data(), model->size(), nullptr);
+    model->destroy();
+}
+
+void TensorRTBackend::loadNetwork(ConstStr& prototxt_path, ConstStr& model_path,
+                                  ConstStr& input_blob, ConstStr& output_blob,
+                                  caffe_ros::DataType data_type, bool use_cached_model)
+{
+    infer_ = createInferRuntime(s_log);
+    if (infer_ == nullptr)
+    {
+        redtail::throwNodeError("Failed to create inference runtime.");
+    }
+
+    if (use_cached_model)
+        loadCachedEngine(prototxt_path, model_path, input_blob, output_blob, data_type);
+    else
+    {
+        auto model = profileModel(prototxt_path, model_path, data_type, input_blob, output_blob);
+        engine_    = infer_->deserializeCudaEngine(model->data(), model->size(), nullptr);
+        model->destroy();
+    }
+    if (engine_ == nullptr)
+    {
+        redtail::throwNodeError("Failed to deserialize engine.");
+    }
+
+    context_ = engine_->createExecutionContext();
+    if (context_ == nullptr)
+    {
+        redtail::throwNodeError("Failed to create execution context.");
+    }
+    ROS_INFO("Created CUDA engine and context.");
+
+    int iinp = engine_->getBindingIndex(input_blob.c_str());
+    in_dims_ = DimsToBlobDims(engine_->getBindingDimensions(iinp));
+    ROS_INFO("Input : (W:%4d, H:%4d, C:%4d).", in_dims_.w, in_dims_.h, in_dims_.c);
+
+    int iout  = engine_->getBindingIndex(output_blob.c_str());
+    out_dims_ = DimsToBlobDims(engine_->getBindingDimensions(iout));
+    ROS_INFO("Output: (W:%4d, H:%4d, C:%4d).", out_dims_.w, out_dims_.h, out_dims_.c);
+}
+
+void TensorRTBackend::createInt8Calibrator(const Int8CalibParams& params)
+{
+    ROS_ASSERT(!params.src.empty() || !params.cache.empty());
+
+    if (!params.src.empty())
+        ROS_INFO("INT8 calibration is requested. This may take some time.");
+
+    int8_calib_ = std::make_unique<Int8EntropyCalibrator>(params);
+}
+
+}
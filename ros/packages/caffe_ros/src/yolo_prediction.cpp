@@ -0,0 +1,569 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "caffe_ros/yolo_prediction.h"
+#include "cpu_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace caffe_ros
+{
+
+using namespace redtail::cpu;
+
+static const int kVecSize = sizeof(float4v) / sizeof(float);
+// Class scores of all cells are computed if at least 1 / kDenseRatio of the cells are candidates.
+static const int kDenseRatio = 8;
+
+static inline float sigmoid(float x)
+{
+    return 1 / (1 + std::exp(-x));
+}
+
+// Appends indices of values >= threshold, 4 values are compared at once
+// and most of the blocks have no candidates.
+static void findCandidates(const float* src, int size, float threshold, std::vector<int>& dst)
+{
+    const float4v thresh_v = float4v{} + threshold;
+    int i = 0;
+    for (; i + kVecSize <= size; i += kVecSize)
+    {
+        int4v mask = loadu(src + i) >= thresh_v;
+        if ((mask[0] | mask[1] | mask[2] | mask[3]) == 0)
+            continue;
+        for (int j = 0; j < kVecSize; j++)
+        {
+            if (mask[j] != 0)
+                dst.push_back(i + j);
+        }
+    }
+    for (; i < size; i++)
+    {
+        if (src[i] >= threshold)
+            dst.push_back(i);
+    }
+}
+
+// Returns max(src) and, if sum_exp is not null, sum(exp(src - max)).
+static float maxAndSumExp(const float* src, int size, float* sum_exp)
+{
+    float max_v = *std::max_element(src, src + size);
+    if (sum_exp == nullptr)
+        return max_v;
+    float4v sum_v = {};
+    int i = 0;
+    for (; i + kVecSize <= size; i += kVecSize)
+        sum_v += exp4(loadu(src + i) - max_v);
+    float sum = sum_v[0] + sum_v[1] + sum_v[2] + sum_v[3];
+    for (; i < size; i++)
+        sum += std::exp(src[i] - max_v);
+    *sum_exp = sum;
+    return max_v;
+}
+
+// Converts box center and size (in pixels) to a box clipped to the image.
+// Returns false if the clipped box is empty.
+static bool addBox(float x, float y, float w, float h, int label, float prob, int w_in, int h_in,
+                   std::vector<ObjectPrediction>& dst)
+{
+    // x,y is the center of the box, find top left corner.
+    x -= w / 2;
+    y -= h / 2;
+    // Make sure box coordinates are in the valid range.
+    x  = std::min(std::max(x, 0.0f), (float)w_in - 1);
+    y  = std::min(std::max(y, 0.0f), (float)h_in - 1);
+    w  = std::min(w, w_in - x);
+    h  = std::min(h, h_in - y);
+    ObjectPrediction cur;
+    cur.label = label;
+    cur.prob  = prob;
+    cur.x = (int)x;
+    cur.y = (int)y;
+    cur.w = (int)w;
+    cur.h = (int)h;
+    if (cur.w <= 0 || cur.h <= 0)
+        return false;
+    assert(0 <= cur.x && cur.x <  w_in);
+    assert(0 <= cur.y && cur.y <  h_in);
+    assert(cur.x + cur.w <= w_in);
+    assert(cur.y + cur.h <= h_in);
+    dst.push_back(cur);
+    return true;
+}
+
+bool parseYoloVersion(const std::string& name, YoloVersion& version)
+{
+    if (name == "v1" || name == "V1")
+        version = YoloVersion::V1;
+    else if (name == "v2" || name == "V2")
+        version = YoloVersion::V2;
+    else if (name == "v3" || name == "V3")
+        version = YoloVersion::V3;
+    else
+        return false;
+    return true;
+}
+
+bool YoloDecoder::init(const YoloParams& params, std::string& error)
+{
+    if (params.num_classes <= 0 || params.num_boxes <= 0)
+    {
+        error = "number of classes and boxes must be > 0";
+        return false;
+    }
+    if (params.grid_sizes.empty() ||
+        std::any_of(params.grid_sizes.begin(), params.grid_sizes.end(), [](int g) { return g <= 0; }))
+    {
+        error = "at least one grid size is required, grid sizes must be > 0";
+        return false;
+    }
+    if (params.version != YoloVersion::V3 && params.grid_sizes.size() != 1)
+    {
+        error = "only YOLOv3 supports multiple scales";
+        return false;
+    }
+    if (params.version != YoloVersion::V1)
+    {
+        if (params.anchors.size() != 2 * params.num_boxes * params.grid_sizes.size())
+        {
+            error = "expected " + std::to_string(2 * params.num_boxes * params.grid_sizes.size()) +
+                    " anchor values (width and height of each box at each scale), got " +
+                    std::to_string(params.anchors.size());
+            return false;
+        }
+        if (std::any_of(params.anchors.begin(), params.anchors.end(), [](float a) { return a <= 0; }))
+        {
+            error = "anchors must be > 0";
+            return false;
+        }
+    }
+    if (params.version == YoloVersion::V3 && (params.input_w <= 0 || params.input_h <= 0))
+    {
+        error = "network input size is required for YOLOv3";
+        return false;
+    }
+    params_ = params;
+    scores_.resize(params_.num_classes);
+    int max_grid = *std::max_element(params_.grid_sizes.begin(), params_.grid_sizes.end());
+    class_max_.resize((size_t)max_grid * max_grid);
+    class_sum_.resize(class_max_.size());
+    class_label_.resize(class_max_.size());
+    return true;
+}
+
+size_t YoloDecoder::getOutputSize() const
+{
+    const size_t num_b = params_.num_boxes;
+    const size_t num_c = params_.num_classes;
+    size_t res = 0;
+    for (int g: params_.grid_sizes)
+    {
+        if (params_.version == YoloVersion::V1)
+            res += (size_t)g * g * (num_b * 5 + num_c);
+        else
+            res += (size_t)g * g * num_b * (5 + num_c);
+    }
+    return res;
+}
+
+void YoloDecoder::decode(const float* output, int w_in, int h_in, float prob_threshold,
+                         std::vector<ObjectPrediction>& dst)
+{
+    assert(output != nullptr);
+    assert(w_in > 0);
+    assert(h_in > 0);
+    assert(0 < prob_threshold && prob_threshold <= 1);
+
+    if (params_.version == YoloVersion::V1)
+    {
+        decodeV1(output, w_in, h_in, prob_threshold, dst);
+        return;
+    }
+    const float* anchors = params_.anchors.data();
+    for (int g: params_.grid_sizes)
+    {
+        decodeScale(output, g, anchors, w_in, h_in, prob_threshold, dst);
+        output  += (size_t)g * g * params_.num_boxes * (5 + params_.num_classes);
+        anchors += 2 * params_.num_boxes;
+    }
+}
+
+void YoloDecoder::decodeV1(const float* predictions, int w_in, int h_in, float prob_threshold,
+                           std::vector<ObjectPrediction>& dst) const
+{
+    const int grid_size     = params_.grid_sizes[0];
+    const int num_lab       = params_.num_classes;
+    const int num_box       = params_.num_boxes;
+    const int num_box_coord = 4;
+
+    size_t icell = 0;
+    for (int row = 0; row < grid_size; row++)
+    {
+        for (int col = 0; col < grid_size; col++, icell++)
+        {
+            // Find a box with a max condidence prediction.
+            auto  cell_box_scores = predictions + grid_size * grid_size * num_lab + icell * num_box;
+            auto  it_box_max = std::max_element(cell_box_scores, cell_box_scores + num_box);
+            int   imax_box   = it_box_max - cell_box_scores;
+            float box_score  = *(it_box_max);
+            // Find max conditional class probability for the current cell.
+            auto cell_preds = predictions + icell * num_lab;
+            auto it_max = std::max_element(cell_preds, cell_preds + num_lab);
+            int  imax_p = it_max - cell_preds;
+            float max_p = *(it_max);
+            // Skip entries with conditional class probability below the threshold.
+            if (box_score * max_p < prob_threshold)
+                continue;
+            // Save box for the current cell.
+            auto cell_box_coords = predictions + grid_size * grid_size * (num_lab + num_box) + (icell * num_box + imax_box) * num_box_coord;
+            float x = (cell_box_coords[0] + col) / grid_size * w_in;
+            float y = (cell_box_coords[1] + row) / grid_size * h_in;
+            float w = std::max(cell_box_coords[2], 0.0f);
+            float h = std::max(cell_box_coords[3], 0.0f);
+            // Square the w/h as it was trained like that in YOLO.
+            w *= w * w_in;
+            h *= h * h_in;
+            addBox(x, y, w, h, imax_p, box_score * max_p, w_in, h_in, dst);
+        }
+    }
+}
+
+void YoloDecoder::computeClassScores(const float* scores, int plane, bool softmax)
+{
+    float* max_s = class_max_.data();
+    float* sum_e = class_sum_.data();
+    int*   label = class_label_.data();
+    const int num_c = params_.num_classes;
+    // Cells are processed 4 at once, class planes are contiguous.
+    int i = 0;
+    for (; i + kVecSize <= plane; i += kVecSize)
+    {
+        float4v max_v   = loadu(scores + i);
+        int4v   label_v = {};
+        for (int c = 1; c < num_c; c++)
+        {
+            float4v s_v    = loadu(scores + (size_t)c * plane + i);
+            int4v   is_max = s_v > max_v;
+            max_v   = is_max ? s_v : max_v;
+            label_v = is_max ? (int4v{} + c) : label_v;
+        }
+        storeu(max_s + i, max_v);
+        std::memcpy(label + i, &label_v, sizeof(label_v));
+        if (!softmax)
+            continue;
+        float4v sum_v = {};
+        for (int c = 0; c < num_c; c++)
+            sum_v += exp4(loadu(scores + (size_t)c * plane + i) - max_v);
+        storeu(sum_e + i, sum_v);
+    }
+    for (; i < plane; i++)
+    {
+        float max_v   = scores[i];
+        int   label_i = 0;
+        for (int c = 1; c < num_c; c++)
+        {
+            if (scores[(size_t)c * plane + i] > max_v)
+            {
+                max_v   = scores[(size_t)c * plane + i];
+                label_i = c;
+            }
+        }
+        max_s[i] = max_v;
+        label[i] = label_i;
+        if (!softmax)
+            continue;
+        float sum = 0;
+        for (int c = 0; c < num_c; c++)
+            sum += std::exp(scores[(size_t)c * plane + i] - max_v);
+        sum_e[i] = sum;
+    }
+}
+
+void YoloDecoder::decodeScale(const float* output, int grid, const float* anchors, int w_in, int h_in,
+                              float prob_threshold, std::vector<ObjectPrediction>& dst)
+{
+    const int  plane  = grid * grid;
+    const int  num_c  = params_.num_classes;
+    const bool is_v3  = params_.version == YoloVersion::V3;
+    // V2 anchors are in grid cells, V3 - in network input pixels.
+    const float anchor_scale_x = (float)w_in / (is_v3 ? params_.input_w : grid);
+    const float anchor_scale_y = (float)h_in / (is_v3 ? params_.input_h : grid);
+    // Class probability is <= 1 so boxes with objectness below the threshold are rejected
+    // before class scores are computed. Raw values are compared as
+    // sigmoid(x) >= t is the same as x >= log(t / (1 - t)).
+    const float obj_threshold = prob_threshold < 1 ? std::log(prob_threshold / (1 - prob_threshold))
+                                                   : std::numeric_limits<float>::infinity();
+
+    for (int b = 0; b < params_.num_boxes; b++)
+    {
+        const float* box = output + (size_t)b * (5 + num_c) * plane;
+        candidates_.clear();
+        findCandidates(box + 4 * (size_t)plane, plane, obj_threshold, candidates_);
+        if (candidates_.empty())
+            continue;
+        // With many candidates (low threshold) class scores of all cells are computed
+        // channel by channel, otherwise scores of each candidate are gathered.
+        bool dense = candidates_.size() * kDenseRatio >= (size_t)plane;
+        if (dense)
+            computeClassScores(box + 5 * (size_t)plane, plane, !is_v3);
+
+        for (int cell: candidates_)
+        {
+            float max_s;
+            float sum_exp = 1;
+            int   label;
+            if (dense)
+            {
+                max_s   = class_max_[cell];
+                sum_exp = class_sum_[cell];
+                label   = class_label_[cell];
+            }
+            else
+            {
+                for (int c = 0; c < num_c; c++)
+                    scores_[c] = box[(size_t)(5 + c) * plane + cell];
+                max_s = maxAndSumExp(scores_.data(), num_c, is_v3 ? nullptr : &sum_exp);
+                label = std::find(scores_.begin(), scores_.begin() + num_c, max_s) - scores_.begin();
+            }
+            // V3: independent sigmoid scores, V2: softmax, max probability is 1 / sum(exp(s - max)).
+            float class_p = is_v3 ? sigmoid(max_s) : 1 / sum_exp;
+            float prob    = sigmoid(box[4 * (size_t)plane + cell]) * class_p;
+            if (prob < prob_threshold)
+                continue;
+            int   row = cell / grid;
+            int   col = cell % grid;
+            float x = (col + sigmoid(box[cell])) / grid * w_in;
+            float y = (row + sigmoid(box[(size_t)plane + cell])) / grid * h_in;
+            float w = anchors[2 * b]     * std::exp(box[2 * (size_t)plane + cell]) * anchor_scale_x;
+            float h = anchors[2 * b + 1] * std::exp(box[3 * (size_t)plane + cell]) * anchor_scale_y;
+            addBox(x, y, w, h, label, prob, w_in, h_in, dst);
+        }
+    }
+}
+
+// Grid size is limited so the index is small even for very small boxes.
+static const int kMaxNmsGrid = 64;
+
+static float computeIou(const ObjectPrediction& a, const ObjectPrediction& b)
+{
+    int wi = std::min(a.x + a.w, b.x + b.w) - std::max(a.x, b.x);
+    int hi = std::min(a.y + a.h, b.y + b.h) - std::max(a.y, b.y);
+    if (wi <= 0 || hi <= 0)
+        return 0;
+    float b_intersect = (float)wi * hi;
+    return b_intersect / ((float)a.w * a.h + (float)b.w * b.h - b_intersect);
+}
+
+void NonMaxSuppression::buildGrid(const std::vector<ObjectPrediction>& src, size_t begin, size_t end)
+{
+    int    x1 = std::numeric_limits<int>::min();
+    int    y1 = x1;
+    double sum_w = 0;
+    double sum_h = 0;
+    x0_ = y0_ = std::numeric_limits<int>::max();
+    for (size_t i = begin; i < end; i++)
+    {
+        const auto& b = src[order_[i]];
+        x0_ = std::min(x0_, b.x);
+        y0_ = std::min(y0_, b.y);
+        x1  = std::max(x1, b.x + b.w);
+        y1  = std::max(y1, b.y + b.h);
+        sum_w += b.w;
+        sum_h += b.h;
+    }
+    // Cells are about the average box size so each box overlaps only a few cells.
+    int ext_w = std::max(x1 - x0_, 1);
+    int ext_h = std::max(y1 - y0_, 1);
+    cell_w_ = std::max((int)(sum_w / (end - begin)), 1);
+    cell_h_ = std::max((int)(sum_h / (end - begin)), 1);
+    grid_w_ = std::min((ext_w + cell_w_ - 1) / cell_w_, kMaxNmsGrid);
+    grid_h_ = std::min((ext_h + cell_h_ - 1) / cell_h_, kMaxNmsGrid);
+    // Sparse boxes: cells are enlarged so there are at most ~4 cells per box.
+    while ((size_t)grid_w_ * grid_h_ > 4 * (end - begin) && (grid_w_ > 1 || grid_h_ > 1))
+    {
+        grid_w_ = (grid_w_ + 1) / 2;
+        grid_h_ = (grid_h_ + 1) / 2;
+    }
+    cell_w_ = (ext_w + grid_w_ - 1) / grid_w_;
+    cell_h_ = (ext_h + grid_h_ - 1) / grid_h_;
+    cell_heads_.assign((size_t)grid_w_ * grid_h_, -1);
+    nodes_.clear();
+}
+
+void NonMaxSuppression::getCells(const ObjectPrediction& box, int& cx0, int& cy0, int& cx1, int& cy1) const
+{
+    cx0 = std::min(std::max((box.x - x0_) / cell_w_, 0), grid_w_ - 1);
+    cy0 = std::min(std::max((box.y - y0_) / cell_h_, 0), grid_h_ - 1);
+    cx1 = std::min(std::max((box.x + std::max(box.w, 1) - 1 - x0_) / cell_w_, cx0), grid_w_ - 1);
+    cy1 = std::min(std::max((box.y + std::max(box.h, 1) - 1 - y0_) / cell_h_, cy0), grid_h_ - 1);
+}
+
+template<typename Fn>
+void NonMaxSuppression::forEachNeighbour(const ObjectPrediction& box, Fn fn)
+{
+    int cx0, cy0, cx1, cy1;
+    getCells(box, cx0, cy0, cx1, cy1);
+    query_++;
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            for (int n = cell_heads_[cy * grid_w_ + cx]; n >= 0; n = nodes_[n].next)
+            {
+                int j = nodes_[n].box;
+                if (visited_[j] == query_)
+                    continue;
+                visited_[j] = query_;
+                if (!fn(j))
+                    return;
+            }
+        }
+    }
+}
+
+void NonMaxSuppression::keep(const std::vector<ObjectPrediction>& src, int ibox)
+{
+    kept_idx_[ibox] = num_kept_++;
+    int cx0, cy0, cx1, cy1;
+    getCells(src[ibox], cx0, cy0, cx1, cy1);
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            int& head = cell_heads_[cy * grid_w_ + cx];
+            nodes_.push_back(Node{ibox, head});
+            head = (int)nodes_.size() - 1;
+        }
+    }
+}
+
+void NonMaxSuppression::applyHard(const std::vector<ObjectPrediction>& src, const NmsParams& params,
+                                  size_t begin, size_t end)
+{
+    // Greedy NMS: a box is kept if it does not overlap any of the kept boxes with higher scores.
+    for (size_t k = begin; k < end; k++)
+    {
+        int i = order_[k];
+        if (scores_[i] < params.min_score)
+            break;
+        bool suppressed = false;
+        forEachNeighbour(src[i], [&](int j)
+            {
+                suppressed = computeIou(src[i], src[j]) > params.iou_threshold;
+                return !suppressed;
+            });
+        if (!suppressed)
+            keep(src, i);
+    }
+}
+
+void NonMaxSuppression::applySoft(const std::vector<ObjectPrediction>& src, const NmsParams& params,
+                                  size_t begin, size_t end)
+{
+    // Soft-NMS: the box with the max score is kept and scores of the remaining boxes are decayed.
+    // Scores only decrease so they are updated lazily: a box taken from the heap is
+    // kept only if all kept boxes have been applied to its score, otherwise it is updated
+    // and pushed back. Decay factors are multiplied so the order of the updates does not matter.
+    auto heap_less = [](const std::pair<float, int>& a, const std::pair<float, int>& b)
+        {
+            return a.first < b.first || (a.first == b.first && a.second > b.second);
+        };
+    heap_.clear();
+    for (size_t k = begin; k < end; k++)
+    {
+        int i = order_[k];
+        version_[i] = num_kept_;
+        if (scores_[i] >= params.min_score)
+            heap_.emplace_back(scores_[i], i);
+    }
+    std::make_heap(heap_.begin(), heap_.end(), heap_less);
+    while (!heap_.empty())
+    {
+        std::pop_heap(heap_.begin(), heap_.end(), heap_less);
+        int i = heap_.back().second;
+        heap_.pop_back();
+        if (version_[i] == num_kept_)
+        {
+            keep(src, i);
+            continue;
+        }
+        forEachNeighbour(src[i], [&](int j)
+            {
+                if (kept_idx_[j] >= version_[i])
+                {
+                    float iou = computeIou(src[i], src[j]);
+                    scores_[i] *= std::exp(-iou * iou / params.soft_sigma);
+                }
+                return true;
+            });
+        version_[i] = num_kept_;
+        if (scores_[i] >= params.min_score)
+        {
+            heap_.emplace_back(scores_[i], i);
+            std::push_heap(heap_.begin(), heap_.end(), heap_less);
+        }
+    }
+}
+
+void NonMaxSuppression::apply(const std::vector<ObjectPrediction>& src, const NmsParams& params,
+                              std::vector<ObjectPrediction>& dst)
+{
+    assert(0 < params.iou_threshold && params.iou_threshold <= 1);
+    assert(params.soft_sigma > 0);
+
+    dst.clear();
+    const int num_boxes = (int)src.size();
+    if (num_boxes == 0)
+        return;
+    scores_.resize(num_boxes);
+    for (int i = 0; i < num_boxes; i++)
+        scores_[i] = src[i].prob;
+    kept_idx_.assign(num_boxes, -1);
+    num_kept_ = 0;
+    version_.resize(num_boxes);
+    visited_.assign(num_boxes, 0);
+    query_ = 0;
+
+    // Boxes are sorted by class (unless class agnostic) and score, each class
+    // is processed separately with its own grid. Class and score are packed
+    // into a single key: bits of non-negative floats have the same order as the values.
+    sort_keys_.resize(num_boxes);
+    for (int i = 0; i < num_boxes; i++)
+    {
+        assert(scores_[i] >= 0);
+        uint32_t score_bits;
+        std::memcpy(&score_bits, &scores_[i], sizeof(score_bits));
+        uint64_t label = params.class_agnostic ? 0 : (uint32_t)src[i].label;
+        sort_keys_[i] = std::make_pair((label << 32) | ~score_bits, i);
+    }
+    std::sort(sort_keys_.begin(), sort_keys_.end());
+    order_.resize(num_boxes);
+    for (int i = 0; i < num_boxes; i++)
+        order_[i] = sort_keys_[i].second;
+    for (size_t begin = 0; begin < order_.size();)
+    {
+        size_t end = begin + 1;
+        while (end < order_.size() && (sort_keys_[end].first >> 32) == (sort_keys_[begin].first >> 32))
+            end++;
+        buildGrid(src, begin, end);
+        if (params.soft)
+            applySoft(src, params, begin, end);
+        else
+            applyHard(src, params, begin, end);
+        begin = end;
+    }
+
+    for (int i = 0; i < num_boxes; i++)
+    {
+        if (kept_idx_[i] < 0)
+            continue;
+        dst.push_back(src[i]);
+        dst.back().prob = scores_[i];
+    }
+}
+
+}
@@ -448,6 +448,66 @@ TEST(CaffeRosTests, YoloNetPredictionsFP16)
     }
 }
 
+TEST(CaffeRosTests, MultiModelPredictions)
+{
+    // TrailNet and YOLO are hosted by one node and share the camera subscription.
+    ros::NodeHandle nh("~");
+    std::string test_data_dir;
+    nh.param<std::string>("test_data_dir", test_data_dir, "");
+    ASSERT_TRUE(fs::exists(test_data_dir));
+
+    CaffeRosTestsCallback trail;
+    CaffeRosTestsCallback yolo;
+    auto trail_sub = nh.subscribe<sensor_msgs::Image>("/multi/dnn/trailnet/network/output", 1,
+                                                      &CaffeRosTestsCallback::dnnCallback, &trail);
+    auto yolo_sub  = nh.subscribe<sensor_msgs::Image>("/multi/dnn/yolo/network/output", 1,
+                                                      &CaffeRosTestsCallback::dnnCallback, &yolo);
+    const char* camera_topic = "/multi/camera/image_raw";
+    auto img_pub = nh.advertise<sensor_msgs::Image>(camera_topic, 1);
+
+    fs::path data_dir{test_data_dir};
+
+    // Both models process the same frames, each image is checked against the model it is meant for.
+    auto trail_msg = readImage((data_dir / "rot_l.jpg").string());
+    trail_msg->header.stamp.nsec = 1;
+    auto yolo_msg  = readImage((data_dir / "yolo_2_obj.png").string());
+    yolo_msg->header.stamp.nsec  = 2;
+
+    ros::Rate rate(1000);
+    while (ros::ok() && (trail.dnn_out_ == nullptr || trail.dnn_out_->header.stamp.nsec != 1))
+    {
+        img_pub.publish(trail_msg);
+        ros::spinOnce();
+        rate.sleep();
+    }
+    ASSERT_TRUE(trail.dnn_out_ != nullptr);
+    EXPECT_EQ(trail.dnn_out_->encoding, "32FC6");
+    float trail_pred[] = {0.932, 0.060, 0.006, 0.080, 0.848, 0.071};
+    auto trail_data = reinterpret_cast<const float*>(trail.dnn_out_->data.data());
+    for (int col = 0; col < 6; col++)
+        EXPECT_NEAR(trail_data[col], trail_pred[col], 0.001f) << "Values are not equal at " << col;
+
+    while (ros::ok() && (yolo.dnn_out_ == nullptr || yolo.dnn_out_->header.stamp.nsec != 2))
+    {
+        img_pub.publish(yolo_msg);
+        ros::spinOnce();
+        rate.sleep();
+    }
+    ASSERT_TRUE(yolo.dnn_out_ != nullptr);
+    auto dnn_out = *yolo.dnn_out_;
+    EXPECT_EQ(dnn_out.width,  6);
+    EXPECT_EQ(dnn_out.height, 2);
+    EXPECT_EQ(dnn_out.encoding,  "32FC1");
+    float yolo_pred[][6] = {{14, 0.290, 184, 128,  72, 158},
+                            {14, 0.660, 529,  84, 105, 239}};
+    auto data = reinterpret_cast<const float*>(dnn_out.data.data());
+    for (size_t row = 0; row < std::min(dnn_out.height, 2u); row++)
+    {
+        for (size_t col = 0; col < 6; col++)
+            EXPECT_NEAR(data[row * 6 + col], yolo_pred[row][col], 0.001f) << "Values are not equal at (" << row << ", " << col <<")";
+    }
+}
+
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "CaffeRosTests");
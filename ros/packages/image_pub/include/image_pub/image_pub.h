@@ -0,0 +1,19 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef IMAGE_PUB_IMAGE_PUB_H
+#define IMAGE_PUB_IMAGE_PUB_H
+
+#include <ros/ros.h>
+
+#include "stop_signal.h"
+
+namespace image_pub
+{
+// Publishes frames of the video file or image sequence until stop is signalled
+// or the source ends (unless repeat is set). nh is the private node handle used
+// for parameters and topics. Shared by the standalone node and the nodelet.
+void run(ros::NodeHandle& nh, const redtail::StopSignal& stop);
+}
+
+#endif
@@ -0,0 +1,21 @@
+// Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <pluginlib/class_list_macros.h>
+
+#include "image_pub/image_pub.h"
+#include "loop_nodelet.h"
+
+namespace image_pub
+{
+class ImagePubNodelet : public redtail::LoopNodelet
+{
+public:
+    ImagePubNodelet():
+        LoopNodelet(&image_pub::run)
+    {
+    }
+};
+}
+
+PLUGINLIB_EXPORT_CLASS(image_pub::ImagePubNodelet, nodelet::Nodelet)
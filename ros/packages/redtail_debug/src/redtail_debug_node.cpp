@@ -11,13 +11,13 @@
 
 //#include <opencv2/opencv.hpp>
 
-static sensor_msgs::Image::ConstPtr dnn_msg;
+#include "event_executor.h"
 
-void dnnCallback(const sensor_msgs::Image::ConstPtr& msg)
+using DnnInput = redtail::executor::LatestInput<sensor_msgs::Image::ConstPtr>;
+
+void dnnCallback(const sensor_msgs::Image::ConstPtr& msg, DnnInput* input)
 {
-    if (dnn_msg != nullptr)
-        return;
-    dnn_msg = msg;
+    input->post(msg);
 }
 
 int main(int argc, char **argv)
@@ -35,18 +35,27 @@ int main(int argc, char **argv)
     ROS_INFO("Topic : %s", caffe_ros_topic.c_str());
     ROS_INFO("Rate  : %.1f", pub_rate);
 
+    // DNN output is processed as soon as it arrives, pub_rate is only a ceiling.
+    redtail::executor::EventExecutor::Params exec_params;
+    exec_params.max_rate_hz = pub_rate;
+    redtail::executor::EventExecutor executor(exec_params);
+    DnnInput dnn_input(executor);
+
     const int queue_size = 10;
     ros::Subscriber dnn_sub;
-    dnn_sub = nh.subscribe<sensor_msgs::Image>(caffe_ros_topic, queue_size, dnnCallback);
+    dnn_sub = nh.subscribe<sensor_msgs::Image>(caffe_ros_topic, queue_size, boost::bind(dnnCallback, _1, &dnn_input));
 
     ros::Publisher  debug_output_pub;
     debug_output_pub = nh.advertise<geometry_msgs::PoseStamped>("network/output_debug", queue_size);
 
-    ros::Rate rate(pub_rate);
-    while (ros::ok())
-    {
-        if (dnn_msg != nullptr)
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+    executor.run([&]
         {
+            sensor_msgs::Image::ConstPtr dnn_msg;
+            if (!dnn_input.take(dnn_msg))
+                return;
+
             auto pose_msg = boost::make_shared<geometry_msgs::PoseStamped>();
             pose_msg->header = dnn_msg->header;
 
@@ -72,12 +81,9 @@ int main(int argc, char **argv)
                 pose_msg->pose.position.y = probs[3] - probs[5];
 
             debug_output_pub.publish(pose_msg);
-            dnn_msg = nullptr;
-        }
-
-        ros::spinOnce();
-        rate.sleep();
-    }
+        },
+        [] { return ros::ok(); });
+    spinner.stop();
 
     return 0;
 }
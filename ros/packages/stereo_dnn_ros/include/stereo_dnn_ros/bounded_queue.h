@@ -0,0 +1,147 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_BOUNDED_QUEUE_H
+#define STEREO_DNN_ROS_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace stereo_dnn_ros
+{
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's algorithm).
+// Each cell has a sequence number which tells producers and consumers whether
+// the cell is ready to be written or read, so the only contention point
+// is CAS on enqueue/dequeue position.
+// push() implements drop-oldest policy: if the queue is full, the oldest
+// element is removed so the consumer always gets the most recent data.
+template<typename T>
+class BoundedQueue
+{
+public:
+    // Capacity is rounded up to the power of 2 (at least 2).
+    explicit BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mask_  = size - 1;
+        cells_ = std::unique_ptr<Cell[]>(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false if the queue is full, value is not modified in such case.
+    bool tryPush(T& value)
+    {
+        Cell*  cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            size_t   seq  = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+        cell->data = std::move(value);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty.
+    bool tryPop(T& value)
+    {
+        Cell*  cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            size_t   seq  = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->data);
+        // Release the reference held by the cell (e.g. image message) right away.
+        cell->data = T();
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pushes the value dropping the oldest elements if the queue is full.
+    // Returns the number of dropped elements.
+    size_t push(T value)
+    {
+        size_t dropped = 0;
+        while (!tryPush(value))
+        {
+            T oldest;
+            if (tryPop(oldest))
+                dropped++;
+        }
+        return dropped;
+    }
+
+    // Number of elements which can be popped right now: published cells from the head
+    // of the queue. Cells reserved by a producer which has not finished writing are not
+    // counted so a consumer waiting for size() > 0 never spins on tryPop() failures.
+    // Exact only when there are no concurrent operations.
+    size_t size() const
+    {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t res = 0;
+        while (res < capacity() && cells_[(pos + res) & mask_].seq.load(std::memory_order_acquire) == pos + res + 1)
+            res++;
+        return res;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    // Cache line padding to avoid false sharing between producers and consumers.
+    static constexpr size_t kCacheLine = 64;
+    using Pad = char[kCacheLine];
+
+    Pad                     pad0_;
+    std::unique_ptr<Cell[]> cells_;
+    size_t                  mask_;
+    Pad                     pad1_;
+    std::atomic<size_t>     enqueue_pos_;
+    Pad                     pad2_;
+    std::atomic<size_t>     dequeue_pos_;
+    Pad                     pad3_;
+};
+
+}
+
+#endif
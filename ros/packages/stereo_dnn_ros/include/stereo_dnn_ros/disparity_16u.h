@@ -0,0 +1,16 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_DISPARITY_16U_H
+#define STEREO_DNN_ROS_DISPARITY_16U_H
+
+namespace stereo_dnn_ros
+{
+
+// Compact disparity output (16UC1 encoding): fixed point disparity
+// in 1/256 pixel units (same as KITTI), 0 means invalid disparity.
+constexpr float kDisparity16UScale = 256;
+
+}
+
+#endif
@@ -0,0 +1,30 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_DISPARITY_KERNELS_H
+#define STEREO_DNN_ROS_DISPARITY_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cuda_runtime_api.h>
+
+#include "stereo_dnn_ros/disparity_16u.h"
+
+namespace stereo_dnn_ros
+{
+
+// Converts h x w FP32 disparity (device memory) to 16-bit fixed point:
+// dst = round(src * scale) saturated to 65535, negative and NaN values are set to 0 (invalid).
+// dst_pitch is dst row size in bytes.
+cudaError_t convertDisparityTo16U(const float* src, int h, int w, float scale,
+                                  uint16_t* dst, size_t dst_pitch, cudaStream_t stream);
+
+// Computes h x w right view disparity (winner-takes-all) over d x h x w cost volume
+// (both in device memory), see LeftRightConsistency. is_cost is true if lower value
+// in the cost volume means better match.
+cudaError_t computeRightDisparityWTA(const float* cost_vol, int d, int h, int w, bool is_cost,
+                                     float* disp_r, cudaStream_t stream);
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_LR_CONSISTENCY_H
+#define STEREO_DNN_ROS_LR_CONSISTENCY_H
+
+#include <cuda_runtime_api.h>
+#include <opencv2/opencv.hpp>
+
+namespace stereo_dnn_ros
+{
+
+// Left-right (LR) consistency check which uses network cost volume
+// to get right view disparity so no additional network pass is required.
+// Cost volume is a DxHxW tensor where C[d][y][x] is the matching score of
+// left pixel (x, y) and right pixel (x - d, y). Right view disparity
+// of right pixel xr is then computed over C[d][y][xr + d] (index flip).
+// Right view disparity is computed on the GPU next to the cost volume
+// so only h x w right disparities are copied to host, not the whole volume.
+class LeftRightConsistency
+{
+public:
+    // is_cost is true if lower value in the cost volume means better match
+    // (softargmin networks), false otherwise (correlation, softargmax networks).
+    // threshold is the max allowed LR disparity difference in cost volume pixels.
+    LeftRightConsistency(bool is_cost, float threshold);
+
+    // Computes right view disparity (winner-takes-all) over the cost volume.
+    // cost_vol and disp_r (h x w) are in device memory.
+    cudaError_t computeRightDisparity(const float* cost_vol, int d, int h, int w, float* disp_r,
+                                      cudaStream_t stream) const;
+
+    // Masks inconsistent and occluded pixels of left disparity with invalid_val.
+    // disp_r is right view disparity (host memory) computed by computeRightDisparity.
+    // disp_l is full resolution left disparity, either CV_32FC1 in pixels or CV_16UC1
+    // fixed point (see disparity_16u.h), invalid_val is in pixels. disp_r may have lower
+    // spatial resolution (e.g. in ResNet18_2D), roi is the area of disp_l
+    // that corresponds to disp_r.
+    void apply(const float* disp_r, int h, int w, cv::Mat& disp_l, const cv::Rect& roi, float invalid_val = 0) const;
+
+private:
+    bool  is_cost_;
+    float threshold_;
+};
+}
+
+#endif
@@ -0,0 +1,107 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_MODEL_SWITCHER_H
+#define STEREO_DNN_ROS_MODEL_SWITCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace stereo_dnn_ros
+{
+
+// Latency-budgeted model selection. Models are ordered from the most accurate
+// (preferred) to the fastest. Per-frame latency of the active model is smoothed
+// with exponential moving average (EMA) and compared to the budget:
+// - if the active model is over budget for down_frames frames in a row, the switcher
+//   moves to the most accurate model predicted to fit the budget (or the fastest one).
+// - if a more accurate model is predicted to fit up_ratio * budget for up_frames
+//   frames in a row, the switcher moves back to it.
+// Latency of inactive models is predicted from their baseline latency scaled by
+// the current slowdown (e.g. due to thermal throttling) of the active model,
+// that is active EMA / active baseline. Baseline is the lowest EMA seen so far
+// and should be initialized with setBaseline (e.g. by warm-up runs).
+// Different thresholds and frame counts provide hysteresis so the switcher
+// does not oscillate between the models.
+// update() is expected to be called from one (inference) thread, getActive()
+// and getStats() can be called from any thread.
+class ModelSwitcher
+{
+public:
+    struct Params
+    {
+        // Per-frame latency budget in milliseconds.
+        float budget_ms   = 50;
+        // Number of consecutive over budget frames before switching to a faster model.
+        int   down_frames = 5;
+        // A more accurate model is selected when its predicted latency is below up_ratio * budget...
+        float up_ratio    = 0.8f;
+        // ...for up_frames consecutive frames.
+        int   up_frames   = 30;
+        // Weight of the new sample in latency EMA.
+        float ema_alpha   = 0.2f;
+    };
+
+    // Per-model statistics since the last reset.
+    struct ModelStats
+    {
+        // Number of frames processed and their average latency.
+        uint64_t frames     = 0;
+        float    avg_ms     = 0;
+        // Wall time during which the model was active.
+        double   active_sec = 0;
+        // Number of switches to this model.
+        uint64_t switches   = 0;
+    };
+
+    ModelSwitcher(int num_models, const Params& params);
+
+    ModelSwitcher(const ModelSwitcher&) = delete;
+    ModelSwitcher& operator=(const ModelSwitcher&) = delete;
+
+    // Sets baseline (unthrottled) latency of the model, should be called before update().
+    void setBaseline(int model, float latency_ms);
+
+    // Index of the model that should process the next frame.
+    int getActive() const { return active_.load(); }
+
+    // Reports latency of the frame processed by the model (frames processed by
+    // a model which is no longer active are counted but do not affect switching).
+    // Returns true if the active model has changed.
+    bool update(int model, float latency_ms);
+
+    // Predicted latency of the model at the current slowdown, should be called from the update() thread.
+    float predictLatency(int model) const;
+
+    std::vector<ModelStats> getStats(bool reset);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // The most accurate model with predicted latency below the threshold, the fastest model if none.
+    int selectModel(float threshold_ms) const;
+    void switchTo(int model, Clock::time_point now);
+
+private:
+    int    num_models_;
+    Params params_;
+
+    std::atomic<int> active_{0};
+    int over_count_ = 0;
+    int up_count_   = 0;
+
+    std::vector<float> ema_ms_;
+    std::vector<float> base_ms_;
+
+    mutable std::mutex mutex_;
+    std::vector<ModelStats> stats_;
+    std::vector<double>     total_ms_;
+    Clock::time_point       active_since_;
+};
+
+}
+
+#endif
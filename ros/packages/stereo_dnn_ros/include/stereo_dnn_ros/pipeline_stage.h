@@ -0,0 +1,162 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_PIPELINE_STAGE_H
+#define STEREO_DNN_ROS_PIPELINE_STAGE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "stereo_dnn_ros/bounded_queue.h"
+
+namespace stereo_dnn_ros
+{
+
+// Statistics of the pipeline stage since the last reset.
+struct PipelineStageStats
+{
+    uint64_t processed   = 0;
+    // Number of items dropped from the stage input queue because the stage was too slow.
+    uint64_t dropped     = 0;
+    float    avg_ms      = 0;
+    float    max_ms      = 0;
+    size_t   queue_depth = 0;
+    size_t   queue_size  = 0;
+};
+
+// Pipeline stage: a worker thread which takes items from the bounded input
+// queue (drop-oldest policy) and processes them. Stages are connected by
+// pushing the results to the next stage from the processing function,
+// so each stage runs concurrently with the others and pipeline throughput
+// is defined by the slowest stage.
+// If the processing function throws, the stage stops processing and passes
+// the exception to the error function which is called on the stage thread.
+template<typename T>
+class PipelineStage
+{
+public:
+    using Func      = std::function<void(T&)>;
+    using ErrorFunc = std::function<void(std::exception_ptr)>;
+
+    PipelineStage(const std::string& name, size_t queue_size, Func func, ErrorFunc on_error)
+        : name_(name), func_(func), on_error_(on_error), queue_(queue_size)
+    {
+    }
+
+    ~PipelineStage()
+    {
+        stop();
+    }
+
+    PipelineStage(const PipelineStage&) = delete;
+    PipelineStage& operator=(const PipelineStage&) = delete;
+
+    void start()
+    {
+        stop_ = false;
+        thread_ = std::thread(&PipelineStage::run, this);
+    }
+
+    void stop()
+    {
+        if (!thread_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            stop_ = true;
+        }
+        wait_cv_.notify_one();
+        thread_.join();
+    }
+
+    // Adds the item to the stage input queue, the oldest item is dropped if the queue is full.
+    void push(T item)
+    {
+        dropped_ += queue_.push(std::move(item));
+        // The mutex is used only to wake up the worker, the queue itself is lock-free.
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+        }
+        wait_cv_.notify_one();
+    }
+
+    PipelineStageStats getStats(bool reset)
+    {
+        PipelineStageStats res;
+        res.processed   = reset ? processed_.exchange(0)  : processed_.load();
+        res.dropped     = reset ? dropped_.exchange(0)    : dropped_.load();
+        uint64_t total  = reset ? total_us_.exchange(0)   : total_us_.load();
+        uint64_t max_us = reset ? max_us_.exchange(0)     : max_us_.load();
+        res.avg_ms      = res.processed > 0 ? total / 1000.0f / res.processed : 0;
+        res.max_ms      = max_us / 1000.0f;
+        res.queue_depth = queue_.size();
+        res.queue_size  = queue_.capacity();
+        return res;
+    }
+
+    const std::string& getName() const { return name_; }
+
+private:
+    void run()
+    {
+        while (true)
+        {
+            T item;
+            if (!queue_.tryPop(item))
+            {
+                std::unique_lock<std::mutex> lock(wait_mutex_);
+                wait_cv_.wait(lock, [this] { return stop_ || queue_.size() > 0; });
+                if (stop_)
+                    break;
+                continue;
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            try
+            {
+                func_(item);
+            }
+            catch (...)
+            {
+                // Items pushed after the failure are dropped by the queue.
+                on_error_(std::current_exception());
+                break;
+            }
+            auto end   = std::chrono::high_resolution_clock::now();
+            uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            processed_++;
+            total_us_ += elapsed_us;
+            uint64_t max_us = max_us_.load();
+            while (elapsed_us > max_us && !max_us_.compare_exchange_weak(max_us, elapsed_us))
+                ;
+        }
+    }
+
+private:
+    std::string     name_;
+    Func            func_;
+    ErrorFunc       on_error_;
+    BoundedQueue<T> queue_;
+
+    std::thread             thread_;
+    std::mutex              wait_mutex_;
+    std::condition_variable wait_cv_;
+    bool                    stop_ = false;
+
+    std::atomic<uint64_t> processed_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> total_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+};
+
+}
+
+#endif
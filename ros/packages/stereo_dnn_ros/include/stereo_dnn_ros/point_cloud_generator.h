@@ -0,0 +1,88 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_POINT_CLOUD_GENERATOR_H
+#define STEREO_DNN_ROS_POINT_CLOUD_GENERATOR_H
+
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/Header.h>
+
+#include "message_pool.h"
+
+namespace stereo_dnn_ros
+{
+
+// Reprojects disparity to 3D points (the same as cv::reprojectImageTo3D with Q matrix
+// of the rectified stereo pair) and writes them directly to PointCloud2 message.
+// The cloud is organized (one point per, possibly decimated, disparity pixel),
+// points are x, y, z floats in the left camera optical frame, in meters,
+// with 16 bytes per point (PCL PointXYZ layout). Invalid points are NaN.
+// Rows are processed in parallel, 4 pixels at a time.
+// Messages are taken from a pool so the point buffers are reused once subscribers release them.
+class PointCloudGenerator
+{
+public:
+    struct Params
+    {
+        // Use every decimation-th pixel in both dimensions.
+        int   decimation     = 1;
+        // Points with depth (z) outside of [min_range, max_range] are invalid.
+        float min_range      = 0;
+        float max_range      = 100;
+        // Points with confidence below min_confidence are invalid (if confidence is provided).
+        float min_confidence = 0;
+    };
+
+    // Reprojection parameters of h x w disparity: z = bf / (d - doffs),
+    // x = (u - cx) * z / fx, y = (v - cy) * z / fy.
+    struct Projection
+    {
+        float fx    = 0;
+        float fy    = 0;
+        float cx    = 0;
+        float cy    = 0;
+        // Focal length times baseline.
+        float bf    = 0;
+        // Difference between principal points of the right and left cameras.
+        float doffs = 0;
+    };
+
+    // h and w are disparity dimensions (network input size).
+    // max_msgs is the number of pooled messages, e.g. publisher queue size plus the ones being processed.
+    PointCloudGenerator(int h, int w, const Params& params, int num_threads = 0, size_t max_msgs = 4);
+
+    // Sets calibration of the rectified stereo pair. Can be called concurrently with generate().
+    // Returns false if the cameras are not calibrated.
+    bool setCalibration(const sensor_msgs::CameraInfo& info_l, const sensor_msgs::CameraInfo& info_r);
+    bool isReady() const;
+
+    // disp is h x w disparity in pixels (CV_32FC1) or fixed point disparity (CV_16UC1,
+    // see disparity_16u.h), 0 and values <= doffs are invalid.
+    // conf is either empty or h x w confidence in [0, 1] (CV_32FC1).
+    // Returns null if calibration has not been set yet.
+    sensor_msgs::PointCloud2::Ptr generate(const std_msgs::Header& header, const cv::Mat& disp, const cv::Mat& conf) const;
+
+    // Computes reprojection parameters of h x w disparity: projection matrices (P) of the cameras
+    // are scaled from calibration image size to h x w.
+    static bool computeProjection(const sensor_msgs::CameraInfo& info_l, const sensor_msgs::CameraInfo& info_r,
+                                  int h, int w, Projection& proj);
+
+private:
+    int    h_;
+    int    w_;
+    Params params_;
+    int    num_threads_;
+
+    mutable redtail::MessagePool<sensor_msgs::PointCloud2> msgs_;
+
+    mutable std::mutex mutex_;
+    Projection proj_;
+    bool       has_proj_ = false;
+};
+
+}
+
+#endif
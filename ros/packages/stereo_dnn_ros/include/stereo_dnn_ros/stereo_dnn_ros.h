@@ -0,0 +1,19 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_STEREO_DNN_ROS_H
+#define STEREO_DNN_ROS_STEREO_DNN_ROS_H
+
+#include <ros/ros.h>
+
+#include "stop_signal.h"
+
+namespace stereo_dnn_ros
+{
+// Runs the stereo DNN node until stop is signalled, nh is the private node handle.
+// Subscription callbacks must be executed by the caller (spinner or nodelet manager).
+// Shared by the standalone node and the nodelet. Throws NodeError on initialization error.
+void run(ros::NodeHandle& nh, const redtail::StopSignal& stop);
+}
+
+#endif
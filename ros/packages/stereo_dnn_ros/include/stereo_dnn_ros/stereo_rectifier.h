@@ -0,0 +1,76 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_STEREO_RECTIFIER_H
+#define STEREO_DNN_ROS_STEREO_RECTIFIER_H
+
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <sensor_msgs/CameraInfo.h>
+
+#include "image_preprocessor.h"
+
+namespace stereo_dnn_ros
+{
+
+// Stereo rectification fused with network input preprocessing.
+// Rectification and resize to the network input size are combined into
+// a single remap table computed from camera calibration (CameraInfo),
+// so preprocessing samples raw camera images directly and rectification
+// does not add a separate pass over the image.
+// Calibration may be updated at any time (e.g. from ROS callbacks)
+// while preprocessors are used by other threads.
+class StereoRectifier
+{
+public:
+    enum Side
+    {
+        kLeft  = 0,
+        kRight = 1
+    };
+
+    // h and w are network input dimensions, roi is network input ROI
+    // (see computeNetworkRoi), preprocessors output only ROI.
+    // order, scale and shift are the same as in ImagePreprocessor.
+    StereoRectifier(int h, int w, const cv::Rect& roi, redtail::preprocessing::ChannelOrder order,
+                    float scale = 1, float shift = 0);
+
+    // Recomputes the remap table if calibration of the camera has changed.
+    // Returns false if camera is not calibrated or distortion model is not supported.
+    bool setCameraInfo(Side side, const sensor_msgs::CameraInfo& info);
+
+    // Returns preprocessor which rectifies and resizes raw images of the camera
+    // or null if calibration has not been received yet.
+    std::shared_ptr<const redtail::preprocessing::ImagePreprocessor> getPreprocessor(Side side) const;
+
+    // Returns true if calibration of both cameras has been received.
+    bool isReady() const;
+
+    // Computes combined rectification and resize maps: for each of samples x samples
+    // sub-pixels of network input ROI pixel, maps contain raw image coordinates.
+    // Rectified camera matrix (P) is scaled from calibration image size to network input size.
+    static bool createMaps(const sensor_msgs::CameraInfo& info, int h, int w, const cv::Rect& roi, int samples,
+                           cv::Mat& map_x, cv::Mat& map_y);
+
+private:
+    struct Camera
+    {
+        sensor_msgs::CameraInfo info;
+        std::shared_ptr<const redtail::preprocessing::ImagePreprocessor> preproc;
+    };
+
+    int      h_;
+    int      w_;
+    cv::Rect roi_;
+    redtail::preprocessing::ChannelOrder order_;
+    float    scale_;
+    float    shift_;
+
+    mutable std::mutex mutex_;
+    Camera   cameras_[2];
+};
+
+}
+
+#endif
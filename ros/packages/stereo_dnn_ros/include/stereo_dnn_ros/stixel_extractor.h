@@ -0,0 +1,93 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_STIXEL_EXTRACTOR_H
+#define STEREO_DNN_ROS_STIXEL_EXTRACTOR_H
+
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/LaserScan.h>
+#include <std_msgs/Header.h>
+
+#include "stereo_dnn_ros/point_cloud_generator.h"
+
+namespace stereo_dnn_ros
+{
+
+// Extracts the nearest obstacle in each image column (stixel) from disparity.
+// Columns (groups of column_width pixels) are scanned top to bottom and pixels
+// are classified as ground or obstacle by their height above the ground plane
+// computed from camera geometry (height above ground and pitch). Obstacle pixels
+// are accumulated in a u-disparity histogram (one bin per disparity pixel) and
+// the nearest obstacle is the highest disparity bin with at least min_points pixels
+// (averaged with its neighbours), so single outliers are ignored. Free space of
+// the column extends up to the obstacle.
+// Pixels are classified 4 at a time, columns are processed in parallel.
+// The result is published as LaserScan: ranges are horizontal distances to
+// the obstacles (+Inf if there is none within max_range) ordered from the right-most
+// column (angle_min) to the left-most, intensities are obstacle top heights above ground.
+// Note: columns are uniform in the image so LaserScan angles are uniform only approximately.
+class StixelExtractor
+{
+public:
+    struct Params
+    {
+        // Width of the column in disparity pixels.
+        int   column_width  = 8;
+        // Camera height above ground (m) and pitch (rad, positive is down).
+        float camera_height = 0.5f;
+        float camera_pitch  = 0;
+        // Pixels with height above ground (m) in [min_height, max_height] are obstacles.
+        float min_height    = 0.2f;
+        float max_height    = 2.0f;
+        // Obstacles further than max_range (m) are ignored.
+        float max_range     = 20;
+        // Min number of obstacle pixels in a disparity bin.
+        int   min_points    = 10;
+    };
+
+    // h and w are disparity dimensions (network input size).
+    StixelExtractor(int h, int w, const Params& params, int num_threads = 0);
+
+    // Sets calibration of the rectified stereo pair. Can be called concurrently with extract().
+    // Returns false if the cameras are not calibrated.
+    bool setCalibration(const sensor_msgs::CameraInfo& info_l, const sensor_msgs::CameraInfo& info_r);
+    bool isReady() const;
+
+    // disp is h x w disparity in pixels (CV_32FC1) or fixed point disparity (CV_16UC1,
+    // see disparity_16u.h), 0 is invalid. Returns null if calibration has not been set yet.
+    sensor_msgs::LaserScan::Ptr extract(const std_msgs::Header& header, const cv::Mat& disp) const;
+
+    int getNumColumns() const { return (w_ + params_.column_width - 1) / params_.column_width; }
+
+private:
+    using Projection = PointCloudGenerator::Projection;
+
+    // Obstacle of one column.
+    struct Stixel
+    {
+        // Horizontal distance along optical axis, 0 if there is no obstacle.
+        float distance = 0;
+        // Max height above ground.
+        float height   = 0;
+    };
+
+    template<typename T>
+    Stixel extractColumn(const cv::Mat& disp, float unit, int u_start, int u_end, const Projection& proj,
+                         std::vector<int>& counts, std::vector<float>& dist_sums, std::vector<float>& heights) const;
+
+private:
+    int    h_;
+    int    w_;
+    Params params_;
+    int    num_threads_;
+
+    mutable std::mutex mutex_;
+    Projection proj_;
+    bool       has_proj_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "stereo_dnn_ros/disparity_kernels.h"
+#include <cassert>
+
+namespace stereo_dnn_ros
+{
+
+__global__ void disparityTo16UKernel(const float* src, int h, int w, float scale, uint16_t* dst, size_t dst_pitch)
+{
+    const int ix = blockIdx.x * blockDim.x + threadIdx.x;
+    const int iy = blockIdx.y * blockDim.y + threadIdx.y;
+    if (ix >= w || iy >= h)
+        return;
+    float val = src[iy * w + ix] * scale;
+    // Comparison is false for NaN as well.
+    val = val > 0 ? fminf(val + 0.5f, 65535.0f) : 0;
+    auto pdst = reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(dst) + iy * dst_pitch);
+    pdst[ix]  = (uint16_t)val;
+}
+
+cudaError_t convertDisparityTo16U(const float* src, int h, int w, float scale,
+                                  uint16_t* dst, size_t dst_pitch, cudaStream_t stream)
+{
+    assert(src != nullptr);
+    assert(dst != nullptr);
+    assert(h > 0 && w > 0);
+    assert(dst_pitch >= w * sizeof(uint16_t));
+
+    dim3 b_dim{32, 8, 1};
+    dim3 g_dim{(w + b_dim.x - 1) / b_dim.x, (h + b_dim.y - 1) / b_dim.y, 1};
+    disparityTo16UKernel<<<g_dim, b_dim, 0, stream>>>(src, h, w, scale, dst, dst_pitch);
+    return cudaGetLastError();
+}
+
+// One thread per right pixel (xr, y) which scans C[di][y][xr + di]. Neighbouring threads
+// read neighbouring elements of each plane so the loads are coalesced.
+template<bool IsCost>
+__global__ void rightDisparityWTAKernel(const float* cost_vol, int d, int h, int w, float* disp_r)
+{
+    const int ix = blockIdx.x * blockDim.x + threadIdx.x;
+    const int iy = blockIdx.y * blockDim.y + threadIdx.y;
+    if (ix >= w || iy >= h)
+        return;
+    const size_t plane_size = (size_t)h * w;
+    const float* src = cost_vol + iy * w + ix;
+    // d == 0 is valid for all right pixels, right pixels with xr + di >= w have no match for di.
+    float best   = src[0];
+    int   best_d = 0;
+    const int max_d = min(d, w - ix);
+    for (int di = 1; di < max_d; di++)
+    {
+        float v = src[di * plane_size + di];
+        if (IsCost ? v < best : v > best)
+        {
+            best   = v;
+            best_d = di;
+        }
+    }
+    disp_r[iy * w + ix] = (float)best_d;
+}
+
+cudaError_t computeRightDisparityWTA(const float* cost_vol, int d, int h, int w, bool is_cost,
+                                     float* disp_r, cudaStream_t stream)
+{
+    assert(cost_vol != nullptr);
+    assert(disp_r   != nullptr);
+    assert(d > 0 && h > 0 && w > 0);
+
+    dim3 b_dim{32, 8, 1};
+    dim3 g_dim{(w + b_dim.x - 1) / b_dim.x, (h + b_dim.y - 1) / b_dim.y, 1};
+    if (is_cost)
+        rightDisparityWTAKernel<true><<<g_dim, b_dim, 0, stream>>>(cost_vol, d, h, w, disp_r);
+    else
+        rightDisparityWTAKernel<false><<<g_dim, b_dim, 0, stream>>>(cost_vol, d, h, w, disp_r);
+    return cudaGetLastError();
+}
+
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "stereo_dnn_ros/lr_consistency.h"
+#include "stereo_dnn_ros/disparity_16u.h"
+#include "stereo_dnn_ros/disparity_kernels.h"
+#include "cpu_utils.h"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace stereo_dnn_ros
+{
+
+LeftRightConsistency::LeftRightConsistency(bool is_cost, float threshold):
+    is_cost_(is_cost), threshold_(threshold)
+{
+    assert(threshold_ >= 0);
+}
+
+cudaError_t LeftRightConsistency::computeRightDisparity(const float* cost_vol, int d, int h, int w, float* disp_r,
+                                                       cudaStream_t stream) const
+{
+    return computeRightDisparityWTA(cost_vol, d, h, w, is_cost_, disp_r, stream);
+}
+
+using namespace redtail::cpu;
+
+static const int kVecSize = sizeof(float4v) / sizeof(float);
+
+static inline float4v load4(const float* src)
+{
+    return loadu(src);
+}
+
+static inline float4v load4(const uint16_t* src)
+{
+    return float4v{(float)src[0], (float)src[1], (float)src[2], (float)src[3]};
+}
+
+// Replaces masked elements with invalid_val, d is the loaded dst.
+static inline void maskStore4(float* dst, float4v d, int4v mask, float invalid_val)
+{
+    storeu(dst, mask ? float4v{} + invalid_val : d);
+}
+
+static inline void maskStore4(uint16_t* dst, float4v d, int4v mask, uint16_t invalid_val)
+{
+    int4v i = {(int)d[0], (int)d[1], (int)d[2], (int)d[3]};
+    i = mask ? int4v{} + invalid_val : i;
+    // Pack the low halves (little-endian) back to 16 bits.
+    u16x8 v = __builtin_shuffle((u16x8)i, u16x8{0, 2, 4, 6, 0, 2, 4, 6});
+    std::memcpy(dst, &v, kVecSize * sizeof(uint16_t));
+}
+
+// Masks left disparities (in pixels: value * unit) that do not match right view disparity.
+// Pixels are processed 4 at a time, right disparities are gathered per lane.
+template<typename T>
+static void maskInconsistent(const float* disp_r, int h, int w, cv::Mat& disp_l, const cv::Rect& roi,
+                             float unit, float threshold, T invalid_val)
+{
+    // Cost volume might have lower resolution than disparity, for example,
+    // in 2D networks with k * stride + 1 input dims the corners are aligned.
+    const float sx = roi.width  > 1 ? (float)(w - 1) / (roi.width  - 1) : 1;
+    const float sy = roi.height > 1 ? (float)(h - 1) / (roi.height - 1) : 1;
+    // Scale from disparity values to cost volume pixels.
+    const float sd = sx * unit;
+    const float4v lanes = {0, 1, 2, 3};
+    for (int y = 0; y < roi.height; y++)
+    {
+        T*           pl = disp_l.ptr<T>(roi.y + y) + roi.x;
+        const float* pr = disp_r + (int)(y * sy + 0.5f) * w;
+        int x = 0;
+        for (; x + kVecSize <= roi.width; x += kVecSize)
+        {
+            // Same as the scalar loop below, out of range lanes read pr[0] and are masked anyway.
+            float4v d    = load4(pl + x);
+            float4v dl   = d * sd;
+            float4v xr_f = ((float)x + lanes) * sx - dl + 0.5f;
+            int4v   xr   = {(int)xr_f[0], (int)xr_f[1], (int)xr_f[2], (int)xr_f[3]};
+            int4v   mask = (xr_f < 0) | (xr >= w);
+            xr           = mask ? int4v{} : xr;
+            float4v diff = dl - float4v{pr[xr[0]], pr[xr[1]], pr[xr[2]], pr[xr[3]]};
+            mask        |= (diff > threshold) | (-diff > threshold);
+            maskStore4(pl + x, d, mask, invalid_val);
+        }
+        for (; x < roi.width; x++)
+        {
+            // Left disparity in cost volume pixels and corresponding right pixel.
+            // Rounding is done by truncation (xr_f is checked to be non-negative first)
+            // as it is much cheaper than std::lround in this loop.
+            float dl   = pl[x] * sd;
+            float xr_f = x * sx - dl + 0.5f;
+            int   xr   = (int)xr_f;
+            // Pixels that fall out of the right view are occluded.
+            if (xr_f < 0 || xr >= w || std::abs(dl - pr[xr]) > threshold)
+                pl[x] = invalid_val;
+        }
+    }
+}
+
+void LeftRightConsistency::apply(const float* disp_r, int h, int w, cv::Mat& disp_l, const cv::Rect& roi,
+                                 float invalid_val) const
+{
+    assert(disp_r != nullptr);
+    assert(disp_l.type() == CV_32FC1 || disp_l.type() == CV_16UC1);
+    assert((roi & cv::Rect(0, 0, disp_l.cols, disp_l.rows)) == roi);
+    assert(roi.width >= w && roi.height >= h);
+
+    if (disp_l.type() == CV_16UC1)
+    {
+        maskInconsistent<uint16_t>(disp_r, h, w, disp_l, roi, 1 / kDisparity16UScale, threshold_,
+                                   (uint16_t)(invalid_val * kDisparity16UScale));
+    }
+    else
+        maskInconsistent<float>(disp_r, h, w, disp_l, roi, 1, threshold_, invalid_val);
+}
+
+}
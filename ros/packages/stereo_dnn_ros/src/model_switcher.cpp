@@ -0,0 +1,133 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "stereo_dnn_ros/model_switcher.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace stereo_dnn_ros
+{
+
+ModelSwitcher::ModelSwitcher(int num_models, const Params& params):
+    num_models_(num_models), params_(params),
+    ema_ms_(num_models, 0), base_ms_(num_models, 0),
+    stats_(num_models), total_ms_(num_models, 0), active_since_(Clock::now())
+{
+    assert(num_models_ > 0);
+    assert(params_.budget_ms > 0);
+    assert(params_.down_frames >= 1 && params_.up_frames >= 1);
+    assert(0 < params_.up_ratio && params_.up_ratio <= 1);
+    assert(0 < params_.ema_alpha && params_.ema_alpha <= 1);
+}
+
+void ModelSwitcher::setBaseline(int model, float latency_ms)
+{
+    assert(0 <= model && model < num_models_);
+    assert(latency_ms > 0);
+    base_ms_[model] = latency_ms;
+    ema_ms_[model]  = latency_ms;
+}
+
+float ModelSwitcher::predictLatency(int model) const
+{
+    assert(0 <= model && model < num_models_);
+    int active = active_.load();
+    if (model == active)
+        return ema_ms_[active];
+    // Model which has never run can't be predicted.
+    if (base_ms_[model] <= 0)
+        return std::numeric_limits<float>::infinity();
+    float slowdown = base_ms_[active] > 0 ? ema_ms_[active] / base_ms_[active] : 1;
+    return base_ms_[model] * slowdown;
+}
+
+int ModelSwitcher::selectModel(float threshold_ms) const
+{
+    for (int i = 0; i < num_models_; i++)
+    {
+        if (predictLatency(i) <= threshold_ms)
+            return i;
+    }
+    return num_models_ - 1;
+}
+
+void ModelSwitcher::switchTo(int model, Clock::time_point now)
+{
+    int active = active_.load();
+    // EMA of the model is stale, start from the prediction for the current conditions.
+    float predicted = predictLatency(model);
+    if (predicted < std::numeric_limits<float>::infinity())
+        ema_ms_[model] = predicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_[active].active_sec += std::chrono::duration<double>(now - active_since_).count();
+        stats_[model].switches++;
+        active_since_ = now;
+        active_       = model;
+    }
+    over_count_ = 0;
+    up_count_   = 0;
+}
+
+bool ModelSwitcher::update(int model, float latency_ms)
+{
+    assert(0 <= model && model < num_models_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_[model].frames++;
+        total_ms_[model] += latency_ms;
+    }
+    float& ema = ema_ms_[model];
+    ema = ema > 0 ? params_.ema_alpha * latency_ms + (1 - params_.ema_alpha) * ema : latency_ms;
+    // Baseline follows the lowest latency, e.g. after the device has cooled down.
+    base_ms_[model] = base_ms_[model] > 0 ? std::min(base_ms_[model], ema) : ema;
+
+    // Frame could have been processed by the previous model while the switch happened.
+    int active = active_.load();
+    if (model != active)
+        return false;
+
+    auto now = Clock::now();
+    over_count_ = ema > params_.budget_ms ? over_count_ + 1 : 0;
+    if (over_count_ >= params_.down_frames)
+    {
+        if (active == num_models_ - 1)
+        {
+            // Already the fastest model, nothing else can be done.
+            over_count_ = 0;
+            return false;
+        }
+        // Move at least one model down as the active one does not fit the budget.
+        switchTo(std::max(selectModel(params_.budget_ms), active + 1), now);
+        return true;
+    }
+
+    int candidate = selectModel(params_.up_ratio * params_.budget_ms);
+    up_count_ = candidate < active ? up_count_ + 1 : 0;
+    if (up_count_ >= params_.up_frames)
+    {
+        switchTo(candidate, now);
+        return true;
+    }
+    return false;
+}
+
+std::vector<ModelSwitcher::ModelStats> ModelSwitcher::getStats(bool reset)
+{
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto res = stats_;
+    res[active_.load()].active_sec += std::chrono::duration<double>(now - active_since_).count();
+    for (int i = 0; i < num_models_; i++)
+        res[i].avg_ms = res[i].frames > 0 ? (float)(total_ms_[i] / res[i].frames) : 0;
+    if (reset)
+    {
+        std::fill(stats_.begin(),    stats_.end(),    ModelStats());
+        std::fill(total_ms_.begin(), total_ms_.end(), 0.0);
+        active_since_ = now;
+    }
+    return res;
+}
+
+}
@@ -0,0 +1,200 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "stereo_dnn_ros/point_cloud_generator.h"
+#include "stereo_dnn_ros/disparity_16u.h"
+#include "cpu_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+namespace stereo_dnn_ros
+{
+
+PointCloudGenerator::PointCloudGenerator(int h, int w, const Params& params, int num_threads, size_t max_msgs):
+    h_(h), w_(w), params_(params), num_threads_(num_threads), msgs_(max_msgs)
+{
+    assert(h_ > 0 && w_ > 0);
+    assert(params_.decimation >= 1);
+    assert(0 <= params_.min_range && params_.min_range <= params_.max_range);
+}
+
+bool PointCloudGenerator::computeProjection(const sensor_msgs::CameraInfo& info_l, const sensor_msgs::CameraInfo& info_r,
+                                            int h, int w, Projection& proj)
+{
+    const auto& pl = info_l.P;
+    const auto& pr = info_r.P;
+    if (pl[0] == 0 || pr[0] == 0 || info_l.width == 0 || info_l.height == 0)
+        return false;
+    // Right camera P[3] is -fx * baseline.
+    double baseline = -pr[3] / pr[0];
+    if (baseline <= 0)
+        return false;
+    // Pixel centers are aligned the same way as in cv::resize: x' = (x + 0.5) * s - 0.5.
+    double sx  = (double)w / info_l.width;
+    double sy  = (double)h / info_l.height;
+    proj.fx    = pl[0] * sx;
+    proj.fy    = pl[5] * sy;
+    proj.cx    = (pl[2] + 0.5) * sx - 0.5;
+    proj.cy    = (pl[6] + 0.5) * sy - 0.5;
+    proj.bf    = proj.fx * baseline;
+    proj.doffs = (pl[2] - pr[2]) * sx;
+    return true;
+}
+
+bool PointCloudGenerator::setCalibration(const sensor_msgs::CameraInfo& info_l, const sensor_msgs::CameraInfo& info_r)
+{
+    Projection proj;
+    if (!computeProjection(info_l, info_r, h_, w_, proj))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    proj_     = proj;
+    has_proj_ = true;
+    return true;
+}
+
+bool PointCloudGenerator::isReady() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_proj_;
+}
+
+using namespace redtail::cpu;
+
+static const int kVecSize = sizeof(float4v) / sizeof(float);
+
+// Loads 4 elements with the stride and converts them to float.
+static inline float4v loads(const float* src, int stride)
+{
+    if (stride == 1)
+        return loadu(src);
+    return float4v{src[0], src[stride], src[2 * stride], src[3 * stride]};
+}
+
+static inline float4v loads(const uint16_t* src, int stride)
+{
+    return float4v{(float)src[0], (float)src[stride], (float)src[2 * stride], (float)src[3 * stride]};
+}
+
+// Reprojects one (decimated) row of n points, disparity in pixels is disp * unit. conf may be null.
+template<typename T>
+static void reprojectRow(const T* disp, float unit, const float* conf, int n, int step, float v,
+                         const PointCloudGenerator::Projection& proj, const PointCloudGenerator::Params& params,
+                         float* dst)
+{
+    const float   nan     = std::numeric_limits<float>::quiet_NaN();
+    const float4v nan_v   = {nan, nan, nan, nan};
+    const float4v zero_v  = {0, 0, 0, 0};
+    const float   inv_fx  = 1 / proj.fx;
+    const float   inv_fy  = 1 / proj.fy;
+    // y / z is the same for the whole row.
+    const float   y_scale = (v - proj.cy) * inv_fy;
+    const float4v u_step  = {0, (float)step, 2.0f * step, 3.0f * step};
+    // Disparity <= doffs is at infinity or behind the camera, 0 marks invalid pixels
+    // (outside of ROI or failed LR check).
+    const float   min_d   = std::max(proj.doffs, 0.0f);
+
+    int i = 0;
+    for (; i + kVecSize <= n; i += kVecSize)
+    {
+        float4v d   = loads(disp + i * step, step) * unit;
+        float4v z   = proj.bf / (d - proj.doffs);
+        int4v valid = (d > min_d) & (z >= params.min_range) & (z <= params.max_range);
+        if (conf != nullptr)
+            valid &= loads(conf + i * step, step) >= params.min_confidence;
+        float4v u   = (float)(i * step) + u_step;
+        float4v x   = valid ? (u - proj.cx) * inv_fx * z : nan_v;
+        float4v y   = valid ? y_scale * z : nan_v;
+        z           = valid ? z : nan_v;
+        // Transpose x, y, z, 0 vectors to 4 points.
+        float4v t0  = __builtin_shuffle(x, y,      int4v{0, 4, 1, 5});
+        float4v t1  = __builtin_shuffle(z, zero_v, int4v{0, 4, 1, 5});
+        float4v t2  = __builtin_shuffle(x, y,      int4v{2, 6, 3, 7});
+        float4v t3  = __builtin_shuffle(z, zero_v, int4v{2, 6, 3, 7});
+        float* p = dst + 4 * i;
+        storeu(p,      __builtin_shuffle(t0, t1, int4v{0, 1, 4, 5}));
+        storeu(p + 4,  __builtin_shuffle(t0, t1, int4v{2, 3, 6, 7}));
+        storeu(p + 8,  __builtin_shuffle(t2, t3, int4v{0, 1, 4, 5}));
+        storeu(p + 12, __builtin_shuffle(t2, t3, int4v{2, 3, 6, 7}));
+    }
+    for (; i < n; i++)
+    {
+        float d  = disp[i * step] * unit;
+        float z  = proj.bf / (d - proj.doffs);
+        bool valid = d > min_d && z >= params.min_range && z <= params.max_range &&
+                     (conf == nullptr || conf[i * step] >= params.min_confidence);
+        float* p = dst + 4 * i;
+        p[0] = valid ? (i * step - proj.cx) * inv_fx * z : nan;
+        p[1] = valid ? y_scale * z : nan;
+        p[2] = valid ? z : nan;
+        p[3] = 0;
+    }
+}
+
+sensor_msgs::PointCloud2::Ptr PointCloudGenerator::generate(const std_msgs::Header& header, const cv::Mat& disp,
+                                                            const cv::Mat& conf) const
+{
+    assert(disp.type() == CV_32FC1 || disp.type() == CV_16UC1);
+    assert(disp.rows == h_ && disp.cols == w_);
+    assert(conf.empty() || (conf.type() == CV_32FC1 && conf.size() == disp.size()));
+
+    Projection proj;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_proj_)
+            return nullptr;
+        proj = proj_;
+    }
+
+    const int step  = params_.decimation;
+    const int out_h = (h_ + step - 1) / step;
+    const int out_w = (w_ + step - 1) / step;
+
+    auto msg = msgs_.acquire();
+    msg->header = header;
+    // Reused messages already have the layout, only new ones are set up and allocated.
+    if ((int)msg->height != out_h || (int)msg->width != out_w)
+    {
+        msg->height = out_h;
+        msg->width  = out_w;
+        const char* names[] {"x", "y", "z"};
+        msg->fields.resize(3);
+        for (int i = 0; i < 3; i++)
+        {
+            msg->fields[i].name     = names[i];
+            msg->fields[i].offset   = i * sizeof(float);
+            msg->fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+            msg->fields[i].count    = 1;
+        }
+        msg->is_bigendian = false;
+        msg->point_step   = 4 * sizeof(float);
+        msg->row_step     = msg->point_step * out_w;
+        msg->is_dense     = false;
+        msg->data.resize((size_t)msg->row_step * out_h);
+    }
+    // Points are written directly to the message buffer, every point is overwritten.
+    auto dst = reinterpret_cast<float*>(msg->data.data());
+
+    const bool use_conf = !conf.empty() && params_.min_confidence > 0;
+    parallelForStripes(out_h, num_threads_, [&](int y_start, int y_end)
+    {
+        for (int y = y_start; y < y_end; y++)
+        {
+            int    v      = y * step;
+            auto   p_conf = use_conf ? conf.ptr<float>(v) : nullptr;
+            float* p_dst  = dst + (size_t)y * out_w * 4;
+            if (disp.type() == CV_16UC1)
+            {
+                reprojectRow(disp.ptr<uint16_t>(v), 1 / kDisparity16UScale, p_conf, out_w, step, (float)v,
+                             proj, params_, p_dst);
+            }
+            else
+                reprojectRow(disp.ptr<float>(v), 1.0f, p_conf, out_w, step, (float)v, proj, params_, p_dst);
+        }
+    });
+
+    return msg;
+}
+
+}
@@ -0,0 +1,1485 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include <cuda_runtime_api.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <ros/ros.h>
+#include <message_filters/subscriber.h>
+#include <message_filters/time_synchronizer.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/LaserScan.h>
+#include <std_msgs/String.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+#include "redtail_tensorrt_plugins.h"
+#include "networks.h"
+#include "sgm_stereo.h"
+#include "image_preprocessor.h"
+#include "motion_gate.h"
+#include "event_executor.h"
+#include "message_pool.h"
+#include "node_error.h"
+#include "stereo_dnn_ros/disparity_kernels.h"
+#include "stereo_dnn_ros/lr_consistency.h"
+#include "stereo_dnn_ros/model_switcher.h"
+#include "stereo_dnn_ros/stereo_dnn_ros.h"
+#include "stereo_dnn_ros/pipeline_stage.h"
+#include "stereo_dnn_ros/point_cloud_generator.h"
+#include "stereo_dnn_ros/stixel_extractor.h"
+#include "stereo_dnn_ros/stereo_rectifier.h"
+
+// CUDA and plugin errors are fatal: the node stops instead of publishing garbage.
+#define CHECK(status) do {                                                          \
+    int rc = (int)(status);                                                         \
+    if (rc != 0)                                                                    \
+        redtail::throwNodeError("%s failed with status %d.", #status, rc);          \
+} while(false)
+
+using namespace nvinfer1;
+using namespace redtail::tensorrt;
+
+using ConstStr = const std::string;
+namespace pp = redtail::preprocessing;
+
+namespace stereo_dnn_ros
+{
+
+// Network output bindings and post-processing settings.
+struct OutputParams
+{
+    int         idx_disp     = -1;
+    int         idx_conf     = -1;
+    int         idx_cost_vol = -1;
+    Dims        cost_vol_dims;
+    // Scale applied to network disparity output to get disparity in pixels.
+    float       disp_scale   = 1;
+    // Disparity output encoding: 32FC1 (pixels) or 16UC1 (fixed point, see disparity_16u.h).
+    std::string disp_encoding;
+    // Device buffer (ROI size) for fixed point disparity.
+    uint16_t*   disp_16u_d   = nullptr;
+    // Device buffer (cost volume H x W) for right view disparity used in LR check.
+    float*      disp_r_d     = nullptr;
+    std::string conf_encoding;
+};
+
+// Stereo pair received from the cameras.
+struct StereoFrame
+{
+    sensor_msgs::ImageConstPtr img_l;
+    sensor_msgs::ImageConstPtr img_r;
+};
+
+// Preprocessed network inputs (ROI only) in CHW format.
+struct InputFrame
+{
+    std_msgs::Header header;
+    cv::Mat          img_l;
+    cv::Mat          img_r;
+    // The frame is nearly the same as the last processed one (motion gate),
+    // images are empty and the previous outputs are republished.
+    bool             skip = false;
+    // Motion gate key frame: the frame itself or the one whose outputs a skipped frame reuses.
+    uint64_t         key_id = 0;
+};
+
+using FloatBuffer = boost::shared_ptr<std::vector<float>>;
+
+// Network outputs copied to host, full frame size.
+struct OutputFrame
+{
+    std_msgs::Header        header;
+    // Index of the model which produced the outputs.
+    int                     model  = 0;
+    // Outputs are not computed, the previous ones should be republished with the new header.
+    bool                    repeat = false;
+    // Motion gate key frame id (see InputFrame).
+    uint64_t                key_id = 0;
+    // Disparity is copied directly into the data of the output message.
+    sensor_msgs::Image::Ptr disp_msg;
+    cv::Mat                 disp;
+    // Confidence in [0, 1] range, points to conf_buf.
+    FloatBuffer             conf_buf;
+    cv::Mat                 conf;
+    // Right view disparity (cost volume H x W) used in LR consistency check.
+    FloatBuffer             disp_r;
+};
+
+// Recycled output messages and host buffers, a message or buffer is reused
+// once it has been published and released by all subscribers and pipeline stages.
+struct OutputPools
+{
+    explicit OutputPools(size_t size):
+        disp_msgs(size), conf_msgs(size), conf_bufs(size), disp_r_bufs(size)
+    {
+    }
+
+    redtail::MessagePool<sensor_msgs::Image> disp_msgs;
+    redtail::MessagePool<sensor_msgs::Image> conf_msgs;
+    redtail::MessagePool<std::vector<float>> conf_bufs;
+    redtail::MessagePool<std::vector<float>> disp_r_bufs;
+};
+
+// TensorRT model: engine, execution context, device buffers and post-processing settings.
+// The model owns all of them so they are released when the node is stopped or fails to start.
+struct StereoModel
+{
+    StereoModel() = default;
+    StereoModel(const StereoModel&) = delete;
+    StereoModel& operator=(const StereoModel&) = delete;
+
+    ~StereoModel()
+    {
+        for (auto buf: buffers)
+            cudaFree(buf);
+        cudaFree(out_params.disp_16u_d);
+        cudaFree(out_params.disp_r_d);
+        if (context != nullptr)
+            context->destroy();
+        if (engine != nullptr)
+            engine->destroy();
+    }
+
+    std::string        type;
+    ICudaEngine*       engine    = nullptr;
+    IExecutionContext* context   = nullptr;
+    void*              buffers[5] {};
+    int                idx_left  = -1;
+    int                idx_right = -1;
+    OutputParams       out_params;
+    // LR check is run in the publish stage, null if disabled.
+    std::unique_ptr<LeftRightConsistency> lr_check;
+};
+
+// Computes network region of interest (ROI) in network input coordinates.
+// ROI is specified as fractions of the frame and is aligned so that
+// its dimensions satisfy network stride requirements (see networks.h).
+cv::Rect computeNetworkRoi(int h, int w, int stride, float top, float bottom, float left, float right)
+{
+    ROS_ASSERT(0 <= top  && top  < bottom && bottom <= 1);
+    ROS_ASSERT(0 <= left && left < right  && right  <= 1);
+
+    int roi_h = std::min(alignNetworkDim((int)std::round((bottom - top) * h), stride), h);
+    int roi_w = std::min(alignNetworkDim((int)std::round((right - left) * w), stride), w);
+    // Keep the ROI inside the frame in case alignment made it bigger.
+    int y = std::min((int)std::round(top  * h), h - roi_h);
+    int x = std::min((int)std::round(left * w), w - roi_w);
+    return cv::Rect(x, y, roi_w, roi_h);
+}
+
+// Maps ROI from network input coordinates to source image coordinates.
+cv::Rect scaleRoi(const cv::Rect& roi, int h, int w, int src_h, int src_w)
+{
+    float sy = (float)src_h / h;
+    float sx = (float)src_w / w;
+    auto  res = cv::Rect((int)std::round(roi.x * sx),     (int)std::round(roi.y * sy),
+                         (int)std::round(roi.width * sx), (int)std::round(roi.height * sy));
+    return res & cv::Rect(0, 0, src_w, src_h);
+}
+
+// Sets values outside of ROI to 0. Outputs are usually recycled buffers
+// so only the area outside of ROI is cleared and ROI is then overwritten.
+void clearOutsideRoi(const cv::Rect& roi, cv::Mat& output)
+{
+    output.rowRange(0, roi.y).setTo(0);
+    output.rowRange(roi.y + roi.height, output.rows).setTo(0);
+    output(cv::Rect(0, roi.y, roi.x, roi.height)).setTo(0);
+    output(cv::Rect(roi.x + roi.width, roi.y, output.cols - roi.x - roi.width, roi.height)).setTo(0);
+}
+
+// Copies network output to the full frame image, values outside of ROI are set to 0.
+void copyRoiOutput(const void* src_d, const cv::Rect& roi, cv::Mat& output)
+{
+    clearOutsideRoi(roi, output);
+    size_t row_size = roi.width * output.elemSize();
+    CHECK(cudaMemcpy2D(output.ptr(roi.y, roi.x), output.step[0], src_d, row_size,
+                       row_size, roi.height, cudaMemcpyDeviceToHost));
+}
+
+// Sets stamp and frame id to the same value as source image so we can synchronize with other nodes if needed.
+void setImageHeader(sensor_msgs::Image& msg, const std_msgs::Header& src_header)
+{
+    msg.header.stamp.sec  = src_header.stamp.sec;
+    msg.header.stamp.nsec = src_header.stamp.nsec;
+    msg.header.frame_id   = src_header.frame_id;
+}
+
+// Sets size and encoding of the message and returns the image which points to the message data.
+// Data of a recycled message is not reallocated if the size does not change.
+cv::Mat prepareImageMessage(sensor_msgs::Image& msg, int h, int w, int type, ConstStr& encoding)
+{
+    msg.encoding = encoding;
+    msg.width    = w;
+    msg.height   = h;
+    msg.step     = w * CV_ELEM_SIZE(type);
+    msg.data.resize(msg.step * msg.height);
+    return cv::Mat(h, w, type, msg.data.data());
+}
+
+// Creates a copy of the message with the new stamp and frame id.
+sensor_msgs::Image::Ptr restampImageMessage(const sensor_msgs::Image& src, const std_msgs::Header& header,
+                                            redtail::MessagePool<sensor_msgs::Image>& pool)
+{
+    auto out_msg = pool.acquire();
+    *out_msg = src;
+    out_msg->header.stamp    = header.stamp;
+    out_msg->header.frame_id = header.frame_id;
+    return out_msg;
+}
+
+// Preprocesses ROI of the left and right images in parallel.
+// Preprocessors output size must be equal to ROI size. Preprocessors with
+// remap (rectification) sample the whole raw image, otherwise the source
+// ROI is resized.
+InputFrame preprocessFrame(const StereoFrame& frame, size_t h, size_t w, const cv::Rect& roi,
+                           const pp::ImagePreprocessor& preproc_l, const pp::ImagePreprocessor& preproc_r)
+{
+    InputFrame res;
+    res.header = frame.img_l->header;
+    sensor_msgs::ImageConstPtr imgs[] {frame.img_l, frame.img_r};
+    cv::Mat* dst[] {&res.img_l, &res.img_r};
+    const pp::ImagePreprocessor* preprocs[] {&preproc_l, &preproc_r};
+    cv::parallel_for_(cv::Range(0, 2), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            const auto& img = *(imgs[i]);
+            const auto& preproc = *(preprocs[i]);
+            auto img_h   = cv::Mat((int)img.height, (int)img.width, img.encoding == "bgra8" ? CV_8UC4 : CV_8UC3, (void*)img.data.data());
+            if (preproc.hasRemap())
+            {
+                *dst[i] = preproc.process(img_h, img.encoding);
+                continue;
+            }
+            // Only the part of the source image that corresponds to ROI is preprocessed.
+            auto src_roi = scaleRoi(roi, h, w, img_h.rows, img_h.cols);
+            *dst[i]      = preproc.process(img_h(src_roi), img.encoding);
+        }
+    }, 2);
+    return res;
+}
+
+// Runs the network and copies outputs to host, disparity is copied to the output message.
+// If lr_check is not null, right view disparity is computed on the device and copied to host.
+OutputFrame runInference(IExecutionContext *context, const InputFrame& frame, size_t h, size_t w, const cv::Rect& roi,
+                         int idx_l, int idx_r, const OutputParams& out_params, const LeftRightConsistency* lr_check,
+                         void** buffers, OutputPools& pools)
+{
+    size_t c = 3;
+    CHECK(cudaMemcpy(buffers[idx_l], frame.img_l.data, c * roi.area() * sizeof(float), cudaMemcpyHostToDevice));
+    CHECK(cudaMemcpy(buffers[idx_r], frame.img_r.data, c * roi.area() * sizeof(float), cudaMemcpyHostToDevice));
+
+    if (!context->execute(1, buffers))
+        redtail::throwNodeError("TensorRT inference failed.");
+
+    OutputFrame res;
+    res.header   = frame.header;
+    res.disp_msg = pools.disp_msgs.acquire();
+    // Disparity outside of ROI is invalid and is set to 0 (same as in KITTI).
+    if (out_params.disp_encoding == "16UC1")
+    {
+        // Scaling and quantization are done on the device so only half of the data is copied to host.
+        CHECK(convertDisparityTo16U((const float*)buffers[out_params.idx_disp], roi.height, roi.width,
+                                    out_params.disp_scale * kDisparity16UScale, out_params.disp_16u_d,
+                                    roi.width * sizeof(uint16_t), nullptr));
+        res.disp = prepareImageMessage(*res.disp_msg, h, w, CV_16UC1, out_params.disp_encoding);
+        copyRoiOutput(out_params.disp_16u_d, roi, res.disp);
+    }
+    else
+    {
+        res.disp = prepareImageMessage(*res.disp_msg, h, w, CV_32FC1, out_params.disp_encoding);
+        copyRoiOutput(buffers[out_params.idx_disp], roi, res.disp);
+    }
+    // Confidence outside of ROI is 0 as well.
+    if (out_params.idx_conf >= 0)
+    {
+        res.conf_buf = pools.conf_bufs.acquire();
+        res.conf_buf->resize(h * w);
+        res.conf = cv::Mat((int)h, (int)w, CV_32FC1, res.conf_buf->data());
+        copyRoiOutput(buffers[out_params.idx_conf], roi, res.conf);
+    }
+    if (lr_check != nullptr)
+    {
+        // Cost volume is either DxHxW or Dx1xHxW and stays on the device.
+        const auto& dims = out_params.cost_vol_dims;
+        int cv_d = dims.d[0];
+        int cv_h = dims.d[dims.nbDims - 2];
+        int cv_w = dims.d[dims.nbDims - 1];
+        CHECK(lr_check->computeRightDisparity((const float*)buffers[out_params.idx_cost_vol], cv_d, cv_h, cv_w,
+                                              out_params.disp_r_d, nullptr));
+        res.disp_r = pools.disp_r_bufs.acquire();
+        res.disp_r->resize(cv_h * cv_w);
+        CHECK(cudaMemcpy(res.disp_r->data(), out_params.disp_r_d, cv_h * cv_w * sizeof(float),
+                         cudaMemcpyDeviceToHost));
+    }
+    return res;
+}
+
+// Creates disparity and, if confidence is present, confidence messages.
+// Confidence in [0, 1] range is converted to conf_encoding (mono8 or mono16).
+// If lr_check is not null, inconsistent and occluded disparities are set to 0.
+// Disparity is post-processed in place in the message returned by runInference.
+sensor_msgs::Image::ConstPtr computeOutputs(OutputFrame& frame, const cv::Rect& roi, const OutputParams& out_params,
+                                            LeftRightConsistency* lr_check, OutputPools& pools,
+                                            sensor_msgs::Image::ConstPtr& conf_msg)
+{
+    auto& output = frame.disp;
+    // Fixed point disparity is already scaled.
+    if (out_params.disp_scale != 1 && output.type() == CV_32FC1)
+        output *= out_params.disp_scale;
+
+    if (lr_check != nullptr)
+    {
+        const auto& dims = out_params.cost_vol_dims;
+        int cv_h = dims.d[dims.nbDims - 2];
+        int cv_w = dims.d[dims.nbDims - 1];
+        lr_check->apply(frame.disp_r->data(), cv_h, cv_w, output, roi, 0);
+    }
+
+    auto& out_msg = *frame.disp_msg;
+    setImageHeader(out_msg, frame.header);
+    assert(output.data == out_msg.data.data());
+
+    conf_msg = nullptr;
+    if (!frame.conf.empty())
+    {
+        const auto& conf_encoding = out_params.conf_encoding;
+        auto msg = pools.conf_msgs.acquire();
+        setImageHeader(*msg, frame.header);
+        // Destination has the required size and type so it is not reallocated.
+        if (conf_encoding == "mono16")
+        {
+            auto conf_out = prepareImageMessage(*msg, frame.conf.rows, frame.conf.cols, CV_16UC1, conf_encoding);
+            frame.conf.convertTo(conf_out, CV_16UC1, std::numeric_limits<uint16_t>::max());
+        }
+        else
+        {
+            auto conf_out = prepareImageMessage(*msg, frame.conf.rows, frame.conf.cols, CV_8UC1, conf_encoding);
+            frame.conf.convertTo(conf_out, CV_8UC1,  std::numeric_limits<uint8_t>::max());
+        }
+        conf_msg = msg;
+    }
+    // ROS_INFO("computeOutputs: %u, %u, %s", out_msg.width, out_msg.height, out_msg.encoding.c_str());
+
+    return frame.disp_msg;
+}
+
+// Gets rectifying preprocessors for the stereo pair. Returns false (the frame
+// should be skipped) if calibration has not been received yet or if it does not match the images.
+bool getRectifyingPreprocessors(const StereoRectifier& rectifier, const StereoFrame& frame,
+                                std::shared_ptr<const pp::ImagePreprocessor>& preproc_l,
+                                std::shared_ptr<const pp::ImagePreprocessor>& preproc_r)
+{
+    preproc_l = rectifier.getPreprocessor(StereoRectifier::kLeft);
+    preproc_r = rectifier.getPreprocessor(StereoRectifier::kRight);
+    if (preproc_l == nullptr || preproc_r == nullptr)
+    {
+        ROS_WARN_THROTTLE(5, "Waiting for camera calibration, frames are skipped.");
+        return false;
+    }
+    for (const auto& p: {std::make_pair(frame.img_l, preproc_l), std::make_pair(frame.img_r, preproc_r)})
+    {
+        auto size = p.second->getRemapSourceSize();
+        if ((int)p.first->width != size.width || (int)p.first->height != size.height)
+        {
+            ROS_ERROR_THROTTLE(5, "Image size %ux%u does not match camera calibration size %dx%d, frames are skipped.",
+                               p.first->width, p.first->height, size.width, size.height);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Computes disparity using classical SGM stereo on CPU, the output is the same as for DNN models.
+// Images are resized to SGM input (ROI) by preproc (RGB output) before the grayscale conversion.
+// If rectifier is not null, raw images are rectified while resized to SGM input.
+// Disparity is written directly to the output message taken from the pool.
+sensor_msgs::Image::ConstPtr computeSgmOutput(redtail::stereo::SgmStereo& sgm, const StereoFrame& frame,
+                                              size_t h, size_t w, const cv::Rect& roi,
+                                              const pp::ImagePreprocessor& preproc,
+                                              const StereoRectifier* rectifier, ConstStr& disp_encoding,
+                                              redtail::MessagePool<sensor_msgs::Image>& pool)
+{
+    std::shared_ptr<const pp::ImagePreprocessor> preprocs[2];
+    if (rectifier != nullptr && !getRectifyingPreprocessors(*rectifier, frame, preprocs[0], preprocs[1]))
+        return nullptr;
+
+    cv::Mat imgs_g[2];
+    sensor_msgs::ImageConstPtr imgs[] {frame.img_l, frame.img_r};
+    for (int i = 0; i < 2; i++)
+    {
+        const auto& img = *(imgs[i]);
+        auto img_h   = cv::Mat((int)img.height, (int)img.width, img.encoding == "bgra8" ? CV_8UC4 : CV_8UC3, (void*)img.data.data());
+        cv::Mat img_rgb;
+        if (rectifier != nullptr)
+            preprocs[i]->resize8u(img_h, img.encoding, img_rgb);
+        else
+            preproc.resize8u(img_h(scaleRoi(roi, h, w, img_h.rows, img_h.cols)), img.encoding, img_rgb);
+        cv::cvtColor(img_rgb, imgs_g[i], CV_RGB2GRAY);
+    }
+
+    cv::Mat disp;
+    sgm.compute(imgs_g[0], imgs_g[1], disp);
+
+    auto out_msg = pool.acquire();
+    setImageHeader(*out_msg, frame.img_l->header);
+    int  type    = disp_encoding == "16UC1" ? CV_16UC1 : CV_32FC1;
+    auto output  = prepareImageMessage(*out_msg, (int)h, (int)w, type, disp_encoding);
+    // Disparity outside of ROI is invalid and is set to 0 (same as in KITTI).
+    clearOutsideRoi(roi, output);
+    cv::Mat output_roi = output(roi);
+    if (disp_encoding == "16UC1")
+        disp.convertTo(output_roi, CV_16UC1, kDisparity16UScale);
+    else
+        disp.copyTo(output_roi);
+    assert(output.data == out_msg->data.data());
+    return out_msg;
+}
+
+bool checkEncoding(const sensor_msgs::Image& img)
+{
+    if (!pp::isSupportedEncoding(img.encoding))
+    {
+        // Called from subscription callbacks which can't stop the node so the frame is skipped.
+        ROS_ERROR_THROTTLE(5, "Image encoding %s is not yet supported, frames are skipped. Supported encodings: rgb8, bgr8, bgra8",
+                           img.encoding.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Posts the stereo pair to SGM processing loop, unprocessed older pair is dropped.
+void imageCallback(const sensor_msgs::ImageConstPtr& msg_l, const sensor_msgs::ImageConstPtr& msg_r,
+                   redtail::executor::LatestInput<StereoFrame>* input)
+{
+    // ROS_INFO("imageCallback: %u, %u, %s", msg_l->width, msg_l->height, msg_l->encoding.c_str());
+    // ROS_INFO("imageCallback: %u, %u, %s", msg_r->width, msg_r->height, msg_r->encoding.c_str());
+    if (!checkEncoding(*msg_l) || !checkEncoding(*msg_r))
+        return;
+    input->post(StereoFrame{msg_l, msg_r});
+}
+
+// Updates rectification maps, point cloud and stixels projection, all are optional (can be null).
+// camera_info holds the latest left and right camera calibration.
+void cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& msg, StereoRectifier::Side side,
+                        sensor_msgs::CameraInfo::ConstPtr* camera_info,
+                        StereoRectifier* rectifier, PointCloudGenerator* point_cloud, StixelExtractor* stixels)
+{
+    const char* name = side == StereoRectifier::kLeft ? "left" : "right";
+    camera_info[side] = msg;
+    if (rectifier != nullptr)
+    {
+        auto prev_preproc = rectifier->getPreprocessor(side);
+        if (!rectifier->setCameraInfo(side, *msg))
+        {
+            ROS_ERROR_THROTTLE(5, "Camera %s is not calibrated or distortion model \"%s\" is not supported.",
+                               name, msg->distortion_model.c_str());
+        }
+        else if (rectifier->getPreprocessor(side) != prev_preproc)
+            ROS_INFO("Rectification maps updated for %s camera (%ux%u).", name, msg->width, msg->height);
+    }
+    const auto& info_l = camera_info[StereoRectifier::kLeft];
+    const auto& info_r = camera_info[StereoRectifier::kRight];
+    if (point_cloud != nullptr && info_l != nullptr && info_r != nullptr)
+    {
+        bool was_ready = point_cloud->isReady();
+        if (!point_cloud->setCalibration(*info_l, *info_r))
+            ROS_ERROR_THROTTLE(5, "Point cloud requires calibrated stereo pair (right camera P must have baseline).");
+        else if (!was_ready)
+            ROS_INFO("Point cloud calibration received.");
+    }
+    if (stixels != nullptr && info_l != nullptr && info_r != nullptr)
+    {
+        bool was_ready = stixels->isReady();
+        if (!stixels->setCalibration(*info_l, *info_r))
+            ROS_ERROR_THROTTLE(5, "Obstacles require calibrated stereo pair (right camera P must have baseline).");
+        else if (!was_ready)
+            ROS_INFO("Obstacles calibration received.");
+    }
+}
+
+// Publishes point cloud reprojected from disparity if there are subscribers.
+void publishPointCloud(const PointCloudGenerator& point_cloud, const std_msgs::Header& header,
+                       const cv::Mat& disp, const cv::Mat& conf, const ros::Publisher& pub)
+{
+    if (pub.getNumSubscribers() == 0)
+        return;
+    auto cloud = point_cloud.generate(header, disp, conf);
+    if (cloud == nullptr)
+    {
+        ROS_WARN_THROTTLE(5, "Waiting for camera calibration, point cloud is not published.");
+        return;
+    }
+    pub.publish(cloud);
+}
+
+// Publishes the nearest obstacle distance of each column if there are subscribers.
+void publishStixels(const StixelExtractor& stixels, const std_msgs::Header& header, ConstStr& frame_id,
+                    const cv::Mat& disp, const ros::Publisher& pub)
+{
+    if (pub.getNumSubscribers() == 0)
+        return;
+    auto scan = stixels.extract(header, disp);
+    if (scan == nullptr)
+    {
+        ROS_WARN_THROTTLE(5, "Waiting for camera calibration, obstacles are not published.");
+        return;
+    }
+    scan->header.frame_id = frame_id;
+    pub.publish(scan);
+}
+
+// Receive stage of the pipeline: passes the stereo pair to preprocessing stage
+// skipping frames that come faster than max_rate_hz.
+void pipelineImageCallback(const sensor_msgs::ImageConstPtr& msg_l, const sensor_msgs::ImageConstPtr& msg_r,
+                           PipelineStage<StereoFrame>* preprocess_stage, float max_rate_hz, ros::WallTime* last_time)
+{
+    if (!checkEncoding(*msg_l) || !checkEncoding(*msg_r))
+        return;
+    auto now = ros::WallTime::now();
+    if (max_rate_hz > 0 && (now - *last_time).toSec() < 1.0 / max_rate_hz)
+        return;
+    *last_time = now;
+    preprocess_stage->push(StereoFrame{msg_l, msg_r});
+}
+
+// Logs stage statistics since the last call and adds them to the pipeline diagnostics message.
+template<typename T>
+void reportStageStats(PipelineStage<T>& stage, double period_sec, diagnostic_msgs::DiagnosticStatus& msg)
+{
+    auto stats = stage.getStats(true);
+    ROS_INFO("Stage %-10s: %5.1f fps, %6.2fms avg, %6.2fms max, queue %zu/%zu, dropped %lu",
+             stage.getName().c_str(), stats.processed / period_sec, stats.avg_ms, stats.max_ms,
+             stats.queue_depth, stats.queue_size, (unsigned long)stats.dropped);
+
+    auto addValue = [&](ConstStr& key, ConstStr& value)
+    {
+        diagnostic_msgs::KeyValue kv;
+        kv.key   = stage.getName() + " " + key;
+        kv.value = value;
+        msg.values.push_back(kv);
+    };
+    addValue("fps",         (boost::format("%.1f") % (stats.processed / period_sec)).str());
+    addValue("avg_ms",      (boost::format("%.2f") % stats.avg_ms).str());
+    addValue("max_ms",      (boost::format("%.2f") % stats.max_ms).str());
+    addValue("queue_depth", std::to_string(stats.queue_depth));
+    addValue("queue_size",  std::to_string(stats.queue_size));
+    addValue("dropped",     std::to_string(stats.dropped));
+    // Frames dropped anywhere in the pipeline mean it can't keep up with the camera.
+    if (stats.dropped > 0)
+    {
+        msg.level   = diagnostic_msgs::DiagnosticStatus::WARN;
+        msg.message = "Dropping frames";
+    }
+}
+
+void printMotionGateStats(pp::MotionGate& gate)
+{
+    ROS_INFO("Motion gate: %s", pp::toString(gate.getStats(true)).c_str());
+}
+
+void parseModelType(const std::string& src, int& h, int& w, int& stride)
+{
+    if (boost::iequals(src, "nvsmall"))
+    {
+        h = 321;
+        w = 1025;
+        stride = kNVSmallStride;
+    }
+    else if (boost::iequals(src, "nvtiny"))
+    {
+        h = 161;
+        w = 513;
+        stride = kNVTinyStride;
+    }
+    else if (boost::iequals(src, "resnet18"))
+    {
+        h = 321;
+        w = 1025;
+        stride = kResNet18Stride;
+    }
+    else if (boost::iequals(src, "resnet18_2D"))
+    {
+        h = 257;
+        w = 513;
+        stride = kResNet18_2DStride;
+    }
+    else if (boost::iequals(src, "sgm"))
+    {
+        // Same resolution as resnet18_2D, SGM does not have stride requirements.
+        h = 257;
+        w = 513;
+        stride = 1;
+    }
+    else
+    {
+        redtail::throwNodeError("Not supported model type: %s. Supported types: nvsmall, nvtiny, resnet18, resnet18_2D, sgm", src.c_str());
+    }
+}
+
+SoftargmaxConfidence parseConfidenceType(const std::string& src)
+{
+    if (src.empty() || boost::iequals(src, "none"))
+        return SoftargmaxConfidence::kNone;
+    if (boost::iequals(src, "entropy"))
+        return SoftargmaxConfidence::kEntropy;
+    if (boost::iequals(src, "peak_prob"))
+        return SoftargmaxConfidence::kPeakProb;
+    else
+    {
+        redtail::throwNodeError("Invalid confidence type: %s. Supported types: none, entropy, peak_prob.", src.c_str());
+    }
+}
+
+DataType parseDataType(const std::string& src)
+{
+    if (boost::iequals(src, "FP32"))
+        return DataType::kFLOAT;
+    if (boost::iequals(src, "FP16"))
+        return DataType::kHALF;
+    else
+    {
+        redtail::throwNodeError("Invalid data type: %s. Supported data types: FP32, FP16.", src.c_str());
+    }
+}
+
+// Marks the input of softargmax layer (cost volume) as network output so it can be used in post-processing.
+void markCostVolumeOutput(INetworkDefinition& network, ConstStr& softargmax_name)
+{
+    for (int i = 0; i < network.getNbLayers(); i++)
+    {
+        auto layer = network.getLayer(i);
+        if (softargmax_name != layer->getName())
+            continue;
+        auto cost_vol = layer->getInput(0);
+        cost_vol->setName("cost_vol");
+        cost_vol->setType(DataType::kFLOAT);
+        network.markOutput(*cost_vol);
+        return;
+    }
+    redtail::throwNodeError("Could not find softargmax layer %s.", softargmax_name.c_str());
+}
+
+std::unordered_map<std::string, Weights> readWeights(const std::string& filename, DataType data_type)
+{
+    assert(data_type == DataType::kFLOAT || data_type == DataType::kHALF);
+
+    std::unordered_map<std::string, Weights> weights;
+    std::ifstream weights_file(filename, std::ios::binary);
+    if (!weights_file.is_open())
+        redtail::throwNodeError("Could not open weights file %s.", filename.c_str());
+    while (weights_file.peek() != std::ifstream::traits_type::eof())
+    {
+        std::string name;
+        uint32_t    count;
+        Weights     w {data_type, nullptr, 0};
+        std::getline(weights_file, name, '\0');
+        weights_file.read(reinterpret_cast<char*>(&count), sizeof(uint32_t));
+        w.count = count;
+        size_t el_size_bytes = data_type == DataType::kFLOAT ? 4 : 2;
+        auto p = new uint8_t[count * el_size_bytes];
+        weights_file.read(reinterpret_cast<char*>(p), count * el_size_bytes);
+        w.values = p;
+        assert(weights.find(name) == weights.cend());
+        weights[name] = w;
+    }
+    return weights;
+}
+
+// Loads TensorRT engine of the model from the plan file or builds it from the weights,
+// allocates device buffers and sets up post-processing. The networks are fully convolutional
+// so the engine is built for ROI dims which may differ from the model native input dims.
+std::unique_ptr<StereoModel> loadModel(ConstStr& model_type, ConstStr& model_path, const cv::Rect& roi,
+                                       DataType data_type, SoftargmaxConfidence conf_type, bool use_lr_check,
+                                       float lr_threshold, ConstStr& conf_encoding, ConstStr& disp_encoding,
+                                       IPluginContainer& plugin_container, ILogger& logger)
+{
+    int c = 3;
+    int h = 0;
+    int w = 0;
+    int stride = 0;
+    parseModelType(model_type, h, w, stride);
+
+    // TensorRT pre-built plan file. Plan depends on network input dims and outputs so add those to the name.
+    bool is_full_frame = roi.width == w && roi.height == h;
+    auto trt_plan_file = model_path + (is_full_frame ? "" : (boost::format(".%dx%d") % roi.width % roi.height).str()) +
+                         (conf_type == SoftargmaxConfidence::kNone ? "" : ".conf" + std::to_string((int)conf_type)) +
+                         (use_lr_check ? ".lr" : "") + ".plan";
+    std::ifstream trt_plan(trt_plan_file, std::ios::binary);
+
+    auto model  = std::make_unique<StereoModel>();
+    model->type = model_type;
+    ICudaEngine* engine = nullptr;
+
+    // Check if we can load pre-built model from TRT plan file.
+    // Currently only ResNet18_2D supports serialization.
+    if (model_type == "resnet18_2D" && trt_plan.good())
+    {
+        ROS_INFO("Loading TensorRT plan from %s...", trt_plan_file.c_str());
+        // StereoDnnPluginFactory object is stateless as it adds plugins to corresponding container.
+        StereoDnnPluginFactory factory(plugin_container);
+        IRuntime* runtime = createInferRuntime(logger);
+        // Load the plan.
+        std::stringstream plan;
+        plan << trt_plan.rdbuf();
+        plan.seekg(0, plan.beg);
+        const auto& plan_final = plan.str();
+        // Deserialize model.
+        engine = runtime->deserializeCudaEngine(plan_final.c_str(), plan_final.size(), &factory);
+        runtime->destroy();
+    }
+    else
+    {
+        ROS_INFO("Loading TensorRT weights from %s...", model_path.c_str());
+        // Read weights.
+        auto weights = readWeights(model_path, data_type);
+
+        // Create builder and network.
+        IBuilder* builder = createInferBuilder(logger);
+
+        // For now only ResNet18_2D has proper support for FP16.
+        // Networks are fully convolutional so are built for ROI dims.
+        auto in_dims = DimsCHW { c, roi.height, roi.width };
+        INetworkDefinition* network = nullptr;
+        if (model_type == "nvsmall")
+            network = createNVSmall1025x321Network(    *builder, plugin_container, in_dims, weights, DataType::kFLOAT, logger, conf_type);
+        else if (model_type == "nvtiny")
+            network = createNVTiny513x161Network(      *builder, plugin_container, in_dims, weights, DataType::kFLOAT, logger, conf_type);
+        else if (model_type == "resnet18")
+            network = createResNet18_1025x321Network(  *builder, plugin_container, in_dims, weights, DataType::kFLOAT, logger, conf_type);
+        else if (model_type == "resnet18_2D")
+            network = createResNet18_2D_513x257Network(*builder, plugin_container, in_dims, weights, data_type, logger, conf_type);
+        else
+            ROS_ASSERT(false);
+
+        // Softargmax layer names are set by the network builders.
+        if (use_lr_check)
+            markCostVolumeOutput(*network, model_type == "resnet18_2D" ? "softargmax" : "disp");
+
+        builder->setMaxBatchSize(1);
+        size_t workspace_bytes = 1024 * 1024 * 1024;
+        builder->setMaxWorkspaceSize(workspace_bytes);
+
+        builder->setHalf2Mode(data_type == DataType::kHALF);
+        // Build the network.
+        engine = builder->buildCudaEngine(*network);
+        // Cleanup, the engine does not reference the weights.
+        network->destroy();
+        builder->destroy();
+        for (auto& w: weights)
+            delete[] (uint8_t*)w.second.values;
+
+        if (model_type == "resnet18_2D")
+        {
+            ROS_INFO("Saving TensorRT plan to %s...", trt_plan_file.c_str());
+            IHostMemory *model_stream = engine->serialize();
+            std::ofstream trt_plan_out(trt_plan_file, std::ios::binary);
+            trt_plan_out.write((const char*)model_stream->data(), model_stream->size());
+            model_stream->destroy();
+        }
+    }
+    if (engine == nullptr)
+        redtail::throwNodeError("Could not create TensorRT engine for model %s.", model_path.c_str());
+    model->engine = engine;
+
+    bool has_conf = conf_type != SoftargmaxConfidence::kNone;
+    assert(engine->getNbBindings() == 3 + (has_conf ? 1 : 0) + (use_lr_check ? 1 : 0));
+    model->idx_left = engine->getBindingIndex("left");
+    assert(model->idx_left == 0);
+    model->idx_right = engine->getBindingIndex("right");
+    assert(model->idx_right == 1);
+
+    auto& out_params = model->out_params;
+    out_params.idx_disp = engine->getBindingIndex("disp");
+    assert(out_params.idx_disp >= 2);
+    out_params.idx_conf = has_conf ? engine->getBindingIndex("conf") : -1;
+    assert(!has_conf || out_params.idx_conf >= 2);
+    out_params.conf_encoding = conf_encoding;
+    out_params.disp_encoding = disp_encoding;
+    // resnet18_2D model normalizes disparity using sigmoid, so bring it back to pixels.
+    // Note: disparity is scaled with respect to full network input width, not ROI width.
+    out_params.disp_scale = model_type == "resnet18_2D" ? w : 1;
+
+    if (use_lr_check)
+    {
+        out_params.idx_cost_vol  = engine->getBindingIndex("cost_vol");
+        assert(out_params.idx_cost_vol >= 2);
+        out_params.cost_vol_dims = engine->getBindingDimensions(out_params.idx_cost_vol);
+        // 3D networks use softargmin over costs, 2D network uses softargmax over correlation.
+        model->lr_check = std::make_unique<LeftRightConsistency>(model_type != "resnet18_2D", lr_threshold);
+    }
+
+    model->context = engine->createExecutionContext();
+
+    auto& buffers   = model->buffers;
+    size_t img_size = c * roi.area();
+    CHECK(cudaMalloc(&buffers[model->idx_left],  img_size * sizeof(float)));
+    CHECK(cudaMalloc(&buffers[model->idx_right], img_size * sizeof(float)));
+    CHECK(cudaMalloc(&buffers[out_params.idx_disp], roi.area() * sizeof(float)));
+    if (disp_encoding == "16UC1")
+        CHECK(cudaMalloc(&out_params.disp_16u_d, roi.area() * sizeof(uint16_t)));
+    if (has_conf)
+        CHECK(cudaMalloc(&buffers[out_params.idx_conf], roi.area() * sizeof(float)));
+    if (use_lr_check)
+    {
+        size_t cost_vol_size = 1;
+        for (int i = 0; i < out_params.cost_vol_dims.nbDims; i++)
+            cost_vol_size *= out_params.cost_vol_dims.d[i];
+        CHECK(cudaMalloc(&buffers[out_params.idx_cost_vol], cost_vol_size * sizeof(float)));
+        const auto& dims = out_params.cost_vol_dims;
+        CHECK(cudaMalloc(&out_params.disp_r_d, dims.d[dims.nbDims - 2] * dims.d[dims.nbDims - 1] * sizeof(float)));
+    }
+    return model;
+}
+
+// Measures baseline latency (in milliseconds) of the model: the best of a few runs on a blank frame.
+// The runs also warm the model up so switching to it later does not cause a latency spike.
+float measureModelLatency(StereoModel& model, size_t h, size_t w, const cv::Rect& roi)
+{
+    const int num_runs = 5;
+    InputFrame frame;
+    frame.img_l = cv::Mat(3 * roi.height, roi.width, CV_32FC1, cv::Scalar(0));
+    frame.img_r = frame.img_l;
+    OutputPools pools(1);
+    float best_ms = std::numeric_limits<float>::max();
+    for (int i = 0; i < num_runs; i++)
+    {
+        auto start = ros::WallTime::now();
+        runInference(model.context, frame, h, w, roi, model.idx_left, model.idx_right, model.out_params,
+                     model.lr_check.get(), model.buffers, pools);
+        best_ms = std::min(best_ms, (float)(ros::WallTime::now() - start).toSec() * 1000);
+    }
+    return best_ms;
+}
+
+// Creates a message with the active model and statistics of each model (cumulative since start).
+diagnostic_msgs::DiagnosticStatus::Ptr createModelStatsMessage(const std::vector<std::unique_ptr<StereoModel>>& models,
+                                                               ModelSwitcher& switcher)
+{
+    auto msg = boost::make_shared<diagnostic_msgs::DiagnosticStatus>();
+    msg->level   = diagnostic_msgs::DiagnosticStatus::OK;
+    msg->name    = "stereo_dnn_ros: model";
+    msg->message = models[switcher.getActive()]->type;
+    auto stats   = switcher.getStats(false);
+    auto addValue = [&](ConstStr& key, ConstStr& value)
+    {
+        diagnostic_msgs::KeyValue kv;
+        kv.key   = key;
+        kv.value = value;
+        msg->values.push_back(kv);
+    };
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        const auto& type = models[i]->type;
+        addValue(type + " active_sec", (boost::format("%.3f") % stats[i].active_sec).str());
+        addValue(type + " frames",     std::to_string(stats[i].frames));
+        addValue(type + " avg_ms",     (boost::format("%.2f") % stats[i].avg_ms).str());
+        addValue(type + " switches",   std::to_string(stats[i].switches));
+    }
+    return msg;
+}
+
+} // stereo_dnn_ros
+
+namespace sd = stereo_dnn_ros;
+namespace mf = message_filters;
+
+class Logger : public ILogger
+{
+public:
+    void log(ILogger::Severity severity, const char* msg) override
+    {
+        // Skip info (verbose) messages.
+        if (severity == Severity::kINFO)
+            return;
+
+        switch (severity)
+        {
+            case Severity::kINTERNAL_ERROR: std::cerr << "TRT INTERNAL_ERROR: "; break;
+            case Severity::kERROR:          std::cerr << "TRT ERROR: "; break;
+            case Severity::kWARNING:        std::cerr << "TRT WARNING: "; break;
+            case Severity::kINFO:           std::cerr << "TRT INFO: "; break;
+            default:                        std::cerr << "TRT UNKNOWN: "; break;
+        }
+        std::cerr << msg << std::endl;
+    }
+};
+
+static Logger gLogger;
+
+void sd::run(ros::NodeHandle& nh, const redtail::StopSignal& stop)
+{
+    ROS_INFO("Starting Stereo DNN ROS node...");
+
+    std::string camera_topic_l;
+    std::string camera_topic_r;
+    std::string model_type;
+    std::string model_path;
+    std::string data_type_s;
+    std::string conf_type_s;
+    std::string conf_encoding;
+    std::string disp_encoding;
+    int         camera_queue_size;
+    int         dnn_queue_size;
+    float       max_rate_hz;
+    bool        debug_mode;
+    float       roi_top;
+    float       roi_bottom;
+    float       roi_left;
+    float       roi_right;
+    bool        use_lr_check;
+    float       lr_threshold;
+    int         sgm_max_disparity;
+    int         sgm_p1;
+    int         sgm_p2;
+    int         sgm_threads;
+    int         pipeline_queue_size;
+    float       stats_period;
+    bool        rectify;
+    bool        use_point_cloud;
+    sd::PointCloudGenerator::Params point_cloud_params;
+    bool        use_stixels;
+    sd::StixelExtractor::Params stixel_params;
+    std::string stixel_frame_id;
+    std::string camera_info_topic_l;
+    std::string camera_info_topic_r;
+    std::vector<std::string> fallback_model_types;
+    std::vector<std::string> fallback_model_paths;
+    sd::ModelSwitcher::Params switcher_params;
+    float       model_stats_period;
+    pp::MotionGate::Params motion_params;
+    float       motion_stats_period;
+
+    nh.param<std::string>("camera_topic_left",  camera_topic_l, "/zed/left/image_rect_color");
+    nh.param<std::string>("camera_topic_right", camera_topic_r, "/zed/right/image_rect_color");
+    nh.param<std::string>("model_type", model_type, "resnet18_2D");
+    nh.param<std::string>("model_path", model_path, "");
+    nh.param<std::string>("data_type",  data_type_s, "fp16");
+    // Per-pixel confidence published on network/confidence topic: none, entropy or peak_prob.
+    nh.param<std::string>("confidence",          conf_type_s,   "none");
+    nh.param<std::string>("confidence_encoding", conf_encoding, "mono8");
+    // Disparity encoding on network/output topic: 32FC1 (pixels) or 16UC1 (1/256 pixel units,
+    // same as KITTI, 0 - invalid) which halves the bandwidth.
+    nh.param<std::string>("output_encoding",     disp_encoding, "32FC1");
+
+    nh.param("camera_queue_size", camera_queue_size, 2);
+    nh.param("dnn_queue_size",    dnn_queue_size,    2);
+    nh.param("max_rate_hz",       max_rate_hz, 30.0f);
+    nh.param("debug_mode",        debug_mode,  false);
+    // Region of interest as fractions of the frame, e.g. use top/bottom to set a row band
+    // that excludes sky and vehicle hood. Only ROI is preprocessed and run through DNN.
+    nh.param("roi_top",           roi_top,     0.0f);
+    nh.param("roi_bottom",        roi_bottom,  1.0f);
+    nh.param("roi_left",          roi_left,    0.0f);
+    nh.param("roi_right",         roi_right,   1.0f);
+    // Left-right consistency check: disparities that differ by more than lr_threshold
+    // (in cost volume pixels) from the right view disparity are set to 0.
+    nh.param("lr_check",          use_lr_check, false);
+    nh.param("lr_threshold",      lr_threshold, 1.0f);
+    // Classical SGM stereo (model_type: sgm) settings: max disparity, small and large
+    // disparity change penalties and number of CPU threads (0 - use all cores).
+    nh.param("sgm_max_disparity", sgm_max_disparity, 64);
+    nh.param("sgm_p1",            sgm_p1,            10);
+    nh.param("sgm_p2",            sgm_p2,            120);
+    nh.param("sgm_threads",       sgm_threads,       0);
+    // DNN pipeline: size of queues between stages (older frames are dropped when a queue is full)
+    // and period (in seconds) of stages statistics output, 0 - disabled. Statistics are logged
+    // and published on network/pipeline_stats (per-stage fps, timing, queue depth and drops).
+    nh.param("pipeline_queue_size", pipeline_queue_size, 2);
+    nh.param("stats_period",        stats_period,        0.0f);
+    // Rectify raw camera images using calibration from camera info topics. Rectification
+    // is fused with resize to the network input so it does not add a pass over the image.
+    // When enabled, camera topics should be set to raw (unrectified) images.
+    nh.param("rectify",             rectify,             false);
+    nh.param<std::string>("camera_info_topic_left",  camera_info_topic_l, "/zed/left/camera_info_raw");
+    nh.param<std::string>("camera_info_topic_right", camera_info_topic_r, "/zed/right/camera_info_raw");
+    // Point cloud reprojected from disparity (network/points topic) using calibration from camera
+    // info topics: decimation, depth range (in meters) and min confidence (if confidence is enabled).
+    nh.param("point_cloud",                use_point_cloud,                   false);
+    nh.param("point_cloud_decimation",     point_cloud_params.decimation,     1);
+    nh.param("point_cloud_min_range",      point_cloud_params.min_range,      0.0f);
+    nh.param("point_cloud_max_range",      point_cloud_params.max_range,      100.0f);
+    nh.param("point_cloud_min_confidence", point_cloud_params.min_confidence, 0.0f);
+    // Nearest obstacle in each image column (stixels) published as LaserScan on network/obstacles
+    // topic: column width (pixels), camera height above ground (m) and pitch (rad, positive is down),
+    // obstacle height range above ground (m), max distance (m) and min number of pixels per obstacle.
+    // The scan plane is horizontal (x forward, z up) so it can't use the camera optical frame:
+    // obstacles_frame_id is required, e.g. the camera link frame (located at the left camera).
+    nh.param("obstacles",                  use_stixels,                  false);
+    nh.param("obstacles_column_width",     stixel_params.column_width,   8);
+    nh.param("obstacles_camera_height",    stixel_params.camera_height,  0.5f);
+    nh.param("obstacles_camera_pitch",     stixel_params.camera_pitch,   0.0f);
+    nh.param("obstacles_min_height",       stixel_params.min_height,     0.2f);
+    nh.param("obstacles_max_height",       stixel_params.max_height,     2.0f);
+    nh.param("obstacles_max_range",        stixel_params.max_range,      20.0f);
+    nh.param("obstacles_min_points",       stixel_params.min_points,     10);
+    nh.param<std::string>("obstacles_frame_id", stixel_frame_id,         "");
+    // Adaptive model switching: fallback models (lists of types and paths) ordered from more
+    // accurate to faster. All models are preloaded and the node switches between them
+    // (model_type being the preferred one) to keep per-frame inference latency within the budget:
+    // to a faster model after latency_down_frames over budget frames, back to a more accurate one
+    // when its predicted latency stays below latency_up_ratio * budget for latency_up_frames frames.
+    // Active model is published on network/model and per-model statistics on network/model_stats
+    // every model_stats_period seconds. All models run at model_type input resolution.
+    nh.param("fallback_model_types", fallback_model_types, std::vector<std::string>());
+    nh.param("fallback_model_paths", fallback_model_paths, std::vector<std::string>());
+    nh.param("latency_budget_ms",    switcher_params.budget_ms,   50.0f);
+    nh.param("latency_down_frames",  switcher_params.down_frames, 5);
+    nh.param("latency_up_ratio",     switcher_params.up_ratio,    0.8f);
+    nh.param("latency_up_frames",    switcher_params.up_frames,   30);
+    nh.param("model_stats_period",   model_stats_period,          1.0f);
+    // Motion gating: frames which differ from the last processed frame by less than motion_threshold
+    // (mean absolute intensity difference of downsampled left image ROI, 0..255, 0 - disabled)
+    // are not run through DNN, the last outputs are republished with the new frame stamp instead.
+    // At most motion_max_skip consecutive frames are skipped. Skip rate and saved inference time
+    // are logged every motion_stats_period seconds.
+    nh.param("motion_threshold",     motion_params.threshold,     0.0f);
+    nh.param("motion_max_skip",      motion_params.max_skip,      10);
+    nh.param("motion_stats_period",  motion_stats_period,         10.0f);
+
+    int h = 0;
+    int w = 0;
+    int stride = 0;
+
+    sd::parseModelType(model_type, h, w, stride);
+    std::vector<std::string> model_types {model_type};
+    std::vector<std::string> model_paths {model_path};
+    model_types.insert(model_types.end(), fallback_model_types.begin(), fallback_model_types.end());
+    model_paths.insert(model_paths.end(), fallback_model_paths.begin(), fallback_model_paths.end());
+    if (fallback_model_types.size() != fallback_model_paths.size())
+    {
+        redtail::throwNodeError("fallback_model_types and fallback_model_paths must have the same number of items.");
+    }
+    // ROI is shared by all models so it must satisfy all stride requirements.
+    for (size_t i = 1; i < model_types.size(); i++)
+    {
+        int model_h = 0;
+        int model_w = 0;
+        int model_stride = 0;
+        sd::parseModelType(model_types[i], model_h, model_w, model_stride);
+        if (model_types[i] == "sgm" || model_type == "sgm")
+        {
+            redtail::throwNodeError("SGM can't be used with adaptive model switching.");
+        }
+        if (model_w != w)
+            ROS_WARN("Model %s has different input width (%d) than %s (%d), disparity ranges will differ.",
+                     model_types[i].c_str(), model_w, model_type.c_str(), w);
+        stride = std::max(stride, model_stride);
+    }
+    auto roi = sd::computeNetworkRoi(h, w, stride, roi_top, roi_bottom, roi_left, roi_right);
+
+    ROS_INFO("Camera L: %s", camera_topic_l.c_str());
+    ROS_INFO("Camera R: %s", camera_topic_r.c_str());
+    ROS_INFO("Model T : %s", model_type.c_str());
+    ROS_INFO("Model   : %s", model_path.c_str());
+    ROS_INFO("DType   : %s", data_type_s.c_str());
+    ROS_INFO("Cam Q   : %d", camera_queue_size);
+    ROS_INFO("DNN Q   : %d", dnn_queue_size);
+    ROS_INFO("Rate    : %.1f", max_rate_hz);
+    ROS_INFO("Pipe Q  : %d", pipeline_queue_size);
+    ROS_INFO("Debug   : %s", debug_mode ? "yes" : "no");
+    ROS_INFO("Output  : %s", disp_encoding.c_str());
+    ROS_INFO("Conf    : %s (%s)", conf_type_s.c_str(), conf_encoding.c_str());
+    ROS_INFO("LR check: %s (%.1f)", use_lr_check ? "yes" : "no", lr_threshold);
+    ROS_INFO("Rectify : %s", rectify ? "yes" : "no");
+    ROS_INFO("Points  : %s (decimation %d, range [%.1f, %.1f], min conf %.2f)", use_point_cloud ? "yes" : "no",
+             point_cloud_params.decimation, point_cloud_params.min_range, point_cloud_params.max_range,
+             point_cloud_params.min_confidence);
+    ROS_INFO("Obstacle: %s (column %d, camera height %.2f, pitch %.3f, height [%.2f, %.2f], range %.1f, min points %d)",
+             use_stixels ? "yes" : "no", stixel_params.column_width, stixel_params.camera_height,
+             stixel_params.camera_pitch, stixel_params.min_height, stixel_params.max_height,
+             stixel_params.max_range, stixel_params.min_points);
+    if (model_types.size() > 1)
+    {
+        ROS_INFO("Adaptive: %s (budget %.1fms, down %d frames, up ratio %.2f, up %d frames)",
+                 boost::algorithm::join(model_types, ", ").c_str(), switcher_params.budget_ms,
+                 switcher_params.down_frames, switcher_params.up_ratio, switcher_params.up_frames);
+    }
+    ROS_INFO("Motion  : %s (threshold %.2f, max skip %d)", motion_params.threshold > 0 ? "yes" : "no",
+             motion_params.threshold, motion_params.max_skip);
+    ROS_INFO("ROI     : (%.2f, %.2f, %.2f, %.2f) -> (X:%d, Y:%d, W:%d, H:%d)",
+             roi_top, roi_bottom, roi_left, roi_right, roi.x, roi.y, roi.width, roi.height);
+
+    auto data_type = sd::parseDataType(data_type_s);
+    auto conf_type = sd::parseConfidenceType(conf_type_s);
+    if (conf_encoding != "mono8" && conf_encoding != "mono16")
+    {
+        redtail::throwNodeError("Invalid confidence encoding: %s. Supported encodings: mono8, mono16.", conf_encoding.c_str());
+    }
+    if (disp_encoding != "32FC1" && disp_encoding != "16UC1")
+    {
+        redtail::throwNodeError("Invalid output encoding: %s. Supported encodings: 32FC1, 16UC1.", disp_encoding.c_str());
+    }
+    if (point_cloud_params.decimation < 1 || point_cloud_params.min_range < 0 ||
+        point_cloud_params.min_range > point_cloud_params.max_range)
+    {
+        redtail::throwNodeError("Invalid point cloud settings: decimation must be >= 1 and 0 <= min_range <= max_range.");
+    }
+    if (stixel_params.column_width < 1 || stixel_params.min_points < 1 || stixel_params.max_range <= 0 ||
+        stixel_params.min_height > stixel_params.max_height)
+    {
+        redtail::throwNodeError("Invalid obstacles settings: column_width and min_points must be >= 1, max_range > 0 "
+                                "and min_height <= max_height.");
+    }
+    if (use_stixels && stixel_frame_id.empty())
+    {
+        redtail::throwNodeError("obstacles_frame_id must be set when obstacles are enabled: the scan is horizontal "
+                                "(x forward, z up) and can't use the camera optical frame.");
+    }
+    if (switcher_params.budget_ms <= 0 || switcher_params.down_frames < 1 || switcher_params.up_frames < 1 ||
+        switcher_params.up_ratio <= 0 || switcher_params.up_ratio > 1)
+    {
+        redtail::throwNodeError("Invalid adaptive model settings: latency_budget_ms must be > 0, latency_down_frames and "
+                                "latency_up_frames >= 1 and latency_up_ratio in (0, 1].");
+    }
+    if (motion_params.threshold < 0 || motion_params.max_skip < 0)
+    {
+        redtail::throwNodeError("Invalid motion gating settings: motion_threshold and motion_max_skip must be >= 0.");
+    }
+    if (model_type == "sgm")
+    {
+        if (sgm_max_disparity <= 0)
+            redtail::throwNodeError("Invalid sgm_max_disparity: %d, must be > 0.", sgm_max_disparity);
+        if (sgm_p1 <= 0 || sgm_p1 >= sgm_p2)
+            redtail::throwNodeError("Invalid sgm_p1: %d, sgm_p2: %d, must be 0 < sgm_p1 < sgm_p2.", sgm_p1, sgm_p2);
+        if (sgm_p2 > redtail::stereo::SgmStereo::getMaxP2())
+        {
+            redtail::throwNodeError("Invalid sgm_p2: %d, must be <= %d so path costs fit into 16 bits.",
+                                    sgm_p2, redtail::stereo::SgmStereo::getMaxP2());
+        }
+        if (sgm_threads < 0)
+            redtail::throwNodeError("Invalid sgm_threads: %d, must be >= 0 (0 - use all cores).", sgm_threads);
+    }
+
+    mf::Subscriber<sensor_msgs::Image> image_sub_l(nh, camera_topic_l, camera_queue_size);
+    mf::Subscriber<sensor_msgs::Image> image_sub_r(nh, camera_topic_r, camera_queue_size);
+
+    using MySyncPolicy = mf::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image>;
+    mf::Synchronizer<MySyncPolicy> sync(MySyncPolicy(camera_queue_size), image_sub_l, image_sub_r);
+    //mf::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image> sync(image_sub_l, image_sub_r, 10);
+
+    auto output_pub = nh.advertise<sensor_msgs::Image>("network/output", dnn_queue_size);
+
+    // Networks expect RGB input in [0, 1] range.
+    std::unique_ptr<sd::StereoRectifier> rectifier;
+    if (rectify)
+        rectifier = std::make_unique<sd::StereoRectifier>(h, w, roi, pp::ChannelOrder::kRGB, 1 / 255.0f);
+    std::unique_ptr<sd::PointCloudGenerator> point_cloud;
+    ros::Publisher points_pub;
+    if (use_point_cloud)
+    {
+        // Messages in the publisher queue, the one being published and the one being generated.
+        point_cloud = std::make_unique<sd::PointCloudGenerator>(h, w, point_cloud_params, 0, dnn_queue_size + 2);
+        points_pub  = nh.advertise<sensor_msgs::PointCloud2>("network/points", dnn_queue_size);
+        if (point_cloud_params.min_confidence > 0 && conf_type == SoftargmaxConfidence::kNone)
+            ROS_WARN("point_cloud_min_confidence requires confidence output and will be ignored.");
+    }
+    std::unique_ptr<sd::StixelExtractor> stixels;
+    ros::Publisher obstacles_pub;
+    if (use_stixels)
+    {
+        stixels       = std::make_unique<sd::StixelExtractor>(h, w, stixel_params);
+        obstacles_pub = nh.advertise<sensor_msgs::LaserScan>("network/obstacles", dnn_queue_size);
+    }
+    // Latest left and right camera calibration.
+    sensor_msgs::CameraInfo::ConstPtr camera_info[2];
+    ros::Subscriber camera_info_sub_l;
+    ros::Subscriber camera_info_sub_r;
+    if (rectify || use_point_cloud || use_stixels)
+    {
+        ROS_INFO("Cam info: %s, %s", camera_info_topic_l.c_str(), camera_info_topic_r.c_str());
+        camera_info_sub_l = nh.subscribe<sensor_msgs::CameraInfo>(camera_info_topic_l, 1,
+            boost::bind(&sd::cameraInfoCallback, _1, sd::StereoRectifier::kLeft, camera_info,
+                        rectifier.get(), point_cloud.get(), stixels.get()));
+        camera_info_sub_r = nh.subscribe<sensor_msgs::CameraInfo>(camera_info_topic_r, 1,
+            boost::bind(&sd::cameraInfoCallback, _1, sd::StereoRectifier::kRight, camera_info,
+                        rectifier.get(), point_cloud.get(), stixels.get()));
+    }
+
+    // SGM runs on CPU so TensorRT is not used at all.
+    if (model_type == "sgm")
+    {
+        // Callbacks run on the spinner (or nodelet manager) thread while SGM runs
+        // on this thread as soon as the stereo pair arrives, max_rate_hz is only a ceiling.
+        redtail::executor::EventExecutor::Params exec_params;
+        exec_params.max_rate_hz = max_rate_hz;
+        redtail::executor::EventExecutor executor(exec_params);
+        redtail::executor::LatestInput<sd::StereoFrame> frame_input(executor);
+        if (conf_type != SoftargmaxConfidence::kNone || use_lr_check)
+            ROS_WARN("Confidence and LR check are not supported by SGM and will be ignored.");
+        redtail::stereo::SgmStereo sgm(sgm_max_disparity, sgm_p1, sgm_p2, sgm_threads);
+        ROS_INFO("SGM     : D:%d, P1:%d, P2:%d, threads:%d", sgm.getMaxDisparity(), sgm_p1, sgm_p2, sgm.getNumThreads());
+        pp::ImagePreprocessor preproc(roi.width, roi.height, pp::ChannelOrder::kRGB, pp::Interpolation::kArea);
+        // Messages in the publisher queue, the one being published and the one being computed.
+        sd::OutputPools pools(dnn_queue_size + 2);
+        sync.registerCallback(boost::bind(&sd::imageCallback, _1, _2, &frame_input));
+        // Callbacks are stopped before the objects they use are destroyed, also when SGM fails.
+        try
+        {
+            executor.run([&]
+                {
+                    sd::StereoFrame frame;
+                    if (!frame_input.take(frame))
+                        return;
+                    auto out_msg = sd::computeSgmOutput(sgm, frame, h, w, roi, preproc, rectifier.get(),
+                                                        disp_encoding, pools.disp_msgs);
+                    if (out_msg == nullptr)
+                        return;
+                    output_pub.publish(out_msg);
+                    int  type = disp_encoding == "16UC1" ? CV_16UC1 : CV_32FC1;
+                    auto disp = cv::Mat(h, w, type, (void*)out_msg->data.data());
+                    if (point_cloud != nullptr)
+                        sd::publishPointCloud(*point_cloud, out_msg->header, disp, cv::Mat(), points_pub);
+                    if (stixels != nullptr)
+                        sd::publishStixels(*stixels, out_msg->header, stixel_frame_id, disp, obstacles_pub);
+                },
+                [&stop] { return !stop.isStopped(); });
+        }
+        catch (...)
+        {
+            image_sub_l.unsubscribe();
+            image_sub_r.unsubscribe();
+            throw;
+        }
+        image_sub_l.unsubscribe();
+        image_sub_r.unsubscribe();
+        return;
+    }
+
+    // Note: the plugin_container object lifetime must be at least the same as the engines.
+    auto plugin_container = IPluginContainer::create(gLogger);
+    // All models are preloaded so switching between them does not stall the pipeline.
+    std::vector<std::unique_ptr<sd::StereoModel>> models;
+    for (size_t i = 0; i < model_types.size(); i++)
+    {
+        models.push_back(sd::loadModel(model_types[i], model_paths[i], roi, data_type, conf_type, use_lr_check,
+                                       lr_threshold, conf_encoding, disp_encoding, *plugin_container, gLogger));
+    }
+
+    std::unique_ptr<sd::ModelSwitcher> switcher;
+    ros::Publisher model_pub;
+    ros::Publisher model_stats_pub;
+    if (models.size() > 1)
+    {
+        switcher = std::make_unique<sd::ModelSwitcher>((int)models.size(), switcher_params);
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            float latency_ms = sd::measureModelLatency(*models[i], h, w, roi);
+            switcher->setBaseline((int)i, latency_ms);
+            ROS_INFO("Model %-12s: %.1fms baseline latency", models[i]->type.c_str(), latency_ms);
+        }
+        // Active model type is published (latched) on each switch.
+        model_pub       = nh.advertise<std_msgs::String>("network/model", 1, true);
+        model_stats_pub = nh.advertise<diagnostic_msgs::DiagnosticStatus>("network/model_stats", 1);
+        std_msgs::String model_msg;
+        model_msg.data = models[0]->type;
+        model_pub.publish(model_msg);
+    }
+
+    // if (debug_mode_)
+    //     net_.showProfile(true);
+
+    bool has_conf = conf_type != SoftargmaxConfidence::kNone;
+    ros::Publisher conf_pub;
+    if (has_conf)
+        conf_pub = nh.advertise<sensor_msgs::Image>("network/confidence", dnn_queue_size);
+
+    std::unique_ptr<pp::MotionGate> motion_gate;
+    if (motion_params.threshold > 0)
+        motion_gate = std::make_unique<pp::MotionGate>(motion_params);
+    // Frames in the pipeline queues and stages, messages in the publisher queue and the last outputs.
+    sd::OutputPools pools(pipeline_queue_size + dnn_queue_size + 4);
+    // The last computed outputs, republished for frames skipped by the motion gate.
+    // The frame keeps the buffers referenced by its disparity and confidence images.
+    sd::OutputFrame last_frame;
+    sensor_msgs::Image::ConstPtr last_out_msg;
+    sensor_msgs::Image::ConstPtr last_conf_msg;
+    // Motion gate key frame of the last published outputs.
+    uint64_t last_key_id = 0;
+    // The first error of a pipeline stage, the node is stopped and the error is rethrown by this thread.
+    std::mutex         error_mutex;
+    std::exception_ptr stage_error;
+    auto on_stage_error = [&](std::exception_ptr error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (stage_error == nullptr)
+                stage_error = error;
+        }
+        stop.wake();
+    };
+
+    // Staged pipeline: receive (ROS callback) -> preprocess (left and right in parallel) -> infer -> publish.
+    // Stages run in their own threads and are connected by bounded lock-free queues which drop
+    // the oldest frame when full, so throughput is defined by the slowest stage and latency stays bounded.
+    // Note: stages are destroyed (stopped) in reverse order so the upstream stage is stopped first.
+    sd::PipelineStage<sd::OutputFrame> publish_stage("publish", pipeline_queue_size, [&](sd::OutputFrame& frame)
+    {
+        if (frame.repeat)
+        {
+            // The key frame of this frame was dropped by the pipeline, republishing the outputs
+            // of an older key frame would be wrong: drop the frame and process the next one.
+            if (last_out_msg == nullptr || frame.key_id != last_key_id)
+            {
+                motion_gate->reset();
+                return;
+            }
+            output_pub.publish(sd::restampImageMessage(*last_out_msg, frame.header, pools.disp_msgs));
+            if (last_conf_msg != nullptr)
+                conf_pub.publish(sd::restampImageMessage(*last_conf_msg, frame.header, pools.conf_msgs));
+            frame.disp = last_frame.disp;
+            frame.conf = last_frame.conf;
+        }
+        else
+        {
+            const auto& model = *models[frame.model];
+            last_out_msg = sd::computeOutputs(frame, roi, model.out_params, model.lr_check.get(), pools, last_conf_msg);
+            output_pub.publish(last_out_msg);
+            if (last_conf_msg != nullptr)
+                conf_pub.publish(last_conf_msg);
+            // Right view disparity is not needed anymore.
+            frame.disp_r.reset();
+            last_frame  = frame;
+            last_key_id = frame.key_id;
+        }
+        // Disparity is in pixels and LR checked at this point.
+        if (point_cloud != nullptr)
+            sd::publishPointCloud(*point_cloud, frame.header, frame.disp, frame.conf, points_pub);
+        if (stixels != nullptr)
+            sd::publishStixels(*stixels, frame.header, stixel_frame_id, frame.disp, obstacles_pub);
+    }, on_stage_error);
+    // GPU buffers and execution contexts are used only by the inference stage thread.
+    // The model is selected per frame so the switch happens between frames and no frame is dropped.
+    sd::PipelineStage<sd::InputFrame> infer_stage("infer", pipeline_queue_size, [&](sd::InputFrame& frame)
+    {
+        // Skipped frames go through the stage so the outputs stay in order.
+        if (frame.skip)
+        {
+            sd::OutputFrame res;
+            res.header = frame.header;
+            res.repeat = true;
+            res.key_id = frame.key_id;
+            publish_stage.push(std::move(res));
+            return;
+        }
+        int   cur   = switcher != nullptr ? switcher->getActive() : 0;
+        auto& model = *models[cur];
+        auto  start = ros::WallTime::now();
+        auto  res   = sd::runInference(model.context, frame, h, w, roi, model.idx_left, model.idx_right,
+                                       model.out_params, model.lr_check.get(), model.buffers, pools);
+        res.model   = cur;
+        res.key_id  = frame.key_id;
+        float infer_ms = (ros::WallTime::now() - start).toSec() * 1000;
+        if (motion_gate != nullptr)
+            motion_gate->addComputeTime(infer_ms);
+        if (switcher != nullptr && switcher->update(cur, infer_ms))
+        {
+            int next = switcher->getActive();
+            ROS_INFO("Switching model %s -> %s (%.1fms predicted latency, %.1fms budget).", model.type.c_str(),
+                     models[next]->type.c_str(), switcher->predictLatency(next), switcher_params.budget_ms);
+            std_msgs::String model_msg;
+            model_msg.data = models[next]->type;
+            model_pub.publish(model_msg);
+        }
+        publish_stage.push(std::move(res));
+    }, on_stage_error);
+    pp::ImagePreprocessor preproc(roi.width, roi.height, pp::ChannelOrder::kRGB, pp::Interpolation::kArea, 1 / 255.0f);
+    sd::PipelineStage<sd::StereoFrame> preprocess_stage("preprocess", pipeline_queue_size, [&](sd::StereoFrame& frame)
+    {
+        // Calibration may be updated concurrently so keep references to the current preprocessors.
+        std::shared_ptr<const pp::ImagePreprocessor> preproc_l;
+        std::shared_ptr<const pp::ImagePreprocessor> preproc_r;
+        if (rectifier != nullptr && !sd::getRectifyingPreprocessors(*rectifier, frame, preproc_l, preproc_r))
+            return;
+        uint64_t key_id = 0;
+        if (motion_gate != nullptr)
+        {
+            // Only the left image ROI is checked, it is enough to detect both ego-motion and moving objects.
+            const auto& img = *frame.img_l;
+            auto img_h   = cv::Mat((int)img.height, (int)img.width, img.encoding == "bgra8" ? CV_8UC4 : CV_8UC3, (void*)img.data.data());
+            auto src_roi = sd::scaleRoi(roi, h, w, img_h.rows, img_h.cols);
+            if (!motion_gate->update(img_h(src_roi), &key_id))
+            {
+                sd::InputFrame skipped;
+                skipped.header = img.header;
+                skipped.skip   = true;
+                skipped.key_id = key_id;
+                infer_stage.push(std::move(skipped));
+                return;
+            }
+        }
+        auto res = rectifier == nullptr ? sd::preprocessFrame(frame, h, w, roi, preproc, preproc) :
+                                          sd::preprocessFrame(frame, h, w, roi, *preproc_l, *preproc_r);
+        res.key_id = key_id;
+        infer_stage.push(std::move(res));
+    }, on_stage_error);
+    publish_stage.start();
+    infer_stage.start();
+    preprocess_stage.start();
+
+    ros::WallTime last_frame_time;
+    sync.registerCallback(boost::bind(&sd::pipelineImageCallback, _1, _2, &preprocess_stage, max_rate_hz, &last_frame_time));
+
+    ros::Publisher stats_pub;
+    ros::WallTimer stats_timer;
+    if (stats_period > 0)
+    {
+        stats_pub   = nh.advertise<diagnostic_msgs::DiagnosticStatus>("network/pipeline_stats", 1);
+        stats_timer = nh.createWallTimer(ros::WallDuration(stats_period), [&](const ros::WallTimerEvent&)
+        {
+            auto msg = boost::make_shared<diagnostic_msgs::DiagnosticStatus>();
+            msg->level   = diagnostic_msgs::DiagnosticStatus::OK;
+            msg->name    = "stereo_dnn_ros: pipeline";
+            sd::reportStageStats(preprocess_stage, stats_period, *msg);
+            sd::reportStageStats(infer_stage,      stats_period, *msg);
+            sd::reportStageStats(publish_stage,    stats_period, *msg);
+            stats_pub.publish(msg);
+        });
+    }
+    ros::WallTimer model_stats_timer;
+    if (switcher != nullptr && model_stats_period > 0)
+    {
+        model_stats_timer = nh.createWallTimer(ros::WallDuration(model_stats_period), [&](const ros::WallTimerEvent&)
+        {
+            model_stats_pub.publish(sd::createModelStatsMessage(models, *switcher));
+        });
+    }
+    ros::WallTimer motion_stats_timer;
+    if (motion_gate != nullptr && motion_stats_period > 0)
+    {
+        motion_stats_timer = nh.createWallTimer(ros::WallDuration(motion_stats_period), [&](const ros::WallTimerEvent&)
+        {
+            sd::printMotionGateStats(*motion_gate);
+        });
+    }
+
+    // Callbacks are executed by the caller (spinner or nodelet manager) and
+    // the pipeline stages run on their own threads, so this thread only waits for the stop or a stage error.
+    stop.wait([&]
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            return stage_error != nullptr;
+        });
+    // Stop callbacks before the objects they use are destroyed.
+    image_sub_l.unsubscribe();
+    image_sub_r.unsubscribe();
+    if (stage_error != nullptr)
+        std::rethrow_exception(stage_error);
+    auto msg_stats = pools.disp_msgs.getStats(false);
+    ROS_INFO("Output messages: %lu published, %lu allocated.", (unsigned long)msg_stats.acquired,
+             (unsigned long)msg_stats.allocated);
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <pluginlib/class_list_macros.h>
+
+#include "stereo_dnn_ros/stereo_dnn_ros.h"
+#include "loop_nodelet.h"
+
+namespace stereo_dnn_ros
+{
+class StereoDnnRosNodelet : public redtail::LoopNodelet
+{
+public:
+    StereoDnnRosNodelet():
+        LoopNodelet(&stereo_dnn_ros::run)
+    {
+    }
+};
+}
+
+PLUGINLIB_EXPORT_CLASS(stereo_dnn_ros::StereoDnnRosNodelet, nodelet::Nodelet)
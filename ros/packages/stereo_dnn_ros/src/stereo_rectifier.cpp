@@ -0,0 +1,102 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "stereo_dnn_ros/stereo_rectifier.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace pp = redtail::preprocessing;
+
+namespace stereo_dnn_ros
+{
+
+StereoRectifier::StereoRectifier(int h, int w, const cv::Rect& roi, pp::ChannelOrder order, float scale, float shift):
+    h_(h), w_(w), roi_(roi), order_(order), scale_(scale), shift_(shift)
+{
+    assert(h_ > 0 && w_ > 0);
+    assert((roi_ & cv::Rect(0, 0, w_, h_)) == roi_);
+}
+
+static bool isSameCalibration(const sensor_msgs::CameraInfo& a, const sensor_msgs::CameraInfo& b)
+{
+    return a.width == b.width && a.height == b.height && a.distortion_model == b.distortion_model &&
+           a.D == b.D && a.K == b.K && a.R == b.R && a.P == b.P;
+}
+
+bool StereoRectifier::createMaps(const sensor_msgs::CameraInfo& info, int h, int w, const cv::Rect& roi, int samples,
+                                 cv::Mat& map_x, cv::Mat& map_y)
+{
+    assert(samples >= 1);
+    // K is all zeros for uncalibrated cameras.
+    if (info.K[0] == 0 || info.P[0] == 0 || info.width == 0 || info.height == 0)
+        return false;
+
+    auto k = cv::Matx33d(info.K.data());
+    auto d = cv::Mat(info.D, true);
+    auto r = cv::Matx33d(info.R.data());
+    // Monocular cameras may have R set to zeros.
+    if (r(2, 2) == 0)
+        r = cv::Matx33d::eye();
+    // Rectified camera matrix scaled to supersampled network input and shifted to ROI.
+    // Pixel centers are aligned the same way as in cv::resize: x' = (x + 0.5) * s - 0.5.
+    const auto& p = info.P;
+    double sx = (double)w * samples / info.width;
+    double sy = (double)h * samples / info.height;
+    auto new_k = cv::Matx33d(p[0] * sx, p[1] * sx, (p[2] + 0.5) * sx - 0.5 - roi.x * samples,
+                             0,         p[5] * sy, (p[6] + 0.5) * sy - 0.5 - roi.y * samples,
+                             0,         0,         1);
+    auto size = cv::Size(roi.width * samples, roi.height * samples);
+    if (info.distortion_model == "equidistant")
+    {
+        if (d.total() != 4)
+            return false;
+        cv::fisheye::initUndistortRectifyMap(k, d, r, new_k, size, CV_32FC1, map_x, map_y);
+    }
+    else if (info.distortion_model == "plumb_bob" || info.distortion_model == "rational_polynomial" || d.empty())
+        cv::initUndistortRectifyMap(k, d, r, new_k, size, CV_32FC1, map_x, map_y);
+    else
+        return false;
+    return true;
+}
+
+bool StereoRectifier::setCameraInfo(Side side, const sensor_msgs::CameraInfo& info)
+{
+    auto& cam = cameras_[side];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cam.preproc != nullptr && isSameCalibration(cam.info, info))
+            return true;
+    }
+
+    // Average several bilinear samples per network pixel when raw image is
+    // significantly bigger than network input to reduce aliasing.
+    float ratio   = std::max((float)info.width / w_, (float)info.height / h_);
+    int   samples = std::min(std::max((int)std::round(ratio), 1), 3);
+    cv::Mat map_x;
+    cv::Mat map_y;
+    if (!createMaps(info, h_, w_, roi_, samples, map_x, map_y))
+        return false;
+    auto preproc = std::make_shared<pp::ImagePreprocessor>(roi_.width, roi_.height, order_, pp::Interpolation::kLinear,
+                                                           scale_, shift_);
+    preproc->setRemap(map_x, map_y, samples, info.width, info.height);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    cam.info    = info;
+    cam.preproc = preproc;
+    return true;
+}
+
+std::shared_ptr<const pp::ImagePreprocessor> StereoRectifier::getPreprocessor(Side side) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cameras_[side].preproc;
+}
+
+bool StereoRectifier::isReady() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cameras_[kLeft].preproc != nullptr && cameras_[kRight].preproc != nullptr;
+}
+
+}
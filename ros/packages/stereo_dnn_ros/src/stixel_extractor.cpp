@@ -0,0 +1,204 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "stereo_dnn_ros/stixel_extractor.h"
+#include "stereo_dnn_ros/disparity_16u.h"
+#include "cpu_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <boost/make_shared.hpp>
+
+namespace stereo_dnn_ros
+{
+
+StixelExtractor::StixelExtractor(int h, int w, const Params& params, int num_threads):
+    h_(h), w_(w), params_(params), num_threads_(num_threads)
+{
+    assert(h_ > 0 && w_ > 0);
+    assert(params_.column_width >= 1);
+    assert(params_.min_height <= params_.max_height);
+    assert(params_.max_range > 0);
+    assert(params_.min_points >= 1);
+}
+
+bool StixelExtractor::setCalibration(const sensor_msgs::CameraInfo& info_l, const sensor_msgs::CameraInfo& info_r)
+{
+    Projection proj;
+    if (!PointCloudGenerator::computeProjection(info_l, info_r, h_, w_, proj))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    proj_     = proj;
+    has_proj_ = true;
+    return true;
+}
+
+bool StixelExtractor::isReady() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_proj_;
+}
+
+using namespace redtail::cpu;
+
+static const int kVecSize = sizeof(float4v) / sizeof(float);
+
+// Loads 4 disparities as floats.
+static inline float4v load4(const float* src)
+{
+    return loadu(src);
+}
+
+static inline float4v load4(const uint16_t* src)
+{
+    return float4v{(float)src[0], (float)src[1], (float)src[2], (float)src[3]};
+}
+
+template<typename T>
+StixelExtractor::Stixel StixelExtractor::extractColumn(const cv::Mat& disp, float unit, int u_start, int u_end,
+                                                       const Projection& proj, std::vector<int>& counts,
+                                                       std::vector<float>& dist_sums, std::vector<float>& heights) const
+{
+    const int   num_bins = (int)counts.size();
+    const float min_d    = std::max(proj.doffs, 0.0f);
+    const float cos_p    = std::cos(params_.camera_pitch);
+    const float sin_p    = std::sin(params_.camera_pitch);
+    std::fill(counts.begin(),    counts.end(),    0);
+    std::fill(dist_sums.begin(), dist_sums.end(), 0.0f);
+    std::fill(heights.begin(),   heights.end(),   -std::numeric_limits<float>::infinity());
+
+    auto addPixel = [&](float d, float dist, float height)
+    {
+        int bin = std::min((int)d, num_bins - 1);
+        counts[bin]++;
+        dist_sums[bin] += dist;
+        heights[bin]    = std::max(heights[bin], height);
+    };
+
+    for (int v = 0; v < h_; v++)
+    {
+        // For a pixel in row v with depth z: height above ground is camera_height - z * a
+        // and horizontal distance along optical axis is z * b.
+        const float ry = (v - proj.cy) / proj.fy;
+        const float a  = ry * cos_p + sin_p;
+        const float b  = cos_p - ry * sin_p;
+        const T*    p  = disp.ptr<T>(v);
+        int u = u_start;
+        for (; u + kVecSize <= u_end; u += kVecSize)
+        {
+            float4v d      = load4(p + u) * unit;
+            float4v z      = proj.bf / (d - proj.doffs);
+            float4v height = params_.camera_height - z * a;
+            float4v dist   = z * b;
+            int4v   is_obs = (d > min_d) & (height >= params_.min_height) & (height <= params_.max_height) &
+                             (dist > 0) & (dist <= params_.max_range);
+            // Obstacle pixels are relatively rare so the histogram is updated only for them.
+            if ((is_obs[0] | is_obs[1] | is_obs[2] | is_obs[3]) == 0)
+                continue;
+            for (int i = 0; i < kVecSize; i++)
+            {
+                if (is_obs[i])
+                    addPixel(d[i], dist[i], height[i]);
+            }
+        }
+        for (; u < u_end; u++)
+        {
+            float d      = p[u] * unit;
+            float z      = proj.bf / (d - proj.doffs);
+            float height = params_.camera_height - z * a;
+            float dist   = z * b;
+            if (d > min_d && height >= params_.min_height && height <= params_.max_height &&
+                dist > 0 && dist <= params_.max_range)
+                addPixel(d, dist, height);
+        }
+    }
+
+    // The nearest obstacle has the highest disparity. Disparity noise spreads obstacle
+    // pixels over adjacent bins so the distance is averaged over the neighbours as well.
+    Stixel res;
+    for (int bin = num_bins - 1; bin >= 0; bin--)
+    {
+        if (counts[bin] < params_.min_points)
+            continue;
+        int   count    = 0;
+        float dist_sum = 0;
+        for (int i = std::max(bin - 1, 0); i <= std::min(bin + 1, num_bins - 1); i++)
+        {
+            count      += counts[i];
+            dist_sum   += dist_sums[i];
+            res.height  = std::max(res.height, heights[i]);
+        }
+        res.distance = dist_sum / count;
+        break;
+    }
+    return res;
+}
+
+sensor_msgs::LaserScan::Ptr StixelExtractor::extract(const std_msgs::Header& header, const cv::Mat& disp) const
+{
+    assert(disp.type() == CV_32FC1 || disp.type() == CV_16UC1);
+    assert(disp.rows == h_ && disp.cols == w_);
+
+    Projection proj;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_proj_)
+            return nullptr;
+        proj = proj_;
+    }
+
+    const int   num_cols = getNumColumns();
+    const int   cw       = params_.column_width;
+    const float inf      = std::numeric_limits<float>::infinity();
+    // Tangent of horizontal angle of column center ray.
+    auto getColumnTan = [&](int col)
+    {
+        float u_c = col * cw + (std::min(cw, w_ - col * cw) - 1) / 2.0f;
+        return (u_c - proj.cx) / proj.fx;
+    };
+
+    auto msg = boost::make_shared<sensor_msgs::LaserScan>();
+    msg->header = header;
+    // Angles are counter-clockwise so the right-most column is the first.
+    msg->angle_min       = -std::atan(getColumnTan(num_cols - 1));
+    msg->angle_max       = -std::atan(getColumnTan(0));
+    msg->angle_increment = num_cols > 1 ? (msg->angle_max - msg->angle_min) / (num_cols - 1) : 0;
+    msg->time_increment  = 0;
+    msg->scan_time       = 0;
+    msg->range_min       = 0;
+    msg->range_max       = params_.max_range;
+    msg->ranges.resize(num_cols);
+    msg->intensities.resize(num_cols);
+
+    const bool is_16u = disp.type() == CV_16UC1;
+    const float unit  = is_16u ? 1 / kDisparity16UScale : 1;
+    // Disparity can't be greater than image width.
+    const int num_bins = w_ + 1;
+    parallelForStripes(num_cols, num_threads_, [&](int col_start, int col_end)
+    {
+        // u-disparity histogram of one column: number of obstacle pixels,
+        // sum of their distances and max height in each disparity bin.
+        std::vector<int>   counts(num_bins);
+        std::vector<float> dist_sums(num_bins);
+        std::vector<float> heights(num_bins);
+        for (int col = col_start; col < col_end; col++)
+        {
+            int u_start = col * cw;
+            int u_end   = std::min(u_start + cw, w_);
+            auto stixel = is_16u ?
+                extractColumn<uint16_t>(disp, unit, u_start, u_end, proj, counts, dist_sums, heights) :
+                extractColumn<float>(   disp, unit, u_start, u_end, proj, counts, dist_sums, heights);
+            int   i     = num_cols - 1 - col;
+            float tan_u = getColumnTan(col);
+            // Horizontal range along the column center ray.
+            msg->ranges[i]      = stixel.distance > 0 ? stixel.distance * std::sqrt(1 + tan_u * tan_u) : inf;
+            msg->intensities[i] = stixel.height;
+        }
+    });
+
+    return msg;
+}
+
+}
@@ -0,0 +1,443 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "stereo_dnn_ros/disparity_16u.h"
+#include "stereo_dnn_ros/model_switcher.h"
+#include "stereo_dnn_ros/point_cloud_generator.h"
+#include "stereo_dnn_ros/stixel_extractor.h"
+
+using namespace stereo_dnn_ros;
+
+// Rectified stereo pair: 1280x720 cameras with 0.12m baseline, the right camera
+// principal point is shifted so disparity offset (doffs) is not 0. Network disparity
+// is not negative so doffs is positive (disparity of far points approaches doffs).
+static void createCameraInfo(sensor_msgs::CameraInfo& info_l, sensor_msgs::CameraInfo& info_r)
+{
+    info_l.width  = info_r.width  = 1280;
+    info_l.height = info_r.height = 720;
+    info_l.P = {700, 0, 640.5, 0,
+                0, 702, 355.2, 0,
+                0, 0, 1, 0};
+    info_r.P = info_l.P;
+    info_r.P[2] = 630.0;
+    info_r.P[3] = -700 * 0.12;
+}
+
+static const float* getPoint(const sensor_msgs::PointCloud2& msg, int y, int x)
+{
+    return reinterpret_cast<const float*>(msg.data.data() + y * msg.row_step + x * msg.point_step);
+}
+
+// Disparity is created from the known depth of each pixel (slanted plane) by projecting
+// the 3D point to both full resolution cameras, reprojected points must be the same 3D points.
+static void runReprojectionTest(int h, int w, int decimation, bool is_16u)
+{
+    sensor_msgs::CameraInfo info_l;
+    sensor_msgs::CameraInfo info_r;
+    createCameraInfo(info_l, info_r);
+    const double fx       = info_l.P[0];
+    const double fy       = info_l.P[5];
+    const double cx_l     = info_l.P[2];
+    const double cx_r     = info_r.P[2];
+    const double cy       = info_l.P[6];
+    const double baseline = -info_r.P[3] / info_r.P[0];
+    // Network input is resized from camera image, pixel centers are aligned as in cv::resize.
+    const double sx = (double)w / info_l.width;
+    const double sy = (double)h / info_l.height;
+
+    cv::Mat depth(h, w, CV_32FC1);
+    cv::Mat disp(h, w, CV_32FC1);
+    for (int v = 0; v < h; v++)
+    {
+        for (int u = 0; u < w; u++)
+        {
+            double z   = 2 + 0.05 * v + 0.02 * u;
+            double u_l = (u + 0.5) / sx - 0.5;
+            double x   = (u_l - cx_l) * z / fx;
+            double u_r = fx * (x - baseline) / z + cx_r;
+            depth.at<float>(v, u) = (float)z;
+            disp.at<float>(v, u)  = (float)((u_l - u_r) * sx);
+        }
+    }
+    // Invalid pixels.
+    disp.at<float>(0, 0) = 0;
+    disp.at<float>(h - 1, w - 1) = 0;
+    if (is_16u)
+        disp.convertTo(disp, CV_16UC1, kDisparity16UScale);
+
+    PointCloudGenerator::Params params;
+    params.decimation = decimation;
+    params.min_range  = 0;
+    params.max_range  = 1000;
+    PointCloudGenerator generator(h, w, params);
+    ASSERT_EQ(nullptr, generator.generate(std_msgs::Header(), disp, cv::Mat()));
+    ASSERT_TRUE(generator.setCalibration(info_l, info_r));
+    ASSERT_TRUE(generator.isReady());
+
+    auto msg = generator.generate(std_msgs::Header(), disp, cv::Mat());
+    ASSERT_NE(nullptr, msg);
+    ASSERT_EQ((uint32_t)(h + decimation - 1) / decimation, msg->height);
+    ASSERT_EQ((uint32_t)(w + decimation - 1) / decimation, msg->width);
+    ASSERT_EQ(16u, msg->point_step);
+    ASSERT_EQ(msg->row_step * msg->height, msg->data.size());
+
+    // 16-bit disparity is quantized to 1/256 pixel.
+    const double tol = is_16u ? 2e-3 : 1e-4;
+    for (int y = 0; y < (int)msg->height; y++)
+    {
+        for (int x = 0; x < (int)msg->width; x++)
+        {
+            int u = x * decimation;
+            int v = y * decimation;
+            const float* p = getPoint(*msg, y, x);
+            if ((u == 0 && v == 0) || (u == w - 1 && v == h - 1))
+            {
+                EXPECT_TRUE(std::isnan(p[0]) && std::isnan(p[1]) && std::isnan(p[2])) << "at " << u << ", " << v;
+                continue;
+            }
+            double z = depth.at<float>(v, u);
+            EXPECT_NEAR((((u + 0.5) / sx - 0.5) - cx_l) * z / fx, p[0], tol * z) << "x at " << u << ", " << v;
+            EXPECT_NEAR((((v + 0.5) / sy - 0.5) - cy)   * z / fy, p[1], tol * z) << "y at " << u << ", " << v;
+            EXPECT_NEAR(z, p[2], tol * z) << "z at " << u << ", " << v;
+        }
+    }
+}
+
+TEST(PointCloudGeneratorTests, Reprojection)
+{
+    // Width is not a multiple of 4 so the scalar tail is tested too.
+    runReprojectionTest(161, 513, 1, false);
+}
+
+TEST(PointCloudGeneratorTests, ReprojectionDecimated)
+{
+    runReprojectionTest(161, 513, 3, false);
+}
+
+TEST(PointCloudGeneratorTests, Reprojection16U)
+{
+    runReprojectionTest(161, 513, 2, true);
+}
+
+TEST(PointCloudGeneratorTests, RangeAndConfidence)
+{
+    sensor_msgs::CameraInfo info_l;
+    sensor_msgs::CameraInfo info_r;
+    createCameraInfo(info_l, info_r);
+    const int h = 4;
+    const int w = 7;
+    PointCloudGenerator::Projection proj;
+    ASSERT_TRUE(PointCloudGenerator::computeProjection(info_l, info_r, h, w, proj));
+
+    PointCloudGenerator::Params params;
+    params.min_range      = 1;
+    params.max_range      = 10;
+    params.min_confidence = 0.5f;
+    PointCloudGenerator generator(h, w, params);
+    ASSERT_TRUE(generator.setCalibration(info_l, info_r));
+
+    // Each column has the disparity of the given depth, rows have different confidence.
+    const float depths[w] {0.5f, 1.5f, 5, 9.5f, 20, 3, 4};
+    cv::Mat disp(h, w, CV_32FC1);
+    cv::Mat conf(h, w, CV_32FC1);
+    for (int v = 0; v < h; v++)
+    {
+        for (int u = 0; u < w; u++)
+        {
+            disp.at<float>(v, u) = proj.bf / depths[u] + proj.doffs;
+            conf.at<float>(v, u) = v == 1 ? 0.4f : 0.9f;
+        }
+    }
+    // Negative disparity is invalid even if its depth is in range.
+    disp.at<float>(0, 5) = -1;
+
+    auto msg = generator.generate(std_msgs::Header(), disp, conf);
+    ASSERT_NE(nullptr, msg);
+    for (int v = 0; v < h; v++)
+    {
+        for (int u = 0; u < w; u++)
+        {
+            bool valid = v != 1 && depths[u] >= params.min_range && depths[u] <= params.max_range &&
+                         !(v == 0 && u == 5);
+            const float* p = getPoint(*msg, v, u);
+            if (valid)
+                EXPECT_NEAR(depths[u], p[2], 1e-4 * depths[u]) << "at " << u << ", " << v;
+            else
+                EXPECT_TRUE(std::isnan(p[2])) << "at " << u << ", " << v;
+        }
+    }
+}
+
+TEST(PointCloudGeneratorTests, MessageReuse)
+{
+    sensor_msgs::CameraInfo info_l;
+    sensor_msgs::CameraInfo info_r;
+    createCameraInfo(info_l, info_r);
+    const int h = 4;
+    const int w = 7;
+    PointCloudGenerator generator(h, w, PointCloudGenerator::Params(), 0, 1);
+    ASSERT_TRUE(generator.setCalibration(info_l, info_r));
+
+    cv::Mat disp(h, w, CV_32FC1, cv::Scalar(20));
+    auto msg_1 = generator.generate(std_msgs::Header(), disp, cv::Mat());
+    ASSERT_NE(nullptr, msg_1);
+    // The message is still referenced (e.g. by a subscriber) so a new one is used.
+    auto msg_2 = generator.generate(std_msgs::Header(), disp, cv::Mat());
+    ASSERT_NE(msg_1, msg_2);
+    // Released message is reused with its buffer and all points are rewritten.
+    const auto* data = msg_1->data.data();
+    float z = getPoint(*msg_1, 0, 0)[2];
+    msg_1.reset();
+    msg_2.reset();
+    disp.at<float>(0, 0) = 0;
+    auto msg_3 = generator.generate(std_msgs::Header(), disp, cv::Mat());
+    ASSERT_NE(nullptr, msg_3);
+    EXPECT_EQ(data, msg_3->data.data());
+    EXPECT_EQ(msg_3->row_step * msg_3->height, msg_3->data.size());
+    EXPECT_TRUE(std::isnan(getPoint(*msg_3, 0, 0)[2]));
+    EXPECT_EQ(z, getPoint(*msg_3, 0, 1)[2]);
+}
+
+// Synthetic scene seen by a level camera: flat ground and a box facing the camera.
+// Pixels above the horizon outside of the box are invalid (sky).
+static void runStixelTest(bool is_16u)
+{
+    sensor_msgs::CameraInfo info_l;
+    sensor_msgs::CameraInfo info_r;
+    createCameraInfo(info_l, info_r);
+    const int h = 161;
+    const int w = 513;
+    PointCloudGenerator::Projection proj;
+    ASSERT_TRUE(PointCloudGenerator::computeProjection(info_l, info_r, h, w, proj));
+
+    StixelExtractor::Params params;
+    params.column_width  = 8;
+    params.camera_height = 0.5f;
+    params.camera_pitch  = 0;
+    params.max_range     = 20;
+    // Box spans columns [25, 32], its front face is 5m away and its top is 1m above ground.
+    const int   box_u_start = 200;
+    const int   box_u_end   = 264;
+    const float box_dist    = 5;
+    const float box_height  = 1;
+
+    cv::Mat disp(h, w, CV_32FC1);
+    for (int v = 0; v < h; v++)
+    {
+        float ry = (v - proj.cy) / proj.fy;
+        for (int u = 0; u < w; u++)
+        {
+            float z = 0;
+            if (u >= box_u_start && u < box_u_end && params.camera_height - box_dist * ry <= box_height &&
+                params.camera_height - box_dist * ry >= 0)
+                z = box_dist;
+            else if (ry > 0)
+                z = params.camera_height / ry;
+            disp.at<float>(v, u) = z > 0 ? proj.bf / z + proj.doffs : 0;
+        }
+    }
+    if (is_16u)
+        disp.convertTo(disp, CV_16UC1, kDisparity16UScale);
+
+    StixelExtractor extractor(h, w, params);
+    ASSERT_EQ(65, extractor.getNumColumns());
+    ASSERT_EQ(nullptr, extractor.extract(std_msgs::Header(), disp));
+    ASSERT_TRUE(extractor.setCalibration(info_l, info_r));
+    ASSERT_TRUE(extractor.isReady());
+
+    auto scan = extractor.extract(std_msgs::Header(), disp);
+    ASSERT_NE(nullptr, scan);
+    ASSERT_EQ(65u, scan->ranges.size());
+    ASSERT_EQ(65u, scan->intensities.size());
+    // The right-most column is the first one and has the min angle.
+    EXPECT_LT(scan->angle_min, 0);
+    EXPECT_GT(scan->angle_max, 0);
+    EXPECT_NEAR((scan->angle_max - scan->angle_min) / 64, scan->angle_increment, 1e-6);
+    for (int col = 0; col < extractor.getNumColumns(); col++)
+    {
+        int i = extractor.getNumColumns() - 1 - col;
+        if (col >= box_u_start / params.column_width && col < box_u_end / params.column_width)
+        {
+            float u_c = col * params.column_width + (params.column_width - 1) / 2.0f;
+            float tan_u = (u_c - proj.cx) / proj.fx;
+            EXPECT_NEAR(box_dist * std::sqrt(1 + tan_u * tan_u), scan->ranges[i], 0.01 * box_dist) << "column " << col;
+            // Height of the top row of the box is within one row from the box top.
+            EXPECT_NEAR(box_height, scan->intensities[i], box_dist / proj.fy) << "column " << col;
+        }
+        else
+        {
+            // Ground only.
+            EXPECT_EQ(std::numeric_limits<float>::infinity(), scan->ranges[i]) << "column " << col;
+        }
+    }
+}
+
+TEST(StixelExtractorTests, GroundAndBox)
+{
+    runStixelTest(false);
+}
+
+TEST(StixelExtractorTests, GroundAndBox16U)
+{
+    runStixelTest(true);
+}
+
+TEST(StixelExtractorTests, MinPoints)
+{
+    sensor_msgs::CameraInfo info_l;
+    sensor_msgs::CameraInfo info_r;
+    createCameraInfo(info_l, info_r);
+    const int h = 16;
+    const int w = 513;
+    PointCloudGenerator::Projection proj;
+    ASSERT_TRUE(PointCloudGenerator::computeProjection(info_l, info_r, h, w, proj));
+
+    StixelExtractor::Params params;
+    params.column_width = 8;
+    params.min_height   = -10;
+    params.max_height   = 10;
+    params.min_points   = 10;
+    StixelExtractor extractor(h, w, params);
+    ASSERT_TRUE(extractor.setCalibration(info_l, info_r));
+
+    // Only the left-most column has valid pixels: 9 near outliers are ignored
+    // and 16 far pixels make the obstacle.
+    cv::Mat disp(h, w, CV_32FC1, cv::Scalar(0));
+    for (int u = 0; u < params.column_width; u++)
+    {
+        disp.at<float>(0, u) = proj.bf / 10 + proj.doffs;
+        disp.at<float>(1, u) = proj.bf / 10 + proj.doffs;
+    }
+    for (int i = 0; i < 9; i++)
+        disp.at<float>(2 + i, i % params.column_width) = proj.bf / 1 + proj.doffs;
+
+    auto scan = extractor.extract(std_msgs::Header(), disp);
+    ASSERT_NE(nullptr, scan);
+    const int num_cols = extractor.getNumColumns();
+    float tan_u = (3.5f - proj.cx) / proj.fx;
+    EXPECT_NEAR(10 * std::sqrt(1 + tan_u * tan_u), scan->ranges[num_cols - 1], 0.1);
+    for (int i = 0; i < num_cols - 1; i++)
+        EXPECT_EQ(std::numeric_limits<float>::infinity(), scan->ranges[i]) << "range " << i;
+}
+
+// Models from the most accurate to the fastest, EMA is disabled (alpha = 1)
+// so predictions follow the reported latencies exactly.
+static ModelSwitcher::Params createSwitcherParams()
+{
+    ModelSwitcher::Params params;
+    params.budget_ms   = 50;
+    params.down_frames = 3;
+    params.up_ratio    = 0.8f;
+    params.up_frames   = 5;
+    params.ema_alpha   = 1;
+    return params;
+}
+
+TEST(ModelSwitcherTests, SwitchDownAndUp)
+{
+    ModelSwitcher switcher(3, createSwitcherParams());
+    switcher.setBaseline(0, 35);
+    switcher.setBaseline(1, 20);
+    switcher.setBaseline(2, 10);
+    ASSERT_EQ(0, switcher.getActive());
+
+    // Throttled: 1.7x slowdown, model 0 is over budget but model 1 (34ms) fits it.
+    for (int i = 0; i < 2; i++)
+    {
+        EXPECT_FALSE(switcher.update(0, 60));
+        EXPECT_EQ(0, switcher.getActive());
+    }
+    EXPECT_TRUE(switcher.update(0, 60));
+    ASSERT_EQ(1, switcher.getActive());
+    EXPECT_NEAR(20 * 60 / 35.0f, switcher.predictLatency(1), 1e-3);
+
+    // Frame of the previous model which was in flight during the switch does not affect switching.
+    EXPECT_FALSE(switcher.update(0, 100));
+    EXPECT_EQ(1, switcher.getActive());
+
+    // Cooled down: model 0 is predicted at 35ms which is below 0.8 * budget,
+    // the switcher moves back only after up_frames frames.
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_FALSE(switcher.update(1, 20));
+        EXPECT_EQ(1, switcher.getActive());
+    }
+    EXPECT_TRUE(switcher.update(1, 20));
+    EXPECT_EQ(0, switcher.getActive());
+}
+
+TEST(ModelSwitcherTests, Hysteresis)
+{
+    ModelSwitcher switcher(3, createSwitcherParams());
+    switcher.setBaseline(0, 35);
+    switcher.setBaseline(1, 20);
+    switcher.setBaseline(2, 10);
+
+    // Over budget for less than down_frames frames in a row does not switch.
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_FALSE(switcher.update(0, i % 2 == 0 ? 60 : 45));
+        EXPECT_EQ(0, switcher.getActive());
+    }
+    for (int i = 0; i < 3; i++)
+        switcher.update(0, 60);
+    ASSERT_EQ(1, switcher.getActive());
+
+    // Model 1 at 1.5x slowdown (30ms) is within budget and model 0 predicted at 52.5ms
+    // is above 0.8 * budget: neither model fits the switching thresholds so no switches.
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_FALSE(switcher.update(1, 30));
+        EXPECT_EQ(1, switcher.getActive());
+    }
+    // Up count is reset by a frame which does not allow moving up.
+    for (int i = 0; i < 4; i++)
+        EXPECT_FALSE(switcher.update(1, 20));
+    EXPECT_FALSE(switcher.update(1, 30));
+    for (int i = 0; i < 4; i++)
+        EXPECT_FALSE(switcher.update(1, 20));
+    EXPECT_EQ(1, switcher.getActive());
+    EXPECT_TRUE(switcher.update(1, 20));
+    EXPECT_EQ(0, switcher.getActive());
+
+    auto stats = switcher.getStats(true);
+    ASSERT_EQ(3u, stats.size());
+    EXPECT_EQ(13u, stats[0].frames);
+    EXPECT_EQ(110u, stats[1].frames);
+    EXPECT_EQ(0u,   stats[2].frames);
+    EXPECT_EQ(1u, stats[0].switches);
+    EXPECT_EQ(1u, stats[1].switches);
+    EXPECT_NEAR((8 * 60 + 5 * 45) / 13.0f, stats[0].avg_ms, 1e-3);
+    EXPECT_EQ(0u, switcher.getStats(false)[0].frames);
+}
+
+TEST(ModelSwitcherTests, FastestAndUnknownModels)
+{
+    ModelSwitcher switcher(3, createSwitcherParams());
+    switcher.setBaseline(0, 35);
+    // Model 1 has never run so it can't be predicted and is skipped.
+    EXPECT_EQ(std::numeric_limits<float>::infinity(), switcher.predictLatency(1));
+    switcher.setBaseline(2, 10);
+    for (int i = 0; i < 3; i++)
+        switcher.update(0, 60);
+    ASSERT_EQ(2, switcher.getActive());
+
+    // The fastest model over budget has nowhere to go.
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_FALSE(switcher.update(2, 80));
+        EXPECT_EQ(2, switcher.getActive());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,19 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef STEREO_DNN_ROS_VIZ_STEREO_DNN_ROS_VIZ_H
+#define STEREO_DNN_ROS_VIZ_STEREO_DNN_ROS_VIZ_H
+
+#include <ros/ros.h>
+
+#include "stop_signal.h"
+
+namespace stereo_dnn_ros_viz
+{
+// Runs the visualization node until stop is signalled, nh is the private node handle.
+// Subscription callbacks must be executed by the caller (spinner or nodelet manager).
+// Shared by the standalone node and the nodelet.
+void run(ros::NodeHandle& nh, const redtail::StopSignal& stop);
+}
+
+#endif
@@ -0,0 +1,230 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <memory>
+#include <unordered_map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <ros/ros.h>
+#include <message_filters/subscriber.h>
+#include <message_filters/time_synchronizer.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <sensor_msgs/Image.h>
+
+#include "image_preprocessor.h"
+#include "event_executor.h"
+#include "stereo_dnn_ros_viz/stereo_dnn_ros_viz.h"
+
+namespace stereo_dnn_ros_viz
+{
+
+using ConstStr = const std::string;
+
+// Synchronized camera images and DNN output.
+struct VizFrame
+{
+    sensor_msgs::Image::ConstPtr img_l;
+    sensor_msgs::Image::ConstPtr img_r;
+    sensor_msgs::Image::ConstPtr dnn;
+};
+
+using VizInput = redtail::executor::LatestInput<VizFrame>;
+
+namespace pp = redtail::preprocessing;
+
+// Preprocessor is recreated if DNN output size changes.
+cv::Mat preprocessImage(sensor_msgs::Image::ConstPtr img_msg, int dst_img_w, int dst_img_h,
+                        std::unique_ptr<pp::ImagePreprocessor>& preproc)
+{
+    if (preproc == nullptr || preproc->getWidth() != dst_img_w || preproc->getHeight() != dst_img_h)
+    {
+        preproc = std::make_unique<pp::ImagePreprocessor>(dst_img_w, dst_img_h, pp::ChannelOrder::kRGB,
+                                                          pp::Interpolation::kArea);
+    }
+    auto img = cv::Mat((int)img_msg->height, (int)img_msg->width,
+                       img_msg->encoding == "bgra8" ? CV_8UC4 : CV_8UC3,
+                       (void*)img_msg->data.data());
+    // Resize (anisotropically) to DNN output size and convert to RGB.
+    cv::Mat res;
+    preproc->resize8u(img, img_msg->encoding, res);
+    return res;
+}
+
+// This is a primitive, unoptimized implementation of disparity colorization using KITTI color scheme. 
+// Based on original implementation from KITTI SDK.
+// max_disp is in the same units as disp values.
+template<typename T>
+cv::Mat dispToColor(const cv::Mat& disp, float max_disp)
+{
+    // Weights and cumsum are precomputed from Python code.
+    const float weights[]{8.77192974, 5.40540552, 8.77192974, 5.74712658, 8.77192974, 5.40540552, 8.77192974, 0};
+    const float cumsum[] {0,          0.114,      0.299,      0.413,      0.587,      0.70100003, 0.88600004, 1};
+    const float w_map[][3]{{0, 0, 0}, {0, 0, 1}, {1, 0, 0}, {1, 0, 1},
+                           {0, 1, 0}, {0, 1, 1}, {1, 1, 0}, {1, 1, 1}};
+    const int   w_num = sizeof(cumsum) / sizeof(cumsum[0]);
+
+    cv::Mat dst(disp.rows, disp.cols, CV_8UC3);
+    auto p_dst = dst.ptr<uint8_t>(0);
+    for (int row = 0; row < disp.rows; row++)
+    {
+        auto p_src = disp.ptr<T>(row);
+        for (int col = 0; col < disp.cols; col++)
+        {
+            float cur_disp = *p_src / max_disp;
+            int index = 1;
+            while (index < w_num && cur_disp > cumsum[index])
+                index++;
+            index--;
+            float w = 1.0 - (cur_disp - cumsum[index]) * weights[index];
+            p_dst[0] = (uint8_t)((w * w_map[index][0] + (1.0 - w) * w_map[index + 1][0]) * 255.0);
+            p_dst[1] = (uint8_t)((w * w_map[index][1] + (1.0 - w) * w_map[index + 1][1]) * 255.0);
+            p_dst[2] = (uint8_t)((w * w_map[index][2] + (1.0 - w) * w_map[index + 1][2]) * 255.0);
+            p_dst += 3;
+            p_src++;
+        }
+    }
+    return dst;
+}
+
+sensor_msgs::Image::ConstPtr computeOutput(const VizFrame& frame, std::unique_ptr<pp::ImagePreprocessor>& preproc)
+{
+    int c = 3;
+    int h = (int)frame.dnn->height;
+    int w = (int)frame.dnn->width;
+    auto img_left  = preprocessImage(frame.img_l, w, h, preproc);
+    auto img_right = preprocessImage(frame.img_r, w, h, preproc);
+
+    auto viz_msg = boost::make_shared<sensor_msgs::Image>();
+    // Set stamp and frame id to the same value as source image so we can synchronize with other nodes if needed.
+    const auto& img_l = *frame.img_l;
+    viz_msg->header.stamp.sec  = img_l.header.stamp.sec;
+    viz_msg->header.stamp.nsec = img_l.header.stamp.nsec;
+    viz_msg->header.frame_id   = img_l.header.frame_id;
+    viz_msg->encoding = "rgb8";
+    viz_msg->width    = 2 * w;
+    viz_msg->height   = 2 * h;
+    viz_msg->step     = c * viz_msg->width;
+    size_t count      = viz_msg->step * viz_msg->height;
+    viz_msg->data.resize(count);
+
+    cv::Mat dst(viz_msg->height, viz_msg->width, CV_8UC3, viz_msg->data.data());
+
+    img_left.copyTo( dst(cv::Rect(0, 0, w, h)));
+    img_right.copyTo(dst(cv::Rect(w, 0, w, h)));
+
+    // REVIEW alexeyk: hardcode max disp for now.
+    float max_disp = 96;
+    // 16UC1 disparity is fixed point in 1/256 pixel units, it is used as is without conversion.
+    bool is_16u = frame.dnn->encoding == "16UC1";
+    if (is_16u)
+        max_disp *= 256;
+    cv::Mat disp(h, w, is_16u ? CV_16UC1 : CV_32FC1, (void*)frame.dnn->data.data());
+    auto disp_color = is_16u ? dispToColor<uint16_t>(disp, max_disp) : dispToColor<float>(disp, max_disp);
+    disp_color.copyTo(dst(cv::Rect(w, h, w, h)));
+
+    // Brighten up according to max disp.
+    cv::Mat output;
+    disp.convertTo(output, CV_8UC1, 255.0 / max_disp);
+    cv::cvtColor(output, output, CV_GRAY2RGB);
+    output.copyTo(dst(cv::Rect(0, h, w, h)));
+
+    // ROS_INFO("computeOutput: %u, %u, %s", viz_msg->width, viz_msg->height, viz_msg->encoding.c_str());
+
+    return viz_msg;
+}
+
+void imageCallback(const sensor_msgs::ImageConstPtr& msg_l, const sensor_msgs::ImageConstPtr& msg_r, 
+                   const sensor_msgs::ImageConstPtr& msg_dnn, VizInput* input)
+{
+    // ROS_INFO("imageCallback: %u, %u, %s", img_l.width, img_l.height, img_l.encoding.c_str());
+    // ROS_INFO("imageCallback: %u, %u, %s", img_r.width, img_r.height, img_r.encoding.c_str());
+    // Callbacks can't stop the node (it may share the process with other nodelets) so unsupported frames are skipped.
+    if (!pp::isSupportedEncoding(msg_l->encoding))
+    {
+        ROS_ERROR_THROTTLE(5, "Image encoding %s is not yet supported, frames are skipped. Supported encodings: rgb8, bgr8, bgra8",
+                           msg_l->encoding.c_str());
+        return;
+    }
+    if (!pp::isSupportedEncoding(msg_r->encoding))
+    {
+        ROS_ERROR_THROTTLE(5, "Image encoding %s is not yet supported, frames are skipped. Supported encodings: rgb8, bgr8, bgra8",
+                           msg_r->encoding.c_str());
+        return;
+    }
+    if (msg_dnn->encoding != "32FC1" && msg_dnn->encoding != "16UC1")
+    {
+        ROS_ERROR_THROTTLE(5, "DNN encoding %s is not yet supported, frames are skipped. Supported encodings: 32FC1, 16UC1",
+                           msg_dnn->encoding.c_str());
+        return;
+    }
+    input->post(VizFrame{msg_l, msg_r, msg_dnn});
+}
+
+} // stereo_dnn_ros_viz
+
+namespace sd = stereo_dnn_ros_viz;
+namespace mf = message_filters;
+
+void sd::run(ros::NodeHandle& nh, const redtail::StopSignal& stop)
+{
+    ROS_INFO("Starting Stereo DNN visualization ROS node...");
+
+    std::string camera_topic_l;
+    std::string camera_topic_r;
+    std::string dnn_topic;
+    std::string viz_topic;
+    std::string model_type;
+    std::string model_path;
+    std::string data_type_s;
+    int         in_queue_size;
+    int         out_queue_size;
+    float       max_rate_hz;
+
+    nh.param<std::string>("camera_topic_left",  camera_topic_l, "/zed/left/image_rect_color");
+    nh.param<std::string>("camera_topic_right", camera_topic_r, "/zed/right/image_rect_color");
+    nh.param<std::string>("dnn_topic",          dnn_topic,      "/stereo_dnn_ros/network/output");
+    nh.param<std::string>("viz_topic",          viz_topic,      "/stereo_dnn_ros_viz/output");
+
+    nh.param("in_queue_size",  in_queue_size,  2);
+    nh.param("out_queue_size", out_queue_size, 2);
+    nh.param("max_rate_hz",    max_rate_hz,    30.0f);
+
+    ROS_INFO("Camera L: %s", camera_topic_l.c_str());
+    ROS_INFO("Camera R: %s", camera_topic_r.c_str());
+    ROS_INFO("DNN     : %s", dnn_topic.c_str());
+    ROS_INFO("Viz     : %s", viz_topic.c_str());
+    ROS_INFO("In Q    : %d", in_queue_size);
+    ROS_INFO("Out Q   : %d", out_queue_size);
+    ROS_INFO("Rate    : %.1f", max_rate_hz);
+
+    // Visualization is computed as soon as synchronized inputs arrive, max_rate_hz is only a ceiling.
+    redtail::executor::EventExecutor::Params exec_params;
+    exec_params.max_rate_hz = max_rate_hz;
+    redtail::executor::EventExecutor executor(exec_params);
+    sd::VizInput viz_input(executor);
+
+    mf::Subscriber<sensor_msgs::Image> image_sub_l(nh, camera_topic_l, in_queue_size);
+    mf::Subscriber<sensor_msgs::Image> image_sub_r(nh, camera_topic_r, in_queue_size);
+    mf::Subscriber<sensor_msgs::Image> dnn_sub_r(  nh, dnn_topic,      in_queue_size);
+
+    using MySyncPolicy = mf::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::Image>;
+    mf::Synchronizer<MySyncPolicy> sync(MySyncPolicy(in_queue_size), image_sub_l, image_sub_r, dnn_sub_r);
+    sync.registerCallback(boost::bind(&sd::imageCallback, _1, _2, _3, &viz_input));
+
+    auto viz_pub = nh.advertise<sensor_msgs::Image>(viz_topic, out_queue_size);
+
+    // Callbacks are executed by the caller: spinner thread or nodelet manager.
+    std::unique_ptr<redtail::preprocessing::ImagePreprocessor> preproc;
+    executor.run([&]
+        {
+            sd::VizFrame frame;
+            if (viz_input.take(frame))
+                viz_pub.publish(sd::computeOutput(frame, preproc));
+        },
+        [&stop] { return !stop.isStopped(); });
+}
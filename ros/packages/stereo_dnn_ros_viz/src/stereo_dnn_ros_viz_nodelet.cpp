@@ -0,0 +1,21 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include <pluginlib/class_list_macros.h>
+
+#include "stereo_dnn_ros_viz/stereo_dnn_ros_viz.h"
+#include "loop_nodelet.h"
+
+namespace stereo_dnn_ros_viz
+{
+class StereoDnnRosVizNodelet : public redtail::LoopNodelet
+{
+public:
+    StereoDnnRosVizNodelet():
+        LoopNodelet(&stereo_dnn_ros_viz::run)
+    {
+    }
+};
+}
+
+PLUGINLIB_EXPORT_CLASS(stereo_dnn_ros_viz::StereoDnnRosVizNodelet, nodelet::Nodelet)
@@ -142,6 +142,16 @@ if [ ! -L "$CATKIN_WS/src/caffe_ros" ]; then
     ln -s $HOME/redtail/ros/packages/redtail_debug $CATKIN_WS/src/
     ln -s $HOME/redtail/ros/packages/image_pub $CATKIN_WS/src/
 fi
+# Image preprocessing library shared by the nodes, linked separately
+# so existing workspaces which already have caffe_ros get it too.
+if [ ! -L "$CATKIN_WS/src/stereoDNN/preprocessing" ]; then
+    mkdir -p $CATKIN_WS/src/stereoDNN
+    ln -s $HOME/redtail/stereoDNN/preprocessing $CATKIN_WS/src/stereoDNN/
+fi
+# Event-driven executor and nodelet helpers shared by the nodes, linked separately as well.
+if [ ! -L "$CATKIN_WS/src/redtail_common" ]; then
+    ln -s $HOME/redtail/ros/common $CATKIN_WS/src/redtail_common
+fi
 
 # if ZED camera is used, prepare packages and needed libraries
 # check if ZED SDK is installed
@@ -168,7 +178,7 @@ if [ -d /usr/local/zed ]; then
     # run test app. See also: https://github.com/NVIDIA-AI-IOT/redtail/tree/master/stereoDNN#building-inference-code
     # ./bin/nvstereo_tests_debug ./tests/data
     # if the test ran successfully, then we link the created samples and libs to the catkin workspace
-    mkdir $CATKIN_WS/src/stereoDNN
+    mkdir -p $CATKIN_WS/src/stereoDNN
     ln -s $HOME/redtail/stereoDNN/build $CATKIN_WS/src/stereoDNN/
     ln -s $HOME/redtail/stereoDNN/lib $CATKIN_WS/src/stereoDNN/
     ln -s $HOME/redtail/stereoDNN/sample_app $CATKIN_WS/src/stereoDNN/
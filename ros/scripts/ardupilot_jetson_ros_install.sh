@@ -133,6 +133,16 @@ if [ ! -L "$CATKIN_WS/src/caffe_ros" ]; then
     ln -s $HOME/redtail/ros/packages/px4_controller $CATKIN_WS/src/
     ln -s $HOME/redtail/ros/packages/redtail_debug $CATKIN_WS/src/
 fi
+# Image preprocessing library shared by the nodes, linked separately
+# so existing workspaces which already have caffe_ros get it too.
+if [ ! -L "$CATKIN_WS/src/stereoDNN/preprocessing" ]; then
+    mkdir -p $CATKIN_WS/src/stereoDNN
+    ln -s $HOME/redtail/stereoDNN/preprocessing $CATKIN_WS/src/stereoDNN/
+fi
+# Event-driven executor and nodelet helpers shared by the nodes, linked separately as well.
+if [ ! -L "$CATKIN_WS/src/redtail_common" ]; then
+    ln -s $HOME/redtail/ros/common $CATKIN_WS/src/redtail_common
+fi
 
 echo "Installing dependencies..."
 cd $HOME
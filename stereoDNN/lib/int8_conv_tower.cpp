@@ -0,0 +1,530 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "int8_conv_tower.h"
+#include "cpu_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#if defined(__AVXVNNI__) || (defined(__AVX512VNNI__) && defined(__AVX512VL__))
+    #define REDTAIL_INT8_X86_VNNI
+    #include <immintrin.h>
+#elif defined(__AVX2__)
+    #define REDTAIL_INT8_X86_AVX2
+    #include <immintrin.h>
+#elif defined(__ARM_FEATURE_DOTPROD)
+    #define REDTAIL_INT8_ARM_DOTPROD
+    #include <arm_neon.h>
+#endif
+
+namespace redtail { namespace tensorrt
+{
+
+// Patch size alignment, in elements: dot product instructions process 4 INT8 values at once.
+static const int kPatchAlign = 4;
+// Output channels are processed in blocks of kMaxOutBlock (or kMinOutBlock)
+// channels which are kept in registers while the patch is processed.
+static const int kMinOutBlock = 8;
+static const int kMaxOutBlock = 32;
+static const int kInt8Max     = 127;
+
+// VNNI multiplies unsigned by signed bytes so quantized activations
+// are stored as unsigned with zero point of 128, other kernels use signed activations.
+#if defined(REDTAIL_INT8_X86_VNNI)
+    using QType = uint8_t;
+    static const int kZeroPoint = 128;
+#else
+    using QType = int8_t;
+    static const int kZeroPoint = 0;
+#endif
+
+std::vector<TowerConvLayer> getFeatureTowerLayers(const std::string& model_type)
+{
+    std::vector<TowerConvLayer> layers;
+    layers.push_back({"conv1", 32, 5, 2, 2, true, -1});
+    if (model_type == "nvsmall" || model_type == "nvtiny")
+    {
+        for (auto name: {"conv2", "conv3", "conv4"})
+            layers.push_back({name, 32, 3, 1, 1, true, -1});
+        layers.push_back({"conv5", model_type == "nvtiny" ? 8 : 32, 3, 1, 1, false, -1});
+    }
+    else if (model_type == "resnet18" || model_type == "resnet18_2D")
+    {
+        for (int i = 1; i <= 8; i++)
+        {
+            // Residual is the block input which is the output of the previous layer.
+            int block_in = (int)layers.size();
+            auto prefix  = "resblock" + std::to_string(i);
+            layers.push_back({prefix + "_conv1", 32, 3, 1, 1, true, -1});
+            layers.push_back({prefix + "_conv2", 32, 3, 1, 1, true, block_in});
+        }
+        layers.push_back({"encoder2D_out", 32, 3, 1, 1, false, -1});
+    }
+    else
+        assert(false);
+    return layers;
+}
+
+// -----------------------------------------------------------------
+// Dot product kernels: compute dot products of the patch x with
+// Block output channels. Vectorization is done over output channels
+// so no horizontal reductions are required:
+// FP32 weights are in [k][Block] format,
+// INT8 weights are in [k / 4][Block][4] format (4 consecutive k of
+// each output channel are processed by one dot product instruction).
+// -----------------------------------------------------------------
+using namespace redtail::cpu;
+
+template<int Block>
+static inline void dotFP32(const float* x, const float* w, int k_size, float* res)
+{
+    const int kNumVec = Block / 4;
+    float4v acc[kNumVec] = {};
+    for (int k = 0; k < k_size; k++, w += Block)
+    {
+        float4v xv = float4v{} + x[k];
+        for (int j = 0; j < kNumVec; j++)
+            acc[j] += xv * loadu(w + 4 * j);
+    }
+    std::memcpy(res, acc, sizeof(acc));
+}
+
+#if defined(REDTAIL_INT8_X86_VNNI) || defined(REDTAIL_INT8_X86_AVX2)
+// Multiplies 4 consecutive unsigned bytes of a by signed bytes of b and adds to acc.
+static inline __m256i dpbusd(__m256i acc, __m256i a, __m256i b)
+{
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpbusd_epi32(acc, a, b);
+#elif defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32(acc, a, b);
+#else
+    // Intermediate 16-bit sums do not saturate as both a and b are in [-127, 127] range.
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), _mm256_set1_epi16(1)));
+#endif
+}
+
+template<int Block>
+static inline void dotInt8(const QType* x, const int8_t* w, int k_size, int32_t* res)
+{
+    const int kNumVec = Block / 8;
+    // Two sets of accumulators to hide dot product instruction latency.
+    __m256i acc[2][kNumVec];
+    for (int j = 0; j < kNumVec; j++)
+    {
+        acc[0][j] = _mm256_setzero_si256();
+        acc[1][j] = _mm256_setzero_si256();
+    }
+    for (int k = 0; k < k_size; k += 4, w += 4 * Block)
+    {
+        int32_t x4;
+        std::memcpy(&x4, x + k, sizeof(x4));
+        __m256i xv = _mm256_set1_epi32(x4);
+    #if defined(REDTAIL_INT8_X86_AVX2)
+        // x is signed: use |x| * (sign(x) * w).
+        __m256i ax = _mm256_abs_epi8(xv);
+    #endif
+        auto& a = acc[(k / 4) % 2];
+        for (int j = 0; j < kNumVec; j++)
+        {
+            __m256i wv = _mm256_loadu_si256((const __m256i*)(w + 32 * j));
+        #if defined(REDTAIL_INT8_X86_AVX2)
+            a[j] = dpbusd(a[j], ax, _mm256_sign_epi8(wv, xv));
+        #else
+            a[j] = dpbusd(a[j], xv, wv);
+        #endif
+        }
+    }
+    for (int j = 0; j < kNumVec; j++)
+        _mm256_storeu_si256((__m256i*)(res + 8 * j), _mm256_add_epi32(acc[0][j], acc[1][j]));
+}
+#elif defined(REDTAIL_INT8_ARM_DOTPROD)
+template<int Block>
+static inline void dotInt8(const QType* x, const int8_t* w, int k_size, int32_t* res)
+{
+    const int kNumVec = Block / 4;
+    int32x4_t acc[kNumVec];
+    for (int j = 0; j < kNumVec; j++)
+        acc[j] = vdupq_n_s32(0);
+    for (int k = 0; k < k_size; k += 4, w += 4 * Block)
+    {
+        int32_t x4;
+        std::memcpy(&x4, x + k, sizeof(x4));
+        int8x16_t xv = vreinterpretq_s8_s32(vdupq_n_s32(x4));
+        for (int j = 0; j < kNumVec; j++)
+            acc[j] = vdotq_s32(acc[j], xv, vld1q_s8(w + 16 * j));
+    }
+    for (int j = 0; j < kNumVec; j++)
+        vst1q_s32(res + 4 * j, acc[j]);
+}
+#else
+// Portable version, compilers vectorize the loop over output channels.
+template<int Block>
+static inline void dotInt8(const QType* x, const int8_t* w, int k_size, int32_t* res)
+{
+    int32_t acc[Block] = {};
+    for (int k = 0; k < k_size; k += 4, w += 4 * Block)
+    {
+        const int32_t x0 = x[k];
+        const int32_t x1 = x[k + 1];
+        const int32_t x2 = x[k + 2];
+        const int32_t x3 = x[k + 3];
+        for (int j = 0; j < Block; j++)
+            acc[j] += x0 * w[4 * j] + x1 * w[4 * j + 1] + x2 * w[4 * j + 2] + x3 * w[4 * j + 3];
+    }
+    std::memcpy(res, acc, sizeof(acc));
+}
+#endif
+
+// Copies (im2col) k x k x c patch of HWC src to patch, out of image values are set to zero.
+// (y0, x0) is the top left corner of the patch, can be out of image due to padding.
+template<typename T>
+static void gatherPatch(const T* src, int h, int w, int c, int k, int y0, int x0, int k_size, T zero, T* patch)
+{
+    T* dst = patch;
+    for (int r = 0; r < k; r++, dst += k * c)
+    {
+        int y = y0 + r;
+        if (y < 0 || y >= h)
+        {
+            std::fill(dst, dst + k * c, zero);
+            continue;
+        }
+        const T* row = src + (size_t)y * w * c;
+        if (x0 >= 0 && x0 + k <= w)
+        {
+            std::copy(row + x0 * c, row + (x0 + k) * c, dst);
+            continue;
+        }
+        for (int s = 0; s < k; s++)
+        {
+            int x = x0 + s;
+            if (x < 0 || x >= w)
+                std::fill(dst + s * c, dst + (s + 1) * c, zero);
+            else
+                std::copy(row + x * c, row + (x + 1) * c, dst + s * c);
+        }
+    }
+    std::fill(dst, patch + k_size, zero);
+}
+
+static inline int quantize(float x, float inv_scale)
+{
+    float v = x * inv_scale;
+    v = std::min(std::max(v, (float)-kInt8Max), (float)kInt8Max);
+    // Round to nearest: the argument of the (truncating) conversion is positive so
+    // the loop over quantized values can be vectorized.
+    return (int)(v + (kInt8Max + 1.5f)) - (kInt8Max + 1);
+}
+
+// ELU activation (alpha = 1, same as cuDNN). exp is computed using polynomial
+// approximation as it has to be vectorized: ELU is applied to every tower activation.
+static inline float4v elu(float4v x)
+{
+    const float4v zero = {};
+    return x > zero ? x : exp4(x < zero ? x : zero) - 1.0f;
+}
+
+static void applyElu(float* data, size_t size)
+{
+    assert(size % 4 == 0);
+    for (size_t i = 0; i < size; i += 4)
+    {
+        storeu(data + i, elu(loadu(data + i)));
+    }
+}
+
+static float maxAbs(const std::vector<float>& src)
+{
+    float res = 0;
+    for (float v: src)
+        res = std::max(res, std::abs(v));
+    return res;
+}
+
+static int convOutDim(int dim, const TowerConvLayer& l)
+{
+    return (dim + 2 * l.pad - l.kernel) / l.stride + 1;
+}
+
+static float getScalarWeight(const std::unordered_map<std::string, Weights>& weights, const std::string& name, float def)
+{
+    auto it = weights.find(name);
+    if (it == weights.end() || it->second.count == 0)
+        return def;
+    assert(it->second.type == DataType::kFLOAT);
+    assert(it->second.count == 1);
+    return *static_cast<const float*>(it->second.values);
+}
+
+Int8ConvTower::Int8ConvTower(const std::vector<TowerConvLayer>& layers, const std::unordered_map<std::string, Weights>& weights,
+                             const std::string& prefix, int in_c):
+    in_c_(in_c)
+{
+    assert(!layers.empty());
+
+    scale_ = getScalarWeight(weights, prefix + "scale_scale", 1);
+    shift_ = getScalarWeight(weights, prefix + "scale_shift", 0);
+    power_ = getScalarWeight(weights, prefix + "scale_power", 1);
+
+    int c = in_c;
+    for (const auto& desc: layers)
+    {
+        assert(desc.out_c % kMinOutBlock == 0);
+        assert(desc.residual < (int)layers_.size() + 1);
+
+        Layer l;
+        l.desc   = desc;
+        l.in_c   = c;
+        l.k_size = (desc.kernel * desc.kernel * c + kPatchAlign - 1) / kPatchAlign * kPatchAlign;
+        l.block  = desc.out_c % kMaxOutBlock == 0 ? kMaxOutBlock : kMinOutBlock;
+
+        const auto& k_w = weights.at(prefix + desc.name + "_k");
+        const auto& b_w = weights.at(prefix + desc.name + "_b");
+        assert(k_w.type == DataType::kFLOAT && b_w.type == DataType::kFLOAT);
+        assert(k_w.count == (int64_t)desc.out_c * c * desc.kernel * desc.kernel);
+        assert(b_w.count == desc.out_c);
+        l.b.assign(static_cast<const float*>(b_w.values), static_cast<const float*>(b_w.values) + desc.out_c);
+
+        // Patch is in RSC (HWC) format, convert weights from KCRS to K(RSC) first.
+        const int   rs  = desc.kernel * desc.kernel;
+        const auto* src = static_cast<const float*>(k_w.values);
+        std::vector<float> w_krsc((size_t)desc.out_c * l.k_size, 0);
+        for (int k = 0; k < desc.out_c; k++)
+        {
+            for (int ci = 0; ci < c; ci++)
+            {
+                for (int i = 0; i < rs; i++)
+                    w_krsc[(size_t)k * l.k_size + i * c + ci] = src[((size_t)k * c + ci) * rs + i];
+            }
+        }
+
+        // Per output channel symmetric quantization.
+        l.w_scale.resize(desc.out_c);
+        l.w_sum.assign(desc.out_c, 0);
+        for (int k = 0; k < desc.out_c; k++)
+        {
+            const float* w_k   = w_krsc.data() + (size_t)k * l.k_size;
+            float        w_max = *std::max_element(w_k, w_k + l.k_size, [](float a, float b) { return std::abs(a) < std::abs(b); });
+            l.w_scale[k] = w_max != 0 ? std::abs(w_max) / kInt8Max : 1;
+        }
+
+        // Reorder to kernel formats, see dotFP32 and dotInt8.
+        l.w.resize(w_krsc.size());
+        l.w_q.resize(w_krsc.size());
+        for (int k = 0; k < desc.out_c; k++)
+        {
+            const int ob = k / l.block;
+            const int oi = k % l.block;
+            for (int i = 0; i < l.k_size; i++)
+            {
+                float  v    = w_krsc[(size_t)k * l.k_size + i];
+                size_t base = (size_t)ob * l.block * l.k_size;
+                l.w[  base + (size_t)i * l.block + oi] = v;
+                int    q    = quantize(v, 1 / l.w_scale[k]);
+                l.w_q[base + (size_t)(i / 4) * 4 * l.block + oi * 4 + i % 4] = (int8_t)q;
+                l.w_sum[k] += q;
+            }
+        }
+
+        c = desc.out_c;
+        layers_.push_back(std::move(l));
+    }
+    amax_.assign(layers_.size(), 0);
+}
+
+void Int8ConvTower::calibrate(const float* img, int h, int w)
+{
+    std::vector<float> out;
+    forward<false>(img, h, w, out, true);
+}
+
+bool Int8ConvTower::isCalibrated() const
+{
+    return std::all_of(amax_.begin(), amax_.end(), [](float v) { return v > 0; });
+}
+
+bool Int8ConvTower::readCalibrationCache(const std::string& filename)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+        return false;
+    std::vector<float> amax(layers_.size());
+    for (size_t i = 0; i < layers_.size(); i++)
+    {
+        std::string name;
+        if (!(file >> name >> amax[i]) || name != layers_[i].desc.name)
+            return false;
+    }
+    amax_ = amax;
+    return true;
+}
+
+void Int8ConvTower::writeCalibrationCache(const std::string& filename) const
+{
+    std::ofstream file(filename);
+    file.precision(std::numeric_limits<float>::max_digits10);
+    for (size_t i = 0; i < layers_.size(); i++)
+        file << layers_[i].desc.name << " " << amax_[i] << "\n";
+}
+
+void Int8ConvTower::forwardFP32(const float* img, int h, int w, std::vector<float>& out)
+{
+    forward<false>(img, h, w, out, false);
+}
+
+void Int8ConvTower::forwardInt8(const float* img, int h, int w, std::vector<float>& out)
+{
+    assert(isCalibrated());
+    forward<true>(img, h, w, out, false);
+}
+
+Dims3 Int8ConvTower::getOutputDims(int h, int w) const
+{
+    for (const auto& l: layers_)
+    {
+        h = convOutDim(h, l.desc);
+        w = convOutDim(w, l.desc);
+    }
+    return Dims3(layers_.back().desc.out_c, h, w);
+}
+
+template<bool IsInt8>
+void Int8ConvTower::forward(const float* img, int h, int w, std::vector<float>& out, bool update_ranges)
+{
+    assert(img != nullptr);
+
+    acts_.resize(layers_.size() + 1);
+    act_h_.resize(layers_.size() + 1);
+    act_w_.resize(layers_.size() + 1);
+
+    // Input scale op and CHW -> HWC.
+    auto& src = acts_[0];
+    src.resize((size_t)h * w * in_c_);
+    for (int c = 0; c < in_c_; c++)
+    {
+        for (int i = 0; i < h * w; i++)
+        {
+            float v = img[(size_t)c * h * w + i] * scale_ + shift_;
+            src[(size_t)i * in_c_ + c] = power_ == 1 ? v : std::pow(v, power_);
+        }
+    }
+    act_h_[0] = h;
+    act_w_[0] = w;
+
+    for (size_t i = 0; i < layers_.size(); i++)
+    {
+        const auto& l = layers_[i];
+        if (update_ranges)
+            amax_[i] = std::max(amax_[i], maxAbs(acts_[i]));
+
+        int oh = convOutDim(act_h_[i], l.desc);
+        int ow = convOutDim(act_w_[i], l.desc);
+        auto& dst = acts_[i + 1];
+        dst.resize((size_t)oh * ow * l.desc.out_c);
+        if (IsInt8)
+            convInt8(l, acts_[i].data(), amax_[i], act_h_[i], act_w_[i], dst.data());
+        else
+            convFP32(l, acts_[i].data(), act_h_[i], act_w_[i], dst.data());
+        act_h_[i + 1] = oh;
+        act_w_[i + 1] = ow;
+
+        // Residual and activation are computed in FP32.
+        if (l.desc.residual >= 0)
+        {
+            const auto& res = acts_[l.desc.residual];
+            assert(res.size() == dst.size());
+            for (size_t j = 0; j < dst.size(); j++)
+                dst[j] += res[j];
+        }
+        if (l.desc.elu)
+            applyElu(dst.data(), dst.size());
+    }
+
+    // HWC -> CHW.
+    const auto& res = acts_.back();
+    const int   oc  = layers_.back().desc.out_c;
+    const int   hw  = act_h_.back() * act_w_.back();
+    out.resize(res.size());
+    for (int i = 0; i < hw; i++)
+    {
+        for (int c = 0; c < oc; c++)
+            out[(size_t)c * hw + i] = res[(size_t)i * oc + c];
+    }
+}
+
+void Int8ConvTower::convFP32(const Layer& l, const float* src, int h, int w, float* dst)
+{
+    const auto& d  = l.desc;
+    const int   oh = convOutDim(h, d);
+    const int   ow = convOutDim(w, d);
+    patch_.resize(l.k_size);
+    for (int y = 0; y < oh; y++)
+    {
+        for (int x = 0; x < ow; x++)
+        {
+            gatherPatch(src, h, w, l.in_c, d.kernel, y * d.stride - d.pad, x * d.stride - d.pad, l.k_size, 0.0f, patch_.data());
+            float* out = dst + ((size_t)y * ow + x) * d.out_c;
+            for (int ob = 0; ob < d.out_c; ob += l.block)
+            {
+                const float* w_b = l.w.data() + (size_t)ob * l.k_size;
+                float res[kMaxOutBlock];
+                if (l.block == kMaxOutBlock)
+                    dotFP32<kMaxOutBlock>(patch_.data(), w_b, l.k_size, res);
+                else
+                    dotFP32<kMinOutBlock>(patch_.data(), w_b, l.k_size, res);
+                for (int j = 0; j < l.block; j++)
+                    out[ob + j] = res[j] + l.b[ob + j];
+            }
+        }
+    }
+}
+
+void Int8ConvTower::convInt8(const Layer& l, const float* src, float in_amax, int h, int w, float* dst)
+{
+    const auto& d  = l.desc;
+    const int   oh = convOutDim(h, d);
+    const int   ow = convOutDim(w, d);
+
+    // Quantize the whole input once, per tensor.
+    const float  in_scale = in_amax > 0 ? in_amax / kInt8Max : 1;
+    const size_t src_size = (size_t)h * w * l.in_c;
+    src_q_.resize(src_size);
+    auto src_q = reinterpret_cast<QType*>(src_q_.data());
+    for (size_t i = 0; i < src_size; i++)
+        src_q[i] = (QType)(quantize(src[i], 1 / in_scale) + kZeroPoint);
+
+    // Dequantization scales.
+    std::vector<float> out_scale(d.out_c);
+    for (int k = 0; k < d.out_c; k++)
+        out_scale[k] = in_scale * l.w_scale[k];
+
+    patch_q_.resize(l.k_size);
+    auto patch_q = reinterpret_cast<QType*>(patch_q_.data());
+    for (int y = 0; y < oh; y++)
+    {
+        for (int x = 0; x < ow; x++)
+        {
+            gatherPatch(src_q, h, w, l.in_c, d.kernel, y * d.stride - d.pad, x * d.stride - d.pad, l.k_size,
+                        (QType)kZeroPoint, patch_q);
+            float* out = dst + ((size_t)y * ow + x) * d.out_c;
+            for (int ob = 0; ob < d.out_c; ob += l.block)
+            {
+                const int8_t* w_b = l.w_q.data() + (size_t)ob * l.k_size;
+                int32_t res[kMaxOutBlock];
+                if (l.block == kMaxOutBlock)
+                    dotInt8<kMaxOutBlock>(patch_q, w_b, l.k_size, res);
+                else
+                    dotInt8<kMinOutBlock>(patch_q, w_b, l.k_size, res);
+                // Remove zero point contribution: sum((x + zp) * w) - zp * sum(w).
+                for (int j = 0; j < l.block; j++)
+                    out[ob + j] = (res[j] - kZeroPoint * l.w_sum[ob + j]) * out_scale[ob + j] + l.b[ob + j];
+            }
+        }
+    }
+}
+
+} }
@@ -0,0 +1,121 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_INT8_CONV_TOWER_H
+#define REDTAIL_INT8_CONV_TOWER_H
+
+#include <NvInfer.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace redtail { namespace tensorrt
+{
+
+using namespace nvinfer1;
+
+// -----------------------------------------------------------------
+// 2D convolution layer of the Stereo DNN feature tower.
+// Weights are read from <prefix><name>_k (KCRS) and <prefix><name>_b
+// entries of the weights map created by the model builder script.
+// -----------------------------------------------------------------
+struct TowerConvLayer
+{
+    std::string name;
+    int         out_c;
+    int         kernel;
+    int         stride;
+    int         pad;
+    // Apply ELU activation after (optional) residual add.
+    bool        elu;
+    // Residual connection: index of the tower activation which is added to the
+    // convolution output: 0 - tower input, i - output of layer i - 1, -1 - none.
+    int         residual;
+};
+
+// Returns 2D feature tower layers of nvsmall, nvtiny, resnet18 or resnet18_2D model.
+std::vector<TowerConvLayer> getFeatureTowerLayers(const std::string& model_type);
+
+// -----------------------------------------------------------------
+// CPU implementation of Stereo DNN 2D feature tower (from input scaling
+// up to cost volume input) with per-channel symmetric INT8 quantization.
+// Weights are quantized per output channel, activations - per tensor
+// using ranges collected during calibration.
+// INT8 dot products use VNNI (AVX-VNNI or AVX512-VNNI) or ARMv8.2 dot
+// product instructions when the code is compiled with corresponding
+// target flags (e.g. -march=native), and portable code otherwise.
+// FP32 version of the tower is provided as a reference (golden output).
+// All images/tensors are in CHW format, batch size is 1.
+// -----------------------------------------------------------------
+class Int8ConvTower
+{
+public:
+    // prefix is the tower prefix in the weights map, e.g. "left_" or "right_".
+    // Weights must be in FP32 format.
+    Int8ConvTower(const std::vector<TowerConvLayer>& layers, const std::unordered_map<std::string, Weights>& weights,
+                  const std::string& prefix, int in_c = 3);
+
+    // Runs FP32 tower and updates activation ranges. Should be called for
+    // each calibration image before running INT8 tower.
+    void calibrate(const float* img, int h, int w);
+    bool isCalibrated() const;
+
+    // Calibration cache is a text file with activation range of each layer input.
+    // Returns false if cache does not exist or does not match the tower.
+    bool readCalibrationCache(const std::string& filename);
+    void writeCalibrationCache(const std::string& filename) const;
+
+    void forwardFP32(const float* img, int h, int w, std::vector<float>& out);
+    void forwardInt8(const float* img, int h, int w, std::vector<float>& out);
+
+    // Returns tower output dimensions (CHW) for h x w input.
+    Dims3 getOutputDims(int h, int w) const;
+
+private:
+    struct Layer
+    {
+        TowerConvLayer desc;
+        int in_c;
+        // Patch (im2col row) size: kernel * kernel * in_c, padded to multiple of 4.
+        int k_size;
+        // Number of output channels computed at once.
+        int block;
+        // FP32 and quantized weights in the formats required by dot product kernels.
+        std::vector<float>   w;
+        std::vector<int8_t>  w_q;
+        std::vector<float>   w_scale;
+        // Sum of quantized weights of each output channel, used to remove activations zero point.
+        std::vector<int32_t> w_sum;
+        std::vector<float>   b;
+    };
+
+    template<bool IsInt8>
+    void forward(const float* img, int h, int w, std::vector<float>& out, bool update_ranges);
+    void convFP32(const Layer& l, const float* src, int h, int w, float* dst);
+    void convInt8(const Layer& l, const float* src, float in_amax, int h, int w, float* dst);
+
+private:
+    std::vector<Layer> layers_;
+    int in_c_;
+    // Input scale op (kUNIFORM): (x * scale + shift) ^ power.
+    float scale_ = 1;
+    float shift_ = 0;
+    float power_ = 1;
+
+    // Max absolute value of each layer input.
+    std::vector<float> amax_;
+
+    // Activations in HWC format, acts_[i] is the input of layer i.
+    std::vector<std::vector<float>> acts_;
+    std::vector<int>     act_h_;
+    std::vector<int>     act_w_;
+    // Quantized activations, signed or unsigned depending on dot product kernel.
+    std::vector<uint8_t> src_q_;
+    std::vector<uint8_t> patch_q_;
+    std::vector<float>   patch_;
+};
+
+} }
+
+#endif
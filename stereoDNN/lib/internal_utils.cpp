@@ -238,10 +238,11 @@ IPluginV2Layer* addPad(IPluginContainer& plugin_factory, INetworkDefinition& net
 }
 
 IPluginV2Layer* addSoftargmax(IPluginContainer& plugin_factory, INetworkDefinition& network, ITensor& input,
-                      SoftargmaxType sm_type, DataType data_type, const std::string& name)
+                      SoftargmaxType sm_type, DataType data_type, const std::string& name,
+                      SoftargmaxConfidence conf_type)
 {
     // Create plugin.
-    auto plugin = plugin_factory.createSoftargmaxPlugin(data_type, sm_type, name);
+    auto plugin = plugin_factory.createSoftargmaxPlugin(data_type, sm_type, conf_type, name);
     assert(plugin != nullptr);
     // Add to the network.
     ITensor* inputs[] = {&input};
@@ -89,6 +89,12 @@ public:
     template<typename T>
     static cudaError_t addDBiasTo3DConv(const T* bias, Dims bias_dims, T* conv, Dims conv_dims, cudaStream_t stream);
 
+    // Fused softargmax: computes softmax, expectation and (optionally) confidence
+    // in a single pass over D dimension of NDHW input. conf may be nullptr if conf_type is kNone.
+    static cudaError_t computeSoftargmax(DataType data_type, SoftargmaxType sm_type, SoftargmaxConfidence conf_type,
+                                         const void* in, Dims in_dims, int batch_size, void* disp, void* conf,
+                                         cudaStream_t stream);
+
     static cudaError_t fp32Tofp16(const float* src,    uint16_t* dst, size_t size, cudaStream_t stream);
     static cudaError_t fp16Tofp32(const uint16_t* src, float* dst,    size_t size, cudaStream_t stream);
 
@@ -155,7 +161,8 @@ public:
     IPluginV2* createSlicePlugin(Dims dims, Dims slice_start, Dims slice_end,
                                std::string name) override;
 
-    IPluginV2* createSoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, std::string name) override;
+    IPluginV2* createSoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, SoftargmaxConfidence conf_type,
+                                      std::string name) override;
     IPluginV2* deserializeSoftargmaxPlugin(const char* name, const void* data, size_t size) override;
 
 private:
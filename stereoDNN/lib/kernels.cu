@@ -334,6 +334,101 @@ cudaError_t CudaKernels::addDBiasTo3DConv(const float* bias, Dims bias_dims, flo
     return cudaSuccess;
 }
 
+// -----------------------------------------------------------------
+// Softargmax kernels.
+// -----------------------------------------------------------------
+
+// Computes softargmax and confidence over D dimension of NDHW tensor.
+// Uses online softmax so the input is read only once: the running max m is updated
+// on the fly and the accumulated sums are rescaled whenever m changes.
+// For each pixel the following is accumulated (e_i = exp(x_i - m)):
+//   s = sum(e_i), a = sum(e_i * i), b = sum(e_i * (x_i - m))
+// which gives: disparity = a / s, max(p) = 1 / s, entropy = log(s) - b / s.
+template<typename T>
+__global__ void softargmaxKernel(const T* src, int32_t d, int32_t h, int32_t w, float sign,
+                                 SoftargmaxConfidence conf_type, T* disp, T* conf)
+{
+    assert(src  != nullptr);
+    assert(disp != nullptr);
+    assert(d > 0);
+
+    const int32_t ix = blockIdx.x * blockDim.x + threadIdx.x;
+    const int32_t iy = blockIdx.y * blockDim.y + threadIdx.y;
+    if (ix >= w || iy >= h)
+        return;
+    const int32_t ib = blockIdx.z;
+
+    const size_t stride = (size_t)h * w;
+    const size_t offset = ib * stride + iy * w + ix;
+    src += ib * d * stride + iy * w + ix;
+
+    float m = sign * (float)(*src);
+    float s = 1;
+    float a = 0;
+    float b = 0;
+    for (int32_t i = 1; i < d; i++)
+    {
+        src += stride;
+        float x = sign * (float)(*src);
+        if (x > m)
+        {
+            float f = expf(m - x);
+            b = f * (b + (m - x) * s);
+            s *= f;
+            a *= f;
+            m = x;
+        }
+        float e = expf(x - m);
+        s += e;
+        a += e * i;
+        b += e * (x - m);
+    }
+
+    disp[offset] = (T)(a / s);
+    if (conf_type == SoftargmaxConfidence::kEntropy)
+    {
+        assert(conf != nullptr);
+        float entropy = logf(s) - b / s;
+        conf[offset] = (T)(d > 1 ? fmaxf(1.0f - entropy / logf((float)d), 0.0f) : 1.0f);
+    }
+    else if (conf_type == SoftargmaxConfidence::kPeakProb)
+    {
+        assert(conf != nullptr);
+        conf[offset] = (T)(1.0f / s);
+    }
+}
+
+cudaError_t CudaKernels::computeSoftargmax(DataType data_type, SoftargmaxType sm_type, SoftargmaxConfidence conf_type,
+                                           const void* in, Dims in_dims, int batch_size, void* disp, void* conf,
+                                           cudaStream_t stream)
+{
+    assert(data_type == DataType::kFLOAT || data_type == DataType::kHALF);
+    assert(in_dims.nbDims == 3);
+    assert(0 < batch_size && batch_size <= kMaxGridSizeZ);
+
+    dim3 b_dim{32, 8, 1};
+    dim3 g_dim;
+    g_dim.x = getBlockCount(in_dims.d[2], b_dim.x);
+    g_dim.y = getBlockCount(in_dims.d[1], b_dim.y);
+    g_dim.z = batch_size;
+
+    // Softargmin is softargmax of negated input.
+    float sign = sm_type == SoftargmaxType::kMin ? -1 : 1;
+    if (data_type == DataType::kFLOAT)
+    {
+        softargmaxKernel<<<g_dim, b_dim, 0, stream>>>((const float*)in, in_dims.d[0], in_dims.d[1], in_dims.d[2], sign,
+                                                      conf_type, (float*)disp, (float*)conf);
+    }
+    else
+    {
+        softargmaxKernel<<<g_dim, b_dim, 0, stream>>>((const __half*)in, in_dims.d[0], in_dims.d[1], in_dims.d[2], sign,
+                                                      conf_type, (__half*)disp, (__half*)conf);
+    }
+    CHECKK(stream);
+
+    return cudaSuccess;
+}
+
 // -----------------------------------------------------------------
 // Conversion kernels.
 // -----------------------------------------------------------------
@@ -42,6 +42,18 @@ enum class SoftargmaxType
     kMin = 1  // Computes softargmin.
 };
 
+// -----------------------------------------------------------------
+// Softargmax confidence type. When not kNone, the plugin produces
+// a second output with per-pixel confidence in [0, 1] range
+// computed in the same pass over the D dimension.
+// -----------------------------------------------------------------
+enum class SoftargmaxConfidence
+{
+    kNone     = 0, // No confidence output.
+    kEntropy  = 1, // 1 - H(p) / log(D), where H is softmax entropy.
+    kPeakProb = 2  // max(p), the probability of the most likely disparity.
+};
+
 // -----------------------------------------------------------------
 // Plugin container/factory.
 // TensorRT does not manage plugins and requires a plugin lifetime
@@ -82,7 +94,8 @@ public:
     virtual IPluginV2* createSlicePlugin(Dims dims, Dims slice_start, Dims slice_end,
                                        std::string name) = 0;
 
-    virtual IPluginV2* createSoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, std::string name) = 0;
+    virtual IPluginV2* createSoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, SoftargmaxConfidence conf_type,
+                                              std::string name) = 0;
     virtual IPluginV2* deserializeSoftargmaxPlugin(const char* name, const void* data, size_t size) = 0;
 
     static std::unique_ptr<IPluginContainer> create(ILogger& log);
@@ -123,8 +136,10 @@ IPluginV2Layer* addPad(IPluginContainer& plugin_factory, INetworkDefinition& net
                Dims4 pad_start, Dims4 pad_end,
                const std::string& name);
 
+// Confidence, if requested, is the second output of the layer.
 IPluginV2Layer* addSoftargmax(IPluginContainer& plugin_factory, INetworkDefinition& network, ITensor& input,
-                      SoftargmaxType sm_type, DataType data_type, const std::string& name);
+                      SoftargmaxType sm_type, DataType data_type, const std::string& name,
+                      SoftargmaxConfidence conf_type = SoftargmaxConfidence::kNone);
 
 // -----------------------------------------------------------------
 // Plugin factory used in (de)serialization.
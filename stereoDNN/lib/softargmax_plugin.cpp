@@ -17,11 +17,13 @@ using namespace nvinfer1;
 class SoftargmaxPlugin: public IPluginV2
 {
 public:
-    SoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, ILogger& log, std::string name):
-        data_type_(data_type), sm_type_(sm_type), log_(log), name_(name)
+    SoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, SoftargmaxConfidence conf_type, ILogger& log, std::string name):
+        data_type_(data_type), sm_type_(sm_type), conf_type_(conf_type), log_(log), name_(name)
     {
         assert(data_type_ == DataType::kFLOAT     || data_type_ == DataType::kHALF);
         assert(sm_type_   == SoftargmaxType::kMax || sm_type_ == SoftargmaxType::kMin);
+        assert(conf_type_ == SoftargmaxConfidence::kNone || conf_type_ == SoftargmaxConfidence::kEntropy ||
+               conf_type_ == SoftargmaxConfidence::kPeakProb);
         createDescriptors();
     }
 
@@ -34,6 +36,7 @@ public:
         // Note: starting with data_type_ as plugin type was already processed by the factory.
         data_type_ = read_stream<DataType>(ss);
         sm_type_   = read_stream<SoftargmaxType>(ss);
+        conf_type_ = read_stream<SoftargmaxConfidence>(ss);
         in_dims_.nbDims = read_stream<int>(ss);
         for (int i = 0; i < in_dims_.nbDims; i++)
             in_dims_.d[i] = read_stream<int>(ss);
@@ -55,11 +58,13 @@ public:
 
     int getNbOutputs() const noexcept override
     {
-        return 1;
+        // Disparity and optional confidence.
+        return conf_type_ == SoftargmaxConfidence::kNone ? 1 : 2;
     }
 
     Dims getOutputDimensions(int index, const Dims* inputs, int nbInputDims) noexcept override
     {
+        assert(0 <= index && index < getNbOutputs());
         assert(nbInputDims == 1);
         assert(inputs[0].nbDims == 3 || inputs[0].nbDims == 4);
         // If input is 5D tensor in NDCHW format (batch index implicit) then C dim must be equal to 1.
@@ -80,13 +85,14 @@ public:
                              DataType type, PluginFormat format, int maxBatchSize) noexcept override
     {
         assert(nbInputs  == 1);
-        assert(nbOutputs == 1);
+        assert(nbOutputs == getNbOutputs());
         assert(inputDims[0].nbDims == 3 || inputDims[0].nbDims == 4);
         if (inputDims[0].nbDims == 3)
             assert(DimsUtils::areEqual(inputDims[0],  in_dims_));
         else
             assert(DimsUtils::areEqual(inputDims[0],  Dims{4, {in_dims_.d[0], 1, in_dims_.d[1], in_dims_.d[2]}}));
-        assert(DimsUtils::areEqual(outputDims[0], out_dims_));
+        for (int i = 0; i < nbOutputs; i++)
+            assert(DimsUtils::areEqual(outputDims[i], out_dims_));
         assert(type == data_type_);
 
         last_batch_size_ = maxBatchSize;
@@ -171,6 +177,15 @@ public:
         cudnnStatus_t status    = CUDNN_STATUS_SUCCESS;
         cudaError_t   cu_status = cudaSuccess;
 
+        // Confidence requires the full softmax distribution which cuDNN path does not expose
+        // so use fused single-pass kernel that computes both outputs.
+        if (conf_type_ != SoftargmaxConfidence::kNone)
+        {
+            CHECK(cu_status = CudaKernels::computeSoftargmax(data_type_, sm_type_, conf_type_, inputs[0], in_dims_, batchSize,
+                                                             outputs[0], outputs[1], stream));
+            return cu_status == cudaSuccess ? 0 : -1;
+        }
+
         CHECK(status = cudnnSetStream(cudnn_, stream));
 
         if (batchSize != last_batch_size_)
@@ -224,7 +239,7 @@ public:
 
     const char* getPluginVersion() const noexcept override
     {
-        return "2";
+        return "3";
     }
 
     void setPluginNamespace(const char* libNamespace) noexcept override
@@ -239,7 +254,7 @@ public:
 
     IPluginV2* clone() const noexcept override
     {
-        auto* plugin = new SoftargmaxPlugin(data_type_, sm_type_, log_, name_);
+        auto* plugin = new SoftargmaxPlugin(data_type_, sm_type_, conf_type_, log_, name_);
         return plugin;
     }
 
@@ -308,6 +323,7 @@ private:
         write_stream((int32_t)StereoDnnPluginFactory::PluginType::kSoftargmax, ss);
         write_stream((int32_t)data_type_, ss);
         write_stream((int32_t)sm_type_, ss);
+        write_stream((int32_t)conf_type_, ss);
         write_stream(in_dims_.nbDims, ss);
         assert(in_dims_.nbDims <= Dims::MAX_DIMS);
         for (int i = 0; i < in_dims_.nbDims; i++)
@@ -321,8 +337,9 @@ private:
     }
 
 private:
-    DataType       data_type_;
-    SoftargmaxType sm_type_;
+    DataType             data_type_;
+    SoftargmaxType       sm_type_;
+    SoftargmaxConfidence conf_type_;
 
     cudnnHandle_t                 cudnn_    = nullptr;
     cudnnTensorDescriptor_t       in_desc_  = nullptr;
@@ -343,10 +360,11 @@ private:
 };
 
 // Factory method.
-IPluginV2* PluginContainer::createSoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, std::string name)
+IPluginV2* PluginContainer::createSoftargmaxPlugin(DataType data_type, SoftargmaxType sm_type, SoftargmaxConfidence conf_type,
+                                                  std::string name)
 {
     std::lock_guard<std::mutex> lock(lock_);
-    plugins_.push_back(new SoftargmaxPlugin(data_type, sm_type, log_, name));
+    plugins_.push_back(new SoftargmaxPlugin(data_type, sm_type, conf_type, log_, name));
     return plugins_.back();
 }
 
@@ -0,0 +1,94 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_CPU_UTILS_H
+#define REDTAIL_CPU_UTILS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <opencv2/core.hpp>
+
+// Building blocks of the CPU kernels shared by stereoDNN, caffe_ros and stereo_dnn_ros.
+namespace redtail { namespace cpu
+{
+
+// 16-byte vectors (GCC vector extensions) which map to SSE on x86 and NEON on ARM (Jetson).
+using float4v = float    __attribute__((vector_size(16)));
+using int4v   = int32_t  __attribute__((vector_size(16)));
+using u16x8   = uint16_t __attribute__((vector_size(16)));
+
+// Unaligned loads and stores, memcpy compiles to a single vector load/store.
+static inline float4v loadu(const float* src)
+{
+    float4v res;
+    std::memcpy(&res, src, sizeof(res));
+    return res;
+}
+
+static inline void storeu(float* dst, float4v val)
+{
+    std::memcpy(dst, &val, sizeof(val));
+}
+
+static inline u16x8 loadu(const uint16_t* src)
+{
+    u16x8 res;
+    std::memcpy(&res, src, sizeof(res));
+    return res;
+}
+
+static inline void storeu(uint16_t* dst, u16x8 val)
+{
+    std::memcpy(dst, &val, sizeof(val));
+}
+
+// exp using Cephes polynomial approximation (relative error ~1e-7), inputs are clamped to [-87, 87].
+static inline float4v exp4(float4v x)
+{
+    const float4v zero   = {};
+    const float   kLog2e = 1.44269504088896341f;
+    const float   kC1    = 0.693359375f;
+    const float   kC2    = -2.12194440e-4f;
+    // Adding 1.5 * 2^23 rounds to nearest integer which is then in low mantissa bits.
+    const float4v kRound = zero + 12582912.0f;
+
+    x = x < zero + 87.0f  ? x : zero + 87.0f;
+    x = x > zero - 87.0f  ? x : zero - 87.0f;
+    // exp(x) = 2^n * exp(r), n = round(x / ln(2)).
+    float4v n  = x * kLog2e + kRound;
+    int4v   ni = (int4v)n - (int4v)kRound;
+    n -= kRound;
+    float4v r = x - n * kC1 - n * kC2;
+    float4v p = zero + 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+    return p * (float4v)((ni + 127) << 23);
+}
+
+// Splits [0, count) into stripes processed by OpenCV thread pool, body(start, end)
+// is called once for each stripe so per-thread buffers can be allocated in the body.
+// num_threads is the max number of stripes, 0 means OpenCV thread count.
+template<typename Body>
+void parallelForStripes(int count, int num_threads, const Body& body)
+{
+    if (count <= 0)
+        return;
+    int num_stripes = std::min(num_threads > 0 ? num_threads : std::max(cv::getNumThreads(), 1), count);
+    cv::parallel_for_(cv::Range(0, num_stripes), [&](const cv::Range& range)
+    {
+        for (int stripe = range.start; stripe < range.end; stripe++)
+        {
+            body((int)((int64_t)count * stripe / num_stripes),
+                 (int)((int64_t)count * (stripe + 1) / num_stripes));
+        }
+    }, num_stripes);
+}
+
+} }
+
+#endif
@@ -0,0 +1,353 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "image_preprocessor.h"
+#include "cpu_utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace redtail { namespace preprocessing
+{
+
+bool isSupportedEncoding(const std::string& encoding)
+{
+    return encoding == "rgb8" || encoding == "bgr8" || encoding == "bgra8";
+}
+
+// -----------------------------------------------------------------
+// Resize coefficients.
+// -----------------------------------------------------------------
+// Source pixel index and its weight, indices may be out of the image
+// and are clamped (replicated border) when taps are created.
+using Tap = std::pair<int, float>;
+
+// Area interpolation is used only when both dimensions are downscaled, otherwise
+// it's a variant of linear interpolation, same as in OpenCV.
+static void getPixelTaps(int dst_idx, int src_size, float scale, Interpolation interp, bool is_downscale,
+                         std::vector<Tap>& taps)
+{
+    taps.clear();
+    if (interp == Interpolation::kArea && is_downscale)
+    {
+        // Average of the source pixels covered by the destination pixel.
+        float f0 = dst_idx * scale;
+        float f1 = std::min(f0 + scale, (float)src_size);
+        for (int s = (int)f0; s < f1; s++)
+        {
+            float w = (std::min(s + 1.0f, f1) - std::max((float)s, f0)) / scale;
+            // Skip rounding errors at the pixel boundaries.
+            if (w > 1e-5f)
+                taps.emplace_back(s, w);
+        }
+        return;
+    }
+
+    // Pixel centers are aligned, same as in OpenCV.
+    float f  = (dst_idx + 0.5f) * scale - 0.5f;
+    if (interp == Interpolation::kCubic)
+    {
+        int   s = (int)std::floor(f);
+        float t = f - s;
+        // Cubic convolution kernel with A = -0.75, same as in OpenCV.
+        const float a = -0.75f;
+        float w0 = ((a * (t + 1) - 5 * a) * (t + 1) + 8 * a) * (t + 1) - 4 * a;
+        float w1 = ((a + 2) * t - (a + 3)) * t * t + 1;
+        float w2 = ((a + 2) * (1 - t) - (a + 3)) * (1 - t) * (1 - t) + 1;
+        taps.emplace_back(s - 1, w0);
+        taps.emplace_back(s,     w1);
+        taps.emplace_back(s + 1, w2);
+        taps.emplace_back(s + 2, 1 - w0 - w1 - w2);
+    }
+    else if (interp == Interpolation::kArea)
+    {
+        // Area interpolation when upscaling: pixels are linearly interpolated
+        // only near the source pixel boundaries.
+        int   s = (int)std::floor(dst_idx * scale);
+        float t = (dst_idx + 1) - (s + 1) / scale;
+        t = t <= 0 ? 0 : t - std::floor(t);
+        taps.emplace_back(s,     1 - t);
+        taps.emplace_back(s + 1, t);
+    }
+    else
+    {
+        f = std::max(f, 0.0f);
+        int   s = (int)f;
+        float t = f - s;
+        taps.emplace_back(s,     1 - t);
+        taps.emplace_back(s + 1, t);
+    }
+}
+
+static void createAxisTaps(int src_size, int dst_size, Interpolation interp, bool is_downscale,
+                           std::vector<int>& start, std::vector<float>& weights, int& num_taps)
+{
+    float scale = (float)src_size / dst_size;
+
+    // Clamp indices and merge weights of the same source pixel so each
+    // output pixel uses a range of consecutive source pixels.
+    std::vector<std::vector<float>> ranges(dst_size);
+    std::vector<Tap> taps;
+    start.resize(dst_size);
+    num_taps = 1;
+    for (int i = 0; i < dst_size; i++)
+    {
+        getPixelTaps(i, src_size, scale, interp, is_downscale, taps);
+        assert(!taps.empty());
+        int lo = src_size;
+        int hi = 0;
+        for (auto& t: taps)
+        {
+            t.first = std::min(std::max(t.first, 0), src_size - 1);
+            lo = std::min(lo, t.first);
+            hi = std::max(hi, t.first);
+        }
+        ranges[i].assign(hi - lo + 1, 0);
+        for (const auto& t: taps)
+            ranges[i][t.first - lo] += t.second;
+        start[i] = lo;
+        num_taps = std::max(num_taps, hi - lo + 1);
+    }
+
+    // Pad all ranges to the same number of taps so the inner loops have
+    // fixed trip count. Ranges are shifted left near the end of the image
+    // so all taps are inside the image.
+    weights.assign((size_t)dst_size * num_taps, 0);
+    for (int i = 0; i < dst_size; i++)
+    {
+        int shift = std::max(start[i] + num_taps - src_size, 0);
+        start[i] -= shift;
+        assert(start[i] >= 0);
+        std::copy(ranges[i].begin(), ranges[i].end(), weights.begin() + (size_t)i * num_taps + shift);
+    }
+}
+
+ImagePreprocessor::ImagePreprocessor(int dst_w, int dst_h, ChannelOrder order, Interpolation interp,
+                                     float scale, float shift, int num_threads):
+    dst_w_(dst_w), dst_h_(dst_h), order_(order), interp_(interp), scale_(scale), shift_(shift),
+    num_threads_(num_threads)
+{
+    assert(dst_w_ > 0 && dst_h_ > 0);
+    assert(num_threads_ >= 0);
+}
+
+const ImagePreprocessor::ResizeTaps& ImagePreprocessor::getTaps(int src_w, int src_h) const
+{
+    std::lock_guard<std::mutex> lock(taps_mutex_);
+    auto& res = taps_[std::make_pair(src_w, src_h)];
+    if (res == nullptr)
+    {
+        res = std::make_unique<ResizeTaps>();
+        bool is_downscale = src_w >= dst_w_ && src_h >= dst_h_;
+        createAxisTaps(src_w, dst_w_, interp_, is_downscale, res->x.start, res->x.weights, res->x.num_taps);
+        createAxisTaps(src_h, dst_h_, interp_, is_downscale, res->y.start, res->y.weights, res->y.num_taps);
+    }
+    return *res;
+}
+
+// -----------------------------------------------------------------
+// Single pass preprocessing.
+// -----------------------------------------------------------------
+// Vertical pass: dst[i] = sum(w[k] * src_rows[k][i]), 8-bit rows are
+// converted on the fly so full resolution float image is never created.
+static void blendRows(const cv::Mat& src, int y_start, const float* w, int num_rows, int size, float* dst)
+{
+    const uint8_t* p_src = src.ptr<uint8_t>(y_start);
+    for (int i = 0; i < size; i++)
+        dst[i] = w[0] * p_src[i];
+    for (int k = 1; k < num_rows; k++)
+    {
+        // Zero weights are the padding, see createAxisTaps.
+        if (w[k] == 0)
+            continue;
+        p_src = src.ptr<uint8_t>(y_start + k);
+        for (int i = 0; i < size; i++)
+            dst[i] += w[k] * p_src[i];
+    }
+}
+
+// Horizontal pass of one output row: resample, swap channels, scale/shift and write
+// to CHW planes or interleaved 8-bit image. All channels of a tap are processed by
+// one vector multiply-add (the 4th lane is the next pixel of 3-channel images or
+// alpha and is ignored). NumTaps > 0 unrolls the taps loop for the common sizes.
+template<bool IsPlanar, int NumTaps>
+static void resampleRow(const float* row, const int* start, const float* weights, int num_taps, int cn,
+                        const int* src_ch, float scale, float shift, int dst_w, int dst_h,
+                        float* p_dst_f, uint8_t* p_dst_u)
+{
+    if (NumTaps > 0)
+        num_taps = NumTaps;
+    for (int x = 0; x < dst_w; x++)
+    {
+        const float* wx = weights + (size_t)x * num_taps;
+        const float* px = row + (size_t)start[x] * cn;
+        cpu::float4v acc {};
+        for (int j = 0; j < num_taps; j++, px += cn)
+            acc += wx[j] * cpu::loadu(px);
+        for (int c = 0; c < 3; c++)
+        {
+            if (IsPlanar)
+                p_dst_f[(size_t)c * dst_h * dst_w + x] = acc[src_ch[c]] * scale + shift;
+            else
+                p_dst_u[3 * x + c] = cv::saturate_cast<uint8_t>(acc[src_ch[c]]);
+        }
+    }
+}
+
+template<bool IsPlanar>
+void ImagePreprocessor::run(const cv::Mat& src, const std::string& encoding, float scale, float shift, void* dst) const
+{
+    assert(isSupportedEncoding(encoding));
+    assert(src.depth() == CV_8U && src.channels() == (encoding == "bgra8" ? 4 : 3));
+    assert(dst != nullptr);
+
+    // Source channel of each output channel.
+    bool is_same_order = (encoding == "rgb8") == (order_ == ChannelOrder::kRGB);
+    int  src_ch[3] {is_same_order ? 0 : 2, 1, is_same_order ? 2 : 0};
+
+    if (hasRemap())
+    {
+        runRemap<IsPlanar>(src, src_ch, scale, shift, dst);
+        return;
+    }
+
+    const auto& taps  = getTaps(src.cols, src.rows);
+    const auto& tx    = taps.x;
+    const auto& ty    = taps.y;
+    const int   cn    = src.channels();
+    const int   dst_w = dst_w_;
+    const int   dst_h = dst_h_;
+    auto resample = tx.num_taps == 2 ? resampleRow<IsPlanar, 2> :
+                    tx.num_taps == 3 ? resampleRow<IsPlanar, 3> :
+                    tx.num_taps == 4 ? resampleRow<IsPlanar, 4> : resampleRow<IsPlanar, 0>;
+
+    cpu::parallelForStripes(dst_h, num_threads_, [&](int y_start, int y_end)
+    {
+        // Source rows blended with vertical weights, interleaved channels.
+        // One extra element so the 4-float load of the last 3-channel pixel stays inside the row.
+        std::vector<float> row((size_t)src.cols * cn + 1);
+        for (int y = y_start; y < y_end; y++)
+        {
+            blendRows(src, ty.start[y], ty.weights.data() + (size_t)y * ty.num_taps, ty.num_taps,
+                      src.cols * cn, row.data());
+            float*   p_dst_f = IsPlanar ? (float*)dst + (size_t)y * dst_w : nullptr;
+            uint8_t* p_dst_u = IsPlanar ? nullptr : (uint8_t*)dst + (size_t)y * dst_w * 3;
+            resample(row.data(), tx.start.data(), tx.weights.data(), tx.num_taps, cn, src_ch, scale, shift,
+                     dst_w, dst_h, p_dst_f, p_dst_u);
+        }
+    });
+}
+
+void ImagePreprocessor::setRemap(const cv::Mat& map_x, const cv::Mat& map_y, int samples, int src_w, int src_h)
+{
+    assert(map_x.type() == CV_32FC1 && map_y.type() == CV_32FC1);
+    assert(map_x.size() == map_y.size());
+    assert(samples >= 1);
+    assert(map_x.cols == dst_w_ * samples && map_x.rows == dst_h_ * samples);
+    assert(src_w >= 2 && src_h >= 2);
+
+    remap_.samples = samples;
+    remap_.src_w   = src_w;
+    remap_.src_h   = src_h;
+    // Samples of each output pixel are stored together.
+    size_t size = (size_t)map_x.rows * map_x.cols;
+    remap_.x0.resize(size);
+    remap_.y0.resize(size);
+    remap_.fx.resize(size);
+    remap_.fy.resize(size);
+    size_t i = 0;
+    for (int y = 0; y < dst_h_; y++)
+    {
+        for (int x = 0; x < dst_w_; x++)
+        {
+            for (int sy = 0; sy < samples; sy++)
+            {
+                for (int sx = 0; sx < samples; sx++, i++)
+                {
+                    // Replicate border: clamp coordinates so both bilinear taps are inside the image.
+                    float mx = std::min(std::max(map_x.at<float>(y * samples + sy, x * samples + sx), 0.0f), src_w - 1.0f);
+                    float my = std::min(std::max(map_y.at<float>(y * samples + sy, x * samples + sx), 0.0f), src_h - 1.0f);
+                    int x0 = std::min((int)mx, src_w - 2);
+                    int y0 = std::min((int)my, src_h - 2);
+                    remap_.x0[i] = x0;
+                    remap_.y0[i] = y0;
+                    remap_.fx[i] = mx - x0;
+                    remap_.fy[i] = my - y0;
+                }
+            }
+        }
+    }
+}
+
+template<bool IsPlanar>
+void ImagePreprocessor::runRemap(const cv::Mat& src, const int* src_ch, float scale, float shift, void* dst) const
+{
+    assert(src.cols == remap_.src_w && src.rows == remap_.src_h);
+
+    const int cn        = src.channels();
+    const int dst_w     = dst_w_;
+    const int dst_h     = dst_h_;
+    const int num_taps  = remap_.samples * remap_.samples;
+    const size_t step   = src.step[0];
+    // Average of the samples.
+    const float w_avg   = 1.0f / num_taps;
+
+    cpu::parallelForStripes(dst_h, num_threads_, [&](int y_start, int y_end)
+    {
+        for (int y = y_start; y < y_end; y++)
+        {
+            float*   p_dst_f = IsPlanar ? (float*)dst + (size_t)y * dst_w : nullptr;
+            uint8_t* p_dst_u = IsPlanar ? nullptr : (uint8_t*)dst + (size_t)y * dst_w * 3;
+            size_t   i       = (size_t)y * dst_w * num_taps;
+            for (int x = 0; x < dst_w; x++)
+            {
+                float acc[3] {};
+                for (int k = 0; k < num_taps; k++, i++)
+                {
+                    const uint8_t* p0 = src.ptr<uint8_t>(remap_.y0[i]) + remap_.x0[i] * cn;
+                    const uint8_t* p1 = p0 + step;
+                    float fx = remap_.fx[i];
+                    float fy = remap_.fy[i];
+                    float w00 = (1 - fx) * (1 - fy);
+                    float w01 = fx * (1 - fy);
+                    float w10 = (1 - fx) * fy;
+                    float w11 = fx * fy;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int sc = src_ch[c];
+                        acc[c] += w00 * p0[sc] + w01 * p0[cn + sc] + w10 * p1[sc] + w11 * p1[cn + sc];
+                    }
+                }
+                for (int c = 0; c < 3; c++)
+                {
+                    if (IsPlanar)
+                        p_dst_f[(size_t)c * dst_h * dst_w + x] = acc[c] * w_avg * scale + shift;
+                    else
+                        p_dst_u[3 * x + c] = cv::saturate_cast<uint8_t>(acc[c] * w_avg);
+                }
+            }
+        }
+    });
+}
+
+void ImagePreprocessor::process(const cv::Mat& src, const std::string& encoding, float* dst) const
+{
+    run<true>(src, encoding, scale_, shift_, dst);
+}
+
+cv::Mat ImagePreprocessor::process(const cv::Mat& src, const std::string& encoding) const
+{
+    cv::Mat dst(3, dst_h_ * dst_w_, CV_32F);
+    process(src, encoding, dst.ptr<float>(0));
+    return dst;
+}
+
+void ImagePreprocessor::resize8u(const cv::Mat& src, const std::string& encoding, cv::Mat& dst) const
+{
+    dst.create(dst_h_, dst_w_, CV_8UC3);
+    assert(dst.isContinuous());
+    run<false>(src, encoding, 1, 0, dst.data);
+}
+
+} }
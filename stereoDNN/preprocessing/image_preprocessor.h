@@ -0,0 +1,137 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_IMAGE_PREPROCESSOR_H
+#define REDTAIL_IMAGE_PREPROCESSOR_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace redtail { namespace preprocessing
+{
+
+// Channel order of the network input.
+enum class ChannelOrder
+{
+    kRGB = 0,
+    kBGR
+};
+
+enum class Interpolation
+{
+    kLinear = 0,
+    kCubic,
+    // Pixel area averaging when downscaling, same as cv::INTER_AREA.
+    kArea
+};
+
+// Image preprocessing shared by the DNN nodes, the sample app and INT8 calibrators.
+// Converts 8-bit color image to the network input in a single pass:
+// channel swap, (anisotropic) resize, scale/shift and HWC -> CHW conversion.
+// Resize is separable: for each output row, the source rows are blended
+// (converting 8-bit pixels on the fly), then the blended row is resampled
+// horizontally and written directly to CHW planes. Resize coefficients are
+// precomputed for each source size. Output rows are processed in parallel.
+// Optionally, resize can be replaced by a remap table (e.g. combined stereo
+// rectification and resize) in which case the source image is sampled
+// bilinearly at the mapped coordinates.
+// Methods can be called concurrently from different threads.
+class ImagePreprocessor
+{
+public:
+    // Output value is resized_pixel * scale + shift.
+    // num_threads == 0 means use all OpenCV threads.
+    ImagePreprocessor(int dst_w, int dst_h, ChannelOrder order, Interpolation interp,
+                      float scale = 1, float shift = 0, int num_threads = 0);
+
+    // src is 8-bit 3 or 4 channel image, encoding is one of ROS encodings:
+    // rgb8, bgr8 or bgra8 (OpenCV images are bgr8).
+    // dst must have space for 3 * dst_h * dst_w floats.
+    void process(const cv::Mat& src, const std::string& encoding, float* dst) const;
+
+    // Returns 3 x (dst_h * dst_w) continuous CV_32F matrix (CHW).
+    cv::Mat process(const cv::Mat& src, const std::string& encoding) const;
+
+    // Resizes the image and converts it to CV_8UC3 (HWC) image in the output channel order,
+    // scale and shift are not applied. Used for visualization.
+    void resize8u(const cv::Mat& src, const std::string& encoding, cv::Mat& dst) const;
+
+    // Sets combined rectification and resize maps so the source image is sampled
+    // directly without a separate rectification pass. map_x and map_y are CV_32FC1
+    // maps of (dst_w * samples) x (dst_h * samples) size which contain source image
+    // coordinates (e.g. created by cv::initUndistortRectifyMap). Each output pixel
+    // is an average of samples x samples bilinear samples which reduces aliasing
+    // when downscaling. After this call, source images must be src_w x src_h.
+    void setRemap(const cv::Mat& map_x, const cv::Mat& map_y, int samples, int src_w, int src_h);
+    bool hasRemap() const { return !remap_.x0.empty(); }
+    // Source image size required by the remap.
+    cv::Size getRemapSourceSize() const { return cv::Size(remap_.src_w, remap_.src_h); }
+
+    int getWidth() const  { return dst_w_; }
+    int getHeight() const { return dst_h_; }
+
+private:
+    // Resize coefficients along one axis. Each output pixel is a weighted
+    // sum of num_taps consecutive source pixels starting from start[i].
+    struct AxisTaps
+    {
+        int                num_taps = 0;
+        std::vector<int>   start;
+        std::vector<float> weights;
+    };
+
+    struct ResizeTaps
+    {
+        AxisTaps x;
+        AxisTaps y;
+    };
+
+    // Bilinear samples of the combined rectification and resize map:
+    // top-left source pixel and interpolation weights of each sample.
+    struct RemapTaps
+    {
+        int                  samples = 0;
+        int                  src_w   = 0;
+        int                  src_h   = 0;
+        std::vector<int32_t> x0;
+        std::vector<int32_t> y0;
+        std::vector<float>   fx;
+        std::vector<float>   fy;
+    };
+
+    const ResizeTaps& getTaps(int src_w, int src_h) const;
+
+    template<bool IsPlanar>
+    void runRemap(const cv::Mat& src, const int* src_ch, float scale, float shift, void* dst) const;
+
+    template<bool IsPlanar>
+    void run(const cv::Mat& src, const std::string& encoding, float scale, float shift, void* dst) const;
+
+private:
+    int           dst_w_;
+    int           dst_h_;
+    ChannelOrder  order_;
+    Interpolation interp_;
+    float         scale_;
+    float         shift_;
+    int           num_threads_;
+
+    RemapTaps     remap_;
+
+    // Resize coefficients for each source size.
+    mutable std::mutex taps_mutex_;
+    mutable std::map<std::pair<int, int>, std::unique_ptr<ResizeTaps>> taps_;
+};
+
+// Returns true if image encoding is supported by ImagePreprocessor.
+bool isSupportedEncoding(const std::string& encoding);
+
+} }
+
+#endif
@@ -0,0 +1,142 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "motion_gate.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+namespace redtail { namespace preprocessing
+{
+
+MotionGate::MotionGate(const Params& params):
+    params_(params)
+{
+    assert(params_.threshold >= 0);
+    assert(params_.max_skip >= 0);
+    assert(params_.thumb_w > 0 && params_.thumb_h > 0);
+    assert(params_.cell_samples > 0);
+}
+
+void MotionGate::computeThumbnail(const cv::Mat& src, std::vector<float>& dst) const
+{
+    const int tw = params_.thumb_w;
+    const int th = params_.thumb_h;
+    const int ns = params_.cell_samples;
+    const int cn = src.channels();
+    dst.resize(tw * th);
+
+    // Sampled source columns (in elements) are the same for all rows.
+    std::vector<int> cols(tw * ns);
+    for (int i = 0; i < (int)cols.size(); i++)
+        cols[i] = std::min((int)((i + 0.5f) * src.cols / cols.size()), src.cols - 1) * cn;
+
+    // Intensity is the sum of channels so it does not depend on the channel order.
+    const float norm = 1.0f / (3 * ns * ns);
+    for (int ty = 0; ty < th; ty++)
+    {
+        float* p_dst = dst.data() + ty * tw;
+        std::fill(p_dst, p_dst + tw, 0.0f);
+        for (int sy = 0; sy < ns; sy++)
+        {
+            int y = std::min((int)((ty * ns + sy + 0.5f) * src.rows / (th * ns)), src.rows - 1);
+            const uint8_t* p_src = src.ptr<uint8_t>(y);
+            for (int tx = 0; tx < tw; tx++)
+            {
+                int sum = 0;
+                for (int sx = 0; sx < ns; sx++)
+                {
+                    const uint8_t* p = p_src + cols[tx * ns + sx];
+                    sum += p[0] + p[1] + p[2];
+                }
+                p_dst[tx] += sum;
+            }
+        }
+        for (int tx = 0; tx < tw; tx++)
+            p_dst[tx] *= norm;
+    }
+}
+
+bool MotionGate::update(const cv::Mat& src, uint64_t* key_id)
+{
+    assert(src.depth() == CV_8U && (src.channels() == 3 || src.channels() == 4));
+
+    computeThumbnail(src, cur_);
+    float diff = 0;
+    for (size_t i = 0; i < cur_.size() && key_.size() == cur_.size(); i++)
+        diff += std::abs(cur_[i] - key_[i]);
+    diff /= cur_.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The first frame and frames of different size are always processed.
+    bool process = force_ || key_.size() != cur_.size() || src.size() != key_size_ ||
+                   diff >= params_.threshold || num_skipped_ >= params_.max_skip;
+    frames_++;
+    last_diff_ = diff;
+    if (!process)
+    {
+        num_skipped_++;
+        skipped_++;
+        if (key_id != nullptr)
+            *key_id = key_id_;
+        return false;
+    }
+    std::swap(key_, cur_);
+    key_size_    = src.size();
+    num_skipped_ = 0;
+    force_       = false;
+    key_id_++;
+    if (key_id != nullptr)
+        *key_id = key_id_;
+    return true;
+}
+
+float MotionGate::getLastDifference() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_diff_;
+}
+
+void MotionGate::addComputeTime(float ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    computed_++;
+    compute_ms_ += ms;
+}
+
+MotionGate::Stats MotionGate::getStats(bool reset)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats res;
+    res.frames     = frames_;
+    res.skipped    = skipped_;
+    res.compute_ms = computed_ > 0 ? (float)(compute_ms_ / computed_) : 0;
+    res.saved_ms   = res.skipped * (double)res.compute_ms;
+    if (reset)
+    {
+        frames_     = 0;
+        skipped_    = 0;
+        computed_   = 0;
+        compute_ms_ = 0;
+    }
+    return res;
+}
+
+void MotionGate::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    force_ = true;
+}
+
+std::string toString(const MotionGate::Stats& stats)
+{
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "skipped %lu of %lu frames (%.1f%%), saved %.0fms of inference (%.2fms per frame)",
+                  (unsigned long)stats.skipped, (unsigned long)stats.frames,
+                  stats.frames > 0 ? 100.0 * stats.skipped / stats.frames : 0.0, stats.saved_ms, stats.compute_ms);
+    return buf;
+}
+
+} }
@@ -0,0 +1,100 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_MOTION_GATE_H
+#define REDTAIL_MOTION_GATE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace redtail { namespace preprocessing
+{
+
+// Motion gate: decides whether a frame differs enough from the last processed
+// (key) frame to be run through the network, so near-static frames can reuse
+// the previous output. The metric is the mean absolute difference of low resolution
+// intensity thumbnails where each thumbnail pixel averages a sparse grid of source
+// pixels, so it costs a small fraction of the preprocessing pass.
+// Frames are compared with the key frame rather than the previous frame so slow
+// changes accumulate and eventually trigger processing. At most max_skip
+// consecutive frames are skipped.
+// update() is expected to be called from one thread, other methods can be called
+// from any thread.
+class MotionGate
+{
+public:
+    struct Params
+    {
+        // Mean absolute intensity difference (0..255) below which the frame is skipped.
+        float threshold    = 2.0f;
+        // Max number of consecutive skipped frames.
+        int   max_skip     = 10;
+        // Thumbnail size.
+        int   thumb_w      = 32;
+        int   thumb_h      = 24;
+        // Number of source pixels sampled in each thumbnail cell along each dimension.
+        int   cell_samples = 4;
+    };
+
+    // Statistics since the last reset.
+    struct Stats
+    {
+        uint64_t frames     = 0;
+        uint64_t skipped    = 0;
+        // Average compute time of processed frames (see addComputeTime).
+        float    compute_ms = 0;
+        // Estimated compute time saved by skipping: skipped * compute_ms.
+        double   saved_ms   = 0;
+    };
+
+    explicit MotionGate(const Params& params);
+
+    // src is 8-bit 3 or 4 channel image. Returns true if the frame should be processed,
+    // in which case it becomes the new key frame, false if it can be skipped.
+    // key_id (if not null) is set to the id of the key frame whose output a skipped frame
+    // should reuse, or to the new key frame id. Pipelines which can drop frames after the gate
+    // use it to reuse only the output of that very key frame: if the key frame was dropped,
+    // its skipped frames must be dropped too and reset() called.
+    bool update(const cv::Mat& src, uint64_t* key_id = nullptr);
+
+    // Difference between the last frame and the key frame.
+    float getLastDifference() const;
+
+    // Reports compute time of a processed frame, used to estimate saved compute.
+    void addComputeTime(float ms);
+
+    Stats getStats(bool reset);
+
+    // Forces the next frame to be processed.
+    void reset();
+
+private:
+    void computeThumbnail(const cv::Mat& src, std::vector<float>& dst) const;
+
+private:
+    Params params_;
+
+    std::vector<float> key_;
+    std::vector<float> cur_;
+    cv::Size           key_size_;
+    int                num_skipped_ = 0;
+    uint64_t           key_id_      = 0;
+
+    mutable std::mutex mutex_;
+    bool     force_      = true;
+    float    last_diff_  = 0;
+    uint64_t frames_     = 0;
+    uint64_t skipped_    = 0;
+    uint64_t computed_   = 0;
+    double   compute_ms_ = 0;
+};
+
+// Human-readable statistics, e.g. for logging.
+std::string toString(const MotionGate::Stats& stats);
+
+} }
+
+#endif
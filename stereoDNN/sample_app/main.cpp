@@ -13,7 +13,10 @@
 #include <opencv2/opencv.hpp>
 
 #include "redtail_tensorrt_plugins.h"
+#include "int8_conv_tower.h"
 #include "networks.h"
+#include "sgm_stereo.h"
+#include "image_preprocessor.h"
 
 #define UNUSED(x) ((void)(x))
 
@@ -94,17 +97,12 @@ std::vector<float> readImgFile(const std::string& filename, int w, int h)
 {
     auto img = cv::imread(filename);
     assert(img.data != nullptr);
-    // 0. Convert to float.
-    img.convertTo(img, CV_32F);
-    // 1. Resize.
-    cv::resize(img, img, cv::Size(w, h), 0, 0,cv::INTER_AREA);
-    // 2. Convert BGR -> RGB.
-    cv::cvtColor(img, img, cv::COLOR_BGR2RGB);
-    // 3. Convert HWC -> CHW.
-    cv::Mat res = img.reshape(1, w * h).t();
-    // 4. Scale.
-    res /= 255.0;
-    return std::vector<float>(res.ptr<float>(0), res.ptr<float>(0) + w * h * 3);
+    // Convert BGR -> RGB, resize, scale to [0, 1] and convert HWC -> CHW in one pass.
+    namespace pp = redtail::preprocessing;
+    pp::ImagePreprocessor preproc(w, h, pp::ChannelOrder::kRGB, pp::Interpolation::kArea, 1 / 255.0f);
+    std::vector<float> res(3 * w * h);
+    preproc.process(img, "bgr8", res.data());
+    return res;
 }
 
 std::vector<float> readBinFile(const std::string& filename)
@@ -143,18 +141,164 @@ std::unordered_map<std::string, Weights> readWeights(const std::string& filename
     return weights;
 }
 
+void writeDisparity(const std::string& filename, const cv::Mat& disp, float png_scale = 1)
+{
+    assert(disp.type() == CV_32FC1 && disp.isContinuous());
+    // 1. As binary file.
+    auto res_file = std::ofstream(filename, std::ios::binary);
+    res_file.write((char*)disp.data, disp.total() * sizeof(float));
+    // 2. As PNG image.
+    // Same as in KITTI, reduce quantization effects by storing as 16-bit PNG.
+    cv::Mat img_u16;
+    disp.convertTo(img_u16, CV_16U, 256 * png_scale);
+    cv::imwrite(filename + ".png", img_u16);
+}
+
+// Runs classical SGM stereo on CPU, useful as a baseline for DNN models
+// at the same resolution. Disparity is in pixels.
+int runSgm(int w, int h, const std::string& left_file, const std::string& right_file, const std::string& disp_file)
+{
+    auto readGray = [&](const std::string& filename)
+    {
+        auto img = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+        assert(img.data != nullptr);
+        cv::resize(img, img, cv::Size(w, h), 0, 0, cv::INTER_AREA);
+        return img;
+    };
+    auto img_left  = readGray(left_file);
+    auto img_right = readGray(right_file);
+
+    // Max disparity of 1/8 of the width covers about the same range as DNN models.
+    redtail::stereo::SgmStereo sgm(w / 8);
+    printf("Using SGM with %d disparities and %d threads.\n", sgm.getMaxDisparity(), sgm.getNumThreads());
+
+    cv::Mat disp;
+    // Warm up to allocate buffers.
+    sgm.compute(img_left, img_right, disp);
+    auto host_start = std::chrono::high_resolution_clock::now();
+    sgm.compute(img_left, img_right, disp);
+    auto host_end   = std::chrono::high_resolution_clock::now();
+    auto host_elapsed_ms = std::chrono::duration<float, std::milli>(host_end - host_start).count();
+    printf("Host time: %.4fms\n", host_elapsed_ms);
+
+    writeDisparity(disp_file, disp);
+    printf("Done\n");
+    return 0;
+}
+
+// Runs 2D feature towers of the model on CPU in FP32 and INT8 and reports
+// INT8 accuracy (FP32 output is the golden output) and speedup.
+// Calibration source is a directory of images or a single image, same as in INT8 calibrator
+// of caffe_ros. If empty, left and right images are used for calibration.
+// Activation ranges are cached in <weights_file>.int8_tower.cache file.
+int runInt8Tower(const std::string& model_type, int w, int h, const std::string& weights_file,
+                 const std::vector<float>& img_left, const std::vector<float>& img_right, const std::string& calib_src)
+{
+    auto weights = readWeights(weights_file, DataType::kFLOAT);
+    // nvsmall at 513x161 is nvtiny model.
+    auto tower_type = model_type == "nvsmall" && w == 513 ? "nvtiny" : model_type;
+    auto layers = getFeatureTowerLayers(tower_type);
+    Int8ConvTower left_tower( layers, weights, "left_");
+    Int8ConvTower right_tower(layers, weights, "right_");
+
+    auto calib_cache = weights_file + ".int8_tower.cache";
+    if (left_tower.readCalibrationCache(calib_cache) && right_tower.readCalibrationCache(calib_cache))
+        printf("Loaded INT8 calibration cache from %s.\n", calib_cache.c_str());
+    else
+    {
+        std::vector<cv::String> files;
+        if (!calib_src.empty())
+            cv::glob(calib_src, files);
+        printf("Calibrating INT8 towers using %zu images...\n", files.empty() ? (size_t)1 : files.size());
+        // Both towers share the weights so use the same activation ranges for both.
+        auto calibrate = [&](const std::vector<float>& img)
+        {
+            left_tower.calibrate(img.data(), h, w);
+            right_tower.calibrate(img.data(), h, w);
+        };
+        if (files.empty())
+        {
+            calibrate(img_left);
+            calibrate(img_right);
+        }
+        for (const auto& file: files)
+            calibrate(readImgFile(file, w, h));
+        left_tower.writeCalibrationCache(calib_cache);
+    }
+
+    // Warm up to allocate buffers.
+    std::vector<float> out_fp32;
+    std::vector<float> out_int8;
+    left_tower.forwardFP32(img_left.data(), h, w, out_fp32);
+    left_tower.forwardInt8(img_left.data(), h, w, out_int8);
+
+    auto runTowers = [&](bool is_int8, std::vector<float>& out_l, std::vector<float>& out_r)
+    {
+        auto host_start = std::chrono::high_resolution_clock::now();
+        if (is_int8)
+        {
+            left_tower.forwardInt8( img_left.data(),  h, w, out_l);
+            right_tower.forwardInt8(img_right.data(), h, w, out_r);
+        }
+        else
+        {
+            left_tower.forwardFP32( img_left.data(),  h, w, out_l);
+            right_tower.forwardFP32(img_right.data(), h, w, out_r);
+        }
+        auto host_end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<float, std::milli>(host_end - host_start).count();
+    };
+    std::vector<float> out_fp32_r;
+    std::vector<float> out_int8_r;
+    float fp32_ms = runTowers(false, out_fp32, out_fp32_r);
+    float int8_ms = runTowers(true,  out_int8, out_int8_r);
+
+    // Accuracy of INT8 towers output (cost volume input).
+    double err_sq  = 0;
+    double ref_sq  = 0;
+    float  err_max = 0;
+    auto accumulate = [&](const std::vector<float>& ref, const std::vector<float>& res)
+    {
+        assert(ref.size() == res.size());
+        for (size_t i = 0; i < ref.size(); i++)
+        {
+            float err = std::abs(res[i] - ref[i]);
+            err_max = std::max(err_max, err);
+            err_sq += (double)err * err;
+            ref_sq += (double)ref[i] * ref[i];
+        }
+    };
+    accumulate(out_fp32,   out_int8);
+    accumulate(out_fp32_r, out_int8_r);
+
+    auto dims = left_tower.getOutputDims(h, w);
+    printf("Tower output : [%d, %d, %d](CHW)\n", dims.d[0], dims.d[1], dims.d[2]);
+    printf("INT8 error   : max %.4f, RMSE %.4f, relative RMSE %.4f\n", err_max,
+           std::sqrt(err_sq / (2 * out_fp32.size())), std::sqrt(err_sq / std::max(ref_sq, 1e-12)));
+    printf("FP32 towers  : %.4fms\n", fp32_ms);
+    printf("INT8 towers  : %.4fms (%.2fx)\n", int8_ms, fp32_ms / int8_ms);
+
+    for (auto& kv: weights)
+        delete[] (uint8_t*)kv.second.values;
+    printf("Done\n");
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 8)
     {
         printf("\n"
-               "Usage  : nvstereo_sample_app[_debug] <model_type> <width> <height> <path_to_weights_file> <path_to_left_image> <path_to_right_image> <disparity_output> [data_type]\n"
+               "Usage  : nvstereo_sample_app[_debug] <model_type> <width> <height> <path_to_weights_file> <path_to_left_image> <path_to_right_image> <disparity_output> [data_type] [int8_calib_src]\n"
                "where  : model_type is the type of the DNN, supported are: nvsmall, resnet18, resnet18_2D\n"
+               "         or sgm to run classical semi-global matching on CPU (weights file is ignored)\n"
                "         width and height are dimensions of the network (e.g. 1025 321)\n"
                "         weights file is the output of TensorRT model builder script\n"
                "         left and right are images that will be scaled to <width> x <height>\n"
                "         disparity output is the output of the network of size <width> x <height> (bin and PNG files are created)\n"
                "         data type(optional) is the data type of the model: fp32 (default) or fp16\n"
+               "         or int8 to compare INT8 and FP32 2D feature towers on CPU (disparity output is not created)\n"
+               "         int8 calibration source(optional) is a directory of images or an image file\n"
                "See <stereoDNN>/models directory for model files\n"
                "Example: nvstereo_sample_app nvsmall 1025 321 trt_weights.bin img_left.png img_right.png out_disp.bin\n\n");
         return 1;
@@ -163,27 +307,41 @@ int main(int argc, char** argv)
 
     auto model_type = std::string(argv[1]);
     if (model_type != "nvsmall" && model_type != "resnet18" &&
-        model_type != "resnet18_2D")
+        model_type != "resnet18_2D" && model_type != "sgm")
     {
-        printf("Invalid model type %s, supported: nvsmall, resnet18, resnet18_2D.\n", model_type.c_str());
+        printf("Invalid model type %s, supported: nvsmall, resnet18, resnet18_2D, sgm.\n", model_type.c_str());
         exit(1);
     }
 
+    if (model_type == "sgm")
+        return runSgm(std::stoi(argv[2]), std::stoi(argv[3]), argv[5], argv[6], argv[7]);
+
     DataType data_type = DataType::kFLOAT;
+    bool     use_int8  = false;
     if (argc >= 9)
     {
         auto d_type = std::string(argv[8]);
-        if (d_type == "fp32")
+        if (d_type == "int8")
+            use_int8 = true;
+        else if (d_type == "fp32")
             data_type = DataType::kFLOAT;
         else if (d_type == "fp16")
             data_type = DataType::kHALF;
         else
         {
-            printf("Data type %s is not supported, supported types: fp32, fp16.\n", d_type.c_str());
+            printf("Data type %s is not supported, supported types: fp32, fp16, int8.\n", d_type.c_str());
             exit(1);
         }
     }
-    printf("Using %s data type.\n", data_type == DataType::kFLOAT ? "fp32" : "fp16");
+    printf("Using %s data type.\n", use_int8 ? "int8" : data_type == DataType::kFLOAT ? "fp32" : "fp16");
+
+    if (use_int8)
+    {
+        int w = std::stoi(argv[2]);
+        int h = std::stoi(argv[3]);
+        return runInt8Tower(model_type, w, h, argv[4], readImgFile(argv[5], w, h), readImgFile(argv[6], w, h),
+                            argc >= 10 ? argv[9] : "");
+    }
 
     // Read weights.
     // Note: the weights object lifetime must be at least the same as engine.
@@ -341,19 +499,9 @@ int main(int argc, char** argv)
     CHECK(cudaMemcpy(output.data(), buffers[out_idx], output.size() * sizeof(float), cudaMemcpyDeviceToHost));
 
     // Write results.
-    // 1. As binary file.
-    auto res_file = std::ofstream(argv[7], std::ios::binary);
-    res_file.write((char*)output.data(), output.size() * sizeof(float));
-    // 2. As PNG image.
     auto img_f = cv::Mat(h, w, CV_32F, output.data());
-    // Same as in KITTI, reduce quantization effects by storing as 16-bit PNG.
-    img_f *= 256;
     // resnet18_2D model normalizes disparity using sigmoid, so bring it back to pixels.
-    if (model_type == "resnet18_2D")
-        img_f *= w;
-    cv::Mat img_u16;
-    img_f.convertTo(img_u16, CV_16U);
-    cv::imwrite(std::string(argv[7]) + ".png", img_u16);
+    writeDisparity(argv[7], img_f, model_type == "resnet18_2D" ? w : 1);
 
     // Cleanup.
 
@@ -18,23 +18,44 @@ using weight_map = std::unordered_map<std::string, Weights>;
 
 class IPluginContainer;
 
-// NVSmall DNN: 1025x321 input, 96 max disparity.
+// Total stride of each network. All networks are fully convolutional so any input
+// can be used as long as its H and W are of the form k * stride + 1, which makes
+// the decoder (upsampling) path line up with the encoder skip connections.
+// Network names reflect the default input dimensions the models were trained with.
+const int kNVSmallStride     = 8;
+const int kNVTinyStride      = 8;
+const int kResNet18Stride    = 32;
+const int kResNet18_2DStride = 8;
+
+// Returns the dimension closest to dim that satisfies k * stride + 1 requirement.
+// The result is never smaller than stride + 1.
+inline int alignNetworkDim(int dim, int stride)
+{
+    int k = (dim - 1 + stride / 2) / stride;
+    return (k > 0 ? k : 1) * stride + 1;
+}
+
+// NVSmall DNN: 1025x321 default input, 96 max disparity.
+// If conf_type is not kNone, softargmax confidence is added as the second network output ("conf").
 INetworkDefinition* createNVSmall1025x321Network(IBuilder& builder, IPluginContainer& plugin_factory,
-                                                 Dims3 img_dims, const weight_map& weights, DataType data_type, ILogger& log);
+                                                 Dims3 img_dims, const weight_map& weights, DataType data_type, ILogger& log,
+                                                 SoftargmaxConfidence conf_type = SoftargmaxConfidence::kNone);
 
-// Tiny version of NVSmall DNN: 513x161 input, 48 max disparity.
+// Tiny version of NVSmall DNN: 513x161 default input, 48 max disparity.
 INetworkDefinition* createNVTiny513x161Network(IBuilder& builder, IPluginContainer& plugin_factory,
                                                Dims3 img_dims, const weight_map& weights, DataType data_type,
-                                               ILogger& log);
+                                               ILogger& log, SoftargmaxConfidence conf_type = SoftargmaxConfidence::kNone);
 
-// Baseline ResNet-18 DNN: 1025x321 input, 136 max disparity.
+// Baseline ResNet-18 DNN: 1025x321 default input, 136 max disparity.
 INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginContainer& plugin_factory,
                                                    Dims3 img_dims, const weight_map& weights, DataType data_type,
-                                                   ILogger& log);
+                                                   ILogger& log, SoftargmaxConfidence conf_type = SoftargmaxConfidence::kNone);
 
-// ResNet18_2D DNN: 513x256 input, 96 max disparity.
+// ResNet18_2D DNN: 513x257 default input, 96 max disparity.
+// Softargmax is computed at half resolution so confidence is upsampled to the input size.
 INetworkDefinition* createResNet18_2D_513x257Network(IBuilder& builder, IPluginContainer& plugin_factory,
-                                                     Dims3 img_dims, const weight_map& weights, DataType data_type, ILogger& log);
+                                                     Dims3 img_dims, const weight_map& weights, DataType data_type, ILogger& log,
+                                                     SoftargmaxConfidence conf_type = SoftargmaxConfidence::kNone);
 }}
 
 #endif
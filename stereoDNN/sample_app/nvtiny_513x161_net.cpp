@@ -20,7 +20,7 @@ using weight_map = std::unordered_map<std::string, Weights>;
 
 INetworkDefinition* createNVTiny513x161Network(IBuilder& builder, IPluginContainer& plugin_factory,
                                      Dims3 img_dims, const weight_map& weights, DataType data_type,
-                                     ILogger& log)
+                                     ILogger& log, SoftargmaxConfidence conf_type)
 {
     INetworkDefinition* network = builder.createNetworkV2(0);
     assert(network != nullptr);
@@ -328,7 +328,7 @@ INetworkDefinition* createNVTiny513x161Network(IBuilder& builder, IPluginContain
     conv3D_8_act->setName("conv3D_8_act");
 
     // deconv3D_1 3D transposed convolution op.
-    Dims deconv3D_1_out_dims{4, {13, 32, 41, 129}};
+    Dims deconv3D_1_out_dims{4, {13, 32, (img_dims.d[1] - 1) / 4 + 1, (img_dims.d[2] - 1) / 4 + 1}};
     auto deconv3D_1 = addConv3DTranspose(plugin_factory, *network, *conv3D_8_act->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {64, 3, 32, 3, 3}}, deconv3D_1_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {0, 1, 1}}, Dims{3, {0, 1, 1}},
@@ -362,7 +362,7 @@ INetworkDefinition* createNVTiny513x161Network(IBuilder& builder, IPluginContain
     deconv3D_1_transform->setName("deconv3D_1_transform");
 
     // deconv3D_2 3D transposed convolution op.
-    Dims deconv3D_2_out_dims{4, {25, 16, 81, 257}};
+    Dims deconv3D_2_out_dims{4, {25, 16, (img_dims.d[1] - 1) / 2 + 1, (img_dims.d[2] - 1) / 2 + 1}};
     auto deconv3D_2 = addConv3DTranspose(plugin_factory, *network, *deconv3D_1_transform->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {32, 3, 16, 3, 3}}, deconv3D_2_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {0, 1, 1}}, Dims{3, {0, 1, 1}},
@@ -396,7 +396,7 @@ INetworkDefinition* createNVTiny513x161Network(IBuilder& builder, IPluginContain
     deconv3D_2_transform->setName("deconv3D_2_transform");
 
     // deconv3D_3 3D transposed convolution op.
-    Dims deconv3D_3_out_dims{4, {49, 1, 161, 513}};
+    Dims deconv3D_3_out_dims{4, {49, 1, img_dims.d[1], img_dims.d[2]}};
     auto deconv3D_3 = addConv3DTranspose(plugin_factory, *network, *deconv3D_2_transform->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {16, 3, 1, 3, 3}}, deconv3D_3_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {0, 1, 1}}, Dims{3, {0, 1, 1}},
@@ -415,10 +415,18 @@ INetworkDefinition* createNVTiny513x161Network(IBuilder& builder, IPluginContain
     deconv3D_3_slice_layer->setName("deconv3D_3_slice_layer");
 
     // Softargmax.
-    auto disp = addSoftargmax(plugin_factory, *network, *deconv3D_3_slice_layer->getOutput(0), SoftargmaxType::kMin, data_type, "disp_softargmax");
+    auto disp = addSoftargmax(plugin_factory, *network, *deconv3D_3_slice_layer->getOutput(0), SoftargmaxType::kMin, data_type, "disp_softargmax", conf_type);
     assert(disp != nullptr);
     disp->setName("disp");
 
+    // Softargmax confidence.
+    if (conf_type != SoftargmaxConfidence::kNone)
+    {
+        auto conf_out = disp->getOutput(1);
+        conf_out->setName("conf");
+        network->markOutput(*conf_out);
+    }
+
     auto disp_out = disp->getOutput(0);
     disp_out->setName("disp");
     network->markOutput(*disp_out);
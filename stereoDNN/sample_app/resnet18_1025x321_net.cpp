@@ -20,7 +20,7 @@ using weight_map = std::unordered_map<std::string, Weights>;
 
 INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginContainer& plugin_factory,
                                      Dims3 img_dims, const weight_map& weights, DataType data_type,
-                                     ILogger& log)
+                                     ILogger& log, SoftargmaxConfidence conf_type)
 {
     INetworkDefinition* network = builder.createNetworkV2(0);
     assert(network != nullptr);
@@ -885,7 +885,7 @@ INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginCon
     conv3D_5b_act->setName("conv3D_5b_act");
 
     // deconv3D_1 3D transposed convolution op.
-    Dims deconv3D_1_out_dims{4, {9, 64, 21, 65}};
+    Dims deconv3D_1_out_dims{4, {9, 64, (img_dims.d[1] - 1) / 16 + 1, (img_dims.d[2] - 1) / 16 + 1}};
     auto deconv3D_1 = addConv3DTranspose(plugin_factory, *network, *conv3D_5b_act->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {128, 3, 64, 3, 3}}, deconv3D_1_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {1, 1, 1}}, Dims{3, {1, 1, 1}},
@@ -910,7 +910,7 @@ INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginCon
     deconv3D_1_transform->setName("deconv3D_1_transform");
 
     // deconv3D_2 3D transposed convolution op.
-    Dims deconv3D_2_out_dims{4, {17, 64, 41, 129}};
+    Dims deconv3D_2_out_dims{4, {17, 64, (img_dims.d[1] - 1) / 8 + 1, (img_dims.d[2] - 1) / 8 + 1}};
     auto deconv3D_2 = addConv3DTranspose(plugin_factory, *network, *deconv3D_1_transform->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {64, 3, 64, 3, 3}}, deconv3D_2_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {1, 1, 1}}, Dims{3, {1, 1, 1}},
@@ -935,7 +935,7 @@ INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginCon
     deconv3D_2_transform->setName("deconv3D_2_transform");
 
     // deconv3D_3 3D transposed convolution op.
-    Dims deconv3D_3_out_dims{4, {35, 64, 81, 257}};
+    Dims deconv3D_3_out_dims{4, {35, 64, (img_dims.d[1] - 1) / 4 + 1, (img_dims.d[2] - 1) / 4 + 1}};
     auto deconv3D_3 = addConv3DTranspose(plugin_factory, *network, *deconv3D_2_transform->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {64, 3, 64, 3, 3}}, deconv3D_3_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {0, 1, 1}}, Dims{3, {0, 1, 1}},
@@ -969,7 +969,7 @@ INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginCon
     deconv3D_3_transform->setName("deconv3D_3_transform");
 
     // deconv3D_4 3D transposed convolution op.
-    Dims deconv3D_4_out_dims{4, {69, 32, 161, 513}};
+    Dims deconv3D_4_out_dims{4, {69, 32, (img_dims.d[1] - 1) / 2 + 1, (img_dims.d[2] - 1) / 2 + 1}};
     auto deconv3D_4 = addConv3DTranspose(plugin_factory, *network, *deconv3D_3_transform->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {64, 3, 32, 3, 3}}, deconv3D_4_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {0, 1, 1}}, Dims{3, {0, 1, 1}},
@@ -1003,7 +1003,7 @@ INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginCon
     deconv3D_4_transform->setName("deconv3D_4_transform");
 
     // deconv3D_5 3D transposed convolution op.
-    Dims deconv3D_5_out_dims{4, {137, 1, 321, 1025}};
+    Dims deconv3D_5_out_dims{4, {137, 1, img_dims.d[1], img_dims.d[2]}};
     auto deconv3D_5 = addConv3DTranspose(plugin_factory, *network, *deconv3D_4_transform->getOutput(0),
                                   Conv3DType::kTensorFlow, {5, {32, 3, 1, 3, 3}}, deconv3D_5_out_dims,
                                   Dims{3, {2, 2, 2}}, Dims{3, {0, 1, 1}}, Dims{3, {0, 1, 1}},
@@ -1022,10 +1022,18 @@ INetworkDefinition* createResNet18_1025x321Network(IBuilder& builder, IPluginCon
     deconv3D_5_slice_layer->setName("deconv3D_5_slice_layer");
 
     // Softargmax.
-    auto disp = addSoftargmax(plugin_factory, *network, *deconv3D_5_slice_layer->getOutput(0), SoftargmaxType::kMin, data_type, "disp_softargmax");
+    auto disp = addSoftargmax(plugin_factory, *network, *deconv3D_5_slice_layer->getOutput(0), SoftargmaxType::kMin, data_type, "disp_softargmax", conf_type);
     assert(disp != nullptr);
     disp->setName("disp");
 
+    // Softargmax confidence.
+    if (conf_type != SoftargmaxConfidence::kNone)
+    {
+        auto conf_out = disp->getOutput(1);
+        conf_out->setName("conf");
+        network->markOutput(*conf_out);
+    }
+
     auto disp_out = disp->getOutput(0);
     disp_out->setName("disp");
     network->markOutput(*disp_out);
@@ -20,7 +20,7 @@ using weight_map = std::unordered_map<std::string, Weights>;
 
 INetworkDefinition* createResNet18_2D_513x257Network(IBuilder& builder, IPluginContainer& plugin_factory,
                                      Dims3 img_dims, const weight_map& weights, DataType data_type,
-                                     ILogger& log)
+                                     ILogger& log, SoftargmaxConfidence conf_type)
 {
     INetworkDefinition* network = builder.createNetworkV2(0);
     assert(network != nullptr);
@@ -604,10 +604,25 @@ INetworkDefinition* createResNet18_2D_513x257Network(IBuilder& builder, IPluginC
     cost_vol->setName("cost_vol");
 
     // Softargmax.
-    auto softargmax = addSoftargmax(plugin_factory, *network, *cost_vol->getOutput(0), SoftargmaxType::kMax, data_type, "softargmax_softargmax");
+    auto softargmax = addSoftargmax(plugin_factory, *network, *cost_vol->getOutput(0), SoftargmaxType::kMax, data_type, "softargmax_softargmax", conf_type);
     assert(softargmax != nullptr);
     softargmax->setName("softargmax");
 
+    // Softargmax confidence, resized to input image size.
+    if (conf_type != SoftargmaxConfidence::kNone)
+    {
+        auto conf = network->addResize(*softargmax->getOutput(1));
+        assert(conf != nullptr);
+        conf->setName("conf");
+        conf->setResizeMode(ResizeMode::kLINEAR);
+        conf->setCoordinateTransformation(ResizeCoordinateTransformation::kALIGN_CORNERS);
+        conf->setOutputDimensions(Dims3(1, img_dims.d[1], img_dims.d[2]));
+
+        auto conf_out = conf->getOutput(0);
+        conf_out->setName("conf");
+        network->markOutput(*conf_out);
+    }
+
     // concat tensor concat op.
     ITensor* concat_inputs[] = {left_conv1_act->getOutput(0), softargmax->getOutput(0)};
     auto concat = network->addConcatenation(concat_inputs, 2);
@@ -0,0 +1,328 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#include "sgm_stereo.h"
+#include "cpu_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace redtail { namespace stereo
+{
+
+using namespace redtail::cpu;
+
+static const int kVecSize = sizeof(u16x8) / sizeof(uint16_t);
+
+// Census window is 9x7 so the transform fits into 64 bits.
+static const int      kCensusW  = 9;
+static const int      kCensusH  = 7;
+static const uint16_t kMaxCost  = kCensusW * kCensusH - 1;
+// Path buffers have guard elements at d == -1 and d == D so d +/- 1 can be loaded
+// without branches. The value is large enough to never be selected and small
+// enough to not overflow when P1 is added.
+static const uint16_t kGuard    = std::numeric_limits<uint16_t>::max() / 2;
+
+static inline u16x8 splat(uint16_t val)
+{
+    return u16x8{} + val;
+}
+
+static inline u16x8 vmin(u16x8 a, u16x8 b)
+{
+    return a < b ? a : b;
+}
+
+static inline uint16_t hmin(u16x8 a)
+{
+    uint16_t res = a[0];
+    for (int i = 1; i < kVecSize; i++)
+        res = std::min(res, (uint16_t)a[i]);
+    return res;
+}
+
+// Computes SGM path cost of one pixel:
+// L(d) = C(d) + min(L'(d), L'(d - 1) + P1, L'(d + 1) + P1, min(L') + P2) - min(L')
+// where L' is the path cost of the previous pixel on the path.
+// prev and cur point to guarded buffers (guard at index 0), returns min(L).
+// The result is either stored (Init == true) or added to sum.
+template<bool Init>
+static inline uint16_t updatePath(const uint16_t* cost, const uint16_t* prev, uint16_t prev_min,
+                                  uint16_t p1, uint16_t p2, int d, uint16_t* cur, uint16_t* sum)
+{
+    const u16x8 p1_v      = splat(p1);
+    const u16x8 prev_p2_v = splat(prev_min + p2);
+    const u16x8 prev_v    = splat(prev_min);
+    u16x8 cur_min = splat(std::numeric_limits<uint16_t>::max());
+    for (int i = 0; i < d; i += kVecSize)
+    {
+        u16x8 l  = loadu(prev + 1 + i);
+        u16x8 lm = loadu(prev + i);
+        u16x8 lp = loadu(prev + 2 + i);
+        u16x8 t  = vmin(vmin(l, prev_p2_v), vmin(lm, lp) + p1_v);
+        l        = loadu(cost + i) + t - prev_v;
+        storeu(cur + 1 + i, l);
+        storeu(sum + i, Init ? l : loadu(sum + i) + l);
+        cur_min = vmin(cur_min, l);
+    }
+    return hmin(cur_min);
+}
+
+// Allocates path buffer for count pixels of d disparities with guards.
+static std::vector<uint16_t> createPathBuffer(int count, int d)
+{
+    std::vector<uint16_t> res((size_t)count * (d + 2), 0);
+    for (int i = 0; i < count; i++)
+    {
+        res[i * (d + 2)]     = kGuard;
+        res[i * (d + 2) + d + 1] = kGuard;
+    }
+    return res;
+}
+
+SgmStereo::SgmStereo(int max_disparity, int p1, int p2, int num_threads):
+    max_disp_((max_disparity + kVecSize - 1) / kVecSize * kVecSize), p1_(p1), p2_(p2), num_threads_(num_threads)
+{
+    if (max_disparity <= 0)
+        throw std::invalid_argument("SGM max disparity must be > 0, got " + std::to_string(max_disparity));
+    if (p1_ <= 0 || p1_ >= p2_ || p2_ > getMaxP2())
+    {
+        throw std::invalid_argument("SGM penalties must satisfy 0 < P1 < P2 <= " + std::to_string(getMaxP2()) +
+                                    ", got P1: " + std::to_string(p1_) + ", P2: " + std::to_string(p2_));
+    }
+
+    if (num_threads_ <= 0)
+        num_threads_ = std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+int SgmStereo::getMaxP2()
+{
+    // Path costs must fit into 16 bits below the guard: L <= max cost + P2 for each of 8 paths.
+    return (kGuard - 1) / 8 - kMaxCost;
+}
+
+void SgmStereo::compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disp)
+{
+    assert(left.type()  == CV_8UC1);
+    assert(right.type() == CV_8UC1);
+    assert(left.size()  == right.size());
+
+    if (w_ != left.cols || h_ != left.rows)
+    {
+        w_ = left.cols;
+        h_ = left.rows;
+        size_t size = (size_t)w_ * h_;
+        census_l_.resize(size);
+        census_r_.resize(size);
+        cost_.resize(size * max_disp_);
+        sum_.resize(size * max_disp_);
+    }
+
+    parallelForStripes(h_, num_threads_, [&](int y_start, int y_end)
+    {
+        computeCensus(left,  census_l_.data(), y_start, y_end);
+        computeCensus(right, census_r_.data(), y_start, y_end);
+    });
+    parallelForStripes(h_, num_threads_, [&](int y_start, int y_end) { computeCosts(y_start, y_end); });
+
+    // Paths are aggregated one direction at a time, each of them in parallel over independent
+    // lines, so every pixel of the sum is updated by one thread at a time.
+    // Horizontal paths initialize the sum.
+    parallelForStripes(h_, num_threads_, [&](int y_start, int y_end) { aggregateHorizontal(y_start, y_end); });
+    for (bool top_down: {true, false})
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            // Vertical lines are the columns, diagonal lines start at the first row or column.
+            int num_lines = dx == 0 ? w_ : w_ + h_ - 1;
+            parallelForStripes(num_lines, num_threads_, [&](int line_start, int line_end)
+            {
+                aggregatePath(dx, top_down, line_start, line_end);
+            });
+        }
+    }
+
+    disp.create(h_, w_, CV_32FC1);
+    parallelForStripes(h_, num_threads_, [&](int y_start, int y_end) { computeDisparity(disp, y_start, y_end); });
+}
+
+void SgmStereo::computeCensus(const cv::Mat& img, uint64_t* census, int y_start, int y_end) const
+{
+    const int rx = kCensusW / 2;
+    const int ry = kCensusH / 2;
+    const int wp = w_ + 2 * rx;
+    // Rows of the window with replicated border.
+    std::vector<uint8_t> rows(kCensusH * wp);
+    for (int y = y_start; y < y_end; y++)
+    {
+        for (int dy = 0; dy < kCensusH; dy++)
+        {
+            const uint8_t* src = img.ptr<uint8_t>(std::min(std::max(y + dy - ry, 0), h_ - 1));
+            uint8_t*       dst = rows.data() + dy * wp;
+            std::fill(dst, dst + rx, src[0]);
+            std::copy(src, src + w_, dst + rx);
+            std::fill(dst + rx + w_, dst + wp, src[w_ - 1]);
+        }
+        // Loop over x is innermost so it is vectorized by the compiler.
+        const uint8_t* center = rows.data() + ry * wp + rx;
+        uint64_t*      dst    = census + y * w_;
+        std::fill(dst, dst + w_, 0);
+        for (int dy = 0; dy < kCensusH; dy++)
+        {
+            for (int dx = 0; dx < kCensusW; dx++)
+            {
+                if (dx == rx && dy == ry)
+                    continue;
+                const uint8_t* src = rows.data() + dy * wp + dx;
+                for (int x = 0; x < w_; x++)
+                    dst[x] = (dst[x] << 1) | (uint64_t)(src[x] < center[x]);
+            }
+        }
+    }
+}
+
+void SgmStereo::computeCosts(int y_start, int y_end)
+{
+    for (int y = y_start; y < y_end; y++)
+    {
+        const uint64_t* cl = census_l_.data() + y * w_;
+        const uint64_t* cr = census_r_.data() + y * w_;
+        for (int x = 0; x < w_; x++)
+        {
+            uint16_t* c = cost_.data() + ((size_t)y * w_ + x) * max_disp_;
+            // Left pixel x matches right pixel x - d, there is no match for d > x.
+            int max_d = std::min(x + 1, max_disp_);
+            for (int d = 0; d < max_d; d++)
+                c[d] = (uint16_t)__builtin_popcountll(cl[x] ^ cr[x - d]);
+            std::fill(c + max_d, c + max_disp_, kMaxCost);
+        }
+    }
+}
+
+void SgmStereo::aggregateHorizontal(int y_start, int y_end)
+{
+    const int d = max_disp_;
+    // Start of the path: previous path cost is 0.
+    auto zero = createPathBuffer(1, d);
+    auto buf  = createPathBuffer(2, d);
+    uint16_t* prev = buf.data();
+    uint16_t* cur  = buf.data() + d + 2;
+    for (int y = y_start; y < y_end; y++)
+    {
+        const uint16_t* cost = cost_.data() + (size_t)y * w_ * d;
+        uint16_t*       sum  = sum_.data()  + (size_t)y * w_ * d;
+        // Left to right.
+        const uint16_t* p = zero.data();
+        uint16_t prev_min = 0;
+        for (int x = 0; x < w_; x++)
+        {
+            prev_min = updatePath<true>(cost + x * d, p, prev_min, p1_, p2_, d, cur, sum + x * d);
+            std::swap(prev, cur);
+            p = prev;
+        }
+        // Right to left.
+        p = zero.data();
+        prev_min = 0;
+        for (int x = w_ - 1; x >= 0; x--)
+        {
+            prev_min = updatePath<false>(cost + x * d, p, prev_min, p1_, p2_, d, cur, sum + x * d);
+            std::swap(prev, cur);
+            p = prev;
+        }
+    }
+}
+
+void SgmStereo::aggregatePath(int dx, bool top_down, int line_start, int line_end)
+{
+    const int d  = max_disp_;
+    const int ds = d + 2;
+    // Previous pixel on the path is (x - dx, y - 1) for top-down and (x - dx, y + 1) for bottom-up paths.
+    // Line of pixel x in row iy (counted in the path direction) is x - dx * iy, shifted to start at 0.
+    // Lines of the stripe are processed row by row so the rows are read sequentially.
+    const int line_shift = dx > 0 ? h_ - 1 : 0;
+    const int num_lines  = line_end - line_start;
+    auto zero = createPathBuffer(1, d);
+    auto prev_rows = createPathBuffer(num_lines, d);
+    auto cur_rows  = createPathBuffer(num_lines, d);
+    std::vector<uint16_t> prev_mins(num_lines);
+    std::vector<uint16_t> cur_mins(num_lines);
+    for (int iy = 0; iy < h_; iy++)
+    {
+        const int y = top_down ? iy : h_ - 1 - iy;
+        const uint16_t* cost = cost_.data() + (size_t)y * w_ * d;
+        uint16_t*       sum  = sum_.data()  + (size_t)y * w_ * d;
+        // x of the line start in this row.
+        const int x_shift = dx * iy - line_shift + line_start;
+        const int x_start = std::max(x_shift, 0);
+        const int x_end   = std::min(x_shift + num_lines, w_);
+        for (int x = x_start; x < x_end; x++)
+        {
+            const int i  = x - x_shift;
+            const int xp = x - dx;
+            // First row or out of image: start of the path.
+            bool is_start = iy == 0 || xp < 0 || xp >= w_;
+            const uint16_t* p = is_start ? zero.data() : prev_rows.data() + i * ds;
+            uint16_t prev_min = is_start ? 0 : prev_mins[i];
+            cur_mins[i] = updatePath<false>(cost + x * d, p, prev_min, p1_, p2_, d, cur_rows.data() + i * ds,
+                                            sum + x * d);
+        }
+        std::swap(prev_rows, cur_rows);
+        std::swap(prev_mins, cur_mins);
+    }
+}
+
+void SgmStereo::computeDisparity(cv::Mat& disp, int y_start, int y_end) const
+{
+    const int d = max_disp_;
+    std::vector<uint16_t> total(d);
+    for (int y = y_start; y < y_end; y++)
+    {
+        float* dst = disp.ptr<float>(y);
+        for (int x = 0; x < w_; x++)
+        {
+            size_t offset = ((size_t)y * w_ + x) * d;
+            // Vectorized argmin: keep min cost and its disparity per lane then reduce the lanes.
+            u16x8 min_v = splat(std::numeric_limits<uint16_t>::max());
+            u16x8 idx_v = {0, 1, 2, 3, 4, 5, 6, 7};
+            u16x8 arg_v = idx_v;
+            for (int i = 0; i < d; i += kVecSize)
+            {
+                u16x8 t = loadu(sum_.data() + offset + i);
+                storeu(total.data() + i, t);
+                auto is_less = t < min_v;
+                min_v = is_less ? t : min_v;
+                arg_v = is_less ? idx_v : arg_v;
+                idx_v += kVecSize;
+            }
+            int best = arg_v[0];
+            for (int i = 1; i < kVecSize; i++)
+            {
+                if (min_v[i] < total[best] || (min_v[i] == total[best] && arg_v[i] < best))
+                    best = arg_v[i];
+            }
+            // No match for disparities larger than x.
+            if (best > x)
+            {
+                dst[x] = 0;
+                continue;
+            }
+            // Parabolic sub-pixel refinement.
+            float res = best;
+            if (0 < best && best < std::min(x, d - 1))
+            {
+                float c0    = total[best - 1];
+                float c1    = total[best];
+                float c2    = total[best + 1];
+                float denom = c0 - 2 * c1 + c2;
+                if (denom > 0)
+                    res += (c0 - c2) / (2 * denom);
+            }
+            dst[x] = res;
+        }
+    }
+}
+
+} }
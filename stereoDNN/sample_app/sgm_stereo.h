@@ -0,0 +1,68 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+// Full license terms provided in LICENSE.md file.
+
+#ifndef REDTAIL_SGM_STEREO_H
+#define REDTAIL_SGM_STEREO_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace redtail { namespace stereo
+{
+
+// Classical semi-global matching (SGM) stereo running on CPU.
+// Can be used as a fast alternative to DNN models on low-end boards.
+// Implementation:
+// - matching cost: Hamming distance between 9x7 census transforms.
+// - aggregation: 8 paths with 16-bit costs, vectorized over disparities.
+//   Each path direction runs in parallel over its independent lines:
+//   rows, columns or diagonals.
+// - disparity: winner-takes-all with parabolic sub-pixel refinement.
+class SgmStereo
+{
+public:
+    // max_disparity is rounded up to the multiple of SIMD width (8).
+    // p1 and p2 are small and large disparity change penalties.
+    // num_threads == 0 means use all available hardware threads.
+    // Throws std::invalid_argument if max_disparity <= 0 or not 0 < p1 < p2 <= getMaxP2().
+    SgmStereo(int max_disparity, int p1 = 10, int p2 = 120, int num_threads = 0);
+
+    // left and right are 8-bit grayscale images of the same size.
+    // disp is CV_32FC1 disparity in pixels, invalid pixels are set to 0.
+    void compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disp);
+
+    int getMaxDisparity() const { return max_disp_; }
+    int getNumThreads() const   { return num_threads_; }
+
+    // Max P2 for which aggregated path costs do not overflow 16 bits.
+    static int getMaxP2();
+
+private:
+    void computeCensus(const cv::Mat& img, uint64_t* census, int y_start, int y_end) const;
+    void computeCosts(int y_start, int y_end);
+    void aggregateHorizontal(int y_start, int y_end);
+    // Vertical (dx == 0) or diagonal paths of lines [line_start, line_end).
+    void aggregatePath(int dx, bool top_down, int line_start, int line_end);
+    void computeDisparity(cv::Mat& disp, int y_start, int y_end) const;
+
+private:
+    int max_disp_;
+    int p1_;
+    int p2_;
+    int num_threads_;
+
+    int w_ = 0;
+    int h_ = 0;
+
+    std::vector<uint64_t> census_l_;
+    std::vector<uint64_t> census_r_;
+    // H x W x D tensors.
+    std::vector<uint16_t> cost_;
+    // Aggregated costs of all paths.
+    std::vector<uint16_t> sum_;
+};
+
+} }
+
+#endif
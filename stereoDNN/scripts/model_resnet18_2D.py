@@ -36,7 +36,7 @@ def create(builder):
     left, right = model_resnet18.write_2d_encoder(builder)
     cur = builder.write_cost_vol(left, right, 'cost_vol', 'model/cost_vol/cost_volume_left', is_corr=True)
     # Softargmax
-    cur = builder.write_softargmax(cur, 'softargmax', is_argmin=False)
+    cur = builder.write_softargmax(cur, 'softargmax', is_argmin=False, resize_conf=True)
     # Concat with features.
     cur = builder.write_concat_tensors('left_conv1_act', cur, 'concat')
     cur = write_2d_bneck_encoder(cur)
@@ -40,6 +40,8 @@ class TrtModelBuilder(object):
         self.data_type      = data_type
         self.act            = act
         self.has_srelu_weights = False  
+        # Input image H and W, used to express decoder dimensions relative to the input.
+        self.img_hw         = None
 
     def _indent_lines(self, src):
         src = src.split('\n')
@@ -85,7 +87,7 @@ using weight_map = std::unordered_map<std::string, Weights>;
 
 INetworkDefinition* create{0}Network(IBuilder& builder, IPluginContainer& plugin_factory,
                                      DimsCHW img_dims, const weight_map& weights, DataType data_type,
-                                     ILogger& log)
+                                     ILogger& log, SoftargmaxConfidence conf_type)
 {{
     INetworkDefinition* network = builder.createNetwork();
     assert(network != nullptr);
@@ -194,6 +196,9 @@ assert({1}_pad != nullptr);
         # Compute padding.
         in_shape  = conv_op.inputs[0].shape.as_list()
         out_shape = conv_op.outputs[0].shape.as_list()
+        # First 2D convolution is applied to the (scaled) input image.
+        if self.img_hw is None:
+            self.img_hw = (in_shape[1], in_shape[2])
         pad_top,  pad_bottom = self._compute_tf_padding(in_shape[1], kh, strides[1])
         pad_left, pad_right  = self._compute_tf_padding(in_shape[2], kw, strides[2])
         # If padding is symetrical - use TensorRT convolution padding
@@ -363,7 +368,7 @@ assert({1} != nullptr);
         # Write code.
         code = """\
 // {1} 3D transposed convolution op.
-Dims {1}_out_dims{{4, {{{out_dims}}}}};
+Dims {1}_out_dims{{4, {{{out_d}, {out_c}, {out_h}, {out_w}}}}};
 auto {1} = addConv3DTranspose(plugin_factory, *network, *{0}->getOutput(0),
                               Conv3DType::kTensorFlow, {{5, {{{k_dims}}}}}, {1}_out_dims,
                               Dims{{3, {{{stride_dims}}}}}, Dims{{3, {{{pad_start_dims}}}}}, Dims{{3, {{{pad_end_dims}}}}},
@@ -428,9 +433,21 @@ assert({0}_slice_layer != nullptr);
             conv_in_shape[1] += 1
             pad_c_start       = 0
             pad_c_end         = 0
+        # H and W of the output are expressed relative to the input image dims
+        # so the same code works with any input of k * stride + 1 size.
+        def rel_dim(out_dim, img_dim, idx):
+            assert self.img_hw is not None, 'Input image dims are not known.'
+            assert (img_dim - 1) % (out_dim - 1) == 0, 'Input dims must be k * stride + 1.'
+            f = (img_dim - 1) // (out_dim - 1)
+            if f == 1:
+                return 'img_dims.d[{}]'.format(idx)
+            return '(img_dims.d[{}] - 1) / {} + 1'.format(idx, f)
         code = code.format(input, name,
                            k_dims         ='{}, {}, {}, {}, {}'.format(kk, kd, kc, kh, kw),
-                           out_dims       ='{}, {}, {}, {}'.format(*(conv_in_shape[1:])[[0, 3, 1, 2]]),
+                           out_d          =conv_in_shape[1],
+                           out_c          =conv_in_shape[4],
+                           out_h          =rel_dim(conv_in_shape[2], self.img_hw[0], 1),
+                           out_w          =rel_dim(conv_in_shape[3], self.img_hw[1], 2),
                            stride_dims    ='{}, {}, {}'.format(strides[1], strides[2], strides[3]),
                            pad_start_dims ='{}, {}, {}'.format(pad_c_start, pad_h_start, pad_w_start),
                            pad_end_dims   ='{}, {}, {}'.format(pad_c_end,   pad_h_end,   pad_w_end))
@@ -582,10 +599,10 @@ assert({2} != nullptr);
         self.code_writer.write(self._indent_lines(code))
         return name
 
-    def write_softargmax(self, input, name, is_argmin):
+    def write_softargmax(self, input, name, is_argmin, resize_conf=False):
         code = """\
 // Softargmax.
-auto {1} = addSoftargmax(plugin_factory, *network, *{0}->getOutput(0), {2}, data_type, "{1}_softargmax");
+auto {1} = addSoftargmax(plugin_factory, *network, *{0}->getOutput(0), {2}, data_type, "{1}_softargmax", conf_type);
 assert({1} != nullptr);
 {1}->setName("{1}");
 
@@ -593,8 +610,43 @@ assert({1} != nullptr);
         code = code.format(input, name,
                            'SoftargmaxType::kMin' if is_argmin else 'SoftargmaxType::kMax' )
         self.code_writer.write(self._indent_lines(code))
+        self.write_softargmax_confidence(name, resize_conf)
         return name
 
+    def write_softargmax_confidence(self, softargmax, resize_conf):
+        # Confidence is the second (optional) output of softargmax.
+        # In case softargmax is not computed at full resolution, confidence is resized to input image size.
+        if resize_conf:
+            code = """\
+// Softargmax confidence, resized to input image size.
+if (conf_type != SoftargmaxConfidence::kNone)
+{{
+    auto conf = network->addResize(*{0}->getOutput(1));
+    assert(conf != nullptr);
+    conf->setName("conf");
+    conf->setResizeMode(ResizeMode::kLINEAR);
+    conf->setCoordinateTransformation(ResizeCoordinateTransformation::kALIGN_CORNERS);
+    conf->setOutputDimensions(Dims3(1, img_dims.d[1], img_dims.d[2]));
+
+    auto conf_out = conf->getOutput(0);
+    conf_out->setName("conf");
+    network->markOutput(*conf_out);
+}}
+
+"""
+        else:
+            code = """\
+// Softargmax confidence.
+if (conf_type != SoftargmaxConfidence::kNone)
+{{
+    auto conf_out = {0}->getOutput(1);
+    conf_out->setName("conf");
+    network->markOutput(*conf_out);
+}}
+
+"""
+        self.code_writer.write(self._indent_lines(code.format(softargmax)))
+
     def write_concat_tensors(self, t1, t2, name):
         # Write code.
         code = """\
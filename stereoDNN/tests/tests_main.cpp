@@ -1,10 +1,14 @@
 // Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
 // Full license terms provided in LICENSE.md file.
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <numeric>
+#include <random>
+#include <string>
 #include <tuple>
 #include <vector>
 
@@ -13,6 +17,9 @@
 
 #include "redtail_tensorrt_plugins.h"
 #include "internal_utils.h"
+#include "int8_conv_tower.h"
+#include "image_preprocessor.h"
+#include "motion_gate.h"
 
 using namespace nvinfer1;
 using namespace redtail::tensorrt;
@@ -1046,7 +1053,7 @@ TEST(SoftargmaxPluginTests, ArgMinBasic)
     auto actual  = runPlugin(1, {{"x", x_dims, x}}, y_dims,
                              [&]
                              {
-                                 return factory->createSoftargmaxPlugin(DataType::kFLOAT, SoftargmaxType::kMin, "Softargmax");
+                                 return factory->createSoftargmaxPlugin(DataType::kFLOAT, SoftargmaxType::kMin, SoftargmaxConfidence::kNone, "Softargmax");
                              },
                              [] (INetworkDefinition*, ILayer* plugin, IPluginContainer&) { return plugin; },
                              *factory);
@@ -1069,7 +1076,7 @@ TEST(SoftargmaxPluginTests, ArgMinBatchSize2)
     auto actual  = runPlugin(2, {{"x", x_dims, x}}, y_dims,
                              [&]
                              {
-                                 return factory->createSoftargmaxPlugin(DataType::kFLOAT, SoftargmaxType::kMin, "Softargmax");
+                                 return factory->createSoftargmaxPlugin(DataType::kFLOAT, SoftargmaxType::kMin, SoftargmaxConfidence::kNone, "Softargmax");
                              },
                              [] (INetworkDefinition*, ILayer* plugin, IPluginContainer&) { return plugin; },
                              *factory);
@@ -1092,7 +1099,7 @@ TEST(SoftargmaxPluginTests, ArgMaxBasic)
     auto actual  = runPlugin(1, {{"x", x_dims, x}}, y_dims,
                              [&]
                              {
-                                 return factory->createSoftargmaxPlugin(DataType::kFLOAT, SoftargmaxType::kMax, "Softargmax");
+                                 return factory->createSoftargmaxPlugin(DataType::kFLOAT, SoftargmaxType::kMax, SoftargmaxConfidence::kNone, "Softargmax");
                              },
                              [] (INetworkDefinition*, ILayer* plugin, IPluginContainer&) { return plugin; },
                              *factory);
@@ -1102,6 +1109,573 @@ TEST(SoftargmaxPluginTests, ArgMaxBasic)
          EXPECT_FLOAT_EQ(y[i], actual[i]) << "Vectors 'actual' and 'y' differ at index " << i;
 }
 
+// Reference CPU implementation of softargmax with confidence.
+// Input is NDHW tensor, outputs are NHW tensors.
+static void softargmaxRef(const FloatVec& x, int n, int d, int h, int w, SoftargmaxType sm_type, SoftargmaxConfidence conf_type,
+                          FloatVec& disp, FloatVec& conf)
+{
+    const float sign = sm_type == SoftargmaxType::kMin ? -1 : 1;
+    const size_t hw  = (size_t)h * w;
+    disp.resize(n * hw);
+    conf.resize(n * hw);
+    for (int b = 0; b < n; b++)
+    {
+        for (size_t i = 0; i < hw; i++)
+        {
+            const float* px = x.data() + b * d * hw + i;
+            float m = sign * px[0];
+            for (int id = 1; id < d; id++)
+                m = std::max(m, sign * px[id * hw]);
+            FloatVec p(d);
+            float s = 0;
+            for (int id = 0; id < d; id++)
+            {
+                p[id] = std::exp(sign * px[id * hw] - m);
+                s += p[id];
+            }
+            float res     = 0;
+            float entropy = 0;
+            for (int id = 0; id < d; id++)
+            {
+                p[id]   /= s;
+                res     += p[id] * id;
+                entropy -= p[id] > 0 ? p[id] * std::log(p[id]) : 0;
+            }
+            disp[b * hw + i] = res;
+            if (conf_type == SoftargmaxConfidence::kEntropy)
+                conf[b * hw + i] = d > 1 ? std::max(1 - entropy / std::log((float)d), 0.0f) : 1;
+            else
+                conf[b * hw + i] = *std::max_element(p.begin(), p.end());
+        }
+    }
+}
+
+static void runSoftargmaxConfidenceTest(int batch_size, const std::string& test_name, SoftargmaxType sm_type,
+                                        SoftargmaxConfidence conf_type)
+{
+    Dims x_dims;
+    Dims y_dims;
+    FloatVec x = readBinaryFile(g_data_dir + test_name + "_x.bin", x_dims);
+    FloatVec y = readBinaryFile(g_data_dir + test_name + "_y.bin", y_dims);
+    ASSERT_EQ(x_dims.nbDims, 5);
+    ASSERT_EQ(y_dims.nbDims, 4);
+    ASSERT_EQ(x_dims.d[2], 1);
+
+    FloatVec disp_ref;
+    FloatVec conf_ref;
+    softargmaxRef(x, x_dims.d[0], x_dims.d[1], x_dims.d[3], x_dims.d[4], sm_type, conf_type, disp_ref, conf_ref);
+    // Check reference implementation first.
+    ASSERT_EQ(y.size(), disp_ref.size());
+    for (size_t i = 0; i < y.size(); i++)
+        ASSERT_NEAR(y[i], disp_ref[i], 0.0001) << "Vectors 'disp_ref' and 'y' differ at index " << i;
+
+    // Disparity (output 0) and confidence (output 1).
+    for (int out_idx = 0; out_idx < 2; out_idx++)
+    {
+        auto factory = IPluginContainer::create(*g_logger);
+        auto actual  = runPlugin(batch_size, {{"x", x_dims, x}}, y_dims,
+                                 [&]
+                                 {
+                                     return factory->createSoftargmaxPlugin(DataType::kFLOAT, sm_type, conf_type, "Softargmax");
+                                 },
+                                 [&] (INetworkDefinition* network, ILayer* plugin, IPluginContainer&)
+                                 {
+                                     return out_idx == 0 ? plugin : network->addIdentity(*plugin->getOutput(1));
+                                 },
+                                 *factory);
+
+        const FloatVec& expected = out_idx == 0 ? y : conf_ref;
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < actual.size(); i++)
+            EXPECT_NEAR(expected[i], actual[i], 0.0001) << "Output " << out_idx << ": vectors 'actual' and 'expected' differ at index " << i;
+    }
+}
+
+TEST(SoftargmaxPluginTests, ArgMaxWithEntropy)
+{
+    runSoftargmaxConfidenceTest(1, "softargmax_03", SoftargmaxType::kMax, SoftargmaxConfidence::kEntropy);
+}
+
+TEST(SoftargmaxPluginTests, ArgMinBatchSize2WithPeakProb)
+{
+    runSoftargmaxConfidenceTest(2, "softargmax_02", SoftargmaxType::kMin, SoftargmaxConfidence::kPeakProb);
+}
+
+// -----------------------------------------------------------------
+// INT8 CPU feature tower tests.
+// -----------------------------------------------------------------
+// Creates tower with random weights, weights storage must outlive the tower.
+static std::unordered_map<std::string, Weights> createTowerWeights(const std::vector<TowerConvLayer>& layers,
+                                                                   std::vector<FloatVec>& storage)
+{
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0, 1);
+    std::unordered_map<std::string, Weights> weights;
+    storage.reserve(2 * layers.size() + 2);
+    auto add = [&](const std::string& name, FloatVec values)
+    {
+        storage.push_back(std::move(values));
+        weights[name] = Weights{DataType::kFLOAT, storage.back().data(), (int64_t)storage.back().size()};
+    };
+
+    int c = 3;
+    for (const auto& l: layers)
+    {
+        // He initialization keeps activations in reasonable range across the tower.
+        float std_dev = std::sqrt(2.0f / (c * l.kernel * l.kernel)) * (l.residual >= 0 ? 0.5f : 1.0f);
+        FloatVec k(l.out_c * c * l.kernel * l.kernel);
+        for (auto& v: k)
+            v = std_dev * dist(rng);
+        FloatVec b(l.out_c);
+        for (auto& v: b)
+            v = 0.1f * dist(rng);
+        add("left_" + l.name + "_k", std::move(k));
+        add("left_" + l.name + "_b", std::move(b));
+        c = l.out_c;
+    }
+    add("left_scale_scale", {2.0f});
+    add("left_scale_shift", {-1.0f});
+    return weights;
+}
+
+// Reference CPU implementation of the tower, input and output are CHW tensors.
+static FloatVec towerRef(const std::vector<TowerConvLayer>& layers, std::unordered_map<std::string, Weights>& weights,
+                         const FloatVec& img, int h, int w)
+{
+    const float scale = *(const float*)weights.at("left_scale_scale").values;
+    const float shift = *(const float*)weights.at("left_scale_shift").values;
+    std::vector<FloatVec> acts(1, img);
+    for (auto& v: acts[0])
+        v = scale * v + shift;
+    int c = 3;
+    for (const auto& l: layers)
+    {
+        auto k = (const float*)weights.at("left_" + l.name + "_k").values;
+        auto b = (const float*)weights.at("left_" + l.name + "_b").values;
+        int oh = (h + 2 * l.pad - l.kernel) / l.stride + 1;
+        int ow = (w + 2 * l.pad - l.kernel) / l.stride + 1;
+        const FloatVec& x = acts.back();
+        FloatVec y((size_t)l.out_c * oh * ow);
+        for (int o = 0; o < l.out_c; o++)
+        for (int iy = 0; iy < oh; iy++)
+        for (int ix = 0; ix < ow; ix++)
+        {
+            double res = b[o];
+            for (int ic = 0; ic < c; ic++)
+            for (int ky = 0; ky < l.kernel; ky++)
+            for (int kx = 0; kx < l.kernel; kx++)
+            {
+                int sy = iy * l.stride - l.pad + ky;
+                int sx = ix * l.stride - l.pad + kx;
+                if (sy >= 0 && sy < h && sx >= 0 && sx < w)
+                    res += x[((size_t)ic * h + sy) * w + sx] * k[((o * c + ic) * l.kernel + ky) * l.kernel + kx];
+            }
+            size_t i = ((size_t)o * oh + iy) * ow + ix;
+            if (l.residual >= 0)
+                res += acts[l.residual][i];
+            y[i] = l.elu && res < 0 ? std::expm1(res) : res;
+        }
+        acts.push_back(std::move(y));
+        c = l.out_c;
+        h = oh;
+        w = ow;
+    }
+    return acts.back();
+}
+
+static void runInt8ConvTowerTest(const std::string& model_type, int h, int w)
+{
+    auto layers = getFeatureTowerLayers(model_type);
+    std::vector<FloatVec> storage;
+    auto weights = createTowerWeights(layers, storage);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(0, 1);
+    FloatVec img(3 * h * w);
+    for (auto& v: img)
+        v = dist(rng);
+
+    auto expected = towerRef(layers, weights, img, h, w);
+
+    Int8ConvTower tower(layers, weights, "left_");
+    auto dims = tower.getOutputDims(h, w);
+    ASSERT_EQ((size_t)dims.d[0] * dims.d[1] * dims.d[2], expected.size());
+
+    // FP32 tower must match reference.
+    FloatVec actual;
+    tower.forwardFP32(img.data(), h, w, actual);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < actual.size(); i++)
+        ASSERT_NEAR(expected[i], actual[i], 0.001) << "Vectors 'actual' and 'expected' differ at index " << i;
+
+    // INT8 tower is compared with FP32 one using relative RMSE.
+    ASSERT_FALSE(tower.isCalibrated());
+    tower.calibrate(img.data(), h, w);
+    ASSERT_TRUE(tower.isCalibrated());
+    FloatVec actual_int8;
+    tower.forwardInt8(img.data(), h, w, actual_int8);
+    ASSERT_EQ(actual.size(), actual_int8.size());
+    double err_sq = 0;
+    double ref_sq = 0;
+    for (size_t i = 0; i < actual.size(); i++)
+    {
+        err_sq += (actual_int8[i] - actual[i]) * (actual_int8[i] - actual[i]);
+        ref_sq += actual[i] * actual[i];
+    }
+    EXPECT_LT(std::sqrt(err_sq / ref_sq), 0.06);
+
+    // Calibration cache round trip must produce the same results.
+    auto cache_file = g_data_dir + "_int8_tower_" + model_type + ".cache";
+    tower.writeCalibrationCache(cache_file);
+    Int8ConvTower tower_cached(layers, weights, "left_");
+    ASSERT_TRUE(tower_cached.readCalibrationCache(cache_file));
+    std::remove(cache_file.c_str());
+    FloatVec actual_cached;
+    tower_cached.forwardInt8(img.data(), h, w, actual_cached);
+    ASSERT_EQ(actual_int8.size(), actual_cached.size());
+    for (size_t i = 0; i < actual_int8.size(); i++)
+        EXPECT_FLOAT_EQ(actual_int8[i], actual_cached[i]) << "Vectors 'actual_int8' and 'actual_cached' differ at index " << i;
+}
+
+TEST(Int8ConvTowerTests, NVTiny)
+{
+    runInt8ConvTowerTest("nvtiny", 33, 65);
+}
+
+TEST(Int8ConvTowerTests, ResNet18_2D)
+{
+    runInt8ConvTowerTest("resnet18_2D", 33, 65);
+}
+
+// Reads FP32 weights file created by the model builder script, weights storage must outlive the tower.
+static std::unordered_map<std::string, Weights> readTowerWeights(const std::string& filename,
+                                                                 std::vector<FloatVec>& storage)
+{
+    std::unordered_map<std::string, Weights> weights;
+    std::ifstream file(filename, std::ios::binary);
+    EXPECT_TRUE(file.is_open()) << "Could not open " << filename;
+    storage.reserve(1024);
+    while (file.is_open() && file.peek() != std::ifstream::traits_type::eof())
+    {
+        std::string name;
+        uint32_t    count;
+        std::getline(file, name, '\0');
+        file.read(reinterpret_cast<char*>(&count), sizeof(uint32_t));
+        storage.emplace_back(count);
+        file.read(reinterpret_cast<char*>(storage.back().data()), count * sizeof(float));
+        weights[name] = Weights{DataType::kFLOAT, storage.back().data(), (int64_t)count};
+    }
+    return weights;
+}
+
+// Center h x w crop of the 1025x321 CHW sample app image.
+static FloatVec readSampleImageCrop(const std::string& filename, int h, int w)
+{
+    const int src_h = 321;
+    const int src_w = 1025;
+    std::ifstream file(filename, std::ios::binary);
+    EXPECT_TRUE(file.is_open()) << "Could not open " << filename;
+    FloatVec src(3 * src_h * src_w);
+    file.read(reinterpret_cast<char*>(src.data()), src.size() * sizeof(float));
+    FloatVec res(3 * h * w);
+    int y0 = (src_h - h) / 2;
+    int x0 = (src_w - w) / 2;
+    for (int c = 0; c < 3; c++)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            std::copy_n(src.begin() + ((size_t)c * src_h + y0 + y) * src_w + x0, w,
+                        res.begin() + ((size_t)c * h + y) * w);
+        }
+    }
+    return res;
+}
+
+// Runs the tower with the shipped model weights on sample app images: the tower is
+// calibrated on the left image and INT8 error is measured on the right one.
+// The thresholds are regression bounds slightly above the measured error
+// (see README), they do not mean INT8 towers match FP32 accuracy.
+static void runInt8ConvTowerModelTest(const std::string& model_type, const std::string& weights_file,
+                                      float max_rel_rmse, float min_mean_cos)
+{
+    // Crop size keeps the reference implementation fast enough.
+    const int h = 97;
+    const int w = 193;
+
+    auto layers = getFeatureTowerLayers(model_type);
+    std::vector<FloatVec> storage;
+    // Test data is in stereoDNN/tests/data, models are in stereoDNN/models.
+    auto weights = readTowerWeights(g_data_dir + "../../models/" + weights_file, storage);
+    ASSERT_FALSE(weights.empty());
+    auto img_left  = readSampleImageCrop(g_data_dir + "../../sample_app/data/img_left.bin",  h, w);
+    auto img_right = readSampleImageCrop(g_data_dir + "../../sample_app/data/img_right.bin", h, w);
+
+    Int8ConvTower tower(layers, weights, "left_");
+
+    // FP32 tower must match reference.
+    auto expected = towerRef(layers, weights, img_right, h, w);
+    FloatVec actual;
+    tower.forwardFP32(img_right.data(), h, w, actual);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < actual.size(); i++)
+        ASSERT_NEAR(expected[i], actual[i], 0.001) << "Vectors 'actual' and 'expected' differ at index " << i;
+
+    tower.calibrate(img_left.data(), h, w);
+    FloatVec actual_int8;
+    tower.forwardInt8(img_right.data(), h, w, actual_int8);
+    ASSERT_EQ(actual.size(), actual_int8.size());
+
+    // Relative RMSE and mean cosine similarity of per-pixel feature vectors (cost volume inputs).
+    auto dims = tower.getOutputDims(h, w);
+    size_t hw = (size_t)dims.d[1] * dims.d[2];
+    double err_sq  = 0;
+    double ref_sq  = 0;
+    double cos_sum = 0;
+    for (size_t i = 0; i < hw; i++)
+    {
+        double dot     = 0;
+        double ref_len = 0;
+        double res_len = 0;
+        for (int c = 0; c < dims.d[0]; c++)
+        {
+            double ref = actual[c * hw + i];
+            double res = actual_int8[c * hw + i];
+            err_sq  += (res - ref) * (res - ref);
+            ref_sq  += ref * ref;
+            dot     += ref * res;
+            ref_len += ref * ref;
+            res_len += res * res;
+        }
+        cos_sum += dot / std::max(std::sqrt(ref_len * res_len), 1e-12);
+    }
+    double rel_rmse = std::sqrt(err_sq / ref_sq);
+    double mean_cos = cos_sum / hw;
+    // Reported in the test XML output, helps to see how close the accuracy is to the bounds.
+    ::testing::Test::RecordProperty("int8_rel_rmse",     std::to_string(rel_rmse));
+    ::testing::Test::RecordProperty("int8_mean_cos_sim", std::to_string(mean_cos));
+    EXPECT_LT(rel_rmse, max_rel_rmse);
+    EXPECT_GT(mean_cos, min_mean_cos);
+}
+
+TEST(Int8ConvTowerTests, NVTinyModelWeights)
+{
+    runInt8ConvTowerModelTest("nvtiny", "NVTiny/TensorRT/trt_weights.bin", 0.13, 0.98);
+}
+
+TEST(Int8ConvTowerTests, ResNet18_2DModelWeights)
+{
+    runInt8ConvTowerModelTest("resnet18_2D", "ResNet-18_2D/TensorRT/trt_weights.bin", 0.09, 0.995);
+}
+
+// -----------------------------------------------------------------
+// Image preprocessing tests.
+// -----------------------------------------------------------------
+namespace pp = redtail::preprocessing;
+
+static cv::Mat createTestImage(int h, int w, int type)
+{
+    cv::Mat img(h, w, type);
+    cv::RNG rng(42);
+    rng.fill(img, cv::RNG::UNIFORM, 0, 256);
+    // Add some structure so interpolation errors are not averaged out.
+    cv::GaussianBlur(img, img, cv::Size(5, 5), 0);
+    return img;
+}
+
+// Reference implementation: multi-pass OpenCV preprocessing used by the nodes before.
+static cv::Mat preprocessRef(const cv::Mat& src, int cvt_code, int dst_w, int dst_h, int interp, float scale, float shift)
+{
+    cv::Mat img = src;
+    if (cvt_code >= 0)
+        cv::cvtColor(img, img, cvt_code);
+    img.convertTo(img, CV_32F);
+    cv::resize(img, img, cv::Size(dst_w, dst_h), 0, 0, interp);
+    img = img * scale + shift;
+    return img.reshape(1, dst_w * dst_h).t();
+}
+
+static void runImagePreprocessorTest(const cv::Mat& src, const std::string& encoding, int cvt_code, int dst_w, int dst_h,
+                                     pp::ChannelOrder order, pp::Interpolation interp, int cv_interp, float scale, float shift)
+{
+    auto expected = preprocessRef(src, cvt_code, dst_w, dst_h, cv_interp, scale, shift);
+    pp::ImagePreprocessor preproc(dst_w, dst_h, order, interp, scale, shift);
+    // Run twice to check cached coefficients.
+    for (int i = 0; i < 2; i++)
+    {
+        auto actual = preproc.process(src, encoding);
+        ASSERT_EQ(expected.size(), actual.size());
+        ASSERT_TRUE(actual.isContinuous());
+        for (int c = 0; c < 3; c++)
+        {
+            for (int j = 0; j < dst_w * dst_h; j++)
+                ASSERT_NEAR(expected.at<float>(c, j), actual.at<float>(c, j), 0.001 * std::abs(scale) * 255) << "Channel " << c << ", index " << j;
+        }
+    }
+}
+
+TEST(ImagePreprocessorTests, AreaDownscaleBGRToRGB)
+{
+    auto src = createTestImage(720, 1280, CV_8UC3);
+    runImagePreprocessorTest(src, "bgr8", cv::COLOR_BGR2RGB, 513, 257, pp::ChannelOrder::kRGB, pp::Interpolation::kArea,
+                             cv::INTER_AREA, 1 / 255.0f, 0);
+}
+
+TEST(ImagePreprocessorTests, AreaUpscaleBGRAToRGB)
+{
+    auto src = createTestImage(376, 672, CV_8UC4);
+    runImagePreprocessorTest(src, "bgra8", cv::COLOR_BGRA2RGB, 1025, 321, pp::ChannelOrder::kRGB, pp::Interpolation::kArea,
+                             cv::INTER_AREA, 1 / 255.0f, 0);
+}
+
+TEST(ImagePreprocessorTests, CubicRGBToBGRWithScaleShift)
+{
+    auto src = createTestImage(480, 640, CV_8UC3);
+    runImagePreprocessorTest(src, "rgb8", cv::COLOR_RGB2BGR, 320, 180, pp::ChannelOrder::kBGR, pp::Interpolation::kCubic,
+                             cv::INTER_CUBIC, 0.5f, -10);
+}
+
+TEST(ImagePreprocessorTests, LinearUpscaleBGR)
+{
+    auto src = createTestImage(50, 60, CV_8UC3);
+    runImagePreprocessorTest(src, "bgr8", -1, 123, 77, pp::ChannelOrder::kBGR, pp::Interpolation::kLinear,
+                             cv::INTER_LINEAR, 1, 0);
+}
+
+TEST(ImagePreprocessorTests, Resize8U)
+{
+    auto src = createTestImage(720, 1280, CV_8UC3);
+    cv::Mat expected;
+    cv::cvtColor(src, expected, cv::COLOR_BGR2RGB);
+    cv::resize(expected, expected, cv::Size(513, 257), 0, 0, cv::INTER_AREA);
+
+    pp::ImagePreprocessor preproc(513, 257, pp::ChannelOrder::kRGB, pp::Interpolation::kArea);
+    cv::Mat actual;
+    preproc.resize8u(src, "bgr8", actual);
+    ASSERT_EQ(CV_8UC3, actual.type());
+    ASSERT_EQ(expected.size(), actual.size());
+    // Allow rounding differences.
+    EXPECT_LE(cv::norm(expected, actual, cv::NORM_INF), 1);
+}
+
+TEST(ImagePreprocessorTests, RemapSupersampledBGRToRGB)
+{
+    int src_w   = 640;
+    int src_h   = 480;
+    int dst_w   = 320;
+    int dst_h   = 180;
+    int samples = 2;
+    auto src = createTestImage(src_h, src_w, CV_8UC3);
+    // Rotation and shift (similar to rectification) combined with downscale,
+    // some samples are outside of the source image.
+    cv::Mat map_x(dst_h * samples, dst_w * samples, CV_32FC1);
+    cv::Mat map_y(dst_h * samples, dst_w * samples, CV_32FC1);
+    float a = 0.05f;
+    for (int y = 0; y < map_x.rows; y++)
+    {
+        for (int x = 0; x < map_x.cols; x++)
+        {
+            float u = (x + 0.5f) * src_w / map_x.cols - 0.5f - src_w / 2;
+            float v = (y + 0.5f) * src_h / map_x.rows - 0.5f - src_h / 2;
+            map_x.at<float>(y, x) = std::cos(a) * u - std::sin(a) * v + src_w / 2 + 3.3f;
+            map_y.at<float>(y, x) = std::sin(a) * u + std::cos(a) * v + src_h / 2 - 2.1f;
+        }
+    }
+
+    // Reference: remap (float image to avoid fixed-point coordinates) followed by samples x samples averaging.
+    cv::Mat expected;
+    cv::cvtColor(src, expected, cv::COLOR_BGR2RGB);
+    expected.convertTo(expected, CV_32F);
+    cv::remap(expected, expected, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    cv::resize(expected, expected, cv::Size(dst_w, dst_h), 0, 0, cv::INTER_AREA);
+    expected = (expected / 255.0f).reshape(1, dst_w * dst_h).t();
+
+    pp::ImagePreprocessor preproc(dst_w, dst_h, pp::ChannelOrder::kRGB, pp::Interpolation::kLinear, 1 / 255.0f);
+    preproc.setRemap(map_x, map_y, samples, src_w, src_h);
+    ASSERT_TRUE(preproc.hasRemap());
+    ASSERT_EQ(cv::Size(src_w, src_h), preproc.getRemapSourceSize());
+    auto actual = preproc.process(src, "bgr8");
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_LE(cv::norm(expected, actual, cv::NORM_INF), 0.001);
+}
+
+TEST(MotionGateTests, SkipsStaticFrames)
+{
+    pp::MotionGate::Params params;
+    params.threshold = 2;
+    params.max_skip  = 3;
+    pp::MotionGate gate(params);
+
+    auto src = createTestImage(480, 640, CV_8UC4);
+    // The first frame is always processed.
+    EXPECT_TRUE(gate.update(src));
+    // Sensor noise is below the threshold.
+    cv::Mat noisy = src.clone();
+    cv::RNG rng(1);
+    cv::Mat noise(src.size(), src.type());
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 3);
+    noisy += noise;
+    EXPECT_FALSE(gate.update(src));
+    EXPECT_FALSE(gate.update(noisy));
+    EXPECT_LT(gate.getLastDifference(), params.threshold);
+    EXPECT_FALSE(gate.update(src));
+    // Max skip interval reached.
+    EXPECT_TRUE(gate.update(src));
+    // Moving object.
+    cv::Mat moved = src.clone();
+    cv::rectangle(moved, cv::Rect(100, 100, 200, 150), cv::Scalar(255, 255, 255, 255), -1);
+    EXPECT_TRUE(gate.update(moved));
+    EXPECT_GE(gate.getLastDifference(), params.threshold);
+    // The moved frame is the key frame now.
+    EXPECT_FALSE(gate.update(moved));
+    // Different size is always processed.
+    EXPECT_TRUE(gate.update(src(cv::Rect(0, 0, 320, 240))));
+    gate.reset();
+    EXPECT_TRUE(gate.update(src(cv::Rect(0, 0, 320, 240))));
+
+    gate.addComputeTime(10);
+    gate.addComputeTime(20);
+    auto stats = gate.getStats(true);
+    EXPECT_EQ(9u, stats.frames);
+    EXPECT_EQ(4u, stats.skipped);
+    EXPECT_FLOAT_EQ(15, stats.compute_ms);
+    EXPECT_DOUBLE_EQ(60, stats.saved_ms);
+    EXPECT_EQ(0u, gate.getStats(false).frames);
+}
+
+TEST(MotionGateTests, KeyFrameIds)
+{
+    pp::MotionGate::Params params;
+    params.threshold = 2;
+    params.max_skip  = 10;
+    pp::MotionGate gate(params);
+
+    auto src = createTestImage(480, 640, CV_8UC3);
+    cv::Mat moved = src.clone();
+    cv::rectangle(moved, cv::Rect(100, 100, 200, 150), cv::Scalar(255, 255, 255), -1);
+    uint64_t key_id = 0;
+    // Skipped frames refer to the last processed frame.
+    EXPECT_TRUE(gate.update(src, &key_id));
+    uint64_t first_id = key_id;
+    EXPECT_FALSE(gate.update(src, &key_id));
+    EXPECT_EQ(first_id, key_id);
+    EXPECT_TRUE(gate.update(moved, &key_id));
+    EXPECT_NE(first_id, key_id);
+    uint64_t second_id = key_id;
+    EXPECT_FALSE(gate.update(moved, &key_id));
+    EXPECT_EQ(second_id, key_id);
+    // Reset (e.g. the key frame was dropped) starts a new key frame.
+    gate.reset();
+    EXPECT_TRUE(gate.update(moved, &key_id));
+    EXPECT_NE(second_id, key_id);
+
+    pp::MotionGate::Stats stats;
+    stats.frames     = 10;
+    stats.skipped    = 4;
+    stats.compute_ms = 15;
+    stats.saved_ms   = 60;
+    EXPECT_EQ("skipped 4 of 10 frames (40.0%), saved 60ms of inference (15.00ms per frame)", pp::toString(stats));
+}
+
 // -----------------------------------------------------------------
 // End of tests.
 // -----------------------------------------------------------------